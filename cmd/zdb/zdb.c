@@ -58,6 +58,7 @@
 #include <sys/zfs_fuid.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/zfeature.h>
 #include <zfs_comutil.h>
 #include <libzfs.h>
@@ -2352,6 +2353,8 @@ typedef struct zdb_cb {
 	zdb_blkstats_t	zcb_type[ZB_TOTAL + 1][ZDB_OT_TOTAL + 1];
 	uint64_t	zcb_dedup_asize;
 	uint64_t	zcb_dedup_blocks;
+	uint64_t	zcb_clone_asize;
+	uint64_t	zcb_clone_blocks;
 	uint64_t	zcb_embedded_blocks[NUM_BP_EMBEDDED_TYPES];
 	uint64_t	zcb_embedded_histogram[NUM_BP_EMBEDDED_TYPES]
 	    [BPE_PAYLOAD_SIZE];
@@ -2425,15 +2428,28 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 		return;
 	}
 
+	/*
+	 * A cloned block is referenced by several block pointers, only the
+	 * last one visited claims it.
+	 */
+	if (brt_maybe_exists(zcb->zcb_spa, bp) &&
+	    !brt_entry_decref(zcb->zcb_spa, bp)) {
+		zcb->zcb_clone_asize += BP_GET_ASIZE(bp);
+		zcb->zcb_clone_blocks++;
+		refcnt = 1;
+	}
+
 	if (dump_opt['L'])
 		return;
 
 	if (BP_GET_DEDUP(bp)) {
 		ddt_t *ddt;
 		ddt_entry_t *dde;
+		ddt_key_t ddk;
 
 		ddt = ddt_select(zcb->zcb_spa, bp);
-		ddt_enter(ddt);
+		ddt_key_fill(&ddk, bp);
+		ddt_enter(ddt, &ddk);
 		dde = ddt_lookup(ddt, bp, B_FALSE);
 
 		if (dde == NULL) {
@@ -2445,7 +2461,7 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 			if (ddt_phys_total_refcnt(dde) == 0)
 				ddt_remove(ddt, dde);
 		}
-		ddt_exit(ddt);
+		ddt_exit(ddt, &ddk);
 	}
 
 	VERIFY3U(zio_wait(zio_claim(NULL, zcb->zcb_spa,
@@ -2623,9 +2639,9 @@ zdb_ddt_leak_init(spa_t *spa, zdb_cb_t *zcb)
 		}
 		if (!dump_opt['L']) {
 			ddt_t *ddt = spa->spa_ddt[ddb.ddb_checksum];
-			ddt_enter(ddt);
+			ddt_enter(ddt, &dde.dde_key);
 			VERIFY(ddt_lookup(ddt, &blk, B_TRUE) != NULL);
-			ddt_exit(ddt);
+			ddt_exit(ddt, &dde.dde_key);
 		}
 	}
 
@@ -2825,7 +2841,8 @@ dump_block_stats(spa_t *spa)
 	norm_space = metaslab_class_get_space(spa_normal_class(spa));
 
 	total_alloc = norm_alloc + metaslab_class_get_alloc(spa_log_class(spa));
-	total_found = tzb->zb_asize - zcb.zcb_dedup_asize;
+	total_found = tzb->zb_asize - zcb.zcb_dedup_asize -
+	    zcb.zcb_clone_asize;
 
 	if (total_found == total_alloc) {
 		if (!dump_opt['L'])
@@ -2867,6 +2884,9 @@ dump_block_stats(spa_t *spa)
 	    (u_longlong_t)zcb.zcb_dedup_asize,
 	    (u_longlong_t)zcb.zcb_dedup_blocks,
 	    (double)zcb.zcb_dedup_asize / tzb->zb_asize + 1.0);
+	(void) printf("\tbp cloned:     %10llu    count: %6llu\n",
+	    (u_longlong_t)zcb.zcb_clone_asize,
+	    (u_longlong_t)zcb.zcb_clone_blocks);
 	(void) printf("\tSPA allocated: %10llu     used: %5.2f%%\n",
 	    (u_longlong_t)norm_alloc, 100.0 * norm_alloc / norm_space);
 
@@ -261,11 +261,13 @@ get_usage(zfs_help_t idx)
 	case HELP_ROLLBACK:
 		return (gettext("\trollback [-rRf] <snapshot>\n"));
 	case HELP_SEND:
-		return (gettext("\tsend [-DnPpRvLe] [-[iI] snapshot] "
+		return (gettext("\tsend [-DnPpRvLec] [-[iI] snapshot] "
 		    "<snapshot>\n"
-		    "\tsend [-Le] [-i snapshot|bookmark] "
+		    "\tsend [-Lec] [-i snapshot|bookmark] "
 		    "<filesystem|volume|snapshot>\n"
-		    "\tsend [-nvPe] -t <receive_resume_token>\n"));
+		    "\tsend [-Lec] [-i snapshot|bookmark] -O range ... "
+		    "<snapshot>\n"
+		    "\tsend [-nvPec] -t <receive_resume_token>\n"));
 	case HELP_SET:
 		return (gettext("\tset <property=value> ... "
 		    "<filesystem|volume|snapshot> ...\n"));
@@ -3701,6 +3703,61 @@ usage:
 	return (-1);
 }
 
+/*
+ * Parse a send range of the form <object>[-<object>][:<offset>[+<length>]].
+ */
+static int
+parse_send_range(const char *arg, dmu_send_range_t *range)
+{
+	char *buf = safe_strdup((char *)arg);
+	char *cp, *end;
+	int err = -1;
+
+	range->dsr_offset = 0;
+	range->dsr_length = UINT64_MAX;
+
+	if ((cp = strchr(buf, ':')) != NULL) {
+		char *lenp;
+
+		*cp++ = '\0';
+		if ((lenp = strchr(cp, '+')) != NULL) {
+			*lenp++ = '\0';
+			if (zfs_nicestrtonum(g_zfs, lenp,
+			    &range->dsr_length) != 0 || range->dsr_length == 0)
+				goto out;
+		}
+		if (zfs_nicestrtonum(g_zfs, cp, &range->dsr_offset) != 0)
+			goto out;
+	}
+
+	errno = 0;
+	range->dsr_firstobj = strtoull(buf, &end, 0);
+	range->dsr_lastobj = range->dsr_firstobj;
+	if (end != buf && *end == '-') {
+		cp = end + 1;
+		range->dsr_lastobj = strtoull(cp, &end, 0);
+		if (end == cp)
+			goto out;
+	}
+	if (errno == 0 && end != buf && *end == '\0' &&
+	    range->dsr_firstobj <= range->dsr_lastobj)
+		err = 0;
+out:
+	free(buf);
+	return (err);
+}
+
+static int
+send_range_compare(const void *arg1, const void *arg2)
+{
+	const dmu_send_range_t *r1 = arg1;
+	const dmu_send_range_t *r2 = arg2;
+
+	if (r1->dsr_firstobj < r2->dsr_firstobj)
+		return (-1);
+	return (r1->dsr_firstobj > r2->dsr_firstobj);
+}
+
 /*
  * Send a backup stream to stdout.
  */
@@ -3716,10 +3773,23 @@ zfs_do_send(int argc, char **argv)
 	int c, err;
 	nvlist_t *dbgnv = NULL;
 	boolean_t extraverbose = B_FALSE;
+	dmu_send_range_t *ranges = NULL;
+	uint_t nranges = 0;
 
 	/* check options */
-	while ((c = getopt(argc, argv, ":i:I:RDpvnPLet:")) != -1) {
+	while ((c = getopt(argc, argv, ":i:I:O:RDpvnPLect:")) != -1) {
 		switch (c) {
+		case 'O':
+			/* each range is its own argument */
+			if (ranges == NULL)
+				ranges = safe_malloc(argc * sizeof (*ranges));
+			if (parse_send_range(optarg, &ranges[nranges]) != 0) {
+				(void) fprintf(stderr,
+				    gettext("invalid range '%s'\n"), optarg);
+				usage(B_FALSE);
+			}
+			nranges++;
+			break;
 		case 'i':
 			if (fromname)
 				usage(B_FALSE);
@@ -3759,6 +3829,9 @@ zfs_do_send(int argc, char **argv)
 		case 'e':
 			flags.embed_data = B_TRUE;
 			break;
+		case 'c':
+			flags.compress = B_TRUE;
+			break;
 		case 't':
 			resume_token = optarg;
 			break;
@@ -3779,7 +3852,7 @@ zfs_do_send(int argc, char **argv)
 
 	if (resume_token != NULL) {
 		if (fromname != NULL || flags.replicate || flags.props ||
-		    flags.dedup) {
+		    flags.dedup || nranges != 0) {
 			(void) fprintf(stderr,
 			    gettext("invalid flags combined with -t\n"));
 			usage(B_FALSE);
@@ -3814,10 +3887,11 @@ zfs_do_send(int argc, char **argv)
 	}
 
 	/*
-	 * Special case sending a filesystem, or from a bookmark.
+	 * Special case sending a filesystem, from a bookmark, or only some
+	 * ranges of a snapshot.
 	 */
 	if (strchr(argv[0], '@') == NULL ||
-	    (fromname && strchr(fromname, '#') != NULL)) {
+	    (fromname && strchr(fromname, '#') != NULL) || nranges != 0) {
 		char frombuf[ZFS_MAX_DATASET_NAME_LEN];
 		enum lzc_send_flags lzc_flags = 0;
 
@@ -3825,8 +3899,8 @@ zfs_do_send(int argc, char **argv)
 		    flags.dedup || flags.dryrun || flags.verbose ||
 		    flags.progress) {
 			(void) fprintf(stderr,
-			    gettext("Error: "
-			    "Unsupported flag with filesystem or bookmark.\n"));
+			    gettext("Error: Unsupported flag with "
+			    "filesystem, bookmark, or range.\n"));
 			return (1);
 		}
 
@@ -3838,6 +3912,8 @@ zfs_do_send(int argc, char **argv)
 			lzc_flags |= LZC_SEND_FLAG_LARGE_BLOCK;
 		if (flags.embed_data)
 			lzc_flags |= LZC_SEND_FLAG_EMBED_DATA;
+		if (flags.compress)
+			lzc_flags |= LZC_SEND_FLAG_COMPRESS;
 
 		if (fromname != NULL &&
 		    (fromname[0] == '#' || fromname[0] == '@')) {
@@ -3852,8 +3928,14 @@ zfs_do_send(int argc, char **argv)
 			(void) strlcat(frombuf, fromname, sizeof (frombuf));
 			fromname = frombuf;
 		}
-		err = zfs_send_one(zhp, fromname, STDOUT_FILENO, lzc_flags);
+		if (nranges != 0) {
+			qsort(ranges, nranges, sizeof (*ranges),
+			    send_range_compare);
+		}
+		err = zfs_send_partial(zhp, fromname, STDOUT_FILENO, lzc_flags,
+		    ranges, nranges);
 		zfs_close(zhp);
+		free(ranges);
 		return (err != 0);
 	}
 
@@ -5509,6 +5509,43 @@ print_scan_status(pool_scan_stat_t *ps)
 	}
 }
 
+/*
+ * Print out the progress of background frees, e.g. from async destroys.
+ */
+static void
+print_free_status(pool_free_stat_t *pfs)
+{
+	time_t start;
+	uint64_t elapsed, mins_left, hours_left, rate;
+	char freed_buf[7], to_free_buf[7], rate_buf[7];
+
+	if (pfs == NULL || pfs->pfs_to_free == 0)
+		return;
+
+	start = pfs->pfs_start_time;
+	(void) printf(gettext("  free: in progress since %s"), ctime(&start));
+
+	elapsed = time(NULL) - start;
+	elapsed = elapsed ? elapsed : 1;
+	rate = pfs->pfs_freed / elapsed;
+	rate = rate ? rate : 1;
+	mins_left = (pfs->pfs_to_free / rate) / 60;
+	hours_left = mins_left / 60;
+
+	zfs_nicenum(pfs->pfs_freed, freed_buf, sizeof (freed_buf));
+	zfs_nicenum(pfs->pfs_to_free, to_free_buf, sizeof (to_free_buf));
+	zfs_nicenum(rate, rate_buf, sizeof (rate_buf));
+
+	(void) printf(gettext("\t%s freed, %s left at %s/s"),
+	    freed_buf, to_free_buf, rate_buf);
+	if (pfs->pfs_freed != 0 && hours_left < (30 * 24)) {
+		(void) printf(gettext(", %lluh%um to go\n"),
+		    (u_longlong_t)hours_left, (uint_t)(mins_left % 60));
+	} else {
+		(void) printf(gettext(", (no estimated time)\n"));
+	}
+}
+
 static void
 print_error_log(zpool_handle_t *zhp)
 {
@@ -5916,11 +5953,16 @@ status_callback(zpool_handle_t *zhp, void *data)
 		nvlist_t **spares, **l2cache;
 		uint_t nspares, nl2cache;
 		pool_scan_stat_t *ps = NULL;
+		pool_free_stat_t *pfs = NULL;
 
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&ps, &c);
 		print_scan_status(ps);
 
+		(void) nvlist_lookup_uint64_array(nvroot,
+		    ZPOOL_CONFIG_FREE_STATS, (uint64_t **)&pfs, &c);
+		print_free_status(pfs);
+
 		namewidth = max_width(zhp, nvroot, 0, 0, cbp->cb_name_flags);
 		if (namewidth < 10)
 			namewidth = 10;
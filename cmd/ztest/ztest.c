@@ -192,6 +192,10 @@ static const ztest_shared_opts_t ztest_opts_defaults = {
 extern uint64_t metaslab_gang_bang;
 extern uint64_t metaslab_df_alloc_threshold;
 extern int metaslab_preload_limit;
+extern int zfs_dedup_log_txg_max;
+extern unsigned long zfs_free_max_blocks;
+extern int zfs_free_sync_target_ms;
+extern int dmu_object_alloc_chunk_shift;
 
 static ztest_shared_opts_t *ztest_shared_opts;
 static ztest_shared_opts_t ztest_opts;
@@ -304,14 +308,17 @@ static ztest_shared_callstate_t *ztest_shared_callstate;
 ztest_func_t ztest_dmu_read_write;
 ztest_func_t ztest_dmu_write_parallel;
 ztest_func_t ztest_dmu_object_alloc_free;
+ztest_func_t ztest_dmu_object_next_chunk;
 ztest_func_t ztest_dmu_commit_callbacks;
 ztest_func_t ztest_zap;
 ztest_func_t ztest_zap_parallel;
 ztest_func_t ztest_zil_commit;
+ztest_func_t ztest_zil_itx_assign;
 ztest_func_t ztest_zil_remount;
 ztest_func_t ztest_dmu_read_write_zcopy;
 ztest_func_t ztest_dmu_objset_create_destroy;
 ztest_func_t ztest_dmu_prealloc;
+ztest_func_t ztest_dmu_brt_clone;
 ztest_func_t ztest_fzap;
 ztest_func_t ztest_dmu_snapshot_create_destroy;
 ztest_func_t ztest_dsl_prop_get_set;
@@ -349,11 +356,13 @@ ztest_info_t ztest_info[] = {
 	ZTI_INIT(ztest_dmu_read_write, 1, &zopt_always),
 	ZTI_INIT(ztest_dmu_write_parallel, 10, &zopt_always),
 	ZTI_INIT(ztest_dmu_object_alloc_free, 1, &zopt_always),
+	ZTI_INIT(ztest_dmu_object_next_chunk, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_dmu_commit_callbacks, 1, &zopt_always),
 	ZTI_INIT(ztest_zap, 30, &zopt_always),
 	ZTI_INIT(ztest_zap_parallel, 100, &zopt_always),
 	ZTI_INIT(ztest_split_pool, 1, &zopt_always),
 	ZTI_INIT(ztest_zil_commit, 1, &zopt_incessant),
+	ZTI_INIT(ztest_zil_itx_assign, 1, &zopt_often),
 	ZTI_INIT(ztest_zil_remount, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_dmu_read_write_zcopy, 1, &zopt_often),
 	ZTI_INIT(ztest_dmu_objset_create_destroy, 1, &zopt_often),
@@ -361,6 +370,7 @@ ztest_info_t ztest_info[] = {
 	ZTI_INIT(ztest_spa_prop_get_set, 1, &zopt_sometimes),
 #if 0
 	ZTI_INIT(ztest_dmu_prealloc, 1, &zopt_sometimes),
+	ZTI_INIT(ztest_dmu_brt_clone, 1, &zopt_sometimes),
 #endif
 	ZTI_INIT(ztest_fzap, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_dmu_snapshot_create_destroy, 1, &zopt_sometimes),
@@ -2076,14 +2086,15 @@ ztest_get_done(zgd_t *zgd, int error)
 	ztest_object_unlock(zd, object);
 
 	if (error == 0 && zgd->zgd_bp)
-		zil_add_block(zgd->zgd_zilog, zgd->zgd_bp);
+		zil_lwb_add_block(zgd->zgd_lwb, zgd->zgd_bp);
 
 	umem_free(zgd, sizeof (*zgd));
 	umem_free(zzp, sizeof (*zzp));
 }
 
 static int
-ztest_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
+ztest_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
+    zio_t *zio)
 {
 	ztest_ds_t *zd = arg;
 	objset_t *os = zd->zd_os;
@@ -2119,7 +2130,7 @@ ztest_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
 	db = NULL;
 
 	zgd = umem_zalloc(sizeof (*zgd), UMEM_NOFAIL);
-	zgd->zgd_zilog = zd->zd_zilog;
+	zgd->zgd_lwb = lwb;
 	zgd_private = umem_zalloc(sizeof (ztest_zgd_private_t), UMEM_NOFAIL);
 	zgd_private->z_zd = zd;
 	zgd_private->z_object = object;
@@ -2573,6 +2584,66 @@ ztest_zil_commit(ztest_ds_t *zd, uint64_t id)
 	(void) rw_unlock(&zd->zd_zilog_lock);
 }
 
+/*
+ * Microbenchmark for zil_itx_assign(): assign a burst of async TX_SETATTR
+ * itxs from every thread at once, as a metadata storm on one dataset
+ * would.  The records are for an object which never exists, so they're
+ * only committed by a zil_commit() of every object and are skipped if
+ * they're ever replayed.  The workload summary (-VV) gives the time spent
+ * here; comparing ZTEST_ITX_BURST * calls / time across runs with
+ * different -t shows how assignment scales with threads.
+ */
+#define	ZTEST_ITX_BURST	256
+
+/* ARGSUSED */
+void
+ztest_zil_itx_assign(ztest_ds_t *zd, uint64_t id)
+{
+	zilog_t *zilog = zd->zd_zilog;
+	uint64_t foid = DN_MAX_OBJECT - 1 - id;
+	hrtime_t start, elapsed;
+	lr_setattr_t *lr;
+	dmu_tx_t *tx;
+	itx_t *itx;
+	int i;
+
+	VERIFY3U(ENOENT, ==, dmu_object_info(zd->zd_os, foid, NULL));
+
+	/*
+	 * Keep ztest_zil_remount() from closing the zilog under us.  It
+	 * waits for the txg to sync with the lock held, so take the lock
+	 * before holding the txg open.
+	 */
+	(void) rw_rdlock(&zd->zd_zilog_lock);
+
+	tx = dmu_tx_create(zd->zd_os);
+	if (ztest_tx_assign(tx, TXG_WAIT, FTAG) == 0) {
+		(void) rw_unlock(&zd->zd_zilog_lock);
+		return;
+	}
+
+	start = gethrtime();
+	for (i = 0; i < ZTEST_ITX_BURST; i++) {
+		itx = zil_itx_create(TX_SETATTR, sizeof (*lr));
+		lr = (lr_setattr_t *)&itx->itx_lr;
+		bzero(&lr->lr_common + 1, sizeof (*lr) - sizeof (lr_t));
+		lr->lr_foid = foid;
+		itx->itx_sync = B_FALSE;
+		zil_itx_assign(zilog, itx, tx);
+	}
+	elapsed = gethrtime() - start;
+
+	dmu_tx_commit(tx);
+
+	(void) rw_unlock(&zd->zd_zilog_lock);
+
+	if (ztest_opts.zo_verbose >= 6) {
+		(void) printf("thread %llu assigned %d itxs in %llu ns\n",
+		    (u_longlong_t)id, ZTEST_ITX_BURST,
+		    (u_longlong_t)elapsed);
+	}
+}
+
 /*
  * This function is designed to simulate the operations that occur during a
  * mount/unmount operation.  We hold the dataset across these operations in an
@@ -3850,6 +3921,24 @@ ztest_dmu_object_alloc_free(ztest_ds_t *zd, uint64_t id)
 	umem_free(od, size);
 }
 
+/*
+ * Rewind the global allocator randomly back to a lower object number
+ * and change the per-CPU chunk size, to force the allocators to search
+ * for and share partially used dnode blocks.
+ */
+/* ARGSUSED */
+void
+ztest_dmu_object_next_chunk(ztest_ds_t *zd, uint64_t id)
+{
+	objset_t *os = zd->zd_os;
+
+	mutex_enter(&os->os_obj_lock);
+	os->os_obj_next_chunk = ztest_random(os->os_obj_next_chunk + 1);
+	mutex_exit(&os->os_obj_lock);
+
+	dmu_object_alloc_chunk_shift = 5 + ztest_random(8);
+}
+
 #undef OD_ARRAY_SIZE
 #define	OD_ARRAY_SIZE	2
 
@@ -4448,6 +4537,113 @@ ztest_dmu_prealloc(ztest_ds_t *zd, uint64_t id)
 	umem_free(od, sizeof (ztest_od_t));
 }
 
+/*
+ * Clone a range of blocks from one object to another, then check that the
+ * clones read back the original data, including after the source blocks
+ * have been freed.
+ */
+/* ARGSUSED */
+void
+ztest_dmu_brt_clone(ztest_ds_t *zd, uint64_t id)
+{
+	objset_t *os = zd->zd_os;
+	spa_t *spa = dmu_objset_spa(os);
+	ztest_od_t *od;
+	uint64_t blocksize, count, size, srcoff, dstoff, seed, txg;
+	uint64_t srcobj, dstobj;
+	uint64_t *data, *cmp;
+	blkptr_t *bps;
+	size_t nbps;
+	dmu_tx_t *tx;
+	int error, i;
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_BLOCK_CLONING))
+		return;
+
+	od = umem_alloc(2 * sizeof (ztest_od_t), UMEM_NOFAIL);
+	blocksize = ztest_random_blocksize();
+	ztest_od_init(od, id, FTAG, 0, DMU_OT_UINT64_OTHER, blocksize, 0, 0);
+	ztest_od_init(od + 1, id, FTAG, 1, DMU_OT_UINT64_OTHER, blocksize,
+	    0, 0);
+
+	/*
+	 * Recreate the objects so that both have the same block size.
+	 */
+	if (ztest_object_init(zd, od, 2 * sizeof (ztest_od_t), B_TRUE) != 0) {
+		umem_free(od, 2 * sizeof (ztest_od_t));
+		return;
+	}
+	srcobj = od[0].od_object;
+	dstobj = od[1].od_object;
+
+	count = ztest_random(8) + 1;
+	size = count * blocksize;
+	srcoff = ztest_random(16) * blocksize;
+	dstoff = ztest_random(16) * blocksize;
+
+	data = umem_alloc(size, UMEM_NOFAIL);
+	cmp = umem_alloc(size, UMEM_NOFAIL);
+	bps = umem_alloc(count * sizeof (blkptr_t), UMEM_NOFAIL);
+
+	seed = ztest_random(-1ULL);
+	for (i = 0; i < size / sizeof (uint64_t); i++)
+		data[i] = seed + i;
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, srcobj, srcoff, size);
+	txg = ztest_tx_assign(tx, TXG_WAIT, FTAG);
+	if (txg == 0)
+		goto out;
+	dmu_write(os, srcobj, srcoff, size, data, tx);
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), txg);
+
+	/*
+	 * Gang and dedup blocks can't be cloned.
+	 */
+	error = dmu_read_l0_bps(os, srcobj, srcoff, size, bps, &nbps);
+	if (error == EOPNOTSUPP)
+		goto out;
+	ASSERT0(error);
+	ASSERT3U(nbps, ==, count);
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, dstobj, dstoff, size);
+	txg = ztest_tx_assign(tx, TXG_WAIT, FTAG);
+	if (txg == 0)
+		goto out;
+	VERIFY0(dmu_brt_clone(os, dstobj, dstoff, size, tx, bps, nbps));
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), txg);
+
+	/*
+	 * Sometimes drop the source's reference before checking the clone.
+	 */
+	if (ztest_random(2) == 0) {
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_free(tx, srcobj, srcoff, size);
+		txg = ztest_tx_assign(tx, TXG_WAIT, FTAG);
+		if (txg == 0)
+			goto out;
+		VERIFY0(dmu_free_range(os, srcobj, srcoff, size, tx));
+		dmu_tx_commit(tx);
+		txg_wait_synced(dmu_objset_pool(os), txg);
+	} else {
+		VERIFY0(dmu_read(os, srcobj, srcoff, size, cmp,
+		    DMU_READ_NO_PREFETCH));
+		VERIFY0(bcmp(data, cmp, size));
+	}
+
+	VERIFY0(dmu_read(os, dstobj, dstoff, size, cmp, DMU_READ_NO_PREFETCH));
+	VERIFY0(bcmp(data, cmp, size));
+
+out:
+	umem_free(bps, count * sizeof (blkptr_t));
+	umem_free(cmp, size);
+	umem_free(data, size);
+	umem_free(od, 2 * sizeof (ztest_od_t));
+}
+
 /*
  * Verify that zap_{create,destroy,add,remove,update} work as expected.
  */
@@ -4596,6 +4792,58 @@ out:
 	umem_free(od, sizeof (ztest_od_t));
 }
 
+#define	ZTEST_FZAP_ENTRIES	2050
+#define	ZTEST_FZAP_BATCH	100
+
+/*
+ * Update or look up, with the batched zap interfaces, the n entries from
+ * first on that ztest_fzap() adds one at a time.
+ */
+static int
+ztest_fzap_batch(objset_t *os, uint64_t object, uint64_t id, int first,
+    int n, boolean_t update)
+{
+	zap_batch_ent_t *zbe;
+	char (*names)[ZFS_MAX_DATASET_NAME_LEN];
+	uint64_t *values;
+	dmu_tx_t *tx;
+	int i, error = 0;
+
+	zbe = umem_zalloc(n * sizeof (zap_batch_ent_t), UMEM_NOFAIL);
+	names = umem_alloc(n * sizeof (*names), UMEM_NOFAIL);
+	values = umem_alloc(n * sizeof (uint64_t), UMEM_NOFAIL);
+
+	for (i = 0; i < n; i++) {
+		(void) snprintf(names[i], sizeof (names[i]), "fzap-%llu-%llu",
+		    (u_longlong_t)id, (u_longlong_t)(first + i));
+		values[i] = update ? first + i : -1ULL;
+		zbe[i].zbe_key = names[i];
+		zbe[i].zbe_integer_size = sizeof (uint64_t);
+		zbe[i].zbe_num_integers = 1;
+		zbe[i].zbe_val = &values[i];
+	}
+
+	if (update) {
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_zap(tx, object, B_TRUE, NULL);
+		if (ztest_tx_assign(tx, TXG_MIGHTWAIT, FTAG) == 0) {
+			error = ENOSPC;
+			goto out;
+		}
+		VERIFY0(zap_update_batch(os, object, zbe, n, tx));
+		dmu_tx_commit(tx);
+	} else {
+		VERIFY0(zap_lookup_batch(os, object, zbe, n));
+		for (i = 0; i < n; i++)
+			VERIFY3U(values[i], ==, first + i);
+	}
+out:
+	umem_free(values, n * sizeof (uint64_t));
+	umem_free(names, n * sizeof (*names));
+	umem_free(zbe, n * sizeof (zap_batch_ent_t));
+	return (error);
+}
+
 /*
  * Testcase to test the upgrading of a microzap to fatzap.
  */
@@ -4615,12 +4863,20 @@ ztest_fzap(ztest_ds_t *zd, uint64_t id)
 		goto out;
 	object = od->od_object;
 
+	/*
+	 * Add the first entries in one batch, while this may still be
+	 * a microzap, so that its block has to grow along the way.
+	 */
+	if (ztest_fzap_batch(os, object, id, 0, ZTEST_FZAP_BATCH,
+	    B_TRUE) != 0)
+		goto out;
+
 	/*
 	 * Add entries to this ZAP and make sure it spills over
 	 * and gets upgraded to a fatzap. Also, since we are adding
 	 * 2050 entries we should see ptrtbl growth and leaf-block split.
 	 */
-	for (i = 0; i < 2050; i++) {
+	for (i = 0; i < ZTEST_FZAP_ENTRIES; i++) {
 		char name[ZFS_MAX_DATASET_NAME_LEN];
 		uint64_t value = i;
 		dmu_tx_t *tx;
@@ -4639,6 +4895,14 @@ ztest_fzap(ztest_ds_t *zd, uint64_t id)
 		ASSERT(error == 0 || error == EEXIST);
 		dmu_tx_commit(tx);
 	}
+
+	/*
+	 * Now that it is a fatzap, read everything back in batches.
+	 */
+	for (i = 0; i < ZTEST_FZAP_ENTRIES; i += ZTEST_FZAP_BATCH) {
+		(void) ztest_fzap_batch(os, object, id, i,
+		    MIN(ZTEST_FZAP_BATCH, ZTEST_FZAP_ENTRIES - i), B_FALSE);
+	}
 out:
 	umem_free(od, sizeof (ztest_od_t));
 }
@@ -5025,6 +5289,16 @@ ztest_dsl_prop_get_set(ztest_ds_t *zd, uint64_t id)
 	VERIFY0(ztest_dsl_prop_set_uint64(zd->zd_name, ZFS_PROP_RECORDSIZE,
 	    ztest_random_blocksize(), (int)ztest_random(2)));
 
+	/*
+	 * Exercise the per-objset ARC limits; 0 removes the limit.
+	 */
+	VERIFY0(ztest_dsl_prop_set_uint64(zd->zd_name, ZFS_PROP_ARCQUOTA,
+	    ztest_random(2) ? 0 : (1ULL << 20) << ztest_random(4),
+	    (int)ztest_random(2)));
+	VERIFY0(ztest_dsl_prop_set_uint64(zd->zd_name, ZFS_PROP_ARCRESERVATION,
+	    ztest_random(2) ? 0 : (1ULL << 20) << ztest_random(4),
+	    (int)ztest_random(2)));
+
 	(void) rw_unlock(&ztest_name_lock);
 }
 
@@ -6125,6 +6399,9 @@ ztest_run(ztest_shared_t *zs)
 	VERIFY0(spa_open(ztest_opts.zo_pool, &spa, FTAG));
 	spa->spa_debug = B_TRUE;
 	metaslab_preload_limit = ztest_random(20) + 1;
+	zfs_dedup_log_txg_max = ztest_random(20) + 1;
+	zfs_free_max_blocks = ztest_random(4096) + 256;
+	zfs_free_sync_target_ms = ztest_random(100) + 1;
 	ztest_spa = spa;
 
 	VERIFY0(dmu_objset_own(ztest_opts.zo_pool,
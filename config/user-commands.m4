@@ -30,6 +30,7 @@ AC_DEFUN([ZFS_AC_CONFIG_USER_COMMANDS_COMMON], [
 	AC_PATH_TOOL(FGREP, fgrep, "")
 	AC_PATH_TOOL(FILE, file, "")
 	AC_PATH_TOOL(FIND, find, "")
+	AC_PATH_TOOL(FIO, fio, "")
 	AC_PATH_TOOL(FSCK, fsck, "")
 	AC_PATH_TOOL(GNUDD, dd, "")
 	AC_PATH_TOOL(GETCONF, getconf, "")
@@ -47,6 +47,7 @@ extern "C" {
 typedef struct arc_buf_hdr arc_buf_hdr_t;
 typedef struct arc_buf arc_buf_t;
 typedef struct arc_prune arc_prune_t;
+typedef struct arc_os arc_os_t;
 typedef void arc_done_func_t(zio_t *zio, arc_buf_t *buf, void *private);
 typedef void arc_prune_func_t(int64_t bytes, void *private);
 typedef int arc_evict_func_t(void *private);
@@ -109,6 +110,9 @@ typedef enum arc_flags
 	ARC_FLAG_HAS_L1HDR		= 1 << 19,
 	ARC_FLAG_HAS_L2HDR		= 1 << 20,
 
+	/* the buffer is charged against its objset's ARC accounting */
+	ARC_FLAG_OS_CHARGED		= 1 << 21,
+
 } arc_flags_t;
 
 struct arc_buf {
@@ -208,6 +212,12 @@ void arc_freed(spa_t *spa, const blkptr_t *bp);
 void arc_set_callback(arc_buf_t *buf, arc_evict_func_t *func, void *private);
 boolean_t arc_clear_callback(arc_buf_t *buf);
 
+arc_os_t *arc_os_register(spa_t *spa, uint64_t objset);
+void arc_os_unregister(arc_os_t *aos);
+void arc_os_set_quota(arc_os_t *aos, uint64_t quota);
+void arc_os_set_reservation(arc_os_t *aos, uint64_t reservation);
+void arc_os_read_stat(arc_os_t *aos, boolean_t hit);
+
 void arc_flush(spa_t *spa, boolean_t retry);
 void arc_tempreserve_clear(uint64_t reserve);
 int arc_tempreserve_space(uint64_t reserve, uint64_t txg);
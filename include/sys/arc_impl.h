@@ -165,6 +165,9 @@ typedef struct l1arc_buf_hdr {
 	arc_callback_t		*b_acb;
 	/* temporary buffer holder for in-flight compressed data */
 	void			*b_tmp_cdata;
+
+	/* objset charged while cached, see ARC_FLAG_OS_CHARGED */
+	uint64_t		b_objset;
 } l1arc_buf_hdr_t;
 
 typedef struct l2arc_dev {
@@ -198,6 +201,42 @@ typedef struct l2arc_write_callback {
 	arc_buf_hdr_t	*l2wcb_head;		/* head of write buflist */
 } l2arc_write_callback_t;
 
+/*
+ * Per-objset ARC accounting.  An entry exists while its objset is open
+ * (registered) or while any cached buffer is still charged to it, and is
+ * found by the (spa load guid, objset id) pair stored in the header.
+ */
+typedef struct arc_os_stats {
+	kstat_named_t aos_arc_size;
+	kstat_named_t aos_arc_quota;
+	kstat_named_t aos_arc_reservation;
+	kstat_named_t aos_arc_hits;
+	kstat_named_t aos_arc_misses;
+	kstat_named_t aos_arc_quota_evicted;
+} arc_os_stats_t;
+
+struct arc_os {
+	/* immutable */
+	uint64_t		ao_spa;		/* spa load guid */
+	uint64_t		ao_objset;	/* objset id */
+
+	/* protected by the arc_os hash lock */
+	arc_os_t		*ao_hash_next;
+	uint64_t		ao_size;	/* bytes charged in MRU/MFU */
+	uint64_t		ao_quota_evicted; /* bytes evicted for quota */
+	uint32_t		ao_registered;	/* open objset holds */
+
+	/* protected by arc_os_lock */
+	uint64_t		ao_quota;	/* hard cap, 0 for none */
+	uint64_t		ao_reservation;	/* soft floor, 0 for none */
+	kstat_t			*ao_ksp;
+	arc_os_stats_t		ao_stats;
+
+	/* updated atomically */
+	uint64_t		ao_hits;
+	uint64_t		ao_misses;
+};
+
 struct arc_buf_hdr {
 	/* protected by hash lock */
 	dva_t			b_dva;
@@ -0,0 +1,105 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_BRT_H
+#define	_SYS_BRT_H
+
+#include <sys/spa.h>
+#include <sys/dmu.h>
+#include <sys/avl.h>
+#include <sys/txg.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * On-disk BRT entry: the key is the vdev and offset of the block's first
+ * DVA, the value is the number of additional references to the block and
+ * the space charged to each of them.
+ */
+#define	BRT_KEY_WORDS	2
+#define	BRT_VALUE_WORDS	2
+
+typedef struct brt_phys {
+	uint64_t	brp_refcnt;	/* references beyond the original */
+	uint64_t	brp_dsize;	/* deflated size of one reference */
+} brt_phys_t;
+
+/*
+ * In-core BRT entry.  Every on-disk entry is mirrored here; entries whose
+ * refcount has dropped to zero stay in the tree until the next brt_sync()
+ * removes them from disk.
+ */
+typedef struct brt_entry {
+	uint64_t	bre_vdev;
+	uint64_t	bre_offset;
+	brt_phys_t	bre_phys;
+	boolean_t	bre_dirty;
+	avl_node_t	bre_node;
+	list_node_t	bre_dirty_node;
+} brt_entry_t;
+
+/*
+ * Clones created in open context, applied to the BRT at the start of
+ * the txg's sync.
+ */
+typedef struct brt_pending_entry {
+	blkptr_t	bpe_bp;
+	uint64_t	bpe_count;
+	avl_node_t	bpe_node;
+} brt_pending_entry_t;
+
+/*
+ * In-core BRT
+ */
+struct brt {
+	kmutex_t	brt_lock;
+	spa_t		*brt_spa;
+	objset_t	*brt_os;
+	uint64_t	brt_object;		/* MOS ZAP, 0 if none */
+	avl_tree_t	brt_tree;		/* all entries */
+	list_t		brt_dirty;		/* entries changed this txg */
+	uint64_t	brt_saved;		/* space saved by clones */
+	kmutex_t	brt_pending_lock;
+	avl_tree_t	brt_pending[TXG_SIZE];	/* per-txg pending clones */
+};
+
+extern void brt_create(spa_t *spa);
+extern int brt_load(spa_t *spa);
+extern void brt_unload(spa_t *spa);
+extern void brt_sync(spa_t *spa, uint64_t txg);
+extern void brt_pending_apply(spa_t *spa, uint64_t txg);
+
+extern void brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx);
+extern void brt_pending_remove(spa_t *spa, const blkptr_t *bp, uint64_t txg);
+extern boolean_t brt_maybe_exists(spa_t *spa, const blkptr_t *bp);
+extern boolean_t brt_entry_decref(spa_t *spa, const blkptr_t *bp);
+extern uint64_t brt_get_dspace(spa_t *spa);
+
+extern void brt_init(void);
+extern void brt_fini(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_BRT_H */
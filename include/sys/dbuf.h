@@ -145,6 +145,17 @@ typedef struct dbuf_dirty_record {
 			override_states_t dr_override_state;
 			uint8_t dr_copies;
 			boolean_t dr_nopwrite;
+			boolean_t dr_brtwrite;
+
+			/*
+			 * dr_cdata is an optional copy of dr_data already
+			 * compressed with dr_cdata_compress (for example
+			 * as received in a compressed send stream), which
+			 * the write may use instead of compressing again.
+			 */
+			void *dr_cdata;
+			uint64_t dr_cdata_size;
+			enum zio_compress dr_cdata_compress;
 		} dl;
 	} dt;
 } dbuf_dirty_record_t;
@@ -252,6 +263,13 @@ typedef struct dmu_buf_impl {
 	 */
 	uint8_t db_pending_evict;
 
+	/*
+	 * Accessed with DMU_UNCACHED (e.g. O_DIRECT).  Drop this
+	 * block from the dbuf cache and the ARC once the refcount
+	 * drops to 0, as if it were not primarycache-able.
+	 */
+	uint8_t db_uncached;
+
 	uint8_t db_dirtycnt;
 } dmu_buf_impl_t;
 
@@ -297,11 +315,14 @@ void dmu_buf_will_not_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_fill_done(dmu_buf_t *db, dmu_tx_t *tx);
 void dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx);
+void dbuf_assign_compressed(dmu_buf_impl_t *db, enum zio_compress compress,
+    void *cdata, uint64_t csize, dmu_tx_t *tx);
 dbuf_dirty_record_t *dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
 arc_buf_t *dbuf_loan_arcbuf(dmu_buf_impl_t *db);
 void dmu_buf_write_embedded(dmu_buf_t *dbuf, void *data,
     bp_embedded_type_t etype, enum zio_compress comp,
     int uncompressed_size, int compressed_size, int byteorder, dmu_tx_t *tx);
+void dmu_buf_write_clone(dmu_buf_t *dbuf, const blkptr_t *bp, dmu_tx_t *tx);
 
 void dbuf_clear(dmu_buf_impl_t *db);
 void dbuf_evict(dmu_buf_impl_t *db);
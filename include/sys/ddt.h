@@ -111,6 +111,8 @@ struct ddt_entry {
 	void		*dde_repair_data;
 	enum ddt_type	dde_type;
 	enum ddt_class	dde_class;
+	enum ddt_type	dde_obj_type;	/* log entries: where the DDT */
+	enum ddt_class	dde_obj_class;	/* objects still have it */
 	uint8_t		dde_loading;
 	uint8_t		dde_loaded;
 	kcondvar_t	dde_cv;
@@ -118,11 +120,94 @@ struct ddt_entry {
 };
 
 /*
- * In-core ddt
+ * On-disk DDT log.  Each txg's changes to a table are appended to its log
+ * object as an array of ddt_log_record_t; the bonus buffer holds the
+ * ddt_log_phys_t header.  A record holds the entry's new contents and
+ * location, and where the DDT objects still have it, so replaying the
+ * records in order rebuilds the in-core log (ddt_log_tree).  An entry
+ * whose location is DDT_TYPES/DDT_CLASSES has been removed.
+ */
+typedef struct ddt_log_phys {
+	uint64_t	dlp_count;	/* number of records */
+	uint64_t	dlp_first_txg;	/* txg the log was created in */
+} ddt_log_phys_t;
+
+typedef struct ddt_log_record {
+	ddt_key_t	dlr_key;
+	ddt_phys_t	dlr_phys[DDT_PHYS_TYPES];
+	uint64_t	dlr_prop;
+} ddt_log_record_t;
+
+#define	DLR_GET_TYPE(dlr)		BF64_GET((dlr)->dlr_prop, 0, 8)
+#define	DLR_SET_TYPE(dlr, x)		BF64_SET((dlr)->dlr_prop, 0, 8, x)
+#define	DLR_GET_CLASS(dlr)		BF64_GET((dlr)->dlr_prop, 8, 8)
+#define	DLR_SET_CLASS(dlr, x)		BF64_SET((dlr)->dlr_prop, 8, 8, x)
+#define	DLR_GET_OBJ_TYPE(dlr)		BF64_GET((dlr)->dlr_prop, 16, 8)
+#define	DLR_SET_OBJ_TYPE(dlr, x)	BF64_SET((dlr)->dlr_prop, 16, 8, x)
+#define	DLR_GET_OBJ_CLASS(dlr)		BF64_GET((dlr)->dlr_prop, 24, 8)
+#define	DLR_SET_OBJ_CLASS(dlr, x)	BF64_SET((dlr)->dlr_prop, 24, 8, x)
+
+/*
+ * On-disk DDT bloom filter.  A table's filter has every key that its
+ * objects (or log) may hold, so a key that isn't in the filter needn't be
+ * looked up in the objects.  The filter is scalable: it starts with one
+ * stage sized for DDT_BLOOM_KEYS keys, and whenever the newest stage is
+ * full, a stage DDT_BLOOM_GROWTH times larger is appended, up to
+ * DDT_BLOOM_STAGES of them.  Keys are added to the newest stage and looked
+ * up in all of them.  Each stage is a blocked bloom filter: all of a key's
+ * DDT_BLOOM_HASHES bits are in one DDT_BLOOM_BLOCK-byte block, so testing
+ * a stage touches a single cache line.
+ *
+ * The stages are stored back to back in the filter object, and the bonus
+ * buffer holds the ddt_bloom_phys_t header.
+ */
+#define	DDT_BLOOM_STAGES	8
+#define	DDT_BLOOM_KEYS		8192
+#define	DDT_BLOOM_GROWTH	4
+#define	DDT_BLOOM_BITS_PER_KEY	16
+#define	DDT_BLOOM_HASHES	8
+#define	DDT_BLOOM_BLOCK		64
+#define	DDT_BLOOM_IOSIZE	(16 << 10)	/* unit of filter writes */
+
+typedef struct ddt_bloom_stage_phys {
+	uint64_t	dbsp_offset;	/* of the stage in the object */
+	uint64_t	dbsp_size;	/* in bytes */
+	uint64_t	dbsp_count;	/* keys added */
+} ddt_bloom_stage_phys_t;
+
+typedef struct ddt_bloom_phys {
+	uint64_t		dbp_nstages;
+	ddt_bloom_stage_phys_t	dbp_stage[DDT_BLOOM_STAGES];
+} ddt_bloom_phys_t;
+
+typedef struct ddt_bloom_stage {
+	uint8_t		*dbs_bits;
+	uint64_t	*dbs_dirty;	/* DDT_BLOOM_IOSIZE chunks to write */
+} ddt_bloom_stage_t;
+
+/*
+ * The in-core entries of a ddt are split by key into DDT_SHARDS shards,
+ * each with its own lock, so that dedup writes of different blocks don't
+ * serialize on one lock.  An entry's dde_cv is waited on with its shard's
+ * lock held.
+ */
+#define	DDT_SHARDS	32
+
+typedef struct ddt_shard {
+	kmutex_t	dds_lock;
+	avl_tree_t	dds_tree;
+} ddt_shard_t;
+
+/*
+ * In-core ddt.  ddt_lock protects the repair tree and the histograms;
+ * ddt_log_lock protects the log tree and ddt_bloom_lock the bloom filter.
+ * Shard locks are taken before any of them.
  */
 struct ddt {
+	ddt_shard_t	ddt_shard[DDT_SHARDS];
 	kmutex_t	ddt_lock;
-	avl_tree_t	ddt_tree;
+	krwlock_t	ddt_log_lock;
+	krwlock_t	ddt_bloom_lock;
 	avl_tree_t	ddt_repair_tree;
 	enum zio_checksum ddt_checksum;
 	spa_t		*ddt_spa;
@@ -132,11 +217,26 @@ struct ddt {
 	ddt_histogram_t	ddt_histogram[DDT_TYPES][DDT_CLASSES];
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
 	ddt_object_t	ddt_object_stats[DDT_TYPES][DDT_CLASSES];
+	avl_tree_t	ddt_log_tree;	/* logged entries not yet flushed */
+	uint64_t	ddt_log_object;
+	uint64_t	ddt_log_count;
+	uint64_t	ddt_log_first_txg;
+	int64_t		ddt_log_delta[DDT_TYPES][DDT_CLASSES];
+	uint64_t	ddt_log_gen;	/* bumped when ddt_log_tree changes */
+	ddt_entry_t	*ddt_log_walk_next;
+	uint64_t	ddt_log_walk_pos;
+	uint64_t	ddt_log_walk_gen;
+	uint64_t	ddt_bloom_object;
+	ddt_bloom_phys_t ddt_bloom_phys;
+	ddt_bloom_stage_t ddt_bloom_stage[DDT_BLOOM_STAGES];
+	boolean_t	ddt_bloom_dirty;	/* header changed */
 	avl_node_t	ddt_node;
 };
 
 /*
- * In-core and on-disk bookmark for DDT walks
+ * In-core and on-disk bookmark for DDT walks.  Within each class, the
+ * objects of every type are walked first, skipping the entries that have
+ * changed in the DDT log, and then the log itself (ddb_type == DDT_TYPES).
  */
 typedef struct ddt_bookmark {
 	uint64_t	ddb_class;
@@ -160,6 +260,10 @@ typedef struct ddt_ops {
 	    dmu_tx_t *tx);
 	int (*ddt_op_remove)(objset_t *os, uint64_t object, ddt_entry_t *dde,
 	    dmu_tx_t *tx);
+	int (*ddt_op_update_batch)(objset_t *os, uint64_t object,
+	    ddt_entry_t **ddes, int n, dmu_tx_t *tx);
+	int (*ddt_op_remove_batch)(objset_t *os, uint64_t object,
+	    ddt_entry_t **ddes, int n, dmu_tx_t *tx);
 	int (*ddt_op_walk)(objset_t *os, uint64_t object, ddt_entry_t *dde,
 	    uint64_t *walk);
 	int (*ddt_op_count)(objset_t *os, uint64_t object, uint64_t *count);
@@ -214,8 +318,8 @@ extern size_t ddt_compress(void *src, uchar_t *dst, size_t s_len, size_t d_len);
 extern void ddt_decompress(uchar_t *src, void *dst, size_t s_len, size_t d_len);
 
 extern ddt_t *ddt_select(spa_t *spa, const blkptr_t *bp);
-extern void ddt_enter(ddt_t *ddt);
-extern void ddt_exit(ddt_t *ddt);
+extern void ddt_enter(ddt_t *ddt, const ddt_key_t *ddk);
+extern void ddt_exit(ddt_t *ddt, const ddt_key_t *ddk);
 extern void ddt_init(void);
 extern void ddt_fini(void);
 extern ddt_entry_t *ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add);
@@ -234,6 +338,7 @@ extern void ddt_create(spa_t *spa);
 extern int ddt_load(spa_t *spa);
 extern void ddt_unload(spa_t *spa);
 extern void ddt_sync(spa_t *spa, uint64_t txg);
+extern void ddt_log_flush_all(spa_t *spa, dmu_tx_t *tx);
 extern int ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde);
 extern int ddt_object_update(ddt_t *ddt, enum ddt_type type,
     enum ddt_class class, ddt_entry_t *dde, dmu_tx_t *tx);
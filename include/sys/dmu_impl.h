@@ -70,7 +70,14 @@ extern "C" {
  * os_obj_lock
  *   must be held before:
  *   	everything except dp_config_rwlock
- *   protects os_obj_next
+ *   protects os_obj_next_chunk
+ *   held from:
+ *   	dmu_object_alloc: dn_dbufs_mtx, db_mtx, hash_mutexes, dn_struct_rwlock
+ *
+ * os_obj_block_lock
+ *   must be held before:
+ *   	everything except dp_config_rwlock
+ *   protects the free dnode slots of the dnode blocks hashed to it
  *   held from:
  *   	dmu_object_alloc: dn_dbufs_mtx, db_mtx, hash_mutexes, dn_struct_rwlock
  *
@@ -201,17 +208,22 @@ extern "C" {
  *
  * os_lock (leaf)
  *   protects:
- *   	os_dirty_dnodes
- *   	os_free_dnodes
  *   	os_dnodes
  *   	os_downgraded_dbufs
- *   	dn_dirtyblksz
- *   	dn_dirty_link
+ *   	os_synced_dnodes (while syncing)
  *   held from:
  *   	dnode_create: none (os_dnodes)
  *   	dnode_destroy: none (os_dnodes)
- *   	dnode_setdirty: none (dn_dirtyblksz, os_*_dnodes)
- *   	dnode_free: none (dn_dirtyblksz, os_*_dnodes)
+ *   	dmu_objset_sync: none (os_synced_dnodes)
+ *
+ * os_dirty_dnodes sublist lock (leaf)
+ *   protects:
+ *   	os_dirty_dnodes
+ *   	dn_dirtyblksz
+ *   	dn_dirty_link
+ *   held from:
+ *   	dnode_setdirty: none (dn_dirtyblksz, os_dirty_dnodes)
+ *   	dmu_objset_sync: dnode_sync() of the sublist's dnodes
  *
  * ds_lock
  *    protects:
@@ -273,6 +285,8 @@ typedef struct dmu_sendarg {
 	uint64_t dsa_last_data_offset;
 	uint64_t dsa_resume_object;
 	uint64_t dsa_resume_offset;
+	const dmu_send_range_t *dsa_ranges;
+	uint_t dsa_nranges;
 } dmu_sendarg_t;
 
 void dmu_object_zapify(objset_t *, uint64_t, dmu_object_type_t, dmu_tx_t *);
@@ -57,6 +57,9 @@ struct dmu_tx;
 
 #define	OBJSET_FLAG_USERACCOUNTING_COMPLETE	(1ULL<<0)
 
+/* number of locks serializing object allocation within a dnode block */
+#define	OS_OBJ_BLOCK_LOCKS	64
+
 typedef struct objset_phys {
 	dnode_phys_t os_meta_dnode;
 	zil_header_t os_zil_header;
@@ -101,6 +104,9 @@ struct objset {
 	zfs_redundant_metadata_type_t os_redundant_metadata;
 	int os_recordsize;
 
+	/* ARC accounting, NULL for the meta-objset: */
+	arc_os_t *os_arc_os;
+
 	/* no lock needed: */
 	struct dmu_tx *os_synctx; /* XXX sketchy */
 	blkptr_t *os_rootbp;
@@ -112,12 +118,20 @@ struct objset {
 
 	/* Protected by os_obj_lock */
 	kmutex_t os_obj_lock;
-	uint64_t os_obj_next;
+	uint64_t os_obj_next_chunk;
+
+	/* Per-CPU next object to allocate, updated atomically */
+	uint64_t *os_obj_next_percpu;
+	int os_obj_next_percpu_len;
+
+	/* Held across dnode_hold_impl() and dnode_allocate() */
+	kmutex_t os_obj_block_lock[OS_OBJ_BLOCK_LOCKS];
+
+	/* Has its own locking */
+	multilist_t os_dirty_dnodes[TXG_SIZE];
 
 	/* Protected by os_lock */
 	kmutex_t os_lock;
-	list_t os_dirty_dnodes[TXG_SIZE];
-	list_t os_free_dnodes[TXG_SIZE];
 	list_t os_dnodes;
 	list_t os_downgraded_dbufs;
 
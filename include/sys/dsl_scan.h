@@ -117,6 +117,9 @@ typedef struct dsl_scan {
 	boolean_t scn_is_bptree;
 	boolean_t scn_async_destroying;
 	boolean_t scn_async_stalled;
+	uint64_t scn_free_max_blocks;	/* blocks we may free this txg */
+	uint64_t scn_free_start_time;	/* when freeing started (in core) */
+	uint64_t scn_freed_bytes;	/* bytes freed since then */
 
 	/* for debugging / information */
 	uint64_t scn_visited_this_txg;
@@ -163,6 +163,8 @@ typedef enum {
 	ZFS_PROP_OVERLAY,
 	ZFS_PROP_PREV_SNAP,
 	ZFS_PROP_RECEIVE_RESUME_TOKEN,
+	ZFS_PROP_ARCQUOTA,
+	ZFS_PROP_ARCRESERVATION,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
@@ -546,6 +548,7 @@ typedef struct zpool_rewind_policy {
 #define	ZPOOL_CONFIG_ASIZE		"asize"
 #define	ZPOOL_CONFIG_DTL		"DTL"
 #define	ZPOOL_CONFIG_SCAN_STATS		"scan_stats"	/* not stored on disk */
+#define	ZPOOL_CONFIG_FREE_STATS		"free_stats"	/* not stored on disk */
 #define	ZPOOL_CONFIG_VDEV_STATS		"vdev_stats"	/* not stored on disk */
 
 /* container nvlist of extended stats */
@@ -784,6 +787,19 @@ typedef struct pool_scan_stat {
 	uint64_t	pss_pass_start;	/* start time of a scan pass */
 } pool_scan_stat_t;
 
+/*
+ * Background free (async destroy) statistics.  None of these are stored
+ * on disk, so the start time and bytes freed restart with each import.
+ * Note: all fields should be 64-bit because this is passed between
+ * kernel and userland as an nvlist uint64 array.
+ */
+typedef struct pool_free_stat {
+	uint64_t	pfs_start_time;	/* time freeing started */
+	uint64_t	pfs_to_free;	/* bytes left to free */
+	uint64_t	pfs_freed;	/* bytes freed since start */
+	uint64_t	pfs_txg_blocks;	/* current per-txg block budget */
+} pool_free_stat_t;
+
 typedef enum dsl_scan_state {
 	DSS_NONE,
 	DSS_SCANNING,
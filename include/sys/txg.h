@@ -103,6 +103,9 @@ extern boolean_t txg_stalled(struct dsl_pool *dp);
 /* returns TRUE if someone is waiting for the next txg to sync */
 extern boolean_t txg_sync_waiting(struct dsl_pool *dp);
 
+/* returns TRUE if txg has quiesced and is waiting for the sync thread */
+extern boolean_t txg_quiesced(struct dsl_pool *dp, uint64_t txg);
+
 /*
  * Wait for pending commit callbacks of already-synced transactions to finish
  * processing.
@@ -35,6 +35,7 @@ extern "C" {
 
 typedef struct vdev_file {
 	vnode_t		*vf_vnode;
+	taskq_t		*vf_taskq;	/* services this vdev's I/O */
 } vdev_file_t;
 
 #ifdef	__cplusplus
@@ -290,6 +290,42 @@ int zap_remove_norm(objset_t *ds, uint64_t zapobj, const char *name,
 int zap_remove_uint64(objset_t *os, uint64_t zapobj, const uint64_t *key,
     int key_numints, dmu_tx_t *tx);
 
+/*
+ * Batched versions of the above.  The zap object is locked once, the
+ * entries are sorted by hash, and each leaf block is visited once for
+ * all the entries that hash to it, rather than once per entry.
+ *
+ * zbe_key is a string for the plain variants and key_numints uint64_t's
+ * for the _uint64 variants; the keys in one batch must be distinct.  For
+ * lookups zbe_integer_size, zbe_num_integers and zbe_val describe the
+ * buffer to read into, for updates they describe the new value, and for
+ * removes they are ignored.
+ *
+ * Each entry's zbe_error is set to what the single-entry call would have
+ * returned.  The return value is the first non-zero zbe_error in array
+ * order, or 0.
+ */
+typedef struct zap_batch_ent {
+	const void	*zbe_key;
+	uint64_t	zbe_integer_size;
+	uint64_t	zbe_num_integers;
+	void		*zbe_val;
+	int		zbe_error;
+} zap_batch_ent_t;
+
+int zap_lookup_batch(objset_t *os, uint64_t zapobj,
+    zap_batch_ent_t *zbe, int n);
+int zap_lookup_uint64_batch(objset_t *os, uint64_t zapobj, int key_numints,
+    zap_batch_ent_t *zbe, int n);
+int zap_update_batch(objset_t *os, uint64_t zapobj,
+    zap_batch_ent_t *zbe, int n, dmu_tx_t *tx);
+int zap_update_uint64_batch(objset_t *os, uint64_t zapobj, int key_numints,
+    zap_batch_ent_t *zbe, int n, dmu_tx_t *tx);
+int zap_remove_batch(objset_t *os, uint64_t zapobj,
+    zap_batch_ent_t *zbe, int n, dmu_tx_t *tx);
+int zap_remove_uint64_batch(objset_t *os, uint64_t zapobj, int key_numints,
+    zap_batch_ent_t *zbe, int n, dmu_tx_t *tx);
+
 /*
  * Returns (in *count) the number of attributes in the specified zap
  * object.
@@ -28,7 +28,6 @@
 
 #include <sys/zap.h>
 #include <sys/zfs_context.h>
-#include <sys/avl.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -62,11 +61,15 @@ typedef struct mzap_phys {
 	/* actually variable size depending on block size */
 } mzap_phys_t;
 
+/*
+ * In-core index entry of a micro zap.  The entries of a micro zap are
+ * kept in one array, sorted by hash and cd, so that a lookup is a binary
+ * search over contiguous memory rather than a walk of per-entry nodes.
+ */
 typedef struct mzap_ent {
-	avl_node_t mze_node;
-	int mze_chunkid;
 	uint64_t mze_hash;
 	uint32_t mze_cd; /* copy from mze_phys->mze_cd */
+	uint16_t mze_chunkid;
 } mzap_ent_t;
 
 #define	MZE_PHYS(zap, mze) \
@@ -161,7 +164,8 @@ typedef struct zap {
 			int16_t zap_num_entries;
 			int16_t zap_num_chunks;
 			int16_t zap_alloc_next;
-			avl_tree_t zap_avl;
+			/* zap_num_chunks long, zap_num_entries used */
+			mzap_ent_t *zap_ents;
 		} zap_micro;
 	} zap_u;
 } zap_t;
@@ -193,6 +197,18 @@ typedef struct zap_name {
 #define	zap_f	zap_u.zap_fat
 #define	zap_m	zap_u.zap_micro
 
+typedef enum zap_batch_op {
+	ZAP_BATCH_LOOKUP,
+	ZAP_BATCH_UPDATE,
+	ZAP_BATCH_REMOVE
+} zap_batch_op_t;
+
+/* One entry of a batched operation, with its name already hashed */
+typedef struct zap_batch_name {
+	zap_name_t *zbn_zn;
+	zap_batch_ent_t *zbn_ent;
+} zap_batch_name_t;
+
 boolean_t zap_match(zap_name_t *zn, const char *matchname);
 int zap_lockdir(objset_t *os, uint64_t obj, dmu_tx_t *tx,
     krw_t lti, boolean_t fatreader, boolean_t adding, zap_t **zapp);
@@ -221,6 +237,8 @@ int fzap_update(zap_name_t *zn,
 int fzap_length(zap_name_t *zn,
     uint64_t *integer_size, uint64_t *num_integers);
 int fzap_remove(zap_name_t *zn, dmu_tx_t *tx);
+int fzap_batch(zap_t **zapp, zap_batch_name_t *zbn, int n, zap_batch_op_t op,
+    dmu_tx_t *tx);
 int fzap_cursor_retrieve(zap_t *zap, zap_cursor_t *zc, zap_attribute_t *za);
 void fzap_get_stats(zap_t *zap, zap_stats_t *zs);
 void zap_put_leaf(struct zap_leaf *l);
@@ -101,6 +101,8 @@ typedef enum drr_headertype {
 #define	DMU_BACKUP_FEATURE_LARGE_BLOCKS		(1 << 19)
 #define	DMU_BACKUP_FEATURE_RESUMING		(1 << 20)
 #define	DMU_BACKUP_FEATURE_LARGE_DNODE		(1 << 21)
+#define	DMU_BACKUP_FEATURE_COMPRESSED		(1 << 22)
+#define	DMU_BACKUP_FEATURE_PARTIAL		(1 << 23)
 
 /*
  * Mask of all supported backup features
@@ -109,11 +111,29 @@ typedef enum drr_headertype {
     DMU_BACKUP_FEATURE_DEDUPPROPS | DMU_BACKUP_FEATURE_SA_SPILL | \
     DMU_BACKUP_FEATURE_EMBED_DATA | DMU_BACKUP_FEATURE_EMBED_DATA_LZ4 | \
     DMU_BACKUP_FEATURE_RESUMING | DMU_BACKUP_FEATURE_LARGE_BLOCKS | \
-    DMU_BACKUP_FEATURE_LARGE_DNODE)
+    DMU_BACKUP_FEATURE_LARGE_DNODE | DMU_BACKUP_FEATURE_COMPRESSED | \
+    DMU_BACKUP_FEATURE_PARTIAL)
 
 /* Are all features in the given flag word currently supported? */
 #define	DMU_STREAM_SUPPORTED(x)	(!((x) & ~DMU_BACKUP_FEATURE_MASK))
 
+/*
+ * A partial (range-limited) send stream only carries the objects between
+ * dsr_firstobj and dsr_lastobj (inclusive) of each range, and of those only
+ * the data between dsr_offset and dsr_offset + dsr_length.  A dsr_length of
+ * UINT64_MAX extends to the end of each object.  Ranges must be sorted by
+ * object and may not share objects.  The ranges of a stream are listed in
+ * the "ranges" uint64 array of its BEGIN record's payload.
+ */
+typedef struct dmu_send_range {
+	uint64_t dsr_firstobj;
+	uint64_t dsr_lastobj;
+	uint64_t dsr_offset;
+	uint64_t dsr_length;
+} dmu_send_range_t;
+
+#define	DMU_SEND_RANGE_NUINT64	(sizeof (dmu_send_range_t) / sizeof (uint64_t))
+
 typedef enum dmu_send_resume_token_version {
 	ZFS_SEND_RESUME_TOKEN_VERSION = 1
 } dmu_send_resume_token_version_t;
@@ -162,6 +182,18 @@ typedef enum dmu_send_resume_token_version {
 
 #define	DRR_IS_DEDUP_CAPABLE(flags)	((flags) & DRR_CHECKSUM_DEDUP)
 
+/*
+ * A DRR_WRITE record in a compressed stream carries the block as stored
+ * on disk: drr_length is still the logical size, but the payload is
+ * drr_compressed_size bytes compressed with drr_compressiontype.  Older
+ * streams leave drr_compressiontype zero, which is never a valid on-disk
+ * compression function.
+ */
+#define	DRR_WRITE_COMPRESSED(drrw)	((drrw)->drr_compressiontype != 0)
+#define	DRR_WRITE_PAYLOAD_SIZE(drrw)	\
+	(DRR_WRITE_COMPRESSED(drrw) ? (drrw)->drr_compressed_size : \
+	(drrw)->drr_length)
+
 /*
  * zfs ioctl command structure
  */
@@ -214,8 +246,11 @@ typedef struct dmu_replay_record {
 			uint64_t drr_toguid;
 			uint8_t drr_checksumtype;
 			uint8_t drr_checksumflags;
-			uint8_t drr_pad2[6];
+			uint8_t drr_compressiontype;
+			uint8_t drr_pad2[5];
 			ddt_key_t drr_key; /* deduplication key */
+			/* only nonzero if drr_compressiontype is not 0 */
+			uint64_t drr_compressed_size;
 			/* content follows */
 		} drr_write;
 		struct drr_free {
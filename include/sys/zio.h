@@ -414,6 +414,11 @@ struct zio {
 	uint64_t	io_size;
 	uint64_t	io_orig_size;
 
+	/* Precompressed payload handed down by zio_write_compressed() */
+	void		*io_cdata;
+	uint64_t	io_cdata_size;
+	enum zio_compress io_cdata_compress;
+
 	/* Stuff for the vdev stack */
 	vdev_t		*io_vd;
 	void		*io_vsd;
@@ -481,6 +486,9 @@ extern zio_t *zio_rewrite(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
 extern void zio_write_override(zio_t *zio, blkptr_t *bp, int copies,
     boolean_t nopwrite);
 
+extern void zio_write_compressed(zio_t *zio, void *cdata, uint64_t csize,
+    enum zio_compress compress);
+
 extern void zio_free(spa_t *spa, uint64_t txg, const blkptr_t *bp);
 
 extern zio_t *zio_claim(zio_t *pio, spa_t *spa, uint64_t txg,
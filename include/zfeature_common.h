@@ -51,6 +51,9 @@ typedef enum spa_feature {
 	SPA_FEATURE_FS_SS_LIMIT,
 	SPA_FEATURE_LARGE_BLOCKS,
 	SPA_FEATURE_LARGE_DNODE,
+	SPA_FEATURE_BLOCK_CLONING,
+	SPA_FEATURE_DEDUP_LOG,
+	SPA_FEATURE_DEDUP_BLOOM,
 	SPA_FEATURES
 } spa_feature_t;
 
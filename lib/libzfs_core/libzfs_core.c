@@ -463,6 +463,10 @@ lzc_get_holds(const char *snapname, nvlist_t **holdsp)
  * to contain DRR_WRITE_EMBEDDED records with drr_etype==BP_EMBEDDED_TYPE_DATA,
  * which the receiving system must support (as indicated by support
  * for the "embedded_data" feature).
+ *
+ * If "flags" contains LZC_SEND_FLAG_COMPRESS, the stream is permitted
+ * to contain DRR_WRITE records whose payload is the block as compressed
+ * on disk (drr_compressiontype and drr_compressed_size are set).
  */
 int
 lzc_send(const char *snapname, const char *from, int fd,
@@ -471,9 +475,10 @@ lzc_send(const char *snapname, const char *from, int fd,
 	return (lzc_send_resume(snapname, from, fd, flags, 0, 0));
 }
 
-int
-lzc_send_resume(const char *snapname, const char *from, int fd,
-    enum lzc_send_flags flags, uint64_t resumeobj, uint64_t resumeoff)
+static int
+send_impl(const char *snapname, const char *from, int fd,
+    enum lzc_send_flags flags, uint64_t resumeobj, uint64_t resumeoff,
+    const dmu_send_range_t *ranges, uint_t nranges)
 {
 	nvlist_t *args;
 	int err;
@@ -486,15 +491,43 @@ lzc_send_resume(const char *snapname, const char *from, int fd,
 		fnvlist_add_boolean(args, "largeblockok");
 	if (flags & LZC_SEND_FLAG_EMBED_DATA)
 		fnvlist_add_boolean(args, "embedok");
+	if (flags & LZC_SEND_FLAG_COMPRESS)
+		fnvlist_add_boolean(args, "compressok");
 	if (resumeobj != 0 || resumeoff != 0) {
 		fnvlist_add_uint64(args, "resume_object", resumeobj);
 		fnvlist_add_uint64(args, "resume_offset", resumeoff);
 	}
+	if (nranges != 0) {
+		fnvlist_add_uint64_array(args, "ranges", (uint64_t *)ranges,
+		    nranges * DMU_SEND_RANGE_NUINT64);
+	}
 	err = lzc_ioctl(ZFS_IOC_SEND_NEW, snapname, args, NULL);
 	nvlist_free(args);
 	return (err);
 }
 
+int
+lzc_send_resume(const char *snapname, const char *from, int fd,
+    enum lzc_send_flags flags, uint64_t resumeobj, uint64_t resumeoff)
+{
+	return (send_impl(snapname, from, fd, flags, resumeobj, resumeoff,
+	    NULL, 0));
+}
+
+/*
+ * Generate a partial send stream, which only carries the given ranges of
+ * the snapshot (see dmu_send_range_t).  The other arguments are as for
+ * lzc_send().  A partial stream must be received incrementally, or as a
+ * clone of an existing snapshot, and its received snapshot gets a new guid.
+ */
+int
+lzc_send_partial(const char *snapname, const char *from, int fd,
+    enum lzc_send_flags flags, const dmu_send_range_t *ranges,
+    uint_t nranges)
+{
+	return (send_impl(snapname, from, fd, flags, 0, 0, ranges, nranges));
+}
+
 /*
  * "from" can be NULL, a snapshot, or a bookmark.
  *
@@ -509,9 +542,13 @@ lzc_send_resume(const char *snapname, const char *from, int fd,
  * the snapshot this bookmark was created from.  This will result in
  * significantly more I/O and be less efficient than a send space estimation on
  * an equivalent snapshot.
+ *
+ * If "flags" contains LZC_SEND_FLAG_COMPRESS, the estimate is for a stream
+ * that carries compressed blocks as they are stored on disk.
  */
 int
-lzc_send_space(const char *snapname, const char *from, uint64_t *spacep)
+lzc_send_space(const char *snapname, const char *from,
+    enum lzc_send_flags flags, uint64_t *spacep)
 {
 	nvlist_t *args;
 	nvlist_t *result;
@@ -520,6 +557,8 @@ lzc_send_space(const char *snapname, const char *from, uint64_t *spacep)
 	args = fnvlist_alloc();
 	if (from != NULL)
 		fnvlist_add_string(args, "from", from);
+	if (flags & LZC_SEND_FLAG_COMPRESS)
+		fnvlist_add_boolean(args, "compressok");
 	err = lzc_ioctl(ZFS_IOC_SEND_SPACE, snapname, args, &result);
 	nvlist_free(args);
 	if (err == 0)
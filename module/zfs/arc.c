@@ -674,6 +674,8 @@ static arc_buf_hdr_t arc_eviction_hdr;
 	((state) == arc_mru_ghost || (state) == arc_mfu_ghost ||	\
 	(state) == arc_l2c_only)
 
+#define	CACHED_STATE(state)	((state) == arc_mru || (state) == arc_mfu)
+
 #define	HDR_IN_HASH_TABLE(hdr)	((hdr)->b_flags & ARC_FLAG_IN_HASH_TABLE)
 #define	HDR_IO_IN_PROGRESS(hdr)	((hdr)->b_flags & ARC_FLAG_IO_IN_PROGRESS)
 #define	HDR_IO_ERROR(hdr)	((hdr)->b_flags & ARC_FLAG_IO_ERROR)
@@ -696,6 +698,7 @@ static arc_buf_hdr_t arc_eviction_hdr;
 
 #define	HDR_HAS_L1HDR(hdr)	((hdr)->b_flags & ARC_FLAG_HAS_L1HDR)
 #define	HDR_HAS_L2HDR(hdr)	((hdr)->b_flags & ARC_FLAG_HAS_L2HDR)
+#define	HDR_OS_CHARGED(hdr)	((hdr)->b_flags & ARC_FLAG_OS_CHARGED)
 
 /*
  * Other sizes
@@ -1512,6 +1515,370 @@ arc_buf_info(arc_buf_t *ab, arc_buf_info_t *abi, int state_index)
 	abi->abi_size = hdr->b_size;
 }
 
+/*
+ * Per-objset ARC accounting
+ *
+ * Every open objset registers an arc_os_t with the ARC.  A buffer read or
+ * written on behalf of a registered objset is charged to it (one copy of
+ * its size) for as long as it holds data in the MRU or MFU state, which
+ * provides the per-dataset "size" kstat and lets the ARC enforce the
+ * "arcquota" and "arcreservation" dataset properties:
+ *
+ *  - the quota is a hard cap; arc_adjust() evicts the objset's own
+ *    buffers whenever it is exceeded, regardless of overall ARC pressure.
+ *  - the reservation is a soft floor; general eviction passes over the
+ *    objset's buffers while it is at or below it, and only falls back to
+ *    them when nothing else of the requested type remains evictable.
+ *
+ * Entries live in a small hash table keyed by (spa load guid, objset id)
+ * and are freed once the objset is closed and nothing is charged to it.
+ * The hash locks are leaf locks; they may be taken with a hash lock or a
+ * multilist sublist lock held.
+ */
+#define	ARC_OS_HASH_SIZE	256
+#define	ARC_OS_HASH_INDEX(spa, objset) \
+	(((spa) ^ (objset) ^ ((objset) >> 8)) & (ARC_OS_HASH_SIZE - 1))
+#define	ARC_OS_HASH_LOCK(idx)	(&arc_os_hash[idx].aob_lock.ht_lock)
+
+typedef struct arc_os_bucket {
+	struct ht_lock	aob_lock;
+	arc_os_t	*aob_head;
+} arc_os_bucket_t;
+
+static arc_os_bucket_t arc_os_hash[ARC_OS_HASH_SIZE];
+static kmutex_t arc_os_lock;		/* registration, limits and kstats */
+static uint64_t arc_os_reserved;	/* sum of all reservations */
+static uint64_t arc_os_quotas;		/* objsets with a quota set */
+
+static arc_os_stats_t arc_os_stats_template = {
+	{ "arc_size",			KSTAT_DATA_UINT64 },
+	{ "arc_quota",			KSTAT_DATA_UINT64 },
+	{ "arc_reservation",		KSTAT_DATA_UINT64 },
+	{ "arc_hits",			KSTAT_DATA_UINT64 },
+	{ "arc_misses",			KSTAT_DATA_UINT64 },
+	{ "arc_quota_evicted",		KSTAT_DATA_UINT64 }
+};
+
+static arc_os_t *
+arc_os_find(int idx, uint64_t spa, uint64_t objset)
+{
+	arc_os_t *aos;
+
+	ASSERT(MUTEX_HELD(ARC_OS_HASH_LOCK(idx)));
+
+	for (aos = arc_os_hash[idx].aob_head; aos != NULL;
+	    aos = aos->ao_hash_next) {
+		if (aos->ao_spa == spa && aos->ao_objset == objset)
+			return (aos);
+	}
+
+	return (NULL);
+}
+
+static void
+arc_os_remove(int idx, arc_os_t *aos)
+{
+	arc_os_t **aosp;
+
+	ASSERT(MUTEX_HELD(ARC_OS_HASH_LOCK(idx)));
+	ASSERT0(aos->ao_registered);
+	ASSERT0(aos->ao_size);
+
+	for (aosp = &arc_os_hash[idx].aob_head; *aosp != aos;
+	    aosp = &(*aosp)->ao_hash_next)
+		ASSERT(*aosp != NULL);
+	*aosp = aos->ao_hash_next;
+	aos->ao_hash_next = NULL;
+}
+
+/*
+ * Charge a header which is entering the MRU or MFU state to the objset
+ * it was last read or written for.  Headers of objsets which are not
+ * registered (e.g. the MOS, or a dataset traversed without being opened)
+ * are simply left uncharged.
+ */
+static void
+arc_os_charge(arc_buf_hdr_t *hdr)
+{
+	uint64_t objset = hdr->b_l1hdr.b_objset;
+	int idx = ARC_OS_HASH_INDEX(hdr->b_spa, objset);
+	boolean_t over_quota = B_FALSE;
+	arc_os_t *aos;
+
+	ASSERT(HDR_HAS_L1HDR(hdr));
+	ASSERT(!HDR_OS_CHARGED(hdr));
+
+	if (objset == 0)
+		return;
+
+	mutex_enter(ARC_OS_HASH_LOCK(idx));
+	aos = arc_os_find(idx, hdr->b_spa, objset);
+	if (aos != NULL && aos->ao_registered != 0) {
+		uint64_t quota = aos->ao_quota;
+
+		over_quota = (quota != 0 && aos->ao_size <= quota &&
+		    aos->ao_size + hdr->b_size > quota);
+		aos->ao_size += hdr->b_size;
+		hdr->b_flags |= ARC_FLAG_OS_CHARGED;
+	}
+	mutex_exit(ARC_OS_HASH_LOCK(idx));
+
+	/*
+	 * Kick the reclaim thread as the objset crosses its quota, rather
+	 * than waiting for its next periodic pass.
+	 */
+	if (over_quota) {
+		mutex_enter(&arc_reclaim_lock);
+		cv_signal(&arc_reclaim_thread_cv);
+		mutex_exit(&arc_reclaim_lock);
+	}
+}
+
+static void
+arc_os_uncharge(arc_buf_hdr_t *hdr)
+{
+	int idx = ARC_OS_HASH_INDEX(hdr->b_spa, hdr->b_l1hdr.b_objset);
+	arc_os_t *aos;
+
+	ASSERT(HDR_HAS_L1HDR(hdr));
+
+	if (!HDR_OS_CHARGED(hdr))
+		return;
+
+	mutex_enter(ARC_OS_HASH_LOCK(idx));
+	aos = arc_os_find(idx, hdr->b_spa, hdr->b_l1hdr.b_objset);
+	ASSERT(aos != NULL);
+	ASSERT3U(aos->ao_size, >=, hdr->b_size);
+	aos->ao_size -= hdr->b_size;
+	hdr->b_flags &= ~ARC_FLAG_OS_CHARGED;
+	if (aos->ao_size == 0 && aos->ao_registered == 0)
+		arc_os_remove(idx, aos);
+	else
+		aos = NULL;
+	mutex_exit(ARC_OS_HASH_LOCK(idx));
+
+	if (aos != NULL)
+		kmem_free(aos, sizeof (arc_os_t));
+}
+
+/*
+ * Returns true if the objset the header is charged to is currently
+ * within its ARC reservation, and so should be passed over by general
+ * eviction.
+ */
+static boolean_t
+arc_os_hdr_reserved(arc_buf_hdr_t *hdr)
+{
+	int idx = ARC_OS_HASH_INDEX(hdr->b_spa, hdr->b_l1hdr.b_objset);
+	boolean_t reserved = B_FALSE;
+	arc_os_t *aos;
+
+	if (!HDR_OS_CHARGED(hdr))
+		return (B_FALSE);
+
+	mutex_enter(ARC_OS_HASH_LOCK(idx));
+	aos = arc_os_find(idx, hdr->b_spa, hdr->b_l1hdr.b_objset);
+	if (aos != NULL && aos->ao_reservation != 0)
+		reserved = (aos->ao_size <= aos->ao_reservation);
+	mutex_exit(ARC_OS_HASH_LOCK(idx));
+
+	return (reserved);
+}
+
+static void
+arc_os_set_quota_impl(arc_os_t *aos, uint64_t quota)
+{
+	ASSERT(MUTEX_HELD(&arc_os_lock));
+
+	if (aos->ao_quota == 0 && quota != 0)
+		atomic_inc_64(&arc_os_quotas);
+	else if (aos->ao_quota != 0 && quota == 0)
+		atomic_dec_64(&arc_os_quotas);
+	aos->ao_quota = quota;
+}
+
+static void
+arc_os_set_reservation_impl(arc_os_t *aos, uint64_t reservation)
+{
+	ASSERT(MUTEX_HELD(&arc_os_lock));
+
+	atomic_add_64(&arc_os_reserved, reservation - aos->ao_reservation);
+	aos->ao_reservation = reservation;
+}
+
+static int
+arc_os_kstat_update(kstat_t *ksp, int rw)
+{
+	arc_os_t *aos = ksp->ks_private;
+	arc_os_stats_t *aoss = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	aoss->aos_arc_size.value.ui64 = aos->ao_size;
+	aoss->aos_arc_quota.value.ui64 = aos->ao_quota;
+	aoss->aos_arc_reservation.value.ui64 = aos->ao_reservation;
+	aoss->aos_arc_hits.value.ui64 = aos->ao_hits;
+	aoss->aos_arc_misses.value.ui64 = aos->ao_misses;
+	aoss->aos_arc_quota_evicted.value.ui64 = aos->ao_quota_evicted;
+
+	return (0);
+}
+
+/*
+ * Register an open objset with the ARC.  Returns the handle used to set
+ * its limits and report its reads, which stays valid until the matching
+ * arc_os_unregister().  The accounting is exported as the
+ * zfs/<pool>/objset-0x<id> kstat.
+ */
+arc_os_t *
+arc_os_register(spa_t *spa, uint64_t objset)
+{
+	uint64_t guid = spa_load_guid(spa);
+	int idx = ARC_OS_HASH_INDEX(guid, objset);
+	arc_os_t *aos, *naos;
+
+	ASSERT3U(objset, !=, 0);
+
+	naos = kmem_zalloc(sizeof (arc_os_t), KM_SLEEP);
+
+	mutex_enter(&arc_os_lock);
+	mutex_enter(ARC_OS_HASH_LOCK(idx));
+	aos = arc_os_find(idx, guid, objset);
+	if (aos == NULL) {
+		aos = naos;
+		naos = NULL;
+		aos->ao_spa = guid;
+		aos->ao_objset = objset;
+		aos->ao_hash_next = arc_os_hash[idx].aob_head;
+		arc_os_hash[idx].aob_head = aos;
+	}
+	aos->ao_registered++;
+	mutex_exit(ARC_OS_HASH_LOCK(idx));
+
+	if (aos->ao_ksp == NULL) {
+		char kstat_module[KSTAT_STRLEN];
+		char kstat_name[KSTAT_STRLEN];
+		kstat_t *ksp;
+
+		(void) snprintf(kstat_module, KSTAT_STRLEN, "zfs/%s",
+		    spa_name(spa));
+		(void) snprintf(kstat_name, KSTAT_STRLEN, "objset-0x%llx",
+		    (u_longlong_t)objset);
+
+		ksp = kstat_create(kstat_module, 0, kstat_name, "misc",
+		    KSTAT_TYPE_NAMED, sizeof (arc_os_stats_t) /
+		    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+		if (ksp != NULL) {
+			aos->ao_stats = arc_os_stats_template;
+			ksp->ks_data = &aos->ao_stats;
+			ksp->ks_private = aos;
+			ksp->ks_update = arc_os_kstat_update;
+			kstat_install(ksp);
+			aos->ao_ksp = ksp;
+		}
+	}
+	mutex_exit(&arc_os_lock);
+
+	if (naos != NULL)
+		kmem_free(naos, sizeof (arc_os_t));
+
+	return (aos);
+}
+
+void
+arc_os_unregister(arc_os_t *aos)
+{
+	int idx = ARC_OS_HASH_INDEX(aos->ao_spa, aos->ao_objset);
+	boolean_t destroy = B_FALSE;
+
+	mutex_enter(&arc_os_lock);
+	ASSERT3U(aos->ao_registered, >, 0);
+	if (aos->ao_registered == 1) {
+		arc_os_set_quota_impl(aos, 0);
+		arc_os_set_reservation_impl(aos, 0);
+		if (aos->ao_ksp != NULL) {
+			kstat_delete(aos->ao_ksp);
+			aos->ao_ksp = NULL;
+		}
+	}
+
+	mutex_enter(ARC_OS_HASH_LOCK(idx));
+	aos->ao_registered--;
+	if (aos->ao_registered == 0 && aos->ao_size == 0) {
+		arc_os_remove(idx, aos);
+		destroy = B_TRUE;
+	}
+	mutex_exit(ARC_OS_HASH_LOCK(idx));
+	mutex_exit(&arc_os_lock);
+
+	if (destroy)
+		kmem_free(aos, sizeof (arc_os_t));
+}
+
+void
+arc_os_set_quota(arc_os_t *aos, uint64_t quota)
+{
+	mutex_enter(&arc_os_lock);
+	arc_os_set_quota_impl(aos, quota);
+	mutex_exit(&arc_os_lock);
+}
+
+void
+arc_os_set_reservation(arc_os_t *aos, uint64_t reservation)
+{
+	mutex_enter(&arc_os_lock);
+	arc_os_set_reservation_impl(aos, reservation);
+	mutex_exit(&arc_os_lock);
+}
+
+/*
+ * Called by the DMU for every read it issues on behalf of an objset.
+ */
+void
+arc_os_read_stat(arc_os_t *aos, boolean_t hit)
+{
+	if (aos == NULL)
+		return;
+
+	if (hit)
+		atomic_inc_64(&aos->ao_hits);
+	else
+		atomic_inc_64(&aos->ao_misses);
+}
+
+static void
+arc_os_init(void)
+{
+	int i;
+
+	mutex_init(&arc_os_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < ARC_OS_HASH_SIZE; i++) {
+		mutex_init(ARC_OS_HASH_LOCK(i), NULL, MUTEX_DEFAULT, NULL);
+		arc_os_hash[i].aob_head = NULL;
+	}
+}
+
+static void
+arc_os_fini(void)
+{
+	int i;
+
+	for (i = 0; i < ARC_OS_HASH_SIZE; i++) {
+		arc_os_t *aos;
+
+		while ((aos = arc_os_hash[i].aob_head) != NULL) {
+			ASSERT0(aos->ao_registered);
+			arc_os_hash[i].aob_head = aos->ao_hash_next;
+			kmem_free(aos, sizeof (arc_os_t));
+		}
+		mutex_destroy(ARC_OS_HASH_LOCK(i));
+	}
+	mutex_destroy(&arc_os_lock);
+	ASSERT0(arc_os_reserved);
+	ASSERT0(arc_os_quotas);
+}
+
 /*
  * Move the supplied buffer to the indicated state. The hash lock
  * for the buffer must be held by the caller.
@@ -1670,6 +2037,15 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *hdr,
 		}
 	}
 
+	/*
+	 * Buffers are charged to their objset only while they hold data
+	 * in one of the cached states.
+	 */
+	if (CACHED_STATE(old_state) && !CACHED_STATE(new_state))
+		arc_os_uncharge(hdr);
+	else if (!CACHED_STATE(old_state) && CACHED_STATE(new_state))
+		arc_os_charge(hdr);
+
 	if (HDR_HAS_L1HDR(hdr))
 		hdr->b_l1hdr.b_state = new_state;
 
@@ -1772,6 +2148,7 @@ arc_buf_alloc(spa_t *spa, uint64_t size, void *tag, arc_buf_contents_t type)
 	ASSERT3P(hdr->b_freeze_cksum, ==, NULL);
 	hdr->b_size = size;
 	hdr->b_spa = spa_load_guid(spa);
+	hdr->b_l1hdr.b_objset = 0;
 	hdr->b_l1hdr.b_mru_hits = 0;
 	hdr->b_l1hdr.b_mru_ghost_hits = 0;
 	hdr->b_l1hdr.b_mfu_hits = 0;
@@ -2460,7 +2837,7 @@ arc_evict_hdr(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 
 static uint64_t
 arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
-    uint64_t spa, int64_t bytes)
+    uint64_t spa, uint64_t objset, boolean_t resv, int64_t bytes)
 {
 	multilist_sublist_t *mls;
 	uint64_t bytes_evicted = 0;
@@ -2510,6 +2887,19 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 			continue;
 		}
 
+		/*
+		 * When enforcing an objset's quota only the buffers charged
+		 * to it are candidates; otherwise, if asked to, pass over
+		 * buffers of objsets which are within their reservation.
+		 */
+		if (objset != 0 && (!HDR_OS_CHARGED(hdr) ||
+		    hdr->b_l1hdr.b_objset != objset))
+			continue;
+		if (resv && arc_os_hdr_reserved(hdr)) {
+			ARCSTAT_BUMP(arcstat_evict_skip);
+			continue;
+		}
+
 		hash_lock = HDR_LOCK(hdr);
 
 		/*
@@ -2574,6 +2964,10 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
  * specified number of bytes. Move the removed buffers to the
  * appropriate evict state.
  *
+ * Eviction may be restricted to the buffers of a single spa, and further
+ * to those charged to a single objset of it.  If 'resv' is set, buffers
+ * of objsets which are within their ARC reservation are left alone.
+ *
  * This function makes a "best effort". It skips over any buffers
  * it can't get a hash_lock on, and so, may not catch all candidates.
  * It may also return without evicting as much space as requested.
@@ -2583,8 +2977,8 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
  * the given arc state; which is used by arc_flush().
  */
 static uint64_t
-arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
-    arc_buf_contents_t type)
+arc_evict_state(arc_state_t *state, uint64_t spa, uint64_t objset,
+    boolean_t resv, int64_t bytes, arc_buf_contents_t type)
 {
 	uint64_t total_evicted = 0;
 	multilist_t *ml = &state->arcs_list[type];
@@ -2657,7 +3051,8 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 				break;
 
 			bytes_evicted = arc_evict_state_impl(ml, sublist_idx,
-			    markers[sublist_idx], spa, bytes_remaining);
+			    markers[sublist_idx], spa, objset, resv,
+			    bytes_remaining);
 
 			scan_evicted += bytes_evicted;
 			total_evicted += bytes_evicted;
@@ -2680,9 +3075,11 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 			 * When bytes is ARC_EVICT_ALL, the only way to
 			 * break the loop is when scan_evicted is zero.
 			 * In that case, we actually have evicted enough,
-			 * so we don't want to increment the kstat.
+			 * so we don't want to increment the kstat.  Nor
+			 * do we when evicting on behalf of an objset,
+			 * which may simply have nothing left here.
 			 */
-			if (bytes != ARC_EVICT_ALL) {
+			if (bytes != ARC_EVICT_ALL && objset == 0) {
 				ASSERT3S(total_evicted, <, bytes);
 				ARCSTAT_BUMP(arcstat_evict_not_enough);
 			}
@@ -2725,7 +3122,8 @@ arc_flush_state(arc_state_t *state, uint64_t spa, arc_buf_contents_t type,
 	uint64_t evicted = 0;
 
 	while (state->arcs_lsize[type] != 0) {
-		evicted += arc_evict_state(state, spa, ARC_EVICT_ALL, type);
+		evicted += arc_evict_state(state, spa, 0, B_FALSE,
+		    ARC_EVICT_ALL, type);
 
 		if (!retry)
 			break;
@@ -2788,21 +3186,32 @@ arc_prune_async(int64_t adjust)
  * is "evictable", and to skip evicting altogether when passed a
  * negative value for "bytes". In contrast, arc_evict_state() will
  * evict everything it can, when passed a negative value for "bytes".
+ *
+ * Objset reservations are soft: buffers of objsets within their
+ * reservation are only evicted when the target can't be met otherwise.
  */
 static uint64_t
 arc_adjust_impl(arc_state_t *state, uint64_t spa, int64_t bytes,
     arc_buf_contents_t type)
 {
+	uint64_t evicted = 0;
 	int64_t delta;
 
 	if (bytes > 0 && state->arcs_lsize[type] > 0) {
 		delta = MIN(state->arcs_lsize[type], bytes);
-		return (arc_evict_state(state, spa, delta, type));
+		if (arc_os_reserved != 0)
+			evicted = arc_evict_state(state, spa, 0, B_TRUE,
+			    delta, type);
+		if (evicted < delta)
+			evicted += arc_evict_state(state, spa, 0, B_FALSE,
+			    delta - evicted, type);
+		return (evicted);
 	}
 
 	return (0);
 }
 
+
 /*
  * The goal of this function is to evict enough meta data buffers from the
  * ARC in order to enforce the arc_meta_limit.  Achieving this is slightly
@@ -3022,6 +3431,94 @@ arc_adjust_type(arc_state_t *state)
 	return (type);
 }
 
+/*
+ * Evict up to 'bytes' of the buffers charged to a single objset, oldest
+ * first, starting with the MRU.
+ */
+static uint64_t
+arc_adjust_os_impl(uint64_t spa, uint64_t objset, int64_t bytes)
+{
+	arc_state_t *states[] = { arc_mru, arc_mfu };
+	arc_buf_contents_t types[] = { ARC_BUFC_DATA, ARC_BUFC_METADATA };
+	uint64_t evicted = 0;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(states); i++) {
+		for (j = 0; j < ARRAY_SIZE(types); j++) {
+			if (evicted >= bytes)
+				return (evicted);
+			if (states[i]->arcs_lsize[types[j]] == 0)
+				continue;
+			evicted += arc_evict_state(states[i], spa, objset,
+			    B_FALSE, bytes - evicted, types[j]);
+		}
+	}
+
+	return (evicted);
+}
+
+/*
+ * Enforce the ARC quota of every objset which has grown beyond it.
+ */
+#define	ARC_OS_ADJUST_BATCH	8
+
+static uint64_t
+arc_adjust_os(void)
+{
+	uint64_t total_evicted = 0;
+	int i, j, n;
+
+	if (arc_os_quotas == 0)
+		return (0);
+
+	for (i = 0; i < ARC_OS_HASH_SIZE; i++) {
+		struct {
+			uint64_t spa;
+			uint64_t objset;
+			int64_t excess;
+		} batch[ARC_OS_ADJUST_BATCH];
+		arc_os_t *aos;
+
+		/*
+		 * Eviction takes the hash locks itself, so note what is
+		 * over quota and drop the lock before evicting it.
+		 */
+		n = 0;
+		mutex_enter(ARC_OS_HASH_LOCK(i));
+		for (aos = arc_os_hash[i].aob_head;
+		    aos != NULL && n < ARC_OS_ADJUST_BATCH;
+		    aos = aos->ao_hash_next) {
+			uint64_t quota = aos->ao_quota;
+
+			if (quota == 0 || aos->ao_size <= quota)
+				continue;
+			batch[n].spa = aos->ao_spa;
+			batch[n].objset = aos->ao_objset;
+			batch[n].excess = aos->ao_size - quota;
+			n++;
+		}
+		mutex_exit(ARC_OS_HASH_LOCK(i));
+
+		for (j = 0; j < n; j++) {
+			uint64_t evicted = arc_adjust_os_impl(batch[j].spa,
+			    batch[j].objset, batch[j].excess);
+
+			if (evicted == 0)
+				continue;
+
+			mutex_enter(ARC_OS_HASH_LOCK(i));
+			aos = arc_os_find(i, batch[j].spa, batch[j].objset);
+			if (aos != NULL)
+				aos->ao_quota_evicted += evicted;
+			mutex_exit(ARC_OS_HASH_LOCK(i));
+
+			total_evicted += evicted;
+		}
+	}
+
+	return (total_evicted);
+}
+
 /*
  * Evict buffers from the cache, such that arc_size is capped by arc_c.
  */
@@ -3032,6 +3529,12 @@ arc_adjust(void)
 	uint64_t bytes;
 	int64_t target;
 
+	/*
+	 * Objset quotas are enforced independently of the overall ARC
+	 * target, and anything evicted here also helps with the latter.
+	 */
+	total_evicted += arc_adjust_os();
+
 	/*
 	 * If we're over arc_meta_limit, we want to correct that before
 	 * potentially evicting data buffers below.
@@ -4451,6 +4954,8 @@ top:
 				hdr->b_flags |= ARC_FLAG_L2COMPRESS;
 			if (BP_GET_LEVEL(bp) > 0)
 				hdr->b_flags |= ARC_FLAG_INDIRECT;
+			if (zb != NULL)
+				hdr->b_l1hdr.b_objset = zb->zb_objset;
 		} else {
 			/*
 			 * This block is in the ghost cache. If it was L2-only
@@ -4466,6 +4971,9 @@ top:
 			ASSERT(!HDR_IO_IN_PROGRESS(hdr));
 			ASSERT(refcount_is_zero(&hdr->b_l1hdr.b_refcnt));
 			ASSERT3P(hdr->b_l1hdr.b_buf, ==, NULL);
+			ASSERT(!HDR_OS_CHARGED(hdr));
+
+			hdr->b_l1hdr.b_objset = (zb != NULL) ? zb->zb_objset : 0;
 
 			/*
 			 * If there is a callback, we pass a reference to it.
@@ -4923,6 +5431,7 @@ arc_release(arc_buf_t *buf, void *tag)
 		nhdr = kmem_cache_alloc(hdr_full_cache, KM_PUSHPAGE);
 		nhdr->b_size = blksz;
 		nhdr->b_spa = spa;
+		nhdr->b_l1hdr.b_objset = 0;
 
 		nhdr->b_l1hdr.b_mru_hits = 0;
 		nhdr->b_l1hdr.b_mru_ghost_hits = 0;
@@ -5141,6 +5650,8 @@ arc_write(zio_t *pio, spa_t *spa, uint64_t txg,
 	ASSERT(!HDR_IO_IN_PROGRESS(hdr));
 	ASSERT(hdr->b_l1hdr.b_acb == NULL);
 	ASSERT(hdr->b_l1hdr.b_datacnt > 0);
+	ASSERT(!HDR_OS_CHARGED(hdr));
+	hdr->b_l1hdr.b_objset = (zb != NULL) ? zb->zb_objset : 0;
 	if (l2arc)
 		hdr->b_flags |= ARC_FLAG_L2CACHE;
 	if (l2arc_compress)
@@ -5574,6 +6085,7 @@ arc_init(void)
 	refcount_create(&arc_l2c_only->arcs_size);
 
 	buf_init();
+	arc_os_init();
 
 	arc_reclaim_thread_exit = FALSE;
 	arc_user_evicts_thread_exit = FALSE;
@@ -5706,6 +6218,7 @@ arc_fini(void)
 	multilist_destroy(&arc_l2c_only->arcs_list[ARC_BUFC_METADATA]);
 	multilist_destroy(&arc_l2c_only->arcs_list[ARC_BUFC_DATA]);
 
+	arc_os_fini();
 	buf_fini();
 
 	ASSERT0(arc_loaned_bytes);
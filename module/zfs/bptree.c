@@ -168,6 +168,30 @@ bptree_visit_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 	return (err);
 }
 
+/*
+ * Start reading the root block of bptree entry "i", so that moving on to the
+ * next destroyed dataset doesn't stall the traversal on a synchronous read.
+ */
+static void
+bptree_prefetch_entry(objset_t *os, uint64_t obj, uint64_t i)
+{
+	bptree_entry_phys_t bte;
+	arc_flags_t flags = ARC_FLAG_NOWAIT | ARC_FLAG_PREFETCH;
+	zbookmark_phys_t zb;
+
+	if (dmu_read(os, obj, i * sizeof (bte), sizeof (bte), &bte,
+	    DMU_READ_NO_PREFETCH) != 0)
+		return;
+	if (BP_IS_HOLE(&bte.be_bp) || bte.be_bp.blk_birth <= bte.be_birth_txg)
+		return;
+
+	SET_BOOKMARK(&zb, ZB_DESTROYED_OBJSET, ZB_ROOT_OBJECT,
+	    ZB_ROOT_LEVEL, ZB_ROOT_BLKID);
+	(void) arc_read(NULL, os->os_spa, &bte.be_bp, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE,
+	    &flags, &zb);
+}
+
 /*
  * If "free" is set:
  *  - It is assumed that "func" will be freeing the block pointers.
@@ -221,6 +245,8 @@ bptree_iterate(objset_t *os, uint64_t obj, boolean_t free, bptree_itor_t func,
 
 		if (zfs_free_leak_on_eio)
 			flags |= TRAVERSE_HARD;
+		if (free && i + 1 < ba.ba_phys->bt_end)
+			bptree_prefetch_entry(os, obj, i + 1);
 		zfs_dbgmsg("bptree index %lld: traversing from min_txg=%lld "
 		    "bookmark %lld/%lld/%lld/%lld",
 		    i, (longlong_t)bte.be_birth_txg,
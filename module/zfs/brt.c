@@ -0,0 +1,480 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Block Reference Table (BRT)
+ *
+ * Block cloning (copy_file_range(2), FICLONE) creates new block pointers
+ * that share the DVAs of existing blocks instead of copying their data.
+ * The BRT counts, for each shared block, the references that exist beyond
+ * the original one, so that freeing any one of them only drops a
+ * reference and the space is returned once the last copy is gone.
+ *
+ * Blocks are identified by the vdev and offset of their first DVA.  The
+ * table is stored in a single MOS ZAP with uint64 keys and is kept fully
+ * in memory, which is cheap as long as cloned blocks are a small fraction
+ * of the pool.  Clones are recorded per txg in open context and applied
+ * to the table at the beginning of that txg's sync, before any frees of
+ * the txg are processed; dirty entries are written out by brt_sync().
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zio.h>
+#include <sys/brt.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_pool.h>
+#include <sys/zfeature.h>
+
+static kmem_cache_t *brt_entry_cache;
+static kmem_cache_t *brt_pending_entry_cache;
+
+int brt_zap_leaf_blockshift = 12;
+int brt_zap_indirect_blockshift = 12;
+
+static int
+brt_entry_compare(const void *x1, const void *x2)
+{
+	const brt_entry_t *bre1 = x1;
+	const brt_entry_t *bre2 = x2;
+
+	if (bre1->bre_vdev < bre2->bre_vdev)
+		return (-1);
+	if (bre1->bre_vdev > bre2->bre_vdev)
+		return (1);
+	if (bre1->bre_offset < bre2->bre_offset)
+		return (-1);
+	if (bre1->bre_offset > bre2->bre_offset)
+		return (1);
+
+	return (0);
+}
+
+static int
+brt_pending_entry_compare(const void *x1, const void *x2)
+{
+	const brt_pending_entry_t *bpe1 = x1;
+	const brt_pending_entry_t *bpe2 = x2;
+	const dva_t *dva1 = &bpe1->bpe_bp.blk_dva[0];
+	const dva_t *dva2 = &bpe2->bpe_bp.blk_dva[0];
+
+	if (DVA_GET_VDEV(dva1) < DVA_GET_VDEV(dva2))
+		return (-1);
+	if (DVA_GET_VDEV(dva1) > DVA_GET_VDEV(dva2))
+		return (1);
+	if (DVA_GET_OFFSET(dva1) < DVA_GET_OFFSET(dva2))
+		return (-1);
+	if (DVA_GET_OFFSET(dva1) > DVA_GET_OFFSET(dva2))
+		return (1);
+
+	return (0);
+}
+
+static brt_t *
+brt_alloc(spa_t *spa)
+{
+	brt_t *brt;
+	int t;
+
+	brt = kmem_zalloc(sizeof (brt_t), KM_SLEEP);
+	mutex_init(&brt->brt_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&brt->brt_pending_lock, NULL, MUTEX_DEFAULT, NULL);
+	brt->brt_spa = spa;
+	brt->brt_os = spa->spa_meta_objset;
+	avl_create(&brt->brt_tree, brt_entry_compare,
+	    sizeof (brt_entry_t), offsetof(brt_entry_t, bre_node));
+	list_create(&brt->brt_dirty, sizeof (brt_entry_t),
+	    offsetof(brt_entry_t, bre_dirty_node));
+	for (t = 0; t < TXG_SIZE; t++) {
+		avl_create(&brt->brt_pending[t], brt_pending_entry_compare,
+		    sizeof (brt_pending_entry_t),
+		    offsetof(brt_pending_entry_t, bpe_node));
+	}
+
+	return (brt);
+}
+
+static void
+brt_free(brt_t *brt)
+{
+	brt_pending_entry_t *bpe;
+	brt_entry_t *bre;
+	void *cookie;
+	int t;
+
+	while (list_remove_head(&brt->brt_dirty) != NULL)
+		continue;
+	list_destroy(&brt->brt_dirty);
+
+	cookie = NULL;
+	while ((bre = avl_destroy_nodes(&brt->brt_tree, &cookie)) != NULL)
+		kmem_cache_free(brt_entry_cache, bre);
+	avl_destroy(&brt->brt_tree);
+
+	for (t = 0; t < TXG_SIZE; t++) {
+		cookie = NULL;
+		while ((bpe = avl_destroy_nodes(&brt->brt_pending[t],
+		    &cookie)) != NULL)
+			kmem_cache_free(brt_pending_entry_cache, bpe);
+		avl_destroy(&brt->brt_pending[t]);
+	}
+
+	mutex_destroy(&brt->brt_pending_lock);
+	mutex_destroy(&brt->brt_lock);
+	kmem_free(brt, sizeof (brt_t));
+}
+
+static brt_entry_t *
+brt_entry_find(brt_t *brt, const blkptr_t *bp)
+{
+	brt_entry_t bre_search;
+
+	ASSERT(MUTEX_HELD(&brt->brt_lock));
+
+	bre_search.bre_vdev = DVA_GET_VDEV(&bp->blk_dva[0]);
+	bre_search.bre_offset = DVA_GET_OFFSET(&bp->blk_dva[0]);
+
+	return (avl_find(&brt->brt_tree, &bre_search, NULL));
+}
+
+static brt_entry_t *
+brt_entry_alloc(uint64_t vdev, uint64_t offset)
+{
+	brt_entry_t *bre;
+
+	bre = kmem_cache_alloc(brt_entry_cache, KM_SLEEP);
+	bre->bre_vdev = vdev;
+	bre->bre_offset = offset;
+	bre->bre_phys.brp_refcnt = 0;
+	bre->bre_phys.brp_dsize = 0;
+	bre->bre_dirty = B_FALSE;
+	list_link_init(&bre->bre_dirty_node);
+
+	return (bre);
+}
+
+static void
+brt_entry_dirty(brt_t *brt, brt_entry_t *bre)
+{
+	ASSERT(MUTEX_HELD(&brt->brt_lock));
+
+	if (!bre->bre_dirty) {
+		bre->bre_dirty = B_TRUE;
+		list_insert_tail(&brt->brt_dirty, bre);
+	}
+}
+
+static void
+brt_entry_addref(brt_t *brt, const blkptr_t *bp, uint64_t count)
+{
+	brt_entry_t *bre;
+
+	mutex_enter(&brt->brt_lock);
+	bre = brt_entry_find(brt, bp);
+	if (bre == NULL) {
+		bre = brt_entry_alloc(DVA_GET_VDEV(&bp->blk_dva[0]),
+		    DVA_GET_OFFSET(&bp->blk_dva[0]));
+		bre->bre_phys.brp_dsize = bp_get_dsize_sync(brt->brt_spa, bp);
+		avl_add(&brt->brt_tree, bre);
+	}
+	bre->bre_phys.brp_refcnt += count;
+	brt->brt_saved += count * bre->bre_phys.brp_dsize;
+	brt_entry_dirty(brt, bre);
+	mutex_exit(&brt->brt_lock);
+}
+
+/*
+ * Returns B_TRUE if the block may have additional references.  This is
+ * only a hint, brt_entry_decref() makes the actual decision.
+ */
+boolean_t
+brt_maybe_exists(spa_t *spa, const blkptr_t *bp)
+{
+	brt_t *brt = spa->spa_brt;
+	brt_entry_t *bre;
+	boolean_t exists;
+
+	if (brt == NULL || BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp) ||
+	    avl_numnodes(&brt->brt_tree) == 0)
+		return (B_FALSE);
+
+	mutex_enter(&brt->brt_lock);
+	bre = brt_entry_find(brt, bp);
+	exists = (bre != NULL && bre->bre_phys.brp_refcnt > 0);
+	mutex_exit(&brt->brt_lock);
+
+	return (exists);
+}
+
+/*
+ * Drop one reference to a cloned block.  Returns B_TRUE if no additional
+ * references remain and the caller should free the block.
+ */
+boolean_t
+brt_entry_decref(spa_t *spa, const blkptr_t *bp)
+{
+	brt_t *brt = spa->spa_brt;
+	brt_entry_t *bre;
+
+	if (brt == NULL)
+		return (B_TRUE);
+
+	mutex_enter(&brt->brt_lock);
+	bre = brt_entry_find(brt, bp);
+	if (bre == NULL || bre->bre_phys.brp_refcnt == 0) {
+		mutex_exit(&brt->brt_lock);
+		return (B_TRUE);
+	}
+	bre->bre_phys.brp_refcnt--;
+	brt->brt_saved -= bre->bre_phys.brp_dsize;
+	brt_entry_dirty(brt, bre);
+	mutex_exit(&brt->brt_lock);
+
+	return (B_FALSE);
+}
+
+/*
+ * Record that bp has been cloned in tx's txg.
+ */
+void
+brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
+{
+	brt_t *brt = spa->spa_brt;
+	avl_tree_t *pending = &brt->brt_pending[tx->tx_txg & TXG_MASK];
+	brt_pending_entry_t *bpe, *newbpe;
+	avl_index_t where;
+
+	ASSERT(!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp));
+
+	newbpe = kmem_cache_alloc(brt_pending_entry_cache, KM_SLEEP);
+	newbpe->bpe_bp = *bp;
+	newbpe->bpe_count = 1;
+
+	mutex_enter(&brt->brt_pending_lock);
+	bpe = avl_find(pending, newbpe, &where);
+	if (bpe == NULL) {
+		avl_insert(pending, newbpe, where);
+		newbpe = NULL;
+	} else {
+		bpe->bpe_count++;
+	}
+	mutex_exit(&brt->brt_pending_lock);
+
+	if (newbpe != NULL)
+		kmem_cache_free(brt_pending_entry_cache, newbpe);
+}
+
+/*
+ * Undo a brt_pending_add() whose clone was undirtied before it synced.
+ */
+void
+brt_pending_remove(spa_t *spa, const blkptr_t *bp, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	avl_tree_t *pending = &brt->brt_pending[txg & TXG_MASK];
+	brt_pending_entry_t *bpe, bpe_search;
+
+	bpe_search.bpe_bp = *bp;
+
+	mutex_enter(&brt->brt_pending_lock);
+	bpe = avl_find(pending, &bpe_search, NULL);
+	VERIFY(bpe != NULL);
+	ASSERT3U(bpe->bpe_count, >, 0);
+	if (--bpe->bpe_count == 0)
+		avl_remove(pending, bpe);
+	else
+		bpe = NULL;
+	mutex_exit(&brt->brt_pending_lock);
+
+	if (bpe != NULL)
+		kmem_cache_free(brt_pending_entry_cache, bpe);
+}
+
+/*
+ * Move the clones made in txg into the table.  Called from spa_sync()
+ * before the txg's frees are processed.
+ */
+void
+brt_pending_apply(spa_t *spa, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	avl_tree_t *pending = &brt->brt_pending[txg & TXG_MASK];
+	brt_pending_entry_t *bpe;
+	void *cookie = NULL;
+
+	mutex_enter(&brt->brt_pending_lock);
+	while ((bpe = avl_destroy_nodes(pending, &cookie)) != NULL) {
+		brt_entry_addref(brt, &bpe->bpe_bp, bpe->bpe_count);
+		kmem_cache_free(brt_pending_entry_cache, bpe);
+	}
+	mutex_exit(&brt->brt_pending_lock);
+}
+
+void
+brt_sync(spa_t *spa, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	objset_t *os = brt->brt_os;
+	brt_entry_t *bre;
+	dmu_tx_t *tx;
+	uint64_t key[BRT_KEY_WORDS];
+	int error;
+
+	if (list_is_empty(&brt->brt_dirty))
+		return;
+
+	tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+	mutex_enter(&brt->brt_lock);
+
+	if (brt->brt_object == 0) {
+		brt->brt_object = zap_create_flags(os, 0,
+		    ZAP_FLAG_HASH64 | ZAP_FLAG_UINT64_KEY,
+		    DMU_OTN_ZAP_METADATA, brt_zap_leaf_blockshift,
+		    brt_zap_indirect_blockshift, DMU_OT_NONE, 0, tx);
+		VERIFY0(zap_add(os, DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_BRT,
+		    sizeof (uint64_t), 1, &brt->brt_object, tx));
+		spa_feature_incr(spa, SPA_FEATURE_BLOCK_CLONING, tx);
+	}
+
+	while ((bre = list_remove_head(&brt->brt_dirty)) != NULL) {
+		bre->bre_dirty = B_FALSE;
+		key[0] = bre->bre_vdev;
+		key[1] = bre->bre_offset;
+
+		if (bre->bre_phys.brp_refcnt == 0) {
+			error = zap_remove_uint64(os, brt->brt_object, key,
+			    BRT_KEY_WORDS, tx);
+			VERIFY(error == 0 || error == ENOENT);
+			avl_remove(&brt->brt_tree, bre);
+			kmem_cache_free(brt_entry_cache, bre);
+		} else {
+			VERIFY0(zap_update_uint64(os, brt->brt_object, key,
+			    BRT_KEY_WORDS, sizeof (uint64_t), BRT_VALUE_WORDS,
+			    &bre->bre_phys, tx));
+		}
+	}
+
+	if (avl_numnodes(&brt->brt_tree) == 0) {
+		ASSERT0(brt->brt_saved);
+		VERIFY0(zap_destroy(os, brt->brt_object, tx));
+		VERIFY0(zap_remove(os, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_BRT, tx));
+		spa_feature_decr(spa, SPA_FEATURE_BLOCK_CLONING, tx);
+		brt->brt_object = 0;
+	}
+
+	mutex_exit(&brt->brt_lock);
+	dmu_tx_commit(tx);
+}
+
+void
+brt_create(spa_t *spa)
+{
+	ASSERT(spa->spa_brt == NULL);
+
+	spa->spa_brt = brt_alloc(spa);
+}
+
+int
+brt_load(spa_t *spa)
+{
+	brt_t *brt;
+	brt_entry_t *bre;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	int error;
+
+	brt_create(spa);
+	brt = spa->spa_brt;
+
+	error = zap_lookup(brt->brt_os, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_BRT, sizeof (uint64_t), 1, &brt->brt_object);
+	if (error == ENOENT)
+		return (0);
+	if (error != 0)
+		return (error);
+
+	for (zap_cursor_init(&zc, brt->brt_os, brt->brt_object);
+	    (error = zap_cursor_retrieve(&zc, &za)) == 0;
+	    zap_cursor_advance(&zc)) {
+		uint64_t *key = (uint64_t *)za.za_name;
+
+		bre = brt_entry_alloc(key[0], key[1]);
+
+		error = zap_lookup_uint64(brt->brt_os, brt->brt_object, key,
+		    BRT_KEY_WORDS, sizeof (uint64_t), BRT_VALUE_WORDS,
+		    &bre->bre_phys);
+		if (error != 0) {
+			kmem_cache_free(brt_entry_cache, bre);
+			break;
+		}
+
+		avl_add(&brt->brt_tree, bre);
+		brt->brt_saved +=
+		    bre->bre_phys.brp_refcnt * bre->bre_phys.brp_dsize;
+	}
+	zap_cursor_fini(&zc);
+
+	return (error == ENOENT ? 0 : error);
+}
+
+void
+brt_unload(spa_t *spa)
+{
+	if (spa->spa_brt == NULL)
+		return;
+
+	brt_free(spa->spa_brt);
+	spa->spa_brt = NULL;
+}
+
+/*
+ * Space saved by cloned blocks, added to the pool's dspace the same way
+ * the dedup savings are.
+ */
+uint64_t
+brt_get_dspace(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+
+	if (brt == NULL)
+		return (0);
+
+	return (brt->brt_saved);
+}
+
+void
+brt_init(void)
+{
+	brt_entry_cache = kmem_cache_create("brt_entry_cache",
+	    sizeof (brt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	brt_pending_entry_cache = kmem_cache_create("brt_pending_entry_cache",
+	    sizeof (brt_pending_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+brt_fini(void)
+{
+	kmem_cache_destroy(brt_pending_entry_cache);
+	kmem_cache_destroy(brt_entry_cache);
+}
@@ -44,6 +44,7 @@
 #include <sys/zfeature.h>
 #include <sys/blkptr.h>
 #include <sys/range_tree.h>
+#include <sys/brt.h>
 #include <sys/trace_dbuf.h>
 
 struct dbuf_hold_impl_data {
@@ -810,6 +811,8 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 	    dbuf_read_done, db, ZIO_PRIORITY_SYNC_READ,
 	    (flags & DB_RF_CANFAIL) ? ZIO_FLAG_CANFAIL : ZIO_FLAG_MUSTSUCCEED,
 	    &aflags, &zb);
+	arc_os_read_stat(db->db_objset->os_arc_os,
+	    (aflags & ARC_FLAG_CACHED) != 0);
 
 	return (SET_ERROR(err));
 }
@@ -828,8 +831,20 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 	 */
 	ASSERT(!refcount_is_zero(&db->db_holds));
 
-	if (db->db_state == DB_NOFILL)
-		return (SET_ERROR(EIO));
+	if (db->db_state == DB_NOFILL) {
+		/*
+		 * Once a NOFILL buffer has no dirty records left its block
+		 * pointer is on disk (e.g. a cloned block which has been
+		 * synced), so it can be read back like an uncached buffer.
+		 */
+		mutex_enter(&db->db_mtx);
+		if (db->db_state == DB_NOFILL && db->db_last_dirty == NULL &&
+		    db->db_blkid != DMU_BONUS_BLKID)
+			db->db_state = DB_UNCACHED;
+		mutex_exit(&db->db_mtx);
+		if (db->db_state == DB_NOFILL)
+			return (SET_ERROR(EIO));
+	}
 
 	DB_DNODE_ENTER(db);
 	dn = DB_DNODE(db);
@@ -983,6 +998,22 @@ dbuf_fix_old_data(dmu_buf_impl_t *db, uint64_t txg)
 	}
 }
 
+/*
+ * Forget any precompressed copy of a leaf dirty record's data; it no
+ * longer matches once the buffer is modified or has been written.
+ */
+static void
+dbuf_drop_compressed(dbuf_dirty_record_t *dr)
+{
+	if (dr->dt.dl.dr_cdata == NULL)
+		return;
+
+	zio_data_buf_free(dr->dt.dl.dr_cdata, dr->dt.dl.dr_cdata_size);
+	dr->dt.dl.dr_cdata = NULL;
+	dr->dt.dl.dr_cdata_size = 0;
+	dr->dt.dl.dr_cdata_compress = ZIO_COMPRESS_OFF;
+}
+
 void
 dbuf_unoverride(dbuf_dirty_record_t *dr)
 {
@@ -994,6 +1025,8 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	ASSERT(dr->dt.dl.dr_override_state != DR_IN_DMU_SYNC);
 	ASSERT(db->db_level == 0);
 
+	dbuf_drop_compressed(dr);
+
 	if (db->db_blkid == DMU_BONUS_BLKID ||
 	    dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN)
 		return;
@@ -1001,11 +1034,14 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	ASSERT(db->db_data_pending != dr);
 
 	/* free this block */
-	if (!BP_IS_HOLE(bp) && !dr->dt.dl.dr_nopwrite)
+	if (dr->dt.dl.dr_brtwrite)
+		brt_pending_remove(db->db_objset->os_spa, bp, txg);
+	else if (!BP_IS_HOLE(bp) && !dr->dt.dl.dr_nopwrite)
 		zio_free(db->db_objset->os_spa, txg, bp);
 
 	dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
 	dr->dt.dl.dr_nopwrite = B_FALSE;
+	dr->dt.dl.dr_brtwrite = B_FALSE;
 
 	/*
 	 * Release the already-written buffer, so we leave it in
@@ -1015,7 +1051,8 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	 * the buf thawed to save the effort of freezing &
 	 * immediately re-thawing it.
 	 */
-	arc_release(dr->dt.dl.dr_data, db);
+	if (dr->dt.dl.dr_data != NULL)
+		arc_release(dr->dt.dl.dr_data, db);
 }
 
 /*
@@ -1621,6 +1658,8 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 		ASSERT(dr->dt.dl.dr_data != NULL);
 		if (dr->dt.dl.dr_data != db->db_buf)
 			VERIFY(arc_buf_remove_ref(dr->dt.dl.dr_data, db));
+	} else if (dr->dt.dl.dr_brtwrite) {
+		dbuf_unoverride(dr);
 	}
 
 	kmem_free(dr, sizeof (dbuf_dirty_record_t));
@@ -1633,7 +1672,8 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 
 		ASSERT(db->db_state == DB_NOFILL || arc_released(buf));
 		dbuf_clear_data(db);
-		VERIFY(arc_buf_remove_ref(buf, db));
+		if (buf != NULL)
+			VERIFY(arc_buf_remove_ref(buf, db));
 		dbuf_evict(db);
 		return (B_TRUE);
 	}
@@ -1769,6 +1809,74 @@ dmu_buf_write_embedded(dmu_buf_t *dbuf, void *data,
 	dl->dr_overridden_by.blk_birth = db->db_last_dirty->dr_txg;
 }
 
+/*
+ * Make this block share the data of bp, which must be a level-0 block of
+ * the same size that has already been synced.  The dbuf becomes NOFILL
+ * and is written out with bp as its override, so no data is read or
+ * copied; the BRT keeps track of the extra reference.
+ */
+void
+dmu_buf_write_clone(dmu_buf_t *dbuf, const blkptr_t *bp, dmu_tx_t *tx)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbuf;
+	spa_t *spa = dmu_objset_spa(db->db_objset);
+	dbuf_dirty_record_t *dr;
+	struct dirty_leaf *dl;
+	dmu_object_type_t type;
+	uint64_t txg = tx->tx_txg;
+	boolean_t was_hole;
+
+	ASSERT0(db->db_level);
+	ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+	ASSERT(BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp) ||
+	    BP_GET_LSIZE(bp) == db->db.db_size);
+
+	DB_DNODE_ENTER(db);
+	type = DB_DNODE(db)->dn_type;
+	DB_DNODE_EXIT(db);
+
+	mutex_enter(&db->db_mtx);
+	while (db->db_state == DB_READ || db->db_state == DB_FILL)
+		cv_wait(&db->db_changed, &db->db_mtx);
+	ASSERT3P(db->db_last_dirty, ==, NULL);
+	if (db->db_state == DB_CACHED) {
+		/* The cached contents are replaced wholesale. */
+		arc_release(db->db_buf, db);
+		VERIFY(arc_buf_remove_ref(db->db_buf, db));
+		dbuf_clear_data(db);
+	}
+	db->db_state = DB_NOFILL;
+	was_hole = (db->db_blkptr == NULL || BP_IS_HOLE(db->db_blkptr));
+	mutex_exit(&db->db_mtx);
+
+	dmu_buf_will_fill(dbuf, tx);
+
+	mutex_enter(&db->db_mtx);
+	dr = db->db_last_dirty;
+	ASSERT3U(dr->dr_txg, ==, txg);
+	dl = &dr->dt.dl;
+	dl->dr_overridden_by = *bp;
+	if (BP_IS_HOLE(bp)) {
+		BP_ZERO(&dl->dr_overridden_by);
+		if (!was_hole &&
+		    spa_feature_is_active(spa, SPA_FEATURE_HOLE_BIRTH)) {
+			BP_SET_LSIZE(&dl->dr_overridden_by, db->db.db_size);
+			BP_SET_TYPE(&dl->dr_overridden_by, type);
+			BP_SET_LEVEL(&dl->dr_overridden_by, 0);
+			BP_SET_BIRTH(&dl->dr_overridden_by, txg, 0);
+		}
+	} else if (BP_IS_EMBEDDED(bp)) {
+		dl->dr_overridden_by.blk_birth = txg;
+	} else {
+		BP_SET_BIRTH(&dl->dr_overridden_by, txg,
+		    BP_PHYSICAL_BIRTH(bp));
+		brt_pending_add(spa, bp, tx);
+		dl->dr_brtwrite = B_TRUE;
+	}
+	dl->dr_override_state = DR_OVERRIDDEN;
+	mutex_exit(&db->db_mtx);
+}
+
 /*
  * Directly assign a provided arc buf to a given dbuf if it's not referenced
  * by anybody except our caller. Otherwise copy arcbuf's contents to dbuf.
@@ -1832,6 +1940,32 @@ dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx)
 	dmu_buf_fill_done(&db->db, tx);
 }
 
+/*
+ * Attach a compressed copy of the data just assigned to this dbuf in
+ * 'tx' (see dbuf_assign_arcbuf()).  The dbuf takes ownership of 'cdata',
+ * which must have been allocated with zio_data_buf_alloc(csize).
+ */
+void
+dbuf_assign_compressed(dmu_buf_impl_t *db, enum zio_compress compress,
+    void *cdata, uint64_t csize, dmu_tx_t *tx)
+{
+	dbuf_dirty_record_t *dr;
+
+	ASSERT(db->db_level == 0);
+	ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+	ASSERT3U(csize, <, db->db.db_size);
+
+	mutex_enter(&db->db_mtx);
+	dr = db->db_last_dirty;
+	ASSERT(dr != NULL);
+	ASSERT3U(dr->dr_txg, ==, tx->tx_txg);
+	dbuf_drop_compressed(dr);
+	dr->dt.dl.dr_cdata = cdata;
+	dr->dt.dl.dr_cdata_size = csize;
+	dr->dt.dl.dr_cdata_compress = compress;
+	mutex_exit(&db->db_mtx);
+}
+
 /*
  * "Clear" the contents of this dbuf.  This will mark the dbuf
  * EVICTING and clear *most* of its references.  Unfortunately,
@@ -2023,6 +2157,7 @@ dbuf_create(dnode_t *dn, uint8_t level, uint64_t blkid,
 	db->db_user_immediate_evict = FALSE;
 	db->db_freed_in_flight = FALSE;
 	db->db_pending_evict = FALSE;
+	db->db_uncached = FALSE;
 
 	if (blkid == DMU_BONUS_BLKID) {
 		ASSERT3P(parent, ==, dn->dn_dbuf);
@@ -2695,7 +2830,8 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag)
 			 *
 			 * In the case of the 'primarycache' a buffer
 			 * is considered for eviction if it matches the
-			 * criteria set in the property.
+			 * criteria set in the property.  The same applies
+			 * to a buffer accessed with DMU_UNCACHED.
 			 *
 			 * To decide if our buffer is considered a
 			 * duplicate, we must call into the arc to determine
@@ -2703,7 +2839,7 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag)
 			 * block on-disk. If so, then we simply evict
 			 * ourselves.
 			 */
-			if (!DBUF_IS_CACHEABLE(db)) {
+			if (!DBUF_IS_CACHEABLE(db) || db->db_uncached) {
 				if (db->db_blkptr != NULL &&
 				    !BP_IS_HOLE(db->db_blkptr) &&
 				    !BP_IS_EMBEDDED(db->db_blkptr)) {
@@ -3310,6 +3446,7 @@ dbuf_write_done(zio_t *zio, arc_buf_t *buf, void *vdb)
 	if (db->db_level == 0) {
 		ASSERT(db->db_blkid != DMU_BONUS_BLKID);
 		ASSERT(dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN);
+		dbuf_drop_compressed(dr);
 		if (db->db_state != DB_NOFILL) {
 			if (dr->dt.dl.dr_data != db->db_buf)
 				VERIFY(arc_buf_remove_ref(dr->dt.dl.dr_data,
@@ -3379,7 +3516,8 @@ dbuf_write_override_done(zio_t *zio)
 	if (!BP_EQUAL(zio->io_bp, obp)) {
 		if (!BP_IS_HOLE(obp))
 			dsl_free(spa_get_dsl(zio->io_spa), zio->io_txg, obp);
-		arc_release(dr->dt.dl.dr_data, db);
+		if (dr->dt.dl.dr_data != NULL)
+			arc_release(dr->dt.dl.dr_data, db);
 	}
 	mutex_exit(&db->db_mtx);
 
@@ -3512,6 +3650,11 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx)
 		    children_ready_cb,
 		    dbuf_write_physdone, dbuf_write_done, db,
 		    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_MUSTSUCCEED, &zb);
+		if (db->db_level == 0 && dr->dt.dl.dr_cdata != NULL) {
+			zio_write_compressed(dr->dr_zio, dr->dt.dl.dr_cdata,
+			    dr->dt.dl.dr_cdata_size,
+			    dr->dt.dl.dr_cdata_compress);
+		}
 	}
 }
 
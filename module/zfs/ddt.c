@@ -36,6 +36,7 @@
 #include <sys/zio_checksum.h>
 #include <sys/zio_compress.h>
 #include <sys/dsl_scan.h>
+#include <sys/zfeature.h>
 
 static kmem_cache_t *ddt_cache;
 static kmem_cache_t *ddt_entry_cache;
@@ -45,6 +46,39 @@ static kmem_cache_t *ddt_entry_cache;
  */
 int zfs_dedup_prefetch = 0;
 
+/*
+ * Limits on the DDT log.  Each table's in-core log index may use up to
+ * zfs_dedup_log_mem_max bytes (0 disables logging), and a log is flushed
+ * once it spans zfs_dedup_log_txg_max txgs, which bounds how much of it
+ * has to be replayed when the pool is imported.
+ */
+unsigned long zfs_dedup_log_mem_max = 64 * 1024 * 1024;
+int zfs_dedup_log_txg_max = 100;
+
+/*
+ * Use the tables' bloom filters to skip looking up new blocks.
+ */
+int zfs_dedup_bloom = 1;
+
+typedef struct ddt_bloom_stats {
+	kstat_named_t ddtbloomstat_lookups;
+	kstat_named_t ddtbloomstat_negatives;
+	kstat_named_t ddtbloomstat_positives;
+	kstat_named_t ddtbloomstat_false_positives;
+} ddt_bloom_stats_t;
+
+static ddt_bloom_stats_t ddt_bloom_stats = {
+	{ "lookups",			KSTAT_DATA_UINT64 },
+	{ "negatives",			KSTAT_DATA_UINT64 },
+	{ "positives",			KSTAT_DATA_UINT64 },
+	{ "false_positives",		KSTAT_DATA_UINT64 },
+};
+
+#define	DDTBLOOMSTAT_BUMP(stat) \
+	atomic_inc_64(&ddt_bloom_stats.stat.value.ui64);
+
+static kstat_t *ddt_bloom_ksp;
+
 static const ddt_ops_t *ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
 };
@@ -159,11 +193,13 @@ ddt_object_sync(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
 
 	/*
 	 * Cache DDT statistics; this is the only time they'll change.
+	 * Entries that are still in the log count toward the class
+	 * they are logged in, not the one the object has them in.
 	 */
 	VERIFY(ddt_object_info(ddt, type, class, &doi) == 0);
 	VERIFY(ddt_object_count(ddt, type, class, &count) == 0);
 
-	ddo->ddo_count = count;
+	ddo->ddo_count = count + ddt->ddt_log_delta[type][class];
 	ddo->ddo_dspace = doi.doi_physical_blocks_512 << 9;
 	ddo->ddo_mspace = doi.doi_fill_count * doi.doi_data_block_size;
 }
@@ -201,13 +237,23 @@ ddt_object_update(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
 }
 
 static int
-ddt_object_remove(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
-    ddt_entry_t *dde, dmu_tx_t *tx)
+ddt_object_update_batch(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
+    ddt_entry_t **ddes, int n, dmu_tx_t *tx)
 {
 	ASSERT(ddt_object_exists(ddt, type, class));
 
-	return (ddt_ops[type]->ddt_op_remove(ddt->ddt_os,
-	    ddt->ddt_object[type][class], dde, tx));
+	return (ddt_ops[type]->ddt_op_update_batch(ddt->ddt_os,
+	    ddt->ddt_object[type][class], ddes, n, tx));
+}
+
+static int
+ddt_object_remove_batch(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
+    ddt_entry_t **ddes, int n, dmu_tx_t *tx)
+{
+	ASSERT(ddt_object_exists(ddt, type, class));
+
+	return (ddt_ops[type]->ddt_op_remove_batch(ddt->ddt_os,
+	    ddt->ddt_object[type][class], ddes, n, tx));
 }
 
 int
@@ -429,7 +475,9 @@ ddt_stat_update(ddt_t *ddt, ddt_entry_t *dde, uint64_t neg)
 
 	ddh = &ddt->ddt_histogram[dde->dde_type][dde->dde_class];
 
+	mutex_enter(&ddt->ddt_lock);
 	ddt_stat_add(&ddh->ddh_stat[bucket], &dds, neg);
+	mutex_exit(&ddt->ddt_lock);
 }
 
 void
@@ -653,16 +701,331 @@ ddt_select(spa_t *spa, const blkptr_t *bp)
 	return (spa->spa_ddt[BP_GET_CHECKSUM(bp)]);
 }
 
+static ddt_shard_t *
+ddt_shard_select(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	return (&ddt->ddt_shard[ddk->ddk_cksum.zc_word[0] % DDT_SHARDS]);
+}
+
 void
-ddt_enter(ddt_t *ddt)
+ddt_enter(ddt_t *ddt, const ddt_key_t *ddk)
 {
-	mutex_enter(&ddt->ddt_lock);
+	mutex_enter(&ddt_shard_select(ddt, ddk)->dds_lock);
 }
 
 void
-ddt_exit(ddt_t *ddt)
+ddt_exit(ddt_t *ddt, const ddt_key_t *ddk)
 {
-	mutex_exit(&ddt->ddt_lock);
+	mutex_exit(&ddt_shard_select(ddt, ddk)->dds_lock);
+}
+
+static void
+ddt_bloom_name(ddt_t *ddt, char *name)
+{
+	(void) sprintf(name, DMU_POOL_DDT_BLOOM,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name);
+}
+
+static uint64_t
+ddt_bloom_hash(const ddt_key_t *ddk)
+{
+	const uint64_t *w = (const uint64_t *)ddk;
+	uint64_t h = 0;
+	int i;
+
+	for (i = 0; i < DDT_KEY_WORDS; i++) {
+		h ^= w[i];
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+	}
+
+	return (h);
+}
+
+/*
+ * Test (or, if set, set) a key's bits in a stage.  The low bits of the
+ * hash pick the block and the high bits the bits within it.  Returns
+ * whether all of them were already set.
+ */
+static boolean_t
+ddt_bloom_stage_test(ddt_t *ddt, int s, uint64_t h, boolean_t set)
+{
+	ddt_bloom_stage_phys_t *dbsp = &ddt->ddt_bloom_phys.dbp_stage[s];
+	ddt_bloom_stage_t *dbs = &ddt->ddt_bloom_stage[s];
+	uint64_t off = (h % (dbsp->dbsp_size / DDT_BLOOM_BLOCK)) *
+	    DDT_BLOOM_BLOCK;
+	uint8_t *blk = dbs->dbs_bits + off;
+	uint32_t a = h >> 32;
+	uint32_t b = (h >> 23) | 1;
+	boolean_t found = B_TRUE;
+	int i;
+
+	for (i = 0; i < DDT_BLOOM_HASHES; i++) {
+		uint32_t bit = (a + i * b) % (DDT_BLOOM_BLOCK * NBBY);
+		uint8_t mask = 1 << (bit % NBBY);
+
+		if (blk[bit / NBBY] & mask)
+			continue;
+		found = B_FALSE;
+		if (!set)
+			break;
+		blk[bit / NBBY] |= mask;
+	}
+
+	if (set && !found) {
+		uint64_t c = off / DDT_BLOOM_IOSIZE;
+		dbs->dbs_dirty[c / 64] |= 1ULL << (c % 64);
+	}
+
+	return (found);
+}
+
+static void
+ddt_bloom_stage_add(ddt_t *ddt)
+{
+	ddt_bloom_phys_t *dbp = &ddt->ddt_bloom_phys;
+	ddt_bloom_stage_phys_t *dbsp;
+	ddt_bloom_stage_t *dbs;
+	int s = dbp->dbp_nstages;
+	uint64_t size = DDT_BLOOM_KEYS * DDT_BLOOM_BITS_PER_KEY / NBBY;
+
+	ASSERT(RW_WRITE_HELD(&ddt->ddt_bloom_lock));
+	ASSERT3S(s, <, DDT_BLOOM_STAGES);
+
+	dbsp = &dbp->dbp_stage[s];
+	dbsp->dbsp_offset = 0;
+	if (s != 0) {
+		ddt_bloom_stage_phys_t *prev = &dbp->dbp_stage[s - 1];
+		dbsp->dbsp_offset = prev->dbsp_offset + prev->dbsp_size;
+		size = prev->dbsp_size * DDT_BLOOM_GROWTH;
+	}
+	dbsp->dbsp_size = size;
+	dbsp->dbsp_count = 0;
+
+	dbs = &ddt->ddt_bloom_stage[s];
+	dbs->dbs_bits = vmem_zalloc(size, KM_SLEEP);
+	dbs->dbs_dirty = kmem_zalloc(howmany(size / DDT_BLOOM_IOSIZE, 64) *
+	    sizeof (uint64_t), KM_SLEEP);
+
+	dbp->dbp_nstages++;
+	ddt->ddt_bloom_dirty = B_TRUE;
+}
+
+static void
+ddt_bloom_free(ddt_t *ddt)
+{
+	ddt_bloom_phys_t *dbp = &ddt->ddt_bloom_phys;
+	int s;
+
+	for (s = 0; s < dbp->dbp_nstages; s++) {
+		ddt_bloom_stage_t *dbs = &ddt->ddt_bloom_stage[s];
+		uint64_t size = dbp->dbp_stage[s].dbsp_size;
+
+		vmem_free(dbs->dbs_bits, size);
+		kmem_free(dbs->dbs_dirty, howmany(size / DDT_BLOOM_IOSIZE,
+		    64) * sizeof (uint64_t));
+	}
+	bzero(dbp, sizeof (*dbp));
+	bzero(ddt->ddt_bloom_stage, sizeof (ddt->ddt_bloom_stage));
+	ddt->ddt_bloom_object = 0;
+	ddt->ddt_bloom_dirty = B_FALSE;
+}
+
+/*
+ * Returns B_FALSE if the table's objects can't have the key.  checked is
+ * set if the filter was consulted.
+ */
+static boolean_t
+ddt_bloom_contains(ddt_t *ddt, const ddt_key_t *ddk, boolean_t *checked)
+{
+	boolean_t found = B_FALSE;
+	uint64_t h;
+	int s;
+
+	*checked = B_FALSE;
+	if (!zfs_dedup_bloom)
+		return (B_TRUE);
+
+	rw_enter(&ddt->ddt_bloom_lock, RW_READER);
+	if (ddt->ddt_bloom_object != 0) {
+		*checked = B_TRUE;
+		h = ddt_bloom_hash(ddk);
+		for (s = ddt->ddt_bloom_phys.dbp_nstages - 1; s >= 0; s--) {
+			if ((found = ddt_bloom_stage_test(ddt, s, h, B_FALSE)))
+				break;
+		}
+	}
+	rw_exit(&ddt->ddt_bloom_lock);
+
+	if (!*checked)
+		return (B_TRUE);
+
+	DDTBLOOMSTAT_BUMP(ddtbloomstat_lookups);
+	if (!found)
+		DDTBLOOMSTAT_BUMP(ddtbloomstat_negatives);
+
+	return (found);
+}
+
+static void
+ddt_bloom_add(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	ddt_bloom_phys_t *dbp = &ddt->ddt_bloom_phys;
+	ddt_bloom_stage_phys_t *dbsp;
+	int s;
+
+	if (ddt->ddt_bloom_object == 0)
+		return;
+
+	rw_enter(&ddt->ddt_bloom_lock, RW_WRITER);
+	s = dbp->dbp_nstages - 1;
+	dbsp = &dbp->dbp_stage[s];
+	(void) ddt_bloom_stage_test(ddt, s, ddt_bloom_hash(ddk), B_TRUE);
+	dbsp->dbsp_count++;
+	ddt->ddt_bloom_dirty = B_TRUE;
+	if (s + 1 < DDT_BLOOM_STAGES && dbsp->dbsp_count >=
+	    dbsp->dbsp_size * NBBY / DDT_BLOOM_BITS_PER_KEY)
+		ddt_bloom_stage_add(ddt);
+	rw_exit(&ddt->ddt_bloom_lock);
+}
+
+/*
+ * A table's filter is only created while the table is empty, since the
+ * keys already in its objects would be missing from it.
+ */
+static void
+ddt_bloom_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	objset_t *os = ddt->ddt_os;
+	char name[DDT_NAMELEN];
+	uint64_t object;
+
+	ddt_bloom_name(ddt, name);
+	object = dmu_object_alloc(os, DMU_OTN_UINT8_METADATA,
+	    DDT_BLOOM_IOSIZE, DMU_OTN_UINT64_METADATA,
+	    sizeof (ddt_bloom_phys_t), tx);
+	VERIFY0(zap_add(os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &object, tx));
+	spa_feature_incr(ddt->ddt_spa, SPA_FEATURE_DEDUP_BLOOM, tx);
+
+	rw_enter(&ddt->ddt_bloom_lock, RW_WRITER);
+	ddt->ddt_bloom_object = object;
+	ddt_bloom_stage_add(ddt);
+	rw_exit(&ddt->ddt_bloom_lock);
+}
+
+static void
+ddt_bloom_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	objset_t *os = ddt->ddt_os;
+	char name[DDT_NAMELEN];
+
+	ddt_bloom_name(ddt, name);
+	VERIFY0(zap_remove(os, DMU_POOL_DIRECTORY_OBJECT, name, tx));
+	VERIFY0(dmu_object_free(os, ddt->ddt_bloom_object, tx));
+	spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_DEDUP_BLOOM, tx);
+
+	rw_enter(&ddt->ddt_bloom_lock, RW_WRITER);
+	ddt_bloom_free(ddt);
+	rw_exit(&ddt->ddt_bloom_lock);
+}
+
+/*
+ * Write out the chunks of the filter that changed in this txg.  Only
+ * syncing context changes the filter, so it is stable here.
+ */
+static void
+ddt_bloom_write(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_bloom_phys_t *dbp = &ddt->ddt_bloom_phys;
+	objset_t *os = ddt->ddt_os;
+	dmu_buf_t *db;
+	int s;
+
+	if (ddt->ddt_bloom_object == 0 || !ddt->ddt_bloom_dirty)
+		return;
+
+	for (s = 0; s < dbp->dbp_nstages; s++) {
+		ddt_bloom_stage_phys_t *dbsp = &dbp->dbp_stage[s];
+		ddt_bloom_stage_t *dbs = &ddt->ddt_bloom_stage[s];
+		uint64_t c, nchunks = dbsp->dbsp_size / DDT_BLOOM_IOSIZE;
+
+		for (c = 0; c < nchunks; c++) {
+			uint64_t *dirty = &dbs->dbs_dirty[c / 64];
+
+			if (*dirty == 0) {
+				c += 63 - c % 64;
+				continue;
+			}
+			if (!(*dirty & (1ULL << (c % 64))))
+				continue;
+			dmu_write(os, ddt->ddt_bloom_object,
+			    dbsp->dbsp_offset + c * DDT_BLOOM_IOSIZE,
+			    DDT_BLOOM_IOSIZE, dbs->dbs_bits +
+			    c * DDT_BLOOM_IOSIZE, tx);
+			*dirty &= ~(1ULL << (c % 64));
+		}
+	}
+
+	VERIFY0(dmu_bonus_hold(os, ddt->ddt_bloom_object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	bcopy(dbp, db->db_data, sizeof (*dbp));
+	dmu_buf_rele(db, FTAG);
+
+	ddt->ddt_bloom_dirty = B_FALSE;
+}
+
+static int
+ddt_bloom_load(ddt_t *ddt)
+{
+	ddt_bloom_phys_t *dbp = &ddt->ddt_bloom_phys;
+	objset_t *os = ddt->ddt_os;
+	ddt_bloom_phys_t phys;
+	char name[DDT_NAMELEN];
+	dmu_buf_t *db;
+	uint64_t object;
+	int error, s;
+
+	ddt_bloom_name(ddt, name);
+
+	error = zap_lookup(os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &object);
+	if (error != 0)
+		return (error);
+
+	error = dmu_bonus_hold(os, object, FTAG, &db);
+	if (error != 0)
+		return (error);
+	bcopy(db->db_data, &phys, sizeof (phys));
+	dmu_buf_rele(db, FTAG);
+
+	if (phys.dbp_nstages == 0 || phys.dbp_nstages > DDT_BLOOM_STAGES)
+		return (SET_ERROR(EINVAL));
+
+	rw_enter(&ddt->ddt_bloom_lock, RW_WRITER);
+	ddt->ddt_bloom_object = object;
+	for (s = 0; s < phys.dbp_nstages; s++) {
+		ddt_bloom_stage_add(ddt);
+		ASSERT3U(dbp->dbp_stage[s].dbsp_offset, ==,
+		    phys.dbp_stage[s].dbsp_offset);
+		ASSERT3U(dbp->dbp_stage[s].dbsp_size, ==,
+		    phys.dbp_stage[s].dbsp_size);
+		dbp->dbp_stage[s].dbsp_count = phys.dbp_stage[s].dbsp_count;
+		error = dmu_read(os, object, dbp->dbp_stage[s].dbsp_offset,
+		    dbp->dbp_stage[s].dbsp_size,
+		    ddt->ddt_bloom_stage[s].dbs_bits, DMU_READ_PREFETCH);
+		if (error != 0) {
+			ddt_bloom_free(ddt);
+			break;
+		}
+	}
+	ddt->ddt_bloom_dirty = B_FALSE;
+	rw_exit(&ddt->ddt_bloom_lock);
+
+	return (error);
 }
 
 void
@@ -672,11 +1035,24 @@ ddt_init(void)
 	    sizeof (ddt_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 	ddt_entry_cache = kmem_cache_create("ddt_entry_cache",
 	    sizeof (ddt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
+	ddt_bloom_ksp = kstat_create("zfs", 0, "ddt_bloom", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (ddt_bloom_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (ddt_bloom_ksp != NULL) {
+		ddt_bloom_ksp->ks_data = &ddt_bloom_stats;
+		kstat_install(ddt_bloom_ksp);
+	}
 }
 
 void
 ddt_fini(void)
 {
+	if (ddt_bloom_ksp != NULL) {
+		kstat_delete(ddt_bloom_ksp);
+		ddt_bloom_ksp = NULL;
+	}
+
 	kmem_cache_destroy(ddt_entry_cache);
 	kmem_cache_destroy(ddt_cache);
 }
@@ -716,42 +1092,84 @@ ddt_free(ddt_entry_t *dde)
 void
 ddt_remove(ddt_t *ddt, ddt_entry_t *dde)
 {
-	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+	ddt_shard_t *dds = ddt_shard_select(ddt, &dde->dde_key);
+
+	ASSERT(MUTEX_HELD(&dds->dds_lock));
 
-	avl_remove(&ddt->ddt_tree, dde);
+	avl_remove(&dds->dds_tree, dde);
 	ddt_free(dde);
 }
 
+/*
+ * Find (or, if add is set, create) the in-core entry for a block, loading
+ * it from the log or the DDT objects the first time.  The caller holds the
+ * block's shard lock (ddt_enter()), which is dropped while the objects are
+ * read; other lookups of the same entry wait for the load on dde_cv.
+ */
 ddt_entry_t *
 ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 {
-	ddt_entry_t *dde, dde_search;
+	ddt_entry_t *dde, *lde, dde_search;
+	ddt_shard_t *dds;
 	enum ddt_type type;
 	enum ddt_class class;
 	avl_index_t where;
+	boolean_t bloom;
 	int error;
 
-	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
-
 	ddt_key_fill(&dde_search.dde_key, bp);
+	dds = ddt_shard_select(ddt, &dde_search.dde_key);
 
-	dde = avl_find(&ddt->ddt_tree, &dde_search, &where);
+	ASSERT(MUTEX_HELD(&dds->dds_lock));
+
+	dde = avl_find(&dds->dds_tree, &dde_search, &where);
 	if (dde == NULL) {
 		if (!add)
 			return (NULL);
 		dde = ddt_alloc(&dde_search.dde_key);
-		avl_insert(&ddt->ddt_tree, dde, where);
+		avl_insert(&dds->dds_tree, dde, where);
 	}
 
 	while (dde->dde_loading)
-		cv_wait(&dde->dde_cv, &ddt->ddt_lock);
+		cv_wait(&dde->dde_cv, &dds->dds_lock);
 
 	if (dde->dde_loaded)
 		return (dde);
 
+	/*
+	 * Entries that have changed since the log was last flushed are
+	 * current in the log, and the objects may not have them at all.
+	 */
+	rw_enter(&ddt->ddt_log_lock, RW_READER);
+	lde = avl_find(&ddt->ddt_log_tree, dde, NULL);
+	if (lde != NULL) {
+		bcopy(lde->dde_phys, dde->dde_phys, sizeof (dde->dde_phys));
+		dde->dde_type = lde->dde_type;
+		dde->dde_class = lde->dde_class;
+		dde->dde_loaded = B_TRUE;
+	}
+	rw_exit(&ddt->ddt_log_lock);
+
+	if (lde != NULL) {
+		if (dde->dde_type != DDT_TYPES)
+			ddt_stat_update(ddt, dde, -1ULL);
+		return (dde);
+	}
+
+	/*
+	 * A block that isn't in the bloom filter is new, which spares us
+	 * reading the objects to find that out.
+	 */
+	if (!ddt_bloom_contains(ddt, &dde->dde_key, &bloom)) {
+		dde->dde_type = DDT_TYPES;
+		dde->dde_class = DDT_CLASSES;
+		dde->dde_loaded = B_TRUE;
+		return (dde);
+	}
+
 	dde->dde_loading = B_TRUE;
 
-	ddt_exit(ddt);
+	mutex_exit(&dds->dds_lock);
 
 	error = ENOENT;
 
@@ -767,7 +1185,12 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 
 	ASSERT(error == 0 || error == ENOENT);
 
-	ddt_enter(ddt);
+	if (bloom && error == 0)
+		DDTBLOOMSTAT_BUMP(ddtbloomstat_positives);
+	if (bloom && error == ENOENT)
+		DDTBLOOMSTAT_BUMP(ddtbloomstat_false_positives);
+
+	mutex_enter(&dds->dds_lock);
 
 	ASSERT(dde->dde_loaded == B_FALSE);
 	ASSERT(dde->dde_loading == B_TRUE);
@@ -830,19 +1253,217 @@ ddt_entry_compare(const void *x1, const void *x2)
 	return (0);
 }
 
+static void
+ddt_log_name(ddt_t *ddt, char *name)
+{
+	(void) sprintf(name, DMU_POOL_DDT_LOG,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name);
+}
+
+/*
+ * Each logged entry counts toward the class it is logged in, and against
+ * the object that still has it, until the log is flushed.
+ */
+static void
+ddt_log_adjust(ddt_t *ddt, const ddt_entry_t *lde, int64_t delta)
+{
+	if (lde->dde_type != DDT_TYPES)
+		ddt->ddt_log_delta[lde->dde_type][lde->dde_class] += delta;
+	if (lde->dde_obj_type != DDT_TYPES)
+		ddt->ddt_log_delta[lde->dde_obj_type][lde->dde_obj_class] -=
+		    delta;
+}
+
+/*
+ * Set the logged contents and location of an entry.  otype/oclass is
+ * where the objects have the entry; it only matters the first time the
+ * entry is logged, since the objects don't change until the log is flushed.
+ */
+static ddt_entry_t *
+ddt_log_apply(ddt_t *ddt, const ddt_key_t *ddk, const ddt_phys_t *ddp,
+    enum ddt_type type, enum ddt_class class,
+    enum ddt_type otype, enum ddt_class oclass)
+{
+	ddt_entry_t *lde, lde_search;
+	avl_index_t where;
+
+	ASSERT(RW_WRITE_HELD(&ddt->ddt_log_lock));
+	ASSERT3U(type, <=, DDT_TYPES);
+	ASSERT3U(class, <=, DDT_CLASSES);
+
+	lde_search.dde_key = *ddk;
+	lde = avl_find(&ddt->ddt_log_tree, &lde_search, &where);
+	if (lde == NULL) {
+		lde = ddt_alloc(ddk);
+		lde->dde_type = lde->dde_obj_type = otype;
+		lde->dde_class = lde->dde_obj_class = oclass;
+		lde->dde_loaded = B_TRUE;
+		avl_insert(&ddt->ddt_log_tree, lde, where);
+		ddt->ddt_log_gen++;
+	}
+
+	ddt_log_adjust(ddt, lde, -1);
+	bcopy(ddp, lde->dde_phys, sizeof (lde->dde_phys));
+	lde->dde_type = type;
+	lde->dde_class = class;
+	ddt_log_adjust(ddt, lde, 1);
+
+	return (lde);
+}
+
+/*
+ * Rebuild the in-core log by replaying the on-disk one.
+ */
+static int
+ddt_log_load(ddt_t *ddt)
+{
+	objset_t *os = ddt->ddt_os;
+	uint64_t chunk = SPA_OLD_MAXBLOCKSIZE / sizeof (ddt_log_record_t);
+	ddt_log_record_t *dlr;
+	ddt_log_phys_t *dlp;
+	dmu_buf_t *db;
+	enum ddt_type type;
+	enum ddt_class class;
+	char name[DDT_NAMELEN];
+	uint64_t i, j, n;
+	int error;
+
+	ddt_log_name(ddt, name);
+
+	error = zap_lookup(os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &ddt->ddt_log_object);
+	if (error != 0)
+		return (error);
+
+	error = dmu_bonus_hold(os, ddt->ddt_log_object, FTAG, &db);
+	if (error != 0)
+		return (error);
+	dlp = db->db_data;
+	ddt->ddt_log_count = dlp->dlp_count;
+	ddt->ddt_log_first_txg = dlp->dlp_first_txg;
+	dmu_buf_rele(db, FTAG);
+
+	dlr = vmem_alloc(chunk * sizeof (ddt_log_record_t), KM_SLEEP);
+
+	for (i = 0; i < ddt->ddt_log_count; i += n) {
+		n = MIN(chunk, ddt->ddt_log_count - i);
+		error = dmu_read(os, ddt->ddt_log_object,
+		    i * sizeof (ddt_log_record_t),
+		    n * sizeof (ddt_log_record_t), dlr, DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		rw_enter(&ddt->ddt_log_lock, RW_WRITER);
+		for (j = 0; j < n; j++) {
+			(void) ddt_log_apply(ddt, &dlr[j].dlr_key,
+			    dlr[j].dlr_phys,
+			    DLR_GET_TYPE(&dlr[j]), DLR_GET_CLASS(&dlr[j]),
+			    DLR_GET_OBJ_TYPE(&dlr[j]),
+			    DLR_GET_OBJ_CLASS(&dlr[j]));
+		}
+		rw_exit(&ddt->ddt_log_lock);
+	}
+
+	vmem_free(dlr, chunk * sizeof (ddt_log_record_t));
+
+	if (error != 0)
+		return (error);
+
+	for (type = 0; type < DDT_TYPES; type++) {
+		for (class = 0; class < DDT_CLASSES; class++) {
+			ddt->ddt_object_stats[type][class].ddo_count +=
+			    ddt->ddt_log_delta[type][class];
+		}
+	}
+
+	return (0);
+}
+
+static boolean_t
+ddt_log_contains(ddt_t *ddt, const ddt_entry_t *dde)
+{
+	boolean_t found;
+
+	rw_enter(&ddt->ddt_log_lock, RW_READER);
+	found = (avl_find(&ddt->ddt_log_tree, dde, NULL) != NULL);
+	rw_exit(&ddt->ddt_log_lock);
+
+	return (found);
+}
+
+/*
+ * Return the next logged entry in the given class.  The walk cursor is
+ * the entry's position in the log; the entry after the last one returned
+ * is cached so that a walk over an unchanging log doesn't go quadratic.
+ */
+static int
+ddt_log_walk(ddt_t *ddt, enum ddt_class class, uint64_t *walk,
+    ddt_entry_t *dde)
+{
+	avl_tree_t *t = &ddt->ddt_log_tree;
+	ddt_entry_t *lde;
+	uint64_t pos;
+
+	rw_enter(&ddt->ddt_log_lock, RW_WRITER);
+
+	if (*walk != 0 && *walk == ddt->ddt_log_walk_pos &&
+	    ddt->ddt_log_walk_gen == ddt->ddt_log_gen) {
+		lde = ddt->ddt_log_walk_next;
+		pos = *walk;
+	} else {
+		for (lde = avl_first(t), pos = 0; lde != NULL && pos < *walk;
+		    lde = AVL_NEXT(t, lde), pos++)
+			continue;
+	}
+
+	while (lde != NULL &&
+	    (lde->dde_type == DDT_TYPES || lde->dde_class != class)) {
+		lde = AVL_NEXT(t, lde);
+		pos++;
+	}
+
+	if (lde == NULL) {
+		rw_exit(&ddt->ddt_log_lock);
+		return (SET_ERROR(ENOENT));
+	}
+
+	dde->dde_key = lde->dde_key;
+	bcopy(lde->dde_phys, dde->dde_phys, sizeof (dde->dde_phys));
+	dde->dde_type = lde->dde_type;
+	dde->dde_class = lde->dde_class;
+
+	*walk = ++pos;
+	ddt->ddt_log_walk_next = AVL_NEXT(t, lde);
+	ddt->ddt_log_walk_pos = pos;
+	ddt->ddt_log_walk_gen = ddt->ddt_log_gen;
+
+	rw_exit(&ddt->ddt_log_lock);
+
+	return (0);
+}
+
 static ddt_t *
 ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 {
 	ddt_t *ddt;
+	int i;
 
 	ddt = kmem_cache_alloc(ddt_cache, KM_SLEEP);
 	bzero(ddt, sizeof (ddt_t));
 
+	for (i = 0; i < DDT_SHARDS; i++) {
+		ddt_shard_t *dds = &ddt->ddt_shard[i];
+		mutex_init(&dds->dds_lock, NULL, MUTEX_DEFAULT, NULL);
+		avl_create(&dds->dds_tree, ddt_entry_compare,
+		    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	}
 	mutex_init(&ddt->ddt_lock, NULL, MUTEX_DEFAULT, NULL);
-	avl_create(&ddt->ddt_tree, ddt_entry_compare,
-	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	rw_init(&ddt->ddt_log_lock, NULL, RW_DEFAULT, NULL);
+	rw_init(&ddt->ddt_bloom_lock, NULL, RW_DEFAULT, NULL);
 	avl_create(&ddt->ddt_repair_tree, ddt_entry_compare,
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	avl_create(&ddt->ddt_log_tree, ddt_entry_compare,
+	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
 	ddt->ddt_checksum = c;
 	ddt->ddt_spa = spa;
 	ddt->ddt_os = spa->spa_meta_objset;
@@ -853,10 +1474,24 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 static void
 ddt_table_free(ddt_t *ddt)
 {
-	ASSERT(avl_numnodes(&ddt->ddt_tree) == 0);
+	ddt_entry_t *lde;
+	void *cookie = NULL;
+	int i;
+
 	ASSERT(avl_numnodes(&ddt->ddt_repair_tree) == 0);
-	avl_destroy(&ddt->ddt_tree);
+	while ((lde = avl_destroy_nodes(&ddt->ddt_log_tree, &cookie)) != NULL)
+		ddt_free(lde);
+	ddt_bloom_free(ddt);
+	for (i = 0; i < DDT_SHARDS; i++) {
+		ddt_shard_t *dds = &ddt->ddt_shard[i];
+		ASSERT(avl_numnodes(&dds->dds_tree) == 0);
+		avl_destroy(&dds->dds_tree);
+		mutex_destroy(&dds->dds_lock);
+	}
 	avl_destroy(&ddt->ddt_repair_tree);
+	avl_destroy(&ddt->ddt_log_tree);
+	rw_destroy(&ddt->ddt_log_lock);
+	rw_destroy(&ddt->ddt_bloom_lock);
 	mutex_destroy(&ddt->ddt_lock);
 	kmem_cache_free(ddt_cache, ddt);
 }
@@ -900,6 +1535,14 @@ ddt_load(spa_t *spa)
 			}
 		}
 
+		error = ddt_log_load(ddt);
+		if (error != 0 && error != ENOENT)
+			return (error);
+
+		error = ddt_bloom_load(ddt);
+		if (error != 0 && error != ENOENT)
+			return (error);
+
 		/*
 		 * Seed the cached histograms.
 		 */
@@ -927,7 +1570,7 @@ boolean_t
 ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 {
 	ddt_t *ddt;
-	ddt_entry_t *dde;
+	ddt_entry_t *dde, *lde;
 	enum ddt_type type;
 	enum ddt_class class;
 
@@ -942,6 +1585,17 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 
 	ddt_key_fill(&(dde->dde_key), bp);
 
+	rw_enter(&ddt->ddt_log_lock, RW_READER);
+	lde = avl_find(&ddt->ddt_log_tree, dde, NULL);
+	if (lde != NULL) {
+		boolean_t found = (lde->dde_type != DDT_TYPES &&
+		    lde->dde_class <= max_class);
+		rw_exit(&ddt->ddt_log_lock);
+		kmem_cache_free(ddt_entry_cache, dde);
+		return (found);
+	}
+	rw_exit(&ddt->ddt_log_lock);
+
 	for (type = 0; type < DDT_TYPES; type++) {
 		for (class = 0; class <= max_class; class++) {
 			if (ddt_object_lookup(ddt, type, class, dde) == 0) {
@@ -959,7 +1613,7 @@ ddt_entry_t *
 ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 {
 	ddt_key_t ddk;
-	ddt_entry_t *dde;
+	ddt_entry_t *dde, *lde;
 	enum ddt_type type;
 	enum ddt_class class;
 
@@ -967,6 +1621,19 @@ ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 
 	dde = ddt_alloc(&ddk);
 
+	rw_enter(&ddt->ddt_log_lock, RW_READER);
+	lde = avl_find(&ddt->ddt_log_tree, dde, NULL);
+	if (lde != NULL) {
+		if (lde->dde_type != DDT_TYPES &&
+		    lde->dde_class != DDT_CLASS_UNIQUE) {
+			bcopy(lde->dde_phys, dde->dde_phys,
+			    sizeof (dde->dde_phys));
+		}
+		rw_exit(&ddt->ddt_log_lock);
+		return (dde);
+	}
+	rw_exit(&ddt->ddt_log_lock);
+
 	for (type = 0; type < DDT_TYPES; type++) {
 		for (class = 0; class < DDT_CLASSES; class++) {
 			/*
@@ -990,7 +1657,7 @@ ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde)
 {
 	avl_index_t where;
 
-	ddt_enter(ddt);
+	mutex_enter(&ddt->ddt_lock);
 
 	if (dde->dde_repair_data != NULL && spa_writeable(ddt->ddt_spa) &&
 	    avl_find(&ddt->ddt_repair_tree, dde, &where) == NULL)
@@ -998,7 +1665,7 @@ ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde)
 	else
 		ddt_free(dde);
 
-	ddt_exit(ddt);
+	mutex_exit(&ddt->ddt_lock);
 }
 
 static void
@@ -1048,22 +1715,283 @@ ddt_repair_table(ddt_t *ddt, zio_t *rio)
 	if (spa_sync_pass(spa) > 1)
 		return;
 
-	ddt_enter(ddt);
+	mutex_enter(&ddt->ddt_lock);
 	for (rdde = avl_first(t); rdde != NULL; rdde = rdde_next) {
 		rdde_next = AVL_NEXT(t, rdde);
 		avl_remove(&ddt->ddt_repair_tree, rdde);
-		ddt_exit(ddt);
+		mutex_exit(&ddt->ddt_lock);
 		ddt_bp_create(ddt->ddt_checksum, &rdde->dde_key, NULL, &blk);
 		dde = ddt_repair_start(ddt, &blk);
 		ddt_repair_entry(ddt, dde, rdde, rio);
 		ddt_repair_done(ddt, dde);
-		ddt_enter(ddt);
+		mutex_enter(&ddt->ddt_lock);
+	}
+	mutex_exit(&ddt->ddt_lock);
+}
+
+/*
+ * The entries to remove from and write to each DDT object in this txg.
+ * ddt_sync_entry() only decides where each entry goes; the objects are
+ * then updated by ddt_sync_flush() with one batch per object, so each
+ * zap leaf is dirtied once however many of its entries changed.  When
+ * the table is logging, the entries are instead collected in dsb_log and
+ * appended to the log by ddt_log_write().
+ */
+typedef struct ddt_sync_batch {
+	int		dsb_size;
+	ddt_entry_t	**dsb_remove[DDT_TYPES][DDT_CLASSES];
+	int		dsb_nremove[DDT_TYPES][DDT_CLASSES];
+	ddt_entry_t	**dsb_update[DDT_TYPES][DDT_CLASSES];
+	int		dsb_nupdate[DDT_TYPES][DDT_CLASSES];
+	ddt_log_record_t *dsb_log;
+	int		dsb_nlog;
+} ddt_sync_batch_t;
+
+static void
+ddt_sync_batch_add(ddt_sync_batch_t *dsb, ddt_entry_t ***ddesp, int *np,
+    ddt_entry_t *dde)
+{
+	if (*ddesp == NULL) {
+		*ddesp = vmem_alloc(dsb->dsb_size * sizeof (ddt_entry_t *),
+		    KM_SLEEP);
+	}
+	ASSERT3S(*np, <, dsb->dsb_size);
+	(*ddesp)[(*np)++] = dde;
+}
+
+static void
+ddt_sync_flush(ddt_t *ddt, ddt_sync_batch_t *dsb, dmu_tx_t *tx)
+{
+	enum ddt_type type;
+	enum ddt_class class;
+	int i;
+
+	for (type = 0; type < DDT_TYPES; type++) {
+		for (class = 0; class < DDT_CLASSES; class++) {
+			ddt_entry_t **ddes = dsb->dsb_remove[type][class];
+			int n = dsb->dsb_nremove[type][class];
+
+			if (ddes == NULL)
+				continue;
+			VERIFY0(ddt_object_remove_batch(ddt, type, class,
+			    ddes, n, tx));
+			for (i = 0; i < n; i++) {
+				ASSERT(ddt_object_lookup(ddt, type, class,
+				    ddes[i]) == ENOENT);
+			}
+			vmem_free(ddes, dsb->dsb_size * sizeof (ddt_entry_t *));
+		}
+	}
+
+	for (type = 0; type < DDT_TYPES; type++) {
+		for (class = 0; class < DDT_CLASSES; class++) {
+			ddt_entry_t **ddes = dsb->dsb_update[type][class];
+			int n = dsb->dsb_nupdate[type][class];
+
+			if (ddes == NULL)
+				continue;
+			VERIFY0(ddt_object_update_batch(ddt, type, class,
+			    ddes, n, tx));
+			vmem_free(ddes, dsb->dsb_size * sizeof (ddt_entry_t *));
+		}
+	}
+}
+
+/*
+ * The DDT log turns the random updates of the DDT objects in every txg
+ * into appends to a per-table log object.  The logged entries are kept
+ * in core (ddt_log_tree), where lookups find them before going to the
+ * objects, and are written to the objects in sorted batches when the log
+ * is flushed, which happens once it grows past zfs_dedup_log_mem_max or
+ * zfs_dedup_log_txg_max.
+ *
+ * The log isn't ordered by class the way scans walk the DDT, so logging
+ * stops while a scan is running and ddt_log_flush_all() empties the logs
+ * when one starts.
+ */
+static boolean_t
+ddt_log_enabled(ddt_t *ddt)
+{
+	spa_t *spa = ddt->ddt_spa;
+	dsl_scan_t *scn = spa->spa_dsl_pool->dp_scan;
+
+	return (zfs_dedup_log_mem_max != 0 &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DEDUP_LOG) &&
+	    (scn == NULL || scn->scn_phys.scn_state != DSS_SCANNING));
+}
+
+static boolean_t
+ddt_log_flush_needed(ddt_t *ddt, boolean_t logging, uint64_t txg)
+{
+	uint64_t n = avl_numnodes(&ddt->ddt_log_tree);
+
+	if (n == 0)
+		return (B_FALSE);
+
+	if (!logging || n * sizeof (ddt_entry_t) > zfs_dedup_log_mem_max)
+		return (B_TRUE);
+
+	return (ddt->ddt_log_object != 0 &&
+	    txg - ddt->ddt_log_first_txg >= zfs_dedup_log_txg_max);
+}
+
+static void
+ddt_log_entry(ddt_t *ddt, ddt_entry_t *dde, ddt_sync_batch_t *dsb,
+    enum ddt_type otype, enum ddt_class oclass)
+{
+	ddt_log_record_t *dlr;
+	ddt_entry_t *lde;
+
+	ASSERT3S(dsb->dsb_nlog, <, dsb->dsb_size);
+	dlr = &dsb->dsb_log[dsb->dsb_nlog++];
+
+	rw_enter(&ddt->ddt_log_lock, RW_WRITER);
+	lde = ddt_log_apply(ddt, &dde->dde_key, dde->dde_phys,
+	    dde->dde_type, dde->dde_class, otype, oclass);
+
+	dlr->dlr_key = lde->dde_key;
+	bcopy(lde->dde_phys, dlr->dlr_phys, sizeof (dlr->dlr_phys));
+	dlr->dlr_prop = 0;
+	DLR_SET_TYPE(dlr, lde->dde_type);
+	DLR_SET_CLASS(dlr, lde->dde_class);
+	DLR_SET_OBJ_TYPE(dlr, lde->dde_obj_type);
+	DLR_SET_OBJ_CLASS(dlr, lde->dde_obj_class);
+	rw_exit(&ddt->ddt_log_lock);
+}
+
+static void
+ddt_log_write(ddt_t *ddt, ddt_sync_batch_t *dsb, dmu_tx_t *tx)
+{
+	objset_t *os = ddt->ddt_os;
+	ddt_log_phys_t *dlp;
+	dmu_buf_t *db;
+	char name[DDT_NAMELEN];
+
+	if (dsb->dsb_nlog == 0)
+		return;
+
+	if (ddt->ddt_log_object == 0) {
+		ddt_log_name(ddt, name);
+		ddt->ddt_log_object = dmu_object_alloc(os,
+		    DMU_OTN_UINT64_METADATA, SPA_OLD_MAXBLOCKSIZE,
+		    DMU_OTN_UINT64_METADATA, sizeof (ddt_log_phys_t), tx);
+		VERIFY0(zap_add(os, DMU_POOL_DIRECTORY_OBJECT, name,
+		    sizeof (uint64_t), 1, &ddt->ddt_log_object, tx));
+		spa_feature_incr(ddt->ddt_spa, SPA_FEATURE_DEDUP_LOG, tx);
+		ddt->ddt_log_count = 0;
+		ddt->ddt_log_first_txg = dmu_tx_get_txg(tx);
+	}
+
+	dmu_write(os, ddt->ddt_log_object,
+	    ddt->ddt_log_count * sizeof (ddt_log_record_t),
+	    dsb->dsb_nlog * sizeof (ddt_log_record_t), dsb->dsb_log, tx);
+	ddt->ddt_log_count += dsb->dsb_nlog;
+
+	VERIFY0(dmu_bonus_hold(os, ddt->ddt_log_object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	dlp = db->db_data;
+	dlp->dlp_count = ddt->ddt_log_count;
+	dlp->dlp_first_txg = ddt->ddt_log_first_txg;
+	dmu_buf_rele(db, FTAG);
+}
+
+/*
+ * Write every logged entry to the object for its class, removing it from
+ * the one that had it if it moved, and discard the log.
+ */
+static void
+ddt_log_flush(ddt_t *ddt, dmu_tx_t *tx)
+{
+	avl_tree_t *t = &ddt->ddt_log_tree;
+	objset_t *os = ddt->ddt_os;
+	ddt_sync_batch_t dsb;
+	ddt_entry_t *lde;
+	void *cookie = NULL;
+	char name[DDT_NAMELEN];
+
+	if (avl_numnodes(t) != 0) {
+		bzero(&dsb, sizeof (dsb));
+		dsb.dsb_size = avl_numnodes(t);
+
+		for (lde = avl_first(t); lde != NULL; lde = AVL_NEXT(t, lde)) {
+			enum ddt_type type = lde->dde_type;
+			enum ddt_class class = lde->dde_class;
+			enum ddt_type otype = lde->dde_obj_type;
+			enum ddt_class oclass = lde->dde_obj_class;
+
+			if (otype != DDT_TYPES &&
+			    (otype != type || oclass != class)) {
+				ddt_sync_batch_add(&dsb,
+				    &dsb.dsb_remove[otype][oclass],
+				    &dsb.dsb_nremove[otype][oclass], lde);
+			}
+			if (type != DDT_TYPES) {
+				if (!ddt_object_exists(ddt, type, class))
+					ddt_object_create(ddt, type, class, tx);
+				ddt_sync_batch_add(&dsb,
+				    &dsb.dsb_update[type][class],
+				    &dsb.dsb_nupdate[type][class], lde);
+			}
+		}
+
+		ddt_sync_flush(ddt, &dsb, tx);
+	}
+
+	rw_enter(&ddt->ddt_log_lock, RW_WRITER);
+	while ((lde = avl_destroy_nodes(t, &cookie)) != NULL)
+		ddt_free(lde);
+	bzero(ddt->ddt_log_delta, sizeof (ddt->ddt_log_delta));
+	ddt->ddt_log_gen++;
+	rw_exit(&ddt->ddt_log_lock);
+
+	if (ddt->ddt_log_object != 0) {
+		ddt_log_name(ddt, name);
+		VERIFY0(zap_remove(os, DMU_POOL_DIRECTORY_OBJECT, name, tx));
+		VERIFY0(dmu_object_free(os, ddt->ddt_log_object, tx));
+		spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_DEDUP_LOG, tx);
+		ddt->ddt_log_object = 0;
+		ddt->ddt_log_count = 0;
+		ddt->ddt_log_first_txg = 0;
+	}
+}
+
+void
+ddt_log_flush_all(spa_t *spa, dmu_tx_t *tx)
+{
+	enum zio_checksum c;
+
+	for (c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt != NULL)
+			ddt_log_flush(ddt, tx);
+	}
+}
+
+/*
+ * Whether the table has no entries, in which case none of its objects
+ * exist (and neither does its log).
+ */
+static boolean_t
+ddt_is_empty(ddt_t *ddt)
+{
+	enum ddt_type type;
+	enum ddt_class class;
+
+	for (type = 0; type < DDT_TYPES; type++) {
+		for (class = 0; class < DDT_CLASSES; class++) {
+			if (ddt_object_exists(ddt, type, class))
+				return (B_FALSE);
+		}
 	}
-	ddt_exit(ddt);
+
+	ASSERT0(avl_numnodes(&ddt->ddt_log_tree));
+
+	return (B_TRUE);
 }
 
 static void
-ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
+ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, ddt_sync_batch_t *dsb,
+    dmu_tx_t *tx, uint64_t txg)
 {
 	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
 	ddt_phys_t *ddp = dde->dde_phys;
@@ -1101,19 +2029,36 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	else
 		nclass = DDT_CLASS_UNIQUE;
 
-	if (otype != DDT_TYPES &&
+	if (dsb->dsb_log == NULL && otype != DDT_TYPES &&
 	    (otype != ntype || oclass != nclass || total_refcnt == 0)) {
-		VERIFY(ddt_object_remove(ddt, otype, oclass, dde, tx) == 0);
-		ASSERT(ddt_object_lookup(ddt, otype, oclass, dde) == ENOENT);
+		ddt_sync_batch_add(dsb, &dsb->dsb_remove[otype][oclass],
+		    &dsb->dsb_nremove[otype][oclass], dde);
 	}
 
-	if (total_refcnt != 0) {
+	if (total_refcnt == 0) {
+		dde->dde_type = DDT_TYPES;
+		dde->dde_class = DDT_CLASSES;
+		if (dsb->dsb_log != NULL && otype != DDT_TYPES)
+			ddt_log_entry(ddt, dde, dsb, otype, oclass);
+	} else {
 		dde->dde_type = ntype;
 		dde->dde_class = nclass;
 		ddt_stat_update(ddt, dde, 0);
+		/*
+		 * The object is created even when logging so that the
+		 * class's histogram is saved in every txg.
+		 */
 		if (!ddt_object_exists(ddt, ntype, nclass))
 			ddt_object_create(ddt, ntype, nclass, tx);
-		VERIFY(ddt_object_update(ddt, ntype, nclass, dde, tx) == 0);
+		if (otype == DDT_TYPES)
+			ddt_bloom_add(ddt, ddk);
+		if (dsb->dsb_log != NULL) {
+			ddt_log_entry(ddt, dde, dsb, otype, oclass);
+		} else {
+			ddt_sync_batch_add(dsb,
+			    &dsb->dsb_update[ntype][nclass],
+			    &dsb->dsb_nupdate[ntype][nclass], dde);
+		}
 
 		/*
 		 * If the class changes, the order that we scan this bp
@@ -1133,12 +2078,17 @@ static void
 ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 {
 	spa_t *spa = ddt->ddt_spa;
-	ddt_entry_t *dde;
-	void *cookie = NULL;
+	ddt_sync_batch_t dsb;
+	ddt_entry_t *dde, **ddes;
 	enum ddt_type type;
 	enum ddt_class class;
+	boolean_t logging = ddt_log_enabled(ddt);
+	int i, n, s;
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	n = 0;
+	for (s = 0; s < DDT_SHARDS; s++)
+		n += avl_numnodes(&ddt->ddt_shard[s].dds_tree);
+	if (n == 0)
 		return;
 
 	ASSERT(spa->spa_uberblock.ub_version >= SPA_VERSION_DEDUP);
@@ -1149,27 +2099,83 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		    DMU_POOL_DDT_STATS, tx);
 	}
 
-	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL) {
-		ddt_sync_entry(ddt, dde, tx, txg);
-		ddt_free(dde);
+	/*
+	 * If the log has been turned off, its entries must reach the
+	 * objects before this txg's changes are written there directly.
+	 */
+	if (!logging)
+		ddt_log_flush(ddt, tx);
+
+	if (ddt->ddt_bloom_object == 0 && zfs_dedup_bloom &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DEDUP_BLOOM) &&
+	    ddt_is_empty(ddt))
+		ddt_bloom_create(ddt, tx);
+
+	bzero(&dsb, sizeof (dsb));
+	dsb.dsb_size = n;
+	ddes = NULL;
+	if (n != 0) {
+		ddes = vmem_alloc(n * sizeof (ddt_entry_t *), KM_SLEEP);
+		if (logging) {
+			dsb.dsb_log = vmem_alloc(n * sizeof (ddt_log_record_t),
+			    KM_SLEEP);
+		}
+	}
+
+	/*
+	 * All of this txg's writes are done, so nothing else touches the
+	 * shards now.  The order the shards are drained in doesn't matter:
+	 * each object is updated in key-hash order by its batch.
+	 */
+	i = 0;
+	for (s = 0; s < DDT_SHARDS; s++) {
+		avl_tree_t *t = &ddt->ddt_shard[s].dds_tree;
+		void *cookie = NULL;
+
+		while ((dde = avl_destroy_nodes(t, &cookie)) != NULL) {
+			ddt_sync_entry(ddt, dde, &dsb, tx, txg);
+			ddes[i++] = dde;
+		}
+	}
+	ASSERT3S(i, ==, n);
+
+	if (ddt_log_flush_needed(ddt, logging, txg))
+		ddt_log_flush(ddt, tx);
+	else if (logging)
+		ddt_log_write(ddt, &dsb, tx);
+	ddt_sync_flush(ddt, &dsb, tx);
+
+	if (n != 0) {
+		for (i = 0; i < n; i++)
+			ddt_free(ddes[i]);
+		vmem_free(ddes, n * sizeof (ddt_entry_t *));
+		if (dsb.dsb_log != NULL) {
+			vmem_free(dsb.dsb_log,
+			    n * sizeof (ddt_log_record_t));
+		}
 	}
 
 	for (type = 0; type < DDT_TYPES; type++) {
-		uint64_t add, count = 0;
+		uint64_t count = 0;
 		for (class = 0; class < DDT_CLASSES; class++) {
 			if (ddt_object_exists(ddt, type, class)) {
 				ddt_object_sync(ddt, type, class, tx);
-				VERIFY(ddt_object_count(ddt, type, class,
-				    &add) == 0);
-				count += add;
+				count += ddt->ddt_object_stats[type][class].
+				    ddo_count;
 			}
 		}
 		for (class = 0; class < DDT_CLASSES; class++) {
-			if (count == 0 && ddt_object_exists(ddt, type, class))
+			if (count == 0 && ddt_object_exists(ddt, type, class) &&
+			    avl_numnodes(&ddt->ddt_log_tree) == 0)
 				ddt_object_destroy(ddt, type, class, tx);
 		}
 	}
 
+	if (ddt->ddt_bloom_object != 0 && ddt_is_empty(ddt))
+		ddt_bloom_destroy(ddt, tx);
+	else
+		ddt_bloom_write(ddt, tx);
+
 	bcopy(ddt->ddt_histogram, &ddt->ddt_histogram_cache,
 	    sizeof (ddt->ddt_histogram));
 }
@@ -1207,14 +2213,22 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 			do {
 				ddt_t *ddt = spa->spa_ddt[ddb->ddb_checksum];
 				int error = ENOENT;
-				if (ddt_object_exists(ddt, ddb->ddb_type,
-				    ddb->ddb_class)) {
-					error = ddt_object_walk(ddt,
-					    ddb->ddb_type, ddb->ddb_class,
-					    &ddb->ddb_cursor, dde);
+				if (ddb->ddb_type == DDT_TYPES) {
+					error = ddt_log_walk(ddt,
+					    ddb->ddb_class, &ddb->ddb_cursor,
+					    dde);
+				} else if (ddt_object_exists(ddt,
+				    ddb->ddb_type, ddb->ddb_class)) {
+					do {
+						error = ddt_object_walk(ddt,
+						    ddb->ddb_type,
+						    ddb->ddb_class,
+						    &ddb->ddb_cursor, dde);
+					} while (error == 0 &&
+					    ddt_log_contains(ddt, dde));
+					dde->dde_type = ddb->ddb_type;
+					dde->dde_class = ddb->ddb_class;
 				}
-				dde->dde_type = ddb->ddb_type;
-				dde->dde_class = ddb->ddb_class;
 				if (error == 0)
 					return (0);
 				if (error != ENOENT)
@@ -1222,7 +2236,7 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 				ddb->ddb_cursor = 0;
 			} while (++ddb->ddb_checksum < ZIO_CHECKSUM_FUNCTIONS);
 			ddb->ddb_checksum = 0;
-		} while (++ddb->ddb_type < DDT_TYPES);
+		} while (++ddb->ddb_type <= DDT_TYPES);
 		ddb->ddb_type = 0;
 	} while (++ddb->ddb_class < DDT_CLASSES);
 
@@ -1232,4 +2246,16 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 #if defined(_KERNEL) && defined(HAVE_SPL)
 module_param(zfs_dedup_prefetch, int, 0644);
 MODULE_PARM_DESC(zfs_dedup_prefetch, "Enable prefetching dedup-ed blks");
+
+module_param(zfs_dedup_log_mem_max, ulong, 0644);
+MODULE_PARM_DESC(zfs_dedup_log_mem_max,
+	"Max bytes of DDT log kept in memory per table (0 disables the log)");
+
+module_param(zfs_dedup_log_txg_max, int, 0644);
+MODULE_PARM_DESC(zfs_dedup_log_txg_max,
+	"Max txgs a DDT log may span before it is flushed");
+
+module_param(zfs_dedup_bloom, int, 0644);
+MODULE_PARM_DESC(zfs_dedup_bloom,
+	"Use bloom filters to skip DDT lookups of new blocks");
 #endif
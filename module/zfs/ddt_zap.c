@@ -111,6 +111,56 @@ ddt_zap_remove(objset_t *os, uint64_t object, ddt_entry_t *dde, dmu_tx_t *tx)
 	    DDT_KEY_WORDS, tx));
 }
 
+static int
+ddt_zap_update_batch(objset_t *os, uint64_t object, ddt_entry_t **ddes,
+    int n, dmu_tx_t *tx)
+{
+	size_t cbufsize = sizeof (ddes[0]->dde_phys) + 1;
+	zap_batch_ent_t *zbe;
+	uchar_t *cbuf;
+	int i, error;
+
+	zbe = vmem_alloc(n * sizeof (zap_batch_ent_t), KM_SLEEP);
+	cbuf = vmem_alloc(n * cbufsize, KM_SLEEP);
+
+	for (i = 0; i < n; i++) {
+		ddt_entry_t *dde = ddes[i];
+
+		zbe[i].zbe_key = &dde->dde_key;
+		zbe[i].zbe_integer_size = 1;
+		zbe[i].zbe_num_integers = ddt_compress(dde->dde_phys,
+		    cbuf + i * cbufsize, sizeof (dde->dde_phys), cbufsize);
+		zbe[i].zbe_val = cbuf + i * cbufsize;
+	}
+
+	error = zap_update_uint64_batch(os, object, DDT_KEY_WORDS,
+	    zbe, n, tx);
+
+	vmem_free(cbuf, n * cbufsize);
+	vmem_free(zbe, n * sizeof (zap_batch_ent_t));
+
+	return (error);
+}
+
+static int
+ddt_zap_remove_batch(objset_t *os, uint64_t object, ddt_entry_t **ddes,
+    int n, dmu_tx_t *tx)
+{
+	zap_batch_ent_t *zbe;
+	int i, error;
+
+	zbe = vmem_zalloc(n * sizeof (zap_batch_ent_t), KM_SLEEP);
+	for (i = 0; i < n; i++)
+		zbe[i].zbe_key = &ddes[i]->dde_key;
+
+	error = zap_remove_uint64_batch(os, object, DDT_KEY_WORDS,
+	    zbe, n, tx);
+
+	vmem_free(zbe, n * sizeof (zap_batch_ent_t));
+
+	return (error);
+}
+
 static int
 ddt_zap_walk(objset_t *os, uint64_t object, ddt_entry_t *dde, uint64_t *walk)
 {
@@ -152,6 +202,8 @@ const ddt_ops_t ddt_zap_ops = {
 	ddt_zap_prefetch,
 	ddt_zap_update,
 	ddt_zap_remove,
+	ddt_zap_update_batch,
+	ddt_zap_remove_batch,
 	ddt_zap_walk,
 	ddt_zap_count,
 };
@@ -436,6 +436,16 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 			return (SET_ERROR(EIO));
 		}
 
+		/*
+		 * Don't keep this block cached once the caller is done
+		 * with it; see dbuf_rele_and_unlock().
+		 */
+		if (flags & DMU_UNCACHED) {
+			mutex_enter(&db->db_mtx);
+			db->db_uncached = TRUE;
+			mutex_exit(&db->db_mtx);
+		}
+
 		/* initiate async i/o */
 		if (read)
 			(void) dbuf_read(db, zio, dbuf_flags);
@@ -894,6 +904,107 @@ dmu_prealloc(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	dmu_buf_rele_array(dbp, numbufs, FTAG);
 }
 
+/*
+ * Return the level-0 block pointers covering [offset, offset + length) of
+ * the object, for cloning with dmu_brt_clone().  Fails with EAGAIN if any
+ * of the blocks is dirty, since its on-disk block pointer is about to
+ * change; the caller should wait for the txg to sync and retry.  Gang and
+ * dedup blocks can not be cloned.
+ */
+int
+dmu_read_l0_bps(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t length, blkptr_t *bps, size_t *nbpsp)
+{
+	dmu_buf_t **dbp;
+	int numbufs, i, error;
+
+	error = dmu_buf_hold_array(os, object, offset, length,
+	    FALSE, FTAG, &numbufs, &dbp);
+	if (error != 0)
+		return (error);
+
+	for (i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		blkptr_t *bp = &bps[i];
+		dnode_t *dn;
+
+		DB_DNODE_ENTER(db);
+		dn = DB_DNODE(db);
+		rw_enter(&dn->dn_struct_rwlock, RW_READER);
+		mutex_enter(&db->db_mtx);
+		if (db->db_last_dirty != NULL) {
+			error = SET_ERROR(EAGAIN);
+		} else if (db->db_blkptr == NULL) {
+			BP_ZERO(bp);
+		} else {
+			*bp = *db->db_blkptr;
+		}
+		mutex_exit(&db->db_mtx);
+		rw_exit(&dn->dn_struct_rwlock);
+		DB_DNODE_EXIT(db);
+
+		if (error != 0)
+			break;
+
+		if (!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp) &&
+		    (BP_IS_GANG(bp) || BP_GET_DEDUP(bp))) {
+			error = SET_ERROR(EOPNOTSUPP);
+			break;
+		}
+	}
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	if (error == 0)
+		*nbpsp = numbufs;
+
+	return (error);
+}
+
+/*
+ * Point the level-0 blocks covering [offset, offset + length) of the
+ * object at the blocks in bps, as returned by dmu_read_l0_bps().  The
+ * block sizes must match.  Fails with EAGAIN if any of the target blocks
+ * is still dirty.
+ */
+int
+dmu_brt_clone(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t length, dmu_tx_t *tx, const blkptr_t *bps, size_t nbps)
+{
+	dmu_buf_t **dbp;
+	int numbufs, i, error;
+
+	error = dmu_buf_hold_array(os, object, offset, length,
+	    FALSE, FTAG, &numbufs, &dbp);
+	if (error != 0)
+		return (error);
+
+	if (numbufs != nbps) {
+		dmu_buf_rele_array(dbp, numbufs, FTAG);
+		return (SET_ERROR(EINVAL));
+	}
+
+	for (i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		const blkptr_t *bp = &bps[i];
+
+		if (db->db_last_dirty != NULL) {
+			error = SET_ERROR(EAGAIN);
+			break;
+		}
+		if (!BP_IS_HOLE(bp) && BP_GET_LSIZE(bp) != db->db.db_size) {
+			error = SET_ERROR(EINVAL);
+			break;
+		}
+	}
+
+	for (i = 0; error == 0 && i < numbufs; i++)
+		dmu_buf_write_clone(dbp[i], &bps[i], tx);
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (error);
+}
+
 void
 dmu_write_embedded(objset_t *os, uint64_t object, uint64_t offset,
     void *data, uint8_t etype, uint8_t comp, int uncompressed_size,
@@ -1063,7 +1174,7 @@ xuio_stat_wbuf_nocopy()
 
 #ifdef _KERNEL
 static int
-dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
+dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, uint32_t flags)
 {
 	dmu_buf_t **dbp;
 	int numbufs, i, err;
@@ -1074,7 +1185,7 @@ dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
 	 * to be reading in parallel.
 	 */
 	err = dmu_buf_hold_array_by_dnode(dn, uio->uio_loffset, size,
-	    TRUE, FTAG, &numbufs, &dbp, 0);
+	    TRUE, FTAG, &numbufs, &dbp, flags);
 	if (err)
 		return (err);
 
@@ -1126,7 +1237,7 @@ dmu_read_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size)
  * because we don't have to find the dnode_t for the object.
  */
 int
-dmu_read_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size)
+dmu_read_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size, uint32_t flags)
 {
 	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
 	dnode_t *dn;
@@ -1137,7 +1248,7 @@ dmu_read_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size)
 
 	DB_DNODE_ENTER(db);
 	dn = DB_DNODE(db);
-	err = dmu_read_uio_dnode(dn, uio, size);
+	err = dmu_read_uio_dnode(dn, uio, size, flags);
 	DB_DNODE_EXIT(db);
 
 	return (err);
@@ -1161,7 +1272,7 @@ dmu_read_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size)
 	if (err)
 		return (err);
 
-	err = dmu_read_uio_dnode(dn, uio, size);
+	err = dmu_read_uio_dnode(dn, uio, size, DMU_READ_PREFETCH);
 
 	dnode_rele(dn, FTAG);
 
@@ -1169,7 +1280,8 @@ dmu_read_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size)
 }
 
 static int
-dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
+dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx,
+    uint32_t flags)
 {
 	dmu_buf_t **dbp;
 	int numbufs;
@@ -1177,7 +1289,7 @@ dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
 	int i;
 
 	err = dmu_buf_hold_array_by_dnode(dn, uio->uio_loffset, size,
-	    FALSE, FTAG, &numbufs, &dbp, DMU_READ_PREFETCH);
+	    FALSE, FTAG, &numbufs, &dbp, flags);
 	if (err)
 		return (err);
 
@@ -1231,7 +1343,7 @@ dmu_write_uio_dnode(dnode_t *dn, uio_t *uio, uint64_t size, dmu_tx_t *tx)
  */
 int
 dmu_write_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size,
-    dmu_tx_t *tx)
+    dmu_tx_t *tx, uint32_t flags)
 {
 	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
 	dnode_t *dn;
@@ -1242,7 +1354,7 @@ dmu_write_uio_dbuf(dmu_buf_t *zdb, uio_t *uio, uint64_t size,
 
 	DB_DNODE_ENTER(db);
 	dn = DB_DNODE(db);
-	err = dmu_write_uio_dnode(dn, uio, size, tx);
+	err = dmu_write_uio_dnode(dn, uio, size, tx, flags);
 	DB_DNODE_EXIT(db);
 
 	return (err);
@@ -1267,7 +1379,7 @@ dmu_write_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size,
 	if (err)
 		return (err);
 
-	err = dmu_write_uio_dnode(dn, uio, size, tx);
+	err = dmu_write_uio_dnode(dn, uio, size, tx, DMU_READ_PREFETCH);
 
 	dnode_rele(dn, FTAG);
 
@@ -1304,6 +1416,22 @@ dmu_return_arcbuf(arc_buf_t *buf)
 void
 dmu_assign_arcbuf(dmu_buf_t *handle, uint64_t offset, arc_buf_t *buf,
     dmu_tx_t *tx)
+{
+	dmu_assign_arcbuf_compressed(handle, offset, buf, ZIO_COMPRESS_OFF,
+	    NULL, 0, tx);
+}
+
+/*
+ * Like dmu_assign_arcbuf(), but 'cdata' optionally holds the same block
+ * already compressed with 'compress' (csize bytes, allocated with
+ * zio_data_buf_alloc()).  If the buffer can be assigned directly the
+ * dbuf keeps 'cdata' so that the write can skip compression; otherwise
+ * it is freed here.
+ */
+void
+dmu_assign_arcbuf_compressed(dmu_buf_t *handle, uint64_t offset,
+    arc_buf_t *buf, uint8_t compress, void *cdata, uint64_t csize,
+    dmu_tx_t *tx)
 {
 	dmu_buf_impl_t *dbuf = (dmu_buf_impl_t *)handle;
 	dnode_t *dn;
@@ -1328,6 +1456,10 @@ dmu_assign_arcbuf(dmu_buf_t *handle, uint64_t offset, arc_buf_t *buf,
 	if (offset == db->db.db_offset && blksz == db->db.db_size &&
 	    DBUF_GET_BUFC_TYPE(db) == ARC_BUFC_DATA) {
 		dbuf_assign_arcbuf(db, buf, tx);
+		if (cdata != NULL) {
+			dbuf_assign_compressed(db, compress, cdata, csize, tx);
+			cdata = NULL;
+		}
 		dbuf_rele(db, FTAG);
 	} else {
 		objset_t *os;
@@ -1344,6 +1476,9 @@ dmu_assign_arcbuf(dmu_buf_t *handle, uint64_t offset, arc_buf_t *buf,
 		dmu_return_arcbuf(buf);
 		XUIOSTAT_BUMP(xuiostat_wbuf_copied);
 	}
+
+	if (cdata != NULL)
+		zio_data_buf_free(cdata, csize);
 }
 
 typedef struct {
@@ -1824,7 +1959,7 @@ dmu_offset_next(objset_t *os, uint64_t object, boolean_t hole, uint64_t *off)
 	 * we go trundling through the block pointers.
 	 */
 	for (i = 0; i < TXG_SIZE; i++) {
-		if (list_link_active(&dn->dn_dirty_link[i]))
+		if (multilist_link_active(&dn->dn_dirty_link[i]))
 			break;
 	}
 	if (i != TXG_SIZE) {
@@ -2029,6 +2164,8 @@ EXPORT_SYMBOL(dmu_free_long_object);
 EXPORT_SYMBOL(dmu_read);
 EXPORT_SYMBOL(dmu_write);
 EXPORT_SYMBOL(dmu_prealloc);
+EXPORT_SYMBOL(dmu_read_l0_bps);
+EXPORT_SYMBOL(dmu_brt_clone);
 EXPORT_SYMBOL(dmu_object_info);
 EXPORT_SYMBOL(dmu_object_info_from_dnode);
 EXPORT_SYMBOL(dmu_object_info_from_db);
@@ -2042,6 +2179,7 @@ EXPORT_SYMBOL(dmu_sync);
 EXPORT_SYMBOL(dmu_request_arcbuf);
 EXPORT_SYMBOL(dmu_return_arcbuf);
 EXPORT_SYMBOL(dmu_assign_arcbuf);
+EXPORT_SYMBOL(dmu_assign_arcbuf_compressed);
 EXPORT_SYMBOL(dmu_buf_hold);
 EXPORT_SYMBOL(dmu_ot);
 
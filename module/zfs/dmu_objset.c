@@ -321,6 +321,22 @@ recordsize_changed_cb(void *arg, uint64_t newval)
 	os->os_recordsize = newval;
 }
 
+static void
+arc_quota_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	arc_os_set_quota(os->os_arc_os, newval);
+}
+
+static void
+arc_reservation_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	arc_os_set_reservation(os->os_arc_os, newval);
+}
+
 void
 dmu_objset_byteswap(void *buf, size_t size)
 {
@@ -407,6 +423,8 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 	if (ds != NULL) {
 		boolean_t needlock = B_FALSE;
 
+		os->os_arc_os = arc_os_register(spa, ds->ds_object);
+
 		/*
 		 * Note: it's valid to open the objset if the dataset is
 		 * long-held, in which case the pool_config lock will not
@@ -471,10 +489,21 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 				    zfs_prop_to_name(ZFS_PROP_DNODESIZE),
 				    dnodesize_changed_cb, os);
 			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_ARCQUOTA),
+				    arc_quota_changed_cb, os);
+			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_ARCRESERVATION),
+				    arc_reservation_changed_cb, os);
+			}
 		}
 		if (needlock)
 			dsl_pool_config_exit(dmu_objset_pool(os), FTAG);
 		if (err != 0) {
+			arc_os_unregister(os->os_arc_os);
 			VERIFY(arc_buf_remove_ref(os->os_phys_buf,
 			    &os->os_phys_buf));
 			kmem_free(os, sizeof (objset_t));
@@ -499,10 +528,9 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 	os->os_zil = zil_alloc(os, &os->os_zil_header);
 
 	for (i = 0; i < TXG_SIZE; i++) {
-		list_create(&os->os_dirty_dnodes[i], sizeof (dnode_t),
-		    offsetof(dnode_t, dn_dirty_link[i]));
-		list_create(&os->os_free_dnodes[i], sizeof (dnode_t),
-		    offsetof(dnode_t, dn_dirty_link[i]));
+		multilist_create(&os->os_dirty_dnodes[i], sizeof (dnode_t),
+		    offsetof(dnode_t, dn_dirty_link[i]), max_ncpus,
+		    dnode_multilist_index_func);
 	}
 	list_create(&os->os_dnodes, sizeof (dnode_t),
 	    offsetof(dnode_t, dn_link));
@@ -514,6 +542,12 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 	mutex_init(&os->os_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&os->os_obj_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&os->os_user_ptr_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < OS_OBJ_BLOCK_LOCKS; i++)
+		mutex_init(&os->os_obj_block_lock[i], NULL, MUTEX_DEFAULT,
+		    NULL);
+	os->os_obj_next_percpu_len = boot_ncpus;
+	os->os_obj_next_percpu = kmem_zalloc(os->os_obj_next_percpu_len *
+	    sizeof (os->os_obj_next_percpu[0]), KM_SLEEP);
 
 	dnode_special_open(os, &os->os_phys->os_meta_dnode,
 	    DMU_META_DNODE_OBJECT, &os->os_meta_dnode);
@@ -778,6 +812,8 @@ dmu_objset_evict(objset_t *os)
 void
 dmu_objset_evict_done(objset_t *os)
 {
+	int t;
+
 	ASSERT3P(list_head(&os->os_dnodes), ==, NULL);
 
 	dnode_special_close(&os->os_meta_dnode);
@@ -789,6 +825,9 @@ dmu_objset_evict_done(objset_t *os)
 
 	VERIFY(arc_buf_remove_ref(os->os_phys_buf, &os->os_phys_buf));
 
+	if (os->os_arc_os != NULL)
+		arc_os_unregister(os->os_arc_os);
+
 	/*
 	 * This is a barrier to prevent the objset from going away in
 	 * dnode_move() until we can safely ensure that the objset is still in
@@ -798,9 +837,15 @@ dmu_objset_evict_done(objset_t *os)
 	rw_enter(&os_lock, RW_READER);
 	rw_exit(&os_lock);
 
+	for (t = 0; t < TXG_SIZE; t++)
+		multilist_destroy(&os->os_dirty_dnodes[t]);
 	mutex_destroy(&os->os_lock);
 	mutex_destroy(&os->os_obj_lock);
 	mutex_destroy(&os->os_user_ptr_lock);
+	for (t = 0; t < OS_OBJ_BLOCK_LOCKS; t++)
+		mutex_destroy(&os->os_obj_block_lock[t]);
+	kmem_free(os->os_obj_next_percpu,
+	    os->os_obj_next_percpu_len * sizeof (os->os_obj_next_percpu[0]));
 	spa_evicting_os_deregister(os->os_spa, os);
 	kmem_free(os, sizeof (objset_t));
 }
@@ -1072,12 +1117,24 @@ dmu_objset_snapshot_one(const char *fsname, const char *snapname)
 	return (err);
 }
 
+typedef struct sync_dnodes_arg {
+	objset_t *sda_os;
+	int sda_sublist_idx;
+	boolean_t sda_userused;
+	dmu_tx_t *sda_tx;
+} sync_dnodes_arg_t;
+
+/*
+ * Sync the dnodes of one os_dirty_dnodes sublist.  The synced dnodes are
+ * collected on newlist when user accounting is enabled.
+ */
 static void
-dmu_objset_sync_dnodes(list_t *list, list_t *newlist, dmu_tx_t *tx)
+dmu_objset_sync_dnodes(multilist_sublist_t *list, list_t *newlist,
+    dmu_tx_t *tx)
 {
 	dnode_t *dn;
 
-	while ((dn = list_head(list))) {
+	while ((dn = multilist_sublist_head(list)) != NULL) {
 		ASSERT(dn->dn_object != DMU_META_DNODE_OBJECT);
 		ASSERT(dn->dn_dbuf->db_data_pending);
 		/*
@@ -1088,10 +1145,16 @@ dmu_objset_sync_dnodes(list_t *list, list_t *newlist, dmu_tx_t *tx)
 		ASSERT(dn->dn_zio);
 
 		ASSERT3U(dn->dn_nlevels, <=, DN_MAX_LEVELS);
-		list_remove(list, dn);
+		multilist_sublist_remove(list, dn);
 
+		/*
+		 * The hold is released by dmu_objset_do_userquota_updates(),
+		 * once the dnode has been moved to os_synced_dnodes.
+		 */
 		if (newlist) {
-			(void) dnode_add_ref(dn, newlist);
+			objset_t *os = dn->dn_objset;
+
+			(void) dnode_add_ref(dn, &os->os_synced_dnodes);
 			list_insert_tail(newlist, dn);
 		}
 
@@ -1099,6 +1162,34 @@ dmu_objset_sync_dnodes(list_t *list, list_t *newlist, dmu_tx_t *tx)
 	}
 }
 
+static void
+dmu_objset_sync_dnodes_task(void *arg)
+{
+	sync_dnodes_arg_t *sda = arg;
+	objset_t *os = sda->sda_os;
+	int txgoff = sda->sda_tx->tx_txg & TXG_MASK;
+	multilist_sublist_t *mls;
+	list_t synced;
+
+	list_create(&synced, sizeof (dnode_t),
+	    offsetof(dnode_t, dn_dirty_link[txgoff]));
+
+	mls = multilist_sublist_lock(&os->os_dirty_dnodes[txgoff],
+	    sda->sda_sublist_idx);
+	dmu_objset_sync_dnodes(mls, sda->sda_userused ? &synced : NULL,
+	    sda->sda_tx);
+	multilist_sublist_unlock(mls);
+
+	if (!list_is_empty(&synced)) {
+		mutex_enter(&os->os_lock);
+		list_move_tail(&os->os_synced_dnodes, &synced);
+		mutex_exit(&os->os_lock);
+	}
+	list_destroy(&synced);
+
+	kmem_free(sda, sizeof (sync_dnodes_arg_t));
+}
+
 /* ARGSUSED */
 static void
 dmu_objset_write_ready(zio_t *zio, arc_buf_t *abuf, void *arg)
@@ -1153,8 +1244,11 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 	zio_prop_t zp;
 	zio_t *zio;
 	list_t *list;
-	list_t *newlist = NULL;
+	multilist_t *ml;
+	taskq_t *tq = dmu_objset_pool(os)->dp_sync_taskq;
 	dbuf_dirty_record_t *dr;
+	boolean_t userused = B_FALSE;
+	int i;
 
 	dprintf_ds(os->os_dsl_dataset, "txg=%llu\n", tx->tx_txg);
 
@@ -1206,17 +1300,40 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 	txgoff = tx->tx_txg & TXG_MASK;
 
 	if (dmu_objset_userused_enabled(os)) {
-		newlist = &os->os_synced_dnodes;
+		userused = B_TRUE;
 		/*
 		 * We must create the list here because it uses the
 		 * dn_dirty_link[] of this txg.
 		 */
-		list_create(newlist, sizeof (dnode_t),
+		list_create(&os->os_synced_dnodes, sizeof (dnode_t),
 		    offsetof(dnode_t, dn_dirty_link[txgoff]));
 	}
 
-	dmu_objset_sync_dnodes(&os->os_free_dnodes[txgoff], newlist, tx);
-	dmu_objset_sync_dnodes(&os->os_dirty_dnodes[txgoff], newlist, tx);
+	/*
+	 * Sync the dirty dnodes one sublist per task, so that an objset
+	 * with many dirty objects is synced by all of dp_sync_taskq.  The
+	 * dnode blocks they are written into are issued below, once every
+	 * dnode has been synced.
+	 */
+	ml = &os->os_dirty_dnodes[txgoff];
+	for (i = 0; i < multilist_get_num_sublists(ml); i++) {
+		sync_dnodes_arg_t *sda;
+		multilist_sublist_t *mls = multilist_sublist_lock(ml, i);
+		boolean_t empty = (multilist_sublist_head(mls) == NULL);
+
+		multilist_sublist_unlock(mls);
+		if (empty)
+			continue;
+
+		sda = kmem_alloc(sizeof (sync_dnodes_arg_t), KM_SLEEP);
+		sda->sda_os = os;
+		sda->sda_sublist_idx = i;
+		sda->sda_userused = userused;
+		sda->sda_tx = tx;
+		(void) taskq_dispatch(tq, dmu_objset_sync_dnodes_task, sda,
+		    TQ_SLEEP);
+	}
+	taskq_wait(tq);
 
 	list = &DMU_META_DNODE(os)->dn_dirty_records[txgoff];
 	while ((dr = list_head(list))) {
@@ -1243,8 +1360,7 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 boolean_t
 dmu_objset_is_dirty(objset_t *os, uint64_t txg)
 {
-	return (!list_is_empty(&os->os_dirty_dnodes[txg & TXG_MASK]) ||
-	    !list_is_empty(&os->os_free_dnodes[txg & TXG_MASK]));
+	return (!multilist_is_empty(&os->os_dirty_dnodes[txg & TXG_MASK]));
 }
 
 static objset_used_cb_t *used_cbs[DMU_OST_NUMTYPES];
@@ -45,6 +45,7 @@
 #include <sys/zfs_ioctl.h>
 #include <sys/zap.h>
 #include <sys/zio_checksum.h>
+#include <sys/zio_compress.h>
 #include <sys/zfs_znode.h>
 #include <zfs_fletcher.h>
 #include <sys/avl.h>
@@ -63,6 +64,10 @@
 int zfs_send_corrupt_data = B_FALSE;
 int zfs_send_queue_length = 16 * 1024 * 1024;
 int zfs_recv_queue_length = 16 * 1024 * 1024;
+/* Number of threads applying the records of a receive stream */
+int zfs_recv_writer_threads = 4;
+/* Largest range of an object that one receive transaction writes */
+int zfs_recv_write_batch_size = 1024 * 1024;
 /* Set this tunable to FALSE to disable setting of DRR_FLAG_FREERECORDS */
 int zfs_send_set_freerecords_bit = B_TRUE;
 
@@ -80,9 +85,12 @@ struct send_thread_arg {
 	dsl_dataset_t	*ds;		/* Dataset to traverse */
 	uint64_t	fromtxg;	/* Traverse from this txg */
 	int		flags;		/* flags to pass to traverse_dataset */
+	uint64_t	featureflags;	/* DMU_BACKUP_FEATURE_* of the stream */
 	int		error_code;
 	boolean_t	cancel;
 	zbookmark_phys_t resume;
+	const dmu_send_range_t *ranges;	/* Limit a partial send to these */
+	uint_t		nranges;
 };
 
 struct send_block_record {
@@ -91,6 +99,14 @@ struct send_block_record {
 	zbookmark_phys_t	zb;
 	uint8_t			indblkshift;
 	uint16_t		datablkszsec;
+	/*
+	 * The read of the block issued by the traverse thread, and the
+	 * buffer it fills: either the raw (still compressed) block for a
+	 * compressed stream, or the block read through the ARC.
+	 */
+	zio_t			*zio;
+	void			*cdata;
+	arc_buf_t		*abuf;
 	bqueue_node_t		ln;
 };
 
@@ -188,6 +204,114 @@ dump_record(dmu_sendarg_t *dsp, void *payload, int payload_len)
 	return (0);
 }
 
+/*
+ * Return the index of the first range that ends at or after this object, or
+ * nranges if there is none.
+ */
+static uint_t
+send_range_index(const dmu_send_range_t *ranges, uint_t nranges,
+    uint64_t object)
+{
+	uint_t lo = 0, hi = nranges;
+
+	while (lo < hi) {
+		uint_t mid = lo + (hi - lo) / 2;
+		if (ranges[mid].dsr_lastobj < object)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+/*
+ * Find the range that contains this object, if any.
+ */
+static const dmu_send_range_t *
+send_range_find(const dmu_send_range_t *ranges, uint_t nranges,
+    uint64_t object)
+{
+	uint_t i = send_range_index(ranges, nranges, object);
+
+	if (i < nranges && ranges[i].dsr_firstobj <= object)
+		return (&ranges[i]);
+	return (NULL);
+}
+
+/*
+ * Return the last byte of the range's window into its objects.
+ */
+static uint64_t
+send_range_end(const dmu_send_range_t *range)
+{
+	if (range->dsr_length > UINT64_MAX - range->dsr_offset)
+		return (UINT64_MAX);
+	return (range->dsr_offset + range->dsr_length - 1);
+}
+
+/*
+ * Validate the ranges of a partial send; see dmu_send_range_t.
+ */
+static int
+send_range_check(const dmu_send_range_t *ranges, uint_t nranges)
+{
+	uint_t i;
+
+	for (i = 0; i < nranges; i++) {
+		if (ranges[i].dsr_firstobj > ranges[i].dsr_lastobj ||
+		    ranges[i].dsr_length == 0)
+			return (SET_ERROR(EINVAL));
+		if (i > 0 &&
+		    ranges[i].dsr_firstobj <= ranges[i - 1].dsr_lastobj)
+			return (SET_ERROR(EINVAL));
+	}
+	return (0);
+}
+
+/*
+ * Does the block at this bookmark cover anything in the ranges of a partial
+ * send?  Blocks whose span does not fit in 64 bits are always visited.
+ */
+static boolean_t
+send_range_visit(const dmu_send_range_t *ranges, uint_t nranges,
+    const zbookmark_phys_t *zb, const dnode_phys_t *dnp)
+{
+	const dmu_send_range_t *range = NULL;
+	uint64_t span, start, end;
+	int shift;
+
+	if (zb->zb_object == DMU_META_DNODE_OBJECT) {
+		if (zb->zb_level == ZB_DNODE_LEVEL)
+			return (B_TRUE);
+	} else {
+		range = send_range_find(ranges, nranges, zb->zb_object);
+		if (range == NULL)
+			return (B_FALSE);
+		if (zb->zb_level == ZB_DNODE_LEVEL ||
+		    zb->zb_blkid == DMU_SPILL_BLKID)
+			return (B_TRUE);
+	}
+
+	shift = SPA_MINBLOCKSHIFT +
+	    zb->zb_level * (dnp->dn_indblkshift - SPA_BLKPTRSHIFT);
+	if (shift + highbit64(dnp->dn_datablkszsec) > 64)
+		return (B_TRUE);
+	span = BP_SPAN(dnp->dn_datablkszsec, dnp->dn_indblkshift,
+	    zb->zb_level);
+	if (zb->zb_blkid > (UINT64_MAX - span + 1) / span)
+		return (B_TRUE);
+	start = zb->zb_blkid * span;
+	end = start + span - 1;
+
+	if (zb->zb_object == DMU_META_DNODE_OBJECT) {
+		uint_t i = send_range_index(ranges, nranges,
+		    start >> DNODE_SHIFT);
+		return (i < nranges &&
+		    ranges[i].dsr_firstobj <= end >> DNODE_SHIFT);
+	}
+	return (start <= send_range_end(range) && end >= range->dsr_offset);
+}
+
 /*
  * Fill in the drr_free struct, or perform aggregation if the previous record is
  * also a free record, and the two are adjacent.
@@ -276,9 +400,14 @@ dump_free(dmu_sendarg_t *dsp, uint64_t object, uint64_t offset,
 	return (0);
 }
 
+/*
+ * Emit a WRITE record.  If psize differs from blksz, 'data' holds the block
+ * exactly as stored on disk (compressed with BP_GET_COMPRESS(bp)) and only
+ * psize bytes of payload follow the record.
+ */
 static int
-dump_write(dmu_sendarg_t *dsp, dmu_object_type_t type,
-    uint64_t object, uint64_t offset, int blksz, const blkptr_t *bp, void *data)
+dump_write(dmu_sendarg_t *dsp, dmu_object_type_t type, uint64_t object,
+    uint64_t offset, int blksz, uint64_t psize, const blkptr_t *bp, void *data)
 {
 	struct drr_write *drrw = &(dsp->dsa_drr->drr_u.drr_write);
 
@@ -329,7 +458,16 @@ dump_write(dmu_sendarg_t *dsp, dmu_object_type_t type,
 		drrw->drr_key.ddk_cksum = bp->blk_cksum;
 	}
 
-	if (dump_record(dsp, data, blksz) != 0)
+	if (psize != blksz) {
+		ASSERT(dsp->dsa_featureflags & DMU_BACKUP_FEATURE_COMPRESSED);
+		ASSERT(bp != NULL && !BP_IS_EMBEDDED(bp));
+		ASSERT3U(psize, ==, BP_GET_PSIZE(bp));
+		ASSERT3U(BP_GET_COMPRESS(bp), !=, ZIO_COMPRESS_OFF);
+		drrw->drr_compressiontype = BP_GET_COMPRESS(bp);
+		drrw->drr_compressed_size = psize;
+	}
+
+	if (dump_record(dsp, data, psize) != 0)
 		return (SET_ERROR(EINTR));
 	return (0);
 }
@@ -437,6 +575,64 @@ dump_freeobjects(dmu_sendarg_t *dsp, uint64_t firstobj, uint64_t numobjs)
 	return (0);
 }
 
+/*
+ * Like dump_free(), but in a partial send only free what lies within the
+ * object's range.
+ */
+static int
+dump_free_range(dmu_sendarg_t *dsp, uint64_t object, uint64_t offset,
+    uint64_t length)
+{
+	const dmu_send_range_t *range;
+	uint64_t end;
+
+	if (dsp->dsa_nranges == 0)
+		return (dump_free(dsp, object, offset, length));
+
+	range = send_range_find(dsp->dsa_ranges, dsp->dsa_nranges, object);
+	if (range == NULL)
+		return (0);
+
+	if (length > UINT64_MAX - offset)
+		end = UINT64_MAX;
+	else
+		end = offset + length - 1;
+	offset = MAX(offset, range->dsr_offset);
+	end = MIN(end, send_range_end(range));
+	if (offset > end)
+		return (0);
+	return (dump_free(dsp, object, offset,
+	    end == UINT64_MAX ? -1ULL : end - offset + 1));
+}
+
+/*
+ * Like dump_freeobjects(), but in a partial send only free the objects that
+ * lie within its ranges.
+ */
+static int
+dump_freeobjects_range(dmu_sendarg_t *dsp, uint64_t firstobj,
+    uint64_t numobjs)
+{
+	const dmu_send_range_t *ranges = dsp->dsa_ranges;
+	uint64_t lastobj = firstobj + numobjs - 1;
+	uint_t i;
+	int err;
+
+	if (dsp->dsa_nranges == 0)
+		return (dump_freeobjects(dsp, firstobj, numobjs));
+
+	for (i = send_range_index(ranges, dsp->dsa_nranges, firstobj);
+	    i < dsp->dsa_nranges && ranges[i].dsr_firstobj <= lastobj; i++) {
+		uint64_t lo = MAX(firstobj, ranges[i].dsr_firstobj);
+		uint64_t hi = MIN(lastobj, ranges[i].dsr_lastobj);
+
+		err = dump_freeobjects(dsp, lo, hi - lo + 1);
+		if (err != 0)
+			return (err);
+	}
+	return (0);
+}
+
 static int
 dump_dnode(dmu_sendarg_t *dsp, uint64_t object, dnode_phys_t *dnp)
 {
@@ -455,6 +651,11 @@ dump_dnode(dmu_sendarg_t *dsp, uint64_t object, dnode_phys_t *dnp)
 		return (0);
 	}
 
+	/* A partial send visits whole blocks of dnodes; skip the others. */
+	if (dsp->dsa_nranges != 0 &&
+	    send_range_find(dsp->dsa_ranges, dsp->dsa_nranges, object) == NULL)
+		return (0);
+
 	if (dnp == NULL || dnp->dn_type == DMU_OT_NONE)
 		return (dump_freeobjects(dsp, object, 1));
 
@@ -487,7 +688,7 @@ dump_dnode(dmu_sendarg_t *dsp, uint64_t object, dnode_phys_t *dnp)
 	}
 
 	/* Free anything past the end of the file. */
-	if (dump_free(dsp, object, (dnp->dn_maxblkid + 1) *
+	if (dump_free_range(dsp, object, (dnp->dn_maxblkid + 1) *
 	    (dnp->dn_datablkszsec << SPA_MINBLOCKSHIFT), -1ULL) != 0)
 		return (SET_ERROR(EINTR));
 	if (dsp->dsa_err != 0)
@@ -522,6 +723,48 @@ backup_do_embed(dmu_sendarg_t *dsp, const blkptr_t *bp)
 	return (B_FALSE);
 }
 
+/*
+ * Can this block be sent in a compressed stream exactly as it is stored on
+ * disk?  Only regular data blocks qualify; everything else is still read
+ * through the ARC by do_dump().
+ */
+static boolean_t
+send_block_raw_ok(struct send_thread_arg *sta, const blkptr_t *bp,
+    const zbookmark_phys_t *zb)
+{
+	dmu_object_type_t type = BP_GET_TYPE(bp);
+
+	if (!(sta->featureflags & DMU_BACKUP_FEATURE_COMPRESSED))
+		return (B_FALSE);
+	if (zb->zb_level != 0 || zb->zb_object == DMU_META_DNODE_OBJECT ||
+	    DMU_OBJECT_IS_SPECIAL(zb->zb_object))
+		return (B_FALSE);
+	if (BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp) ||
+	    BP_GET_COMPRESS(bp) == ZIO_COMPRESS_OFF)
+		return (B_FALSE);
+	if (type == DMU_OT_DNODE || type == DMU_OT_SA || type == DMU_OT_OBJSET)
+		return (B_FALSE);
+	/* Blocks that must be split for the stream go out uncompressed. */
+	if (!(sta->featureflags & DMU_BACKUP_FEATURE_LARGE_BLOCKS) &&
+	    BP_GET_LSIZE(bp) > SPA_OLD_MAXBLOCKSIZE)
+		return (B_FALSE);
+	return (B_TRUE);
+}
+
+/*
+ * Will do_dump() read this block through the ARC?
+ */
+static boolean_t
+send_block_read_ok(const blkptr_t *bp, const zbookmark_phys_t *zb)
+{
+	if (zb->zb_level != 0 || BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp))
+		return (B_FALSE);
+	if (zb->zb_object != DMU_META_DNODE_OBJECT &&
+	    DMU_OBJECT_IS_SPECIAL(zb->zb_object))
+		return (B_FALSE);
+	return (BP_GET_TYPE(bp) != DMU_OT_OBJSET);
+}
+
 /*
  * This is the callback function to traverse_dataset that acts as the worker
  * thread for dmu_send_impl.
@@ -542,6 +785,18 @@ send_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 	if (sta->cancel)
 		return (SET_ERROR(EINTR));
 
+	/*
+	 * Prune everything outside the ranges of a partial send.  Holes
+	 * have no children, and must not return TRAVERSE_VISIT_NO_CHILDREN.
+	 */
+	if (sta->nranges != 0 &&
+	    (zb->zb_level >= 0 || zb->zb_level == ZB_DNODE_LEVEL) &&
+	    !send_range_visit(sta->ranges, sta->nranges, zb, dnp)) {
+		if (bp != NULL && BP_IS_HOLE(bp))
+			return (0);
+		return (TRAVERSE_VISIT_NO_CHILDREN);
+	}
+
 	if (bp == NULL) {
 		ASSERT3U(zb->zb_level, ==, ZB_DNODE_LEVEL);
 		return (0);
@@ -556,6 +811,32 @@ send_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 	record->indblkshift = dnp->dn_indblkshift;
 	record->datablkszsec = dnp->dn_datablkszsec;
 	record_size = dnp->dn_datablkszsec << SPA_MINBLOCKSHIFT;
+
+	/*
+	 * Issue the read of every block that do_dump() will need before
+	 * enqueueing it, so that up to zfs_send_queue_length bytes of reads
+	 * are in flight ahead of the dump thread, and their checksums are
+	 * verified by the zio read threads rather than by the dump thread.
+	 * Blocks that can be sent as stored on disk are read raw, bypassing
+	 * the ARC; everything else is read through it.
+	 */
+	if (send_block_raw_ok(sta, bp, zb)) {
+		uint64_t psize = BP_GET_PSIZE(bp);
+
+		record->cdata = zio_data_buf_alloc(psize);
+		record->zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+		zio_nowait(zio_read(record->zio, spa, bp, record->cdata, psize,
+		    NULL, NULL, ZIO_PRIORITY_ASYNC_READ,
+		    ZIO_FLAG_CANFAIL | ZIO_FLAG_RAW, zb));
+	} else if (send_block_read_ok(bp, zb)) {
+		arc_flags_t aflags = ARC_FLAG_NOWAIT;
+
+		record->zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+		(void) arc_read(record->zio, spa, bp, arc_getbuf_func,
+		    &record->abuf, ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
+		    &aflags, zb);
+	}
+
 	bqueue_enqueue(&sta->q, record, record_size);
 
 	return (err);
@@ -585,6 +866,52 @@ send_traverse_thread(void *arg)
 	data = kmem_zalloc(sizeof (*data), KM_SLEEP);
 	data->eos_marker = B_TRUE;
 	bqueue_enqueue(&st_arg->q, data, 1);
+	thread_exit();
+}
+
+/*
+ * Wait for the read issued by send_cb() to complete.  On failure the
+ * caller falls back to reading the block through the ARC, which handles
+ * zfs_send_corrupt_data.
+ */
+static int
+send_block_wait(struct send_block_record *data)
+{
+	int err;
+
+	ASSERT(data->zio != NULL);
+	err = zio_wait(data->zio);
+	data->zio = NULL;
+	return (err);
+}
+
+/*
+ * Read the block through the ARC into data->abuf, using the read issued by
+ * send_cb() if there was one.  The buffer is released along with the record.
+ */
+static int
+send_block_read(spa_t *spa, struct send_block_record *data)
+{
+	arc_flags_t aflags = ARC_FLAG_WAIT;
+
+	if (data->zio != NULL)
+		(void) send_block_wait(data);
+	if (data->abuf != NULL)
+		return (0);
+	return (arc_read(NULL, spa, &data->bp, arc_getbuf_func, &data->abuf,
+	    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL, &aflags, &data->zb));
+}
+
+static void
+send_block_record_free(struct send_block_record *data)
+{
+	if (data->zio != NULL)
+		(void) send_block_wait(data);
+	if (data->cdata != NULL)
+		zio_data_buf_free(data->cdata, BP_GET_PSIZE(&data->bp));
+	if (data->abuf != NULL)
+		(void) arc_buf_remove_ref(data->abuf, &data->abuf);
+	kmem_free(data, sizeof (*data));
 }
 
 /*
@@ -617,57 +944,59 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 	    zb->zb_object == DMU_META_DNODE_OBJECT) {
 		uint64_t span = BP_SPAN(dblkszsec, indblkshift, zb->zb_level);
 		uint64_t dnobj = (zb->zb_blkid * span) >> DNODE_SHIFT;
-		err = dump_freeobjects(dsa, dnobj, span >> DNODE_SHIFT);
+		err = dump_freeobjects_range(dsa, dnobj, span >> DNODE_SHIFT);
 	} else if (BP_IS_HOLE(bp)) {
 		uint64_t span = BP_SPAN(dblkszsec, indblkshift, zb->zb_level);
 		uint64_t offset = zb->zb_blkid * span;
-		err = dump_free(dsa, zb->zb_object, offset, span);
+		err = dump_free_range(dsa, zb->zb_object, offset, span);
 	} else if (zb->zb_level > 0 || type == DMU_OT_OBJSET) {
 		return (0);
 	} else if (type == DMU_OT_DNODE) {
 		dnode_phys_t *blk;
 		int epb = BP_GET_LSIZE(bp) >> DNODE_SHIFT;
-		arc_flags_t aflags = ARC_FLAG_WAIT;
-		arc_buf_t *abuf;
 		int i;
 
 		ASSERT0(zb->zb_level);
 
-		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
-		    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
-		    &aflags, zb) != 0)
+		if (send_block_read(spa, data) != 0)
 			return (SET_ERROR(EIO));
 
-		blk = abuf->b_data;
+		blk = data->abuf->b_data;
 		dnobj = zb->zb_blkid * epb;
 		for (i = 0; i < epb; i += blk[i].dn_extra_slots + 1) {
 			err = dump_dnode(dsa, dnobj + i, blk + i);
 			if (err != 0)
 				break;
 		}
-		(void) arc_buf_remove_ref(abuf, &abuf);
 	} else if (type == DMU_OT_SA) {
-		arc_flags_t aflags = ARC_FLAG_WAIT;
-		arc_buf_t *abuf;
 		int blksz = BP_GET_LSIZE(bp);
 
-		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
-		    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
-		    &aflags, zb) != 0)
+		if (send_block_read(spa, data) != 0)
 			return (SET_ERROR(EIO));
 
-		err = dump_spill(dsa, zb->zb_object, blksz, abuf->b_data);
-		(void) arc_buf_remove_ref(abuf, &abuf);
+		err = dump_spill(dsa, zb->zb_object, blksz,
+		    data->abuf->b_data);
 	} else if (backup_do_embed(dsa, bp)) {
 		/* it's an embedded level-0 block of a regular object */
 		int blksz = dblkszsec << SPA_MINBLOCKSHIFT;
 		ASSERT0(zb->zb_level);
 		err = dump_write_embedded(dsa, zb->zb_object,
 		    zb->zb_blkid * blksz, blksz, bp);
+	} else if (data->cdata != NULL && send_block_wait(data) == 0) {
+		/* a level-0 block sent as stored on disk */
+		int blksz = dblkszsec << SPA_MINBLOCKSHIFT;
+
+		ASSERT0(zb->zb_level);
+		ASSERT3U(blksz, ==, BP_GET_LSIZE(bp));
+		ASSERT(zb->zb_object > dsa->dsa_resume_object ||
+		    (zb->zb_object == dsa->dsa_resume_object &&
+		    zb->zb_blkid * blksz >= dsa->dsa_resume_offset));
+
+		err = dump_write(dsa, type, zb->zb_object, zb->zb_blkid * blksz,
+		    blksz, BP_GET_PSIZE(bp), bp, data->cdata);
 	} else {
 		/* it's a level-0 block of a regular object */
-		arc_flags_t aflags = ARC_FLAG_WAIT;
-		arc_buf_t *abuf;
+		char *buf;
 		int blksz = dblkszsec << SPA_MINBLOCKSHIFT;
 		uint64_t offset;
 
@@ -676,17 +1005,15 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 		    (zb->zb_object == dsa->dsa_resume_object &&
 		    zb->zb_blkid * blksz >= dsa->dsa_resume_offset));
 
-		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
-		    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
-		    &aflags, zb) != 0) {
+		if (send_block_read(spa, data) != 0) {
 			if (zfs_send_corrupt_data) {
 				uint64_t *ptr;
 				/* Send a block filled with 0x"zfs badd bloc" */
-				abuf = arc_buf_alloc(spa, blksz, &abuf,
-				    ARC_BUFC_DATA);
-				for (ptr = abuf->b_data;
-				    (char *)ptr < (char *)abuf->b_data + blksz;
-				    ptr++)
+				data->abuf = arc_buf_alloc(spa, blksz,
+				    &data->abuf, ARC_BUFC_DATA);
+				for (ptr = data->abuf->b_data;
+				    (char *)ptr < (char *)data->abuf->b_data +
+				    blksz; ptr++)
 					*ptr = 0x2f5baddb10cULL;
 			} else {
 				return (SET_ERROR(EIO));
@@ -694,24 +1021,23 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 		}
 
 		offset = zb->zb_blkid * blksz;
+		buf = data->abuf->b_data;
 
 		if (!(dsa->dsa_featureflags &
 		    DMU_BACKUP_FEATURE_LARGE_BLOCKS) &&
 		    blksz > SPA_OLD_MAXBLOCKSIZE) {
-			char *buf = abuf->b_data;
 			while (blksz > 0 && err == 0) {
 				int n = MIN(blksz, SPA_OLD_MAXBLOCKSIZE);
 				err = dump_write(dsa, type, zb->zb_object,
-				    offset, n, NULL, buf);
+				    offset, n, n, NULL, buf);
 				offset += n;
 				buf += n;
 				blksz -= n;
 			}
 		} else {
 			err = dump_write(dsa, type, zb->zb_object,
-			    offset, blksz, bp, abuf->b_data);
+			    offset, blksz, blksz, bp, buf);
 		}
-		(void) arc_buf_remove_ref(abuf, &abuf);
 	}
 
 	ASSERT(err == 0 || err == EINTR);
@@ -725,7 +1051,7 @@ static struct send_block_record *
 get_next_record(bqueue_t *bq, struct send_block_record *data)
 {
 	struct send_block_record *tmp = bqueue_dequeue(bq);
-	kmem_free(data, sizeof (*data));
+	send_block_record_free(data);
 	return (tmp);
 }
 
@@ -737,9 +1063,9 @@ get_next_record(bqueue_t *bq, struct send_block_record *data)
 static int
 dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
     zfs_bookmark_phys_t *ancestor_zb,
-    boolean_t is_clone, boolean_t embedok, boolean_t large_block_ok, int outfd,
-    uint64_t resumeobj, uint64_t resumeoff,
-    vnode_t *vp, offset_t *off)
+    boolean_t is_clone, boolean_t embedok, boolean_t large_block_ok,
+    boolean_t compressok, int outfd, uint64_t resumeobj, uint64_t resumeoff,
+    const dmu_send_range_t *ranges, uint_t nranges, vnode_t *vp, offset_t *off)
 {
 	objset_t *os;
 	dmu_replay_record_t *drr;
@@ -753,6 +1079,13 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 	struct send_block_record *to_data;
 
 	err = dmu_objset_from_ds(to_ds, &os);
+	if (err == 0 && nranges != 0) {
+		/* a partial send has no resume token to resume from */
+		if (resumeobj != 0 || resumeoff != 0)
+			err = SET_ERROR(EINVAL);
+		else
+			err = send_range_check(ranges, nranges);
+	}
 	if (err != 0) {
 		dsl_pool_rele(dp, tag);
 		return (err);
@@ -790,10 +1123,14 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 		if (spa_feature_is_active(dp->dp_spa, SPA_FEATURE_LZ4_COMPRESS))
 			featureflags |= DMU_BACKUP_FEATURE_EMBED_DATA_LZ4;
 	}
+	if (compressok)
+		featureflags |= DMU_BACKUP_FEATURE_COMPRESSED;
 
 	if (resumeobj != 0 || resumeoff != 0) {
 		featureflags |= DMU_BACKUP_FEATURE_RESUMING;
 	}
+	if (nranges != 0)
+		featureflags |= DMU_BACKUP_FEATURE_PARTIAL;
 
 	DMU_SET_FEATUREFLAGS(drr->drr_u.drr_begin.drr_versioninfo,
 	    featureflags);
@@ -833,6 +1170,8 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 	dsp->dsa_featureflags = featureflags;
 	dsp->dsa_resume_object = resumeobj;
 	dsp->dsa_resume_offset = resumeoff;
+	dsp->dsa_ranges = ranges;
+	dsp->dsa_nranges = nranges;
 
 	mutex_enter(&to_ds->ds_sendstream_lock);
 	list_insert_head(&to_ds->ds_sendstreams, dsp);
@@ -856,6 +1195,13 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 		payload = fnvlist_pack(nvl, &payload_len);
 		drr->drr_payloadlen = payload_len;
 		fnvlist_free(nvl);
+	} else if (nranges != 0) {
+		nvlist_t *nvl = fnvlist_alloc();
+		fnvlist_add_uint64_array(nvl, "ranges", (uint64_t *)ranges,
+		    nranges * DMU_SEND_RANGE_NUINT64);
+		payload = fnvlist_pack(nvl, &payload_len);
+		drr->drr_payloadlen = payload_len;
+		fnvlist_free(nvl);
 	}
 
 	err = dump_record(dsp, payload, payload_len);
@@ -871,7 +1217,17 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 	to_arg.cancel = B_FALSE;
 	to_arg.ds = to_ds;
 	to_arg.fromtxg = fromtxg;
-	to_arg.flags = TRAVERSE_PRE | TRAVERSE_PREFETCH;
+	to_arg.featureflags = featureflags;
+	to_arg.ranges = ranges;
+	to_arg.nranges = nranges;
+	/*
+	 * send_cb() reads the data blocks itself, so only prefetch metadata.
+	 * The prefetcher does not know about the ranges of a partial send,
+	 * which usually cover a small part of the dataset, so don't use it.
+	 */
+	to_arg.flags = TRAVERSE_PRE;
+	if (nranges == 0)
+		to_arg.flags |= TRAVERSE_PREFETCH_METADATA;
 	(void) thread_create(NULL, 0, send_traverse_thread, &to_arg, 0, curproc,
 	    TS_RUN, minclsyspri);
 
@@ -890,7 +1246,7 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *to_ds,
 			to_data = get_next_record(&to_arg.q, to_data);
 		}
 	}
-	kmem_free(to_data, sizeof (*to_data));
+	send_block_record_free(to_data);
 
 	bqueue_destroy(&to_arg.q);
 
@@ -933,7 +1289,7 @@ out:
 
 int
 dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
-    boolean_t embedok, boolean_t large_block_ok,
+    boolean_t embedok, boolean_t large_block_ok, boolean_t compressok,
     int outfd, vnode_t *vp, offset_t *off)
 {
 	dsl_pool_t *dp;
@@ -970,10 +1326,12 @@ dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
 		is_clone = (fromds->ds_dir != ds->ds_dir);
 		dsl_dataset_rele(fromds, FTAG);
 		err = dmu_send_impl(FTAG, dp, ds, &zb, is_clone,
-		    embedok, large_block_ok, outfd, 0, 0, vp, off);
+		    embedok, large_block_ok, compressok, outfd, 0, 0,
+		    NULL, 0, vp, off);
 	} else {
 		err = dmu_send_impl(FTAG, dp, ds, NULL, B_FALSE,
-		    embedok, large_block_ok, outfd, 0, 0, vp, off);
+		    embedok, large_block_ok, compressok, outfd, 0, 0,
+		    NULL, 0, vp, off);
 	}
 	dsl_dataset_rele(ds, FTAG);
 	return (err);
@@ -981,8 +1339,9 @@ dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
 
 int
 dmu_send(const char *tosnap, const char *fromsnap, boolean_t embedok,
-    boolean_t large_block_ok, int outfd, uint64_t resumeobj, uint64_t resumeoff,
-    vnode_t *vp, offset_t *off)
+    boolean_t large_block_ok, boolean_t compressok, int outfd,
+    uint64_t resumeobj, uint64_t resumeoff,
+    const dmu_send_range_t *ranges, uint_t nranges, vnode_t *vp, offset_t *off)
 {
 	dsl_pool_t *dp;
 	dsl_dataset_t *ds;
@@ -1049,12 +1408,12 @@ dmu_send(const char *tosnap, const char *fromsnap, boolean_t embedok,
 			return (err);
 		}
 		err = dmu_send_impl(FTAG, dp, ds, &zb, is_clone,
-		    embedok, large_block_ok,
-		    outfd, resumeobj, resumeoff, vp, off);
+		    embedok, large_block_ok, compressok,
+		    outfd, resumeobj, resumeoff, ranges, nranges, vp, off);
 	} else {
 		err = dmu_send_impl(FTAG, dp, ds, NULL, B_FALSE,
-		    embedok, large_block_ok,
-		    outfd, resumeobj, resumeoff, vp, off);
+		    embedok, large_block_ok, compressok,
+		    outfd, resumeobj, resumeoff, ranges, nranges, vp, off);
 	}
 	if (owned)
 		dsl_dataset_disown(ds, FTAG);
@@ -1064,8 +1423,8 @@ dmu_send(const char *tosnap, const char *fromsnap, boolean_t embedok,
 }
 
 static int
-dmu_adjust_send_estimate_for_indirects(dsl_dataset_t *ds, uint64_t size,
-    uint64_t *sizep)
+dmu_adjust_send_estimate_for_indirects(dsl_dataset_t *ds, uint64_t uncompressed,
+    uint64_t compressed, boolean_t stream_compressed, uint64_t *sizep)
 {
 	int err;
 	/*
@@ -1084,13 +1443,22 @@ dmu_adjust_send_estimate_for_indirects(dsl_dataset_t *ds, uint64_t size,
 	 * block, which we observe in practice.
 	 */
 	uint64_t recordsize;
+	uint64_t record_count;
+	uint64_t size;
 	err = dsl_prop_get_int_ds(ds, "recordsize", &recordsize);
 	if (err != 0)
 		return (err);
-	size -= size / recordsize * sizeof (blkptr_t);
+
+	/*
+	 * The number of blocks follows from the logical size; a compressed
+	 * stream carries the physical size of each block as its payload.
+	 */
+	record_count = uncompressed / recordsize;
+	size = stream_compressed ? compressed : uncompressed;
+	size -= MIN(size, record_count * sizeof (blkptr_t));
 
 	/* Add in the space for the record associated with each block. */
-	size += size / recordsize * sizeof (dmu_replay_record_t);
+	size += record_count * sizeof (dmu_replay_record_t);
 
 	*sizep = size;
 
@@ -1098,10 +1466,11 @@ dmu_adjust_send_estimate_for_indirects(dsl_dataset_t *ds, uint64_t size,
 }
 
 int
-dmu_send_estimate(dsl_dataset_t *ds, dsl_dataset_t *fromds, uint64_t *sizep)
+dmu_send_estimate(dsl_dataset_t *ds, dsl_dataset_t *fromds,
+    boolean_t stream_compressed, uint64_t *sizep)
 {
 	int err;
-	uint64_t size;
+	uint64_t uncomp, comp;
 
 	ASSERT(dsl_pool_config_held(ds->ds_dir->dd_pool));
 
@@ -1120,33 +1489,41 @@ dmu_send_estimate(dsl_dataset_t *ds, dsl_dataset_t *fromds, uint64_t *sizep)
 	if (fromds != NULL && !dsl_dataset_is_before(ds, fromds, 0))
 		return (SET_ERROR(EXDEV));
 
-	/* Get uncompressed size estimate of changed data. */
+	/* Get compressed and uncompressed size estimates of changed data. */
 	if (fromds == NULL) {
-		size = dsl_dataset_phys(ds)->ds_uncompressed_bytes;
+		uncomp = dsl_dataset_phys(ds)->ds_uncompressed_bytes;
+		comp = dsl_dataset_phys(ds)->ds_compressed_bytes;
 	} else {
-		uint64_t used, comp;
+		uint64_t used;
 		err = dsl_dataset_space_written(fromds, ds,
-		    &used, &comp, &size);
+		    &used, &comp, &uncomp);
 		if (err != 0)
 			return (err);
 	}
 
-	err = dmu_adjust_send_estimate_for_indirects(ds, size, sizep);
+	err = dmu_adjust_send_estimate_for_indirects(ds, uncomp, comp,
+	    stream_compressed, sizep);
 	return (err);
 }
 
+typedef struct dmu_send_space {
+	uint64_t	dss_uncompressed;
+	uint64_t	dss_compressed;
+} dmu_send_space_t;
+
 /*
  * Simple callback used to traverse the blocks of a snapshot and sum their
- * uncompressed size
+ * uncompressed and compressed sizes
  */
 /* ARGSUSED */
 static int
 dmu_calculate_send_traversal(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
     const zbookmark_phys_t *zb, const dnode_phys_t *dnp, void *arg)
 {
-	uint64_t *spaceptr = arg;
+	dmu_send_space_t *space = arg;
 	if (bp != NULL && !BP_IS_HOLE(bp)) {
-		*spaceptr += BP_GET_UCSIZE(bp);
+		space->dss_uncompressed += BP_GET_UCSIZE(bp);
+		space->dss_compressed += BP_GET_PSIZE(bp);
 	}
 	return (0);
 }
@@ -1158,10 +1535,10 @@ dmu_calculate_send_traversal(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
  */
 int
 dmu_send_estimate_from_txg(dsl_dataset_t *ds, uint64_t from_txg,
-    uint64_t *sizep)
+    boolean_t stream_compressed, uint64_t *sizep)
 {
 	int err;
-	uint64_t size = 0;
+	dmu_send_space_t space = { 0 };
 
 	ASSERT(dsl_pool_config_held(ds->ds_dir->dd_pool));
 
@@ -1175,14 +1552,15 @@ dmu_send_estimate_from_txg(dsl_dataset_t *ds, uint64_t from_txg,
 	}
 	/*
 	 * traverse the blocks of the snapshot with birth times after
-	 * from_txg, summing their uncompressed size
+	 * from_txg, summing their uncompressed and compressed sizes
 	 */
 	err = traverse_dataset(ds, from_txg, TRAVERSE_POST,
-	    dmu_calculate_send_traversal, &size);
+	    dmu_calculate_send_traversal, &space);
 	if (err)
 		return (err);
 
-	err = dmu_adjust_send_estimate_for_indirects(ds, size, sizep);
+	err = dmu_adjust_send_estimate_for_indirects(ds, space.dss_uncompressed,
+	    space.dss_compressed, stream_compressed, sizep);
 	return (err);
 }
 
@@ -1342,6 +1720,17 @@ dmu_recv_begin_check(void *arg, dmu_tx_t *tx)
 	    !spa_feature_is_enabled(dp->dp_spa, SPA_FEATURE_LARGE_DNODE))
 		return (SET_ERROR(ENOTSUP));
 
+	/*
+	 * A partial stream only describes the objects in its ranges, so it
+	 * must be applied to a base: either incrementally, or to a clone of
+	 * the given origin.  It carries no ranges in its resume token, so it
+	 * can't be received resumably.
+	 */
+	if ((featureflags & DMU_BACKUP_FEATURE_PARTIAL) &&
+	    ((fromguid == 0 && drba->drba_origin == NULL) ||
+	    drba->drba_cookie->drc_resumable))
+		return (SET_ERROR(EINVAL));
+
 	error = dsl_dataset_hold(dp, tofs, FTAG, &ds);
 	if (error == 0) {
 		/* target fs already exists; recv into temp clone */
@@ -1504,6 +1893,11 @@ dmu_recv_begin_sync(void *arg, dmu_tx_t *tx)
 			VERIFY0(zap_add(mos, dsobj, DS_FIELD_RESUME_EMBEDOK,
 			    8, 1, &one, tx));
 		}
+		if (DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
+		    DMU_BACKUP_FEATURE_COMPRESSED) {
+			VERIFY0(zap_add(mos, dsobj, DS_FIELD_RESUME_COMPRESSOK,
+			    8, 1, &one, tx));
+		}
 	}
 
 	dmu_buf_will_dirty(newds->ds_dbuf, tx);
@@ -1721,12 +2115,48 @@ struct receive_record_arg {
 	 * payload.
 	 */
 	arc_buf_t *write_buf;
+	/*
+	 * If the write came from a compressed stream, the payload as it was
+	 * received (drr_compressed_size bytes), kept so that it can be
+	 * written without compressing the block again.
+	 */
+	void *write_cbuf;
 	int payload_size;
 	uint64_t bytes_read; /* bytes read from stream when record created */
+	uint64_t seq; /* position of the record in the stream */
+	struct receive_writer_worker *worker; /* thread applying the record */
 	boolean_t eos_marker; /* Marks the end of the stream */
 	bqueue_node_t node;
 };
 
+/*
+ * Records are applied by several worker threads.  All records for an
+ * object go to the same worker, so they are applied in stream order;
+ * records that may touch other objects are applied once every worker
+ * is idle.
+ */
+/* Most DRR_WRITE records applied in one transaction */
+#define	RECV_WRITE_BATCH_MAX	256
+
+struct receive_writer_worker {
+	struct receive_writer_arg *rww_rwa;
+	bqueue_t rww_q;
+	/* Records being applied together */
+	struct receive_record_arg *rww_batch[RECV_WRITE_BATCH_MAX];
+	/*
+	 * Protected by the receive_writer_arg's mutex.  Every record of
+	 * this worker up to rww_done has been applied; rww_dispatched is
+	 * the last record handed to it.  The rww_resume fields describe
+	 * the last applied record that a receive could resume from.
+	 */
+	uint64_t rww_dispatched;
+	uint64_t rww_done;
+	uint64_t rww_resume_seq;
+	uint64_t rww_resume_object;
+	uint64_t rww_resume_offset;
+	uint64_t rww_resume_bytes;
+};
+
 struct receive_writer_arg {
 	objset_t *os;
 	boolean_t byteswap;
@@ -1746,6 +2176,15 @@ struct receive_writer_arg {
 	boolean_t resumable;
 	uint64_t last_object, last_offset;
 	uint64_t bytes_read; /* bytes read when current record created */
+
+	struct receive_writer_worker *workers;
+	int nworkers;
+	/* The following are protected by mutex. */
+	kcondvar_t worker_cv;
+	uint64_t seq; /* last record handed to a worker */
+	uint64_t pending; /* records handed to workers but not yet done */
+	int running; /* worker threads that have not exited */
+	uint64_t resume_seq; /* record last saved as the resume point */
 };
 
 struct objlist {
@@ -1894,6 +2333,7 @@ byteswap_record(dmu_replay_record_t *drr)
 		DO64(drr_write.drr_toguid);
 		ZIO_CHECKSUM_BSWAP(&drr->drr_u.drr_write.drr_key.ddk_cksum);
 		DO64(drr_write.drr_key.ddk_prop);
+		DO64(drr_write.drr_compressed_size);
 		break;
 	case DRR_WRITE_BYREF:
 		DO64(drr_write_byref.drr_object);
@@ -1954,11 +2394,24 @@ deduce_nblkptr(dmu_object_type_t bonus_type, uint64_t bonus_size)
 	}
 }
 
+/*
+ * Called with tx still open once the record rrd has been applied.  The
+ * workers apply records out of stream order, so the resume point saved
+ * in this txg is the latest record such that it and every record before
+ * it in the stream have been applied.  Those records were all assigned
+ * to this txg or an earlier one: txg tx cannot have quiesced yet, so no
+ * later txg is open.
+ */
 static void
 save_resume_state(struct receive_writer_arg *rwa,
-    uint64_t object, uint64_t offset, dmu_tx_t *tx)
+    struct receive_record_arg *rrd, uint64_t object, uint64_t offset,
+    dmu_tx_t *tx)
 {
 	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	struct receive_writer_worker *w = rrd->worker;
+	struct receive_writer_worker *best = NULL;
+	uint64_t applied;
+	int i;
 
 	if (!rwa->resumable)
 		return;
@@ -1967,7 +2420,7 @@ save_resume_state(struct receive_writer_arg *rwa,
 	 * We use ds_resume_bytes[] != 0 to indicate that we need to
 	 * update this on disk, so it must not be 0.
 	 */
-	ASSERT(rwa->bytes_read != 0);
+	ASSERT(rrd->bytes_read != 0);
 
 	/*
 	 * We only resume from write records, which have a valid
@@ -1975,20 +2428,52 @@ save_resume_state(struct receive_writer_arg *rwa,
 	 */
 	ASSERT(object != 0);
 
+	mutex_enter(&rwa->mutex);
+	w->rww_done = rrd->seq;
+	w->rww_resume_seq = rrd->seq;
+	w->rww_resume_object = object;
+	w->rww_resume_offset = offset;
+	w->rww_resume_bytes = rrd->bytes_read;
+
+	/* Every record before "applied" has been applied. */
+	applied = rwa->seq + 1;
+	for (i = 0; i < rwa->nworkers; i++) {
+		struct receive_writer_worker *rww = &rwa->workers[i];
+		if (rww->rww_dispatched != rww->rww_done)
+			applied = MIN(applied, rww->rww_done + 1);
+	}
+	for (i = 0; i < rwa->nworkers; i++) {
+		struct receive_writer_worker *rww = &rwa->workers[i];
+		if (rww->rww_resume_seq < applied &&
+		    rww->rww_resume_seq > rwa->resume_seq &&
+		    (best == NULL ||
+		    rww->rww_resume_seq > best->rww_resume_seq))
+			best = rww;
+	}
+	if (best == NULL) {
+		mutex_exit(&rwa->mutex);
+		return;
+	}
+	rwa->resume_seq = best->rww_resume_seq;
+	object = best->rww_resume_object;
+	offset = best->rww_resume_offset;
+
 	/*
 	 * For resuming to work correctly, we must receive records in order,
-	 * sorted by object,offset.  This is checked by the callers, but
-	 * assert it here for good measure.
+	 * sorted by object,offset.  This is checked when the records are
+	 * handed to the workers, but assert it here for good measure.
 	 */
 	ASSERT3U(object, >=, rwa->os->os_dsl_dataset->ds_resume_object[txgoff]);
 	ASSERT(object != rwa->os->os_dsl_dataset->ds_resume_object[txgoff] ||
 	    offset >= rwa->os->os_dsl_dataset->ds_resume_offset[txgoff]);
-	ASSERT3U(rwa->bytes_read, >=,
+	ASSERT3U(best->rww_resume_bytes, >=,
 	    rwa->os->os_dsl_dataset->ds_resume_bytes[txgoff]);
 
 	rwa->os->os_dsl_dataset->ds_resume_object[txgoff] = object;
 	rwa->os->os_dsl_dataset->ds_resume_offset[txgoff] = offset;
-	rwa->os->os_dsl_dataset->ds_resume_bytes[txgoff] = rwa->bytes_read;
+	rwa->os->os_dsl_dataset->ds_resume_bytes[txgoff] =
+	    best->rww_resume_bytes;
+	mutex_exit(&rwa->mutex);
 }
 
 noinline static int
@@ -2127,52 +2612,70 @@ receive_freeobjects(struct receive_writer_arg *rwa,
 	return (0);
 }
 
+/*
+ * Apply a run of n DRR_WRITE records to the same object, in increasing
+ * offset order, in a single transaction.  On success the records' buffers
+ * have been consumed.
+ */
 noinline static int
-receive_write(struct receive_writer_arg *rwa, struct drr_write *drrw,
-	arc_buf_t *abuf)
+receive_write(struct receive_writer_arg *rwa, struct receive_record_arg **rrds,
+    int n)
 {
+	struct drr_write *first = &rrds[0]->header.drr_u.drr_write;
+	struct drr_write *last = &rrds[n - 1]->header.drr_u.drr_write;
 	dmu_tx_t *tx;
 	dmu_buf_t *bonus;
-	int err;
+	int err, i;
 
-	if (drrw->drr_offset + drrw->drr_length < drrw->drr_offset ||
-	    !DMU_OT_IS_VALID(drrw->drr_type))
-		return (SET_ERROR(EINVAL));
+	for (i = 0; i < n; i++) {
+		struct drr_write *drrw = &rrds[i]->header.drr_u.drr_write;
 
-	/*
-	 * For resuming to work, records must be in increasing order
-	 * by (object, offset).
-	 */
-	if (drrw->drr_object < rwa->last_object ||
-	    (drrw->drr_object == rwa->last_object &&
-	    drrw->drr_offset < rwa->last_offset)) {
-		return (SET_ERROR(EINVAL));
+		if (drrw->drr_offset + drrw->drr_length < drrw->drr_offset ||
+		    !DMU_OT_IS_VALID(drrw->drr_type))
+			return (SET_ERROR(EINVAL));
+		ASSERT3U(drrw->drr_object, ==, first->drr_object);
+		ASSERT3U(drrw->drr_offset, >=, first->drr_offset);
 	}
-	rwa->last_object = drrw->drr_object;
-	rwa->last_offset = drrw->drr_offset;
 
-	if (dmu_object_info(rwa->os, drrw->drr_object, NULL) != 0)
+	if (dmu_object_info(rwa->os, first->drr_object, NULL) != 0)
 		return (SET_ERROR(EINVAL));
 
 	tx = dmu_tx_create(rwa->os);
 
-	dmu_tx_hold_write(tx, drrw->drr_object,
-	    drrw->drr_offset, drrw->drr_length);
+	dmu_tx_hold_write(tx, first->drr_object, first->drr_offset,
+	    last->drr_offset + last->drr_length - first->drr_offset);
 	err = dmu_tx_assign(tx, TXG_WAIT);
 	if (err != 0) {
 		dmu_tx_abort(tx);
 		return (err);
 	}
-	if (rwa->byteswap) {
-		dmu_object_byteswap_t byteswap =
-		    DMU_OT_BYTESWAP(drrw->drr_type);
-		dmu_ot_byteswap[byteswap].ob_func(abuf->b_data,
-		    drrw->drr_length);
-	}
 
-	if (dmu_bonus_hold(rwa->os, drrw->drr_object, FTAG, &bonus) != 0)
+	if (dmu_bonus_hold(rwa->os, first->drr_object, FTAG, &bonus) != 0) {
+		dmu_tx_commit(tx);
 		return (SET_ERROR(EINVAL));
-	dmu_assign_arcbuf(bonus, drrw->drr_offset, abuf, tx);
+	}
+	for (i = 0; i < n; i++) {
+		struct receive_record_arg *rrd = rrds[i];
+		struct drr_write *drrw = &rrd->header.drr_u.drr_write;
+
+		if (rwa->byteswap) {
+			dmu_object_byteswap_t byteswap =
+			    DMU_OT_BYTESWAP(drrw->drr_type);
+			dmu_ot_byteswap[byteswap].ob_func(
+			    rrd->write_buf->b_data, drrw->drr_length);
+		}
+		if (rrd->write_cbuf != NULL) {
+			dmu_assign_arcbuf_compressed(bonus, drrw->drr_offset,
+			    rrd->write_buf, drrw->drr_compressiontype,
+			    rrd->write_cbuf, drrw->drr_compressed_size, tx);
+		} else {
+			dmu_assign_arcbuf(bonus, drrw->drr_offset,
+			    rrd->write_buf, tx);
+		}
+		rrd->write_buf = NULL;
+		rrd->write_cbuf = NULL;
+		rrd->payload = NULL;
+	}
 
 	/*
 	 * Note: If the receive fails, we want the resume stream to start
@@ -2180,7 +2683,8 @@ receive_write(struct receive_writer_arg *rwa, struct drr_write *drrw,
 	 * to the next record), so that we can verify that we are
 	 * resuming from the correct location.
 	 */
-	save_resume_state(rwa, drrw->drr_object, drrw->drr_offset, tx);
+	save_resume_state(rwa, rrds[n - 1], last->drr_object,
+	    last->drr_offset, tx);
 	dmu_tx_commit(tx);
 	dmu_buf_rele(bonus, FTAG);
 
@@ -2196,8 +2700,9 @@ receive_write(struct receive_writer_arg *rwa, struct drr_write *drrw,
  */
 static int
 receive_write_byref(struct receive_writer_arg *rwa,
-    struct drr_write_byref *drrwbr)
+    struct receive_record_arg *rrd)
 {
+	struct drr_write_byref *drrwbr = &rrd->header.drr_u.drr_write_byref;
 	dmu_tx_t *tx;
 	int err;
 	guid_map_entry_t gmesrch;
@@ -2244,15 +2749,19 @@ receive_write_byref(struct receive_writer_arg *rwa,
 	dmu_buf_rele(dbp, FTAG);
 
 	/* See comment in restore_write. */
-	save_resume_state(rwa, drrwbr->drr_object, drrwbr->drr_offset, tx);
+	save_resume_state(rwa, rrd, drrwbr->drr_object, drrwbr->drr_offset,
+	    tx);
 	dmu_tx_commit(tx);
 	return (0);
 }
 
 static int
 receive_write_embedded(struct receive_writer_arg *rwa,
-    struct drr_write_embedded *drrwe, void *data)
+    struct receive_record_arg *rrd)
 {
+	struct drr_write_embedded *drrwe =
+	    &rrd->header.drr_u.drr_write_embedded;
+	void *data = rrd->payload;
 	dmu_tx_t *tx;
 	int err;
 
@@ -2283,7 +2792,8 @@ receive_write_embedded(struct receive_writer_arg *rwa,
 	    rwa->byteswap ^ ZFS_HOST_BYTEORDER, tx);
 
 	/* See comment in restore_write. */
-	save_resume_state(rwa, drrwe->drr_object, drrwe->drr_offset, tx);
+	save_resume_state(rwa, rrd, drrwe->drr_object, drrwe->drr_offset,
+	    tx);
 	dmu_tx_commit(tx);
 	return (0);
 }
@@ -2585,16 +3095,60 @@ receive_read_record(struct receive_arg *ra)
 	case DRR_WRITE:
 	{
 		struct drr_write *drrw = &ra->rrd->header.drr_u.drr_write;
-		arc_buf_t *abuf = arc_loan_buf(dmu_objset_spa(ra->os),
-		    drrw->drr_length);
+		arc_buf_t *abuf;
+		void *cbuf;
+		uint64_t psize;
+
+		if (!DRR_WRITE_COMPRESSED(drrw)) {
+			abuf = arc_loan_buf(dmu_objset_spa(ra->os),
+			    drrw->drr_length);
+			err = receive_read_payload_and_next_header(ra,
+			    drrw->drr_length, abuf->b_data);
+			if (err != 0) {
+				dmu_return_arcbuf(abuf);
+				return (err);
+			}
+			ra->rrd->write_buf = abuf;
+			receive_read_prefetch(ra, drrw->drr_object,
+			    drrw->drr_offset, drrw->drr_length);
+			return (err);
+		}
+
+		/*
+		 * The block arrived as stored on the sending pool.  Decompress
+		 * it for the dbuf, and hold on to the compressed copy so the
+		 * write can reuse it if this dataset compresses the same way.
+		 */
+		psize = drrw->drr_compressed_size;
+		if (drrw->drr_compressiontype >= ZIO_COMPRESS_FUNCTIONS ||
+		    psize == 0 || psize >= drrw->drr_length ||
+		    drrw->drr_length > SPA_MAXBLOCKSIZE)
+			return (SET_ERROR(EINVAL));
 
-		err = receive_read_payload_and_next_header(ra,
-		    drrw->drr_length, abuf->b_data);
+		cbuf = zio_data_buf_alloc(psize);
+		err = receive_read_payload_and_next_header(ra, psize, cbuf);
 		if (err != 0) {
-			dmu_return_arcbuf(abuf);
+			zio_data_buf_free(cbuf, psize);
 			return (err);
 		}
+		abuf = arc_loan_buf(dmu_objset_spa(ra->os), drrw->drr_length);
+		if (zio_decompress_data(drrw->drr_compressiontype, cbuf,
+		    abuf->b_data, psize, drrw->drr_length) != 0) {
+			dmu_return_arcbuf(abuf);
+			zio_data_buf_free(cbuf, psize);
+			ra->rrd->payload = NULL;
+			return (SET_ERROR(EINVAL));
+		}
+
+		/* A byteswapped block no longer matches its compressed form. */
+		if (ra->byteswap) {
+			zio_data_buf_free(cbuf, psize);
+			cbuf = NULL;
+		}
 		ra->rrd->write_buf = abuf;
+		ra->rrd->write_cbuf = cbuf;
+		/* Charge the receive queue for the decompressed buffer. */
+		ra->rrd->payload_size = drrw->drr_length;
 		receive_read_prefetch(ra, drrw->drr_object, drrw->drr_offset,
 		    drrw->drr_length);
 		return (err);
@@ -2656,6 +3210,19 @@ receive_read_record(struct receive_arg *ra)
 	}
 }
 
+/*
+ * Release the buffers of a DRR_WRITE record that was not applied.
+ */
+static void
+receive_free_write_bufs(struct receive_record_arg *rrd)
+{
+	dmu_return_arcbuf(rrd->write_buf);
+	if (rrd->write_cbuf != NULL) {
+		zio_data_buf_free(rrd->write_cbuf,
+		    rrd->header.drr_u.drr_write.drr_compressed_size);
+	}
+}
+
 /*
  * Commit the records to the pool.
  */
@@ -2665,10 +3232,6 @@ receive_process_record(struct receive_writer_arg *rwa,
 {
 	int err;
 
-	/* Processing in order, therefore bytes_read should be increasing. */
-	ASSERT3U(rrd->bytes_read, >=, rwa->bytes_read);
-	rwa->bytes_read = rrd->bytes_read;
-
 	switch (rrd->header.drr_type) {
 	case DRR_OBJECT:
 	{
@@ -2686,26 +3249,25 @@ receive_process_record(struct receive_writer_arg *rwa,
 	}
 	case DRR_WRITE:
 	{
-		struct drr_write *drrw = &rrd->header.drr_u.drr_write;
-		err = receive_write(rwa, drrw, rrd->write_buf);
-		/* if receive_write() is successful, it consumes the arc_buf */
+		err = receive_write(rwa, &rrd, 1);
+		/*
+		 * if receive_write() is successful, it consumes the arc_buf
+		 * and the compressed buffer
+		 */
 		if (err != 0)
-			dmu_return_arcbuf(rrd->write_buf);
+			receive_free_write_bufs(rrd);
 		rrd->write_buf = NULL;
+		rrd->write_cbuf = NULL;
 		rrd->payload = NULL;
 		return (err);
 	}
 	case DRR_WRITE_BYREF:
 	{
-		struct drr_write_byref *drrwbr =
-		    &rrd->header.drr_u.drr_write_byref;
-		return (receive_write_byref(rwa, drrwbr));
+		return (receive_write_byref(rwa, rrd));
 	}
 	case DRR_WRITE_EMBEDDED:
 	{
-		struct drr_write_embedded *drrwe =
-		    &rrd->header.drr_u.drr_write_embedded;
-		err = receive_write_embedded(rwa, drrwe, rrd->payload);
+		err = receive_write_embedded(rwa, rrd);
 		kmem_free(rrd->payload, rrd->payload_size);
 		rrd->payload = NULL;
 		return (err);
@@ -2729,38 +3291,267 @@ receive_process_record(struct receive_writer_arg *rwa,
 }
 
 /*
- * dmu_recv_stream's worker thread; pull records off the queue, and then call
- * receive_process_record  When we're done, signal the main thread and exit.
+ * Free a record that will not be applied, along with its payload.
+ */
+static void
+receive_discard_record(struct receive_record_arg *rrd)
+{
+	if (rrd->write_buf != NULL)
+		receive_free_write_bufs(rrd);
+	else if (rrd->payload != NULL)
+		kmem_free(rrd->payload, rrd->payload_size);
+	kmem_free(rrd, sizeof (*rrd));
+}
+
+/*
+ * rww_batch[0] is a DRR_WRITE record.  Add the DRR_WRITE records queued
+ * behind it to the batch, for as long as they write to the same object
+ * within zfs_recv_write_batch_size bytes of the first one.  Only records
+ * that have already arrived are taken, so a batch never waits for more
+ * of the stream.  Return the size of the batch, and the record that ended
+ * it, if any, in *nextp.
+ */
+static int
+receive_write_batch(struct receive_writer_worker *w,
+    struct receive_record_arg **nextp)
+{
+	struct drr_write *first = &w->rww_batch[0]->header.drr_u.drr_write;
+	int n = 1;
+
+	*nextp = NULL;
+	while (n < RECV_WRITE_BATCH_MAX && !bqueue_empty(&w->rww_q)) {
+		struct receive_record_arg *rrd = bqueue_dequeue(&w->rww_q);
+		struct drr_write *drrw = &rrd->header.drr_u.drr_write;
+
+		if (rrd->eos_marker || rrd->header.drr_type != DRR_WRITE ||
+		    drrw->drr_object != first->drr_object ||
+		    drrw->drr_offset < first->drr_offset ||
+		    drrw->drr_offset + drrw->drr_length < drrw->drr_offset ||
+		    drrw->drr_offset + drrw->drr_length - first->drr_offset >
+		    zfs_recv_write_batch_size) {
+			*nextp = rrd;
+			break;
+		}
+		w->rww_batch[n++] = rrd;
+	}
+	return (n);
+}
+
+/*
+ * Pull records off a worker's queue and apply them.  Consecutive writes to
+ * an object are applied in one transaction.  A worker keeps draining its
+ * queue after an error so that the dispatcher never blocks.
+ */
+static void
+receive_writer_worker_thread(void *arg)
+{
+	struct receive_writer_worker *w = arg;
+	struct receive_writer_arg *rwa = w->rww_rwa;
+	struct receive_record_arg *rrd, *next;
+
+	for (rrd = bqueue_dequeue(&w->rww_q); !rrd->eos_marker; rrd = next) {
+		uint64_t seq;
+		int err = EINTR;
+		int i, n = 1;
+
+		next = NULL;
+		w->rww_batch[0] = rrd;
+		if (rwa->err == 0 && rrd->header.drr_type == DRR_WRITE) {
+			n = receive_write_batch(w, &next);
+			err = receive_write(rwa, w->rww_batch, n);
+		} else if (rwa->err == 0) {
+			err = receive_process_record(rwa, rrd);
+		}
+		seq = w->rww_batch[n - 1]->seq;
+		for (i = 0; i < n; i++)
+			receive_discard_record(w->rww_batch[i]);
+
+		mutex_enter(&rwa->mutex);
+		if (err == 0)
+			w->rww_done = seq;
+		else if (rwa->err == 0)
+			rwa->err = err;
+		rwa->pending -= n;
+		if (rwa->pending == 0)
+			cv_broadcast(&rwa->worker_cv);
+		mutex_exit(&rwa->mutex);
+
+		if (next == NULL)
+			next = bqueue_dequeue(&w->rww_q);
+	}
+	kmem_free(rrd, sizeof (*rrd));
+
+	mutex_enter(&rwa->mutex);
+	rwa->running--;
+	cv_broadcast(&rwa->worker_cv);
+	mutex_exit(&rwa->mutex);
+	thread_exit();
+}
+
+/*
+ * Wait until every record handed to the workers has been applied.
+ */
+static void
+receive_writer_drain(struct receive_writer_arg *rwa)
+{
+	mutex_enter(&rwa->mutex);
+	while (rwa->pending != 0)
+		cv_wait(&rwa->worker_cv, &rwa->mutex);
+	mutex_exit(&rwa->mutex);
+}
+
+/*
+ * Hand a record to the worker that owns its object.  Records that may
+ * touch several objects, or another object's data, are applied on their
+ * own once all earlier records are done.
+ */
+static int
+receive_writer_dispatch(struct receive_writer_arg *rwa,
+    struct receive_record_arg *rrd)
+{
+	struct receive_writer_worker *w;
+	boolean_t barrier = B_FALSE;
+	uint64_t object = 0;
+
+	/* Dispatching in order, therefore bytes_read should be increasing. */
+	ASSERT3U(rrd->bytes_read, >=, rwa->bytes_read);
+	rwa->bytes_read = rrd->bytes_read;
+
+	switch (rrd->header.drr_type) {
+	case DRR_OBJECT:
+		object = rrd->header.drr_u.drr_object.drr_object;
+		break;
+	case DRR_WRITE:
+	{
+		struct drr_write *drrw = &rrd->header.drr_u.drr_write;
+
+		/*
+		 * For resuming to work, records must be in increasing order
+		 * by (object, offset).
+		 */
+		if (drrw->drr_object < rwa->last_object ||
+		    (drrw->drr_object == rwa->last_object &&
+		    drrw->drr_offset < rwa->last_offset)) {
+			return (SET_ERROR(EINVAL));
+		}
+		rwa->last_object = drrw->drr_object;
+		rwa->last_offset = drrw->drr_offset;
+		object = drrw->drr_object;
+		break;
+	}
+	case DRR_WRITE_EMBEDDED:
+		object = rrd->header.drr_u.drr_write_embedded.drr_object;
+		break;
+	case DRR_FREE:
+		object = rrd->header.drr_u.drr_free.drr_object;
+		break;
+	case DRR_SPILL:
+		object = rrd->header.drr_u.drr_spill.drr_object;
+		break;
+	default:
+		/* DRR_FREEOBJECTS, DRR_WRITE_BYREF */
+		barrier = (rwa->nworkers > 1);
+		break;
+	}
+
+	if (barrier)
+		receive_writer_drain(rwa);
+	w = &rwa->workers[(object * 0x9e3779b97f4a7c15ULL >> 32) %
+	    rwa->nworkers];
+
+	mutex_enter(&rwa->mutex);
+	rrd->seq = ++rwa->seq;
+	rrd->worker = w;
+	/* All of an idle worker's records come before this one. */
+	if (w->rww_dispatched == w->rww_done)
+		w->rww_done = rrd->seq - 1;
+	w->rww_dispatched = rrd->seq;
+	rwa->pending++;
+	mutex_exit(&rwa->mutex);
+
+	bqueue_enqueue(&w->rww_q, rrd,
+	    sizeof (struct receive_record_arg) + rrd->payload_size);
+	if (barrier)
+		receive_writer_drain(rwa);
+	return (0);
+}
+
+/*
+ * dmu_recv_stream's writer thread; pull records off the queue, and hand them
+ * to the worker threads that apply them.  When we're done, signal the main
+ * thread and exit.
  */
 static void
 receive_writer_thread(void *arg)
 {
 	struct receive_writer_arg *rwa = arg;
 	struct receive_record_arg *rrd;
+	uint64_t qlen;
+	int i;
+
+	rwa->nworkers = MAX(zfs_recv_writer_threads, 1);
+	rwa->workers = kmem_zalloc(rwa->nworkers *
+	    sizeof (struct receive_writer_worker), KM_SLEEP);
+	qlen = MAX(zfs_recv_queue_length / rwa->nworkers,
+	    sizeof (struct receive_record_arg) + SPA_MAXBLOCKSIZE);
+	cv_init(&rwa->worker_cv, NULL, CV_DEFAULT, NULL);
+	for (i = 0; i < rwa->nworkers; i++) {
+		struct receive_writer_worker *w = &rwa->workers[i];
+
+		w->rww_rwa = rwa;
+		(void) bqueue_init(&w->rww_q, qlen,
+		    offsetof(struct receive_record_arg, node));
+		rwa->running++;
+		(void) thread_create(NULL, 0, receive_writer_worker_thread,
+		    w, 0, curproc, TS_RUN, minclsyspri);
+	}
+
 	for (rrd = bqueue_dequeue(&rwa->q); !rrd->eos_marker;
 	    rrd = bqueue_dequeue(&rwa->q)) {
+		int err;
+
 		/*
 		 * If there's an error, the main thread will stop putting things
 		 * on the queue, but we need to clear everything in it before we
 		 * can exit.
 		 */
-		if (rwa->err == 0) {
-			rwa->err = receive_process_record(rwa, rrd);
-		} else if (rrd->write_buf != NULL) {
-			dmu_return_arcbuf(rrd->write_buf);
-			rrd->write_buf = NULL;
-			rrd->payload = NULL;
-		} else if (rrd->payload != NULL) {
-			kmem_free(rrd->payload, rrd->payload_size);
-			rrd->payload = NULL;
+		if (rwa->err != 0) {
+			receive_discard_record(rrd);
+			continue;
+		}
+		err = receive_writer_dispatch(rwa, rrd);
+		if (err != 0) {
+			receive_discard_record(rrd);
+			mutex_enter(&rwa->mutex);
+			if (rwa->err == 0)
+				rwa->err = err;
+			mutex_exit(&rwa->mutex);
 		}
-		kmem_free(rrd, sizeof (*rrd));
 	}
 	kmem_free(rrd, sizeof (*rrd));
+
+	for (i = 0; i < rwa->nworkers; i++) {
+		rrd = kmem_zalloc(sizeof (*rrd), KM_SLEEP);
+		rrd->eos_marker = B_TRUE;
+		bqueue_enqueue(&rwa->workers[i].rww_q, rrd, 1);
+	}
+	mutex_enter(&rwa->mutex);
+	while (rwa->running != 0)
+		cv_wait(&rwa->worker_cv, &rwa->mutex);
+	mutex_exit(&rwa->mutex);
+	ASSERT0(rwa->pending);
+	for (i = 0; i < rwa->nworkers; i++)
+		bqueue_destroy(&rwa->workers[i].rww_q);
+	cv_destroy(&rwa->worker_cv);
+	kmem_free(rwa->workers, rwa->nworkers *
+	    sizeof (struct receive_writer_worker));
+	rwa->workers = NULL;
+
 	mutex_enter(&rwa->mutex);
 	rwa->done = B_TRUE;
 	cv_signal(&rwa->cv);
 	mutex_exit(&rwa->mutex);
+	thread_exit();
 }
 
 static int
@@ -2790,14 +3581,16 @@ resume_check(struct receive_arg *ra, nvlist_t *begin_nvl)
 }
 
 /*
- * Read in the stream's records, one by one, and apply them to the pool.  There
- * are two threads involved; the thread that calls this function will spin up a
- * worker thread, read the records off the stream one by one, and issue
- * prefetches for any necessary indirect blocks.  It will then push the records
- * onto an internal blocking queue.  The worker thread will pull the records off
- * the queue, and actually write the data into the DMU.  This way, the worker
- * thread doesn't have to wait for reads to complete, since everything it needs
- * (the indirect blocks) will be prefetched.
+ * Read in the stream's records, one by one, and apply them to the pool.  The
+ * thread that calls this function will spin up a writer thread, read the
+ * records off the stream one by one, and issue prefetches for any necessary
+ * indirect blocks.  It will then push the records onto an internal blocking
+ * queue.  The writer thread will pull the records off the queue and hand each
+ * one to one of zfs_recv_writer_threads worker threads, chosen by object
+ * number, which actually write the data into the DMU.  This way, the workers
+ * don't have to wait for reads to complete, since everything they need (the
+ * indirect blocks) will be prefetched, and records for different objects are
+ * applied concurrently.
  *
  * NB: callers *must* call dmu_recv_end() if this succeeds.
  */
@@ -3060,6 +3853,13 @@ dmu_recv_end_sync(void *arg, dmu_tx_t *tx)
 {
 	dmu_recv_cookie_t *drc = arg;
 	dsl_pool_t *dp = dmu_tx_pool(tx);
+	/*
+	 * The snapshot received from a partial stream differs from the one
+	 * that was sent, so it keeps its own guid: no later incremental
+	 * stream from the sent snapshot may be applied to it.
+	 */
+	boolean_t partial = !!(DMU_GET_FEATUREFLAGS(
+	    drc->drc_drrb->drr_versioninfo) & DMU_BACKUP_FEATURE_PARTIAL);
 
 	spa_history_log_internal_ds(drc->drc_ds, "finish receiving",
 	    tx, "snap=%s", drc->drc_tosnap);
@@ -3102,8 +3902,10 @@ dmu_recv_end_sync(void *arg, dmu_tx_t *tx)
 		dmu_buf_will_dirty(origin_head->ds_prev->ds_dbuf, tx);
 		dsl_dataset_phys(origin_head->ds_prev)->ds_creation_time =
 		    drc->drc_drrb->drr_creation_time;
-		dsl_dataset_phys(origin_head->ds_prev)->ds_guid =
-		    drc->drc_drrb->drr_toguid;
+		if (!partial) {
+			dsl_dataset_phys(origin_head->ds_prev)->ds_guid =
+			    drc->drc_drrb->drr_toguid;
+		}
 		dsl_dataset_phys(origin_head->ds_prev)->ds_flags &=
 		    ~DS_FLAG_INCONSISTENT;
 
@@ -3125,8 +3927,10 @@ dmu_recv_end_sync(void *arg, dmu_tx_t *tx)
 		dmu_buf_will_dirty(ds->ds_prev->ds_dbuf, tx);
 		dsl_dataset_phys(ds->ds_prev)->ds_creation_time =
 		    drc->drc_drrb->drr_creation_time;
-		dsl_dataset_phys(ds->ds_prev)->ds_guid =
-		    drc->drc_drrb->drr_toguid;
+		if (!partial) {
+			dsl_dataset_phys(ds->ds_prev)->ds_guid =
+			    drc->drc_drrb->drr_toguid;
+		}
 		dsl_dataset_phys(ds->ds_prev)->ds_flags &=
 		    ~DS_FLAG_INCONSISTENT;
 
@@ -3145,6 +3949,10 @@ dmu_recv_end_sync(void *arg, dmu_tx_t *tx)
 			    DS_FIELD_RESUME_TOGUID, tx);
 			(void) zap_remove(dp->dp_meta_objset, ds->ds_object,
 			    DS_FIELD_RESUME_TONAME, tx);
+			(void) zap_remove(dp->dp_meta_objset, ds->ds_object,
+			    DS_FIELD_RESUME_EMBEDOK, tx);
+			(void) zap_remove(dp->dp_meta_objset, ds->ds_object,
+			    DS_FIELD_RESUME_COMPRESSOK, tx);
 		}
 	}
 	drc->drc_newsnapobj = dsl_dataset_phys(drc->drc_ds)->ds_prev_snap_obj;
@@ -3255,4 +4063,12 @@ dmu_objset_is_receiving(objset_t *os)
 #if defined(_KERNEL)
 module_param(zfs_send_corrupt_data, int, 0644);
 MODULE_PARM_DESC(zfs_send_corrupt_data, "Allow sending corrupt data");
+
+module_param(zfs_recv_writer_threads, int, 0644);
+MODULE_PARM_DESC(zfs_recv_writer_threads,
+	"Number of threads applying the records of a receive stream");
+
+module_param(zfs_recv_write_batch_size, int, 0644);
+MODULE_PARM_DESC(zfs_recv_write_batch_size,
+	"Max bytes of an object written per receive transaction");
 #endif
@@ -176,7 +176,7 @@ resume_skip_check(traverse_data_t *td, const dnode_phys_t *dnp,
 }
 
 static void
-traverse_prefetch_metadata(traverse_data_t *td,
+traverse_prefetch_metadata(traverse_data_t *td, const dnode_phys_t *dnp,
     const blkptr_t *bp, const zbookmark_phys_t *zb)
 {
 	arc_flags_t flags = ARC_FLAG_NOWAIT | ARC_FLAG_PREFETCH;
@@ -184,11 +184,17 @@ traverse_prefetch_metadata(traverse_data_t *td,
 	if (!(td->td_flags & TRAVERSE_PREFETCH_METADATA))
 		return;
 	/*
-	 * If we are in the process of resuming, don't prefetch, because
-	 * some children will not be needed (and in fact may have already
-	 * been freed).
+	 * If we are in the process of resuming, don't prefetch the children
+	 * that were visited before we paused, because they will not be
+	 * needed (and in fact may have already been freed).  The children
+	 * after the resume point are still ahead of us; prefetching them
+	 * keeps a resumed traversal, such as an async destroy picking up
+	 * where the previous txg left off, from reading each of the
+	 * remaining indirect blocks synchronously.
 	 */
-	if (td->td_resume != NULL && !ZB_IS_ZERO(td->td_resume))
+	if (td->td_resume != NULL && !ZB_IS_ZERO(td->td_resume) &&
+	    (zb->zb_blkid == DMU_SPILL_BLKID ||
+	    zbookmark_subtree_completed(dnp, zb, td->td_resume)))
 		return;
 	if (BP_IS_HOLE(bp) || bp->blk_birth <= td->td_min_txg)
 		return;
@@ -303,7 +309,7 @@ traverse_visitbp(traverse_data_t *td, const dnode_phys_t *dnp,
 			SET_BOOKMARK(czb, zb->zb_objset, zb->zb_object,
 			    zb->zb_level - 1,
 			    zb->zb_blkid * epb + i);
-			traverse_prefetch_metadata(td,
+			traverse_prefetch_metadata(td, dnp,
 			    &((blkptr_t *)buf->b_data)[i], czb);
 		}
 
@@ -436,12 +442,13 @@ prefetch_dnode_metadata(traverse_data_t *td, const dnode_phys_t *dnp,
 
 	for (j = 0; j < dnp->dn_nblkptr; j++) {
 		SET_BOOKMARK(&czb, objset, object, dnp->dn_nlevels - 1, j);
-		traverse_prefetch_metadata(td, &dnp->dn_blkptr[j], &czb);
+		traverse_prefetch_metadata(td, dnp, &dnp->dn_blkptr[j], &czb);
 	}
 
 	if (dnp->dn_flags & DNODE_FLAG_SPILL_BLKPTR) {
 		SET_BOOKMARK(&czb, objset, object, 0, DMU_SPILL_BLKID);
-		traverse_prefetch_metadata(td, DN_SPILL_BLKPTR(dnp), &czb);
+		traverse_prefetch_metadata(td, dnp, DN_SPILL_BLKPTR(dnp),
+		    &czb);
 	}
 }
 
@@ -126,7 +126,12 @@ free_blocks(dnode_t *dn, blkptr_t *bp, int num, dmu_tx_t *tx)
 		if (BP_IS_HOLE(bp))
 			continue;
 
-		bytesfreed += dsl_dataset_block_kill(ds, bp, tx, B_FALSE);
+		/*
+		 * Dnodes of the same dataset are synced concurrently from
+		 * dp_sync_taskq, so defer any deadlist insert to the
+		 * pending deadlist like a write done callback does.
+		 */
+		bytesfreed += dsl_dataset_block_kill(ds, bp, tx, B_TRUE);
 		ASSERT3U(bytesfreed, <=, DN_USED_BYTES(dn->dn_phys));
 
 		/*
@@ -686,7 +691,7 @@ dnode_sync(dnode_t *dn, dmu_tx_t *tx)
 	}
 
 	if (freeing_dnode) {
-		dn->dn_objset->os_freed_dnodes++;
+		atomic_inc_64(&dn->dn_objset->os_freed_dnodes);
 		dnode_sync_free(dn, tx);
 		return;
 	}
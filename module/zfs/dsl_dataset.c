@@ -191,10 +191,12 @@ dsl_dataset_block_kill(dsl_dataset_t *ds, const blkptr_t *bp, dmu_tx_t *tx,
 		if (async) {
 			/*
 			 * We are here as part of zio's write done callback,
-			 * which means we're a zio interrupt thread.  We can't
-			 * call dsl_deadlist_insert() now because it may block
-			 * waiting for I/O.  Instead, put bp on the deferred
-			 * queue and let dsl_pool_sync() finish the job.
+			 * which means we're a zio interrupt thread, or we are
+			 * syncing one of several dnodes of this dataset in
+			 * parallel.  We can't call dsl_deadlist_insert() now
+			 * because it may block waiting for I/O and is not
+			 * safe to call concurrently.  Instead, put bp on the
+			 * deferred queue and let dsl_pool_sync() finish the job.
 			 */
 			bplist_append(&ds->ds_pending_deadlist, bp);
 		} else {
@@ -1763,6 +1765,10 @@ get_receive_resume_stats(dsl_dataset_t *ds, nvlist_t *nv)
 		    DS_FIELD_RESUME_EMBEDOK) == 0) {
 			fnvlist_add_boolean(token_nv, "embedok");
 		}
+		if (zap_contains(dp->dp_meta_objset, ds->ds_object,
+		    DS_FIELD_RESUME_COMPRESSOK) == 0) {
+			fnvlist_add_boolean(token_nv, "compressok");
+		}
 		packed = fnvlist_pack(token_nv, &packed_size);
 		fnvlist_free(token_nv);
 		compressed = kmem_alloc(packed_size, KM_SLEEP);
@@ -128,6 +128,12 @@ int zfs_delay_min_dirty_percent = 60;
  */
 unsigned long zfs_delay_scale = 1000 * 1000 * 1000 / 2000;
 
+/*
+ * Number of threads, as a percentage of CPUs, used to sync the dirty
+ * dnodes of each objset in parallel during spa_sync().
+ */
+int zfs_sync_taskq_batch_pct = 75;
+
 hrtime_t zfs_throttle_delay = MSEC2NSEC(10);
 hrtime_t zfs_throttle_resolution = MSEC2NSEC(10);
 
@@ -166,12 +172,18 @@ dsl_pool_open_impl(spa_t *spa, uint64_t txg)
 	    offsetof(dsl_dir_t, dd_dirty_link));
 	txg_list_create(&dp->dp_sync_tasks,
 	    offsetof(dsl_sync_task_t, dst_node));
+	list_create(&dp->dp_synced_datasets, sizeof (dsl_dataset_t),
+	    offsetof(dsl_dataset_t, ds_synced_link));
 
 	mutex_init(&dp->dp_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&dp->dp_spaceavail_cv, NULL, CV_DEFAULT, NULL);
 
 	dp->dp_iput_taskq = taskq_create("z_iput", max_ncpus, defclsyspri,
 	    max_ncpus * 8, INT_MAX, TASKQ_PREPOPULATE | TASKQ_DYNAMIC);
+	dp->dp_early_sync_taskq = taskq_create("z_early_sync", 1,
+	    defclsyspri, 1, 1, 0);
+	dp->dp_sync_taskq = taskq_create("z_sync", zfs_sync_taskq_batch_pct,
+	    defclsyspri, 1, INT_MAX, TASKQ_THREADS_CPU_PCT);
 
 	return (dp);
 }
@@ -324,6 +336,7 @@ dsl_pool_close(dsl_pool_t *dp)
 	txg_list_destroy(&dp->dp_dirty_zilogs);
 	txg_list_destroy(&dp->dp_sync_tasks);
 	txg_list_destroy(&dp->dp_dirty_dirs);
+	list_destroy(&dp->dp_synced_datasets);
 
 	/*
 	 * We can't set retry to TRUE since we're explicitly specifying
@@ -340,6 +353,8 @@ dsl_pool_close(dsl_pool_t *dp)
 	rrw_destroy(&dp->dp_config_rwlock);
 	mutex_destroy(&dp->dp_lock);
 	taskq_destroy(dp->dp_iput_taskq);
+	taskq_destroy(dp->dp_early_sync_taskq);
+	taskq_destroy(dp->dp_sync_taskq);
 	if (dp->dp_blkstats)
 		vmem_free(dp->dp_blkstats, sizeof (zfs_all_blkstats_t));
 	kmem_free(dp, sizeof (dsl_pool_t));
@@ -467,24 +482,23 @@ dsl_pool_dirty_delta(dsl_pool_t *dp, int64_t delta)
 		cv_signal(&dp->dp_spaceavail_cv);
 }
 
+/*
+ * Write out the dirty blocks of every dirty dataset in the given txg and
+ * move the datasets onto dp_synced_datasets, where dsl_pool_sync() picks
+ * them up for the user accounting updates and the final release.  This
+ * may be called ahead of dsl_pool_sync(), from dp_early_sync_taskq, once
+ * the txg has quiesced.
+ */
 void
-dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
+dsl_pool_sync_datasets(dsl_pool_t *dp, uint64_t txg)
 {
 	zio_t *zio;
 	dmu_tx_t *tx;
-	dsl_dir_t *dd;
 	dsl_dataset_t *ds;
-	objset_t *mos = dp->dp_meta_objset;
-	list_t synced_datasets;
 
-	list_create(&synced_datasets, sizeof (dsl_dataset_t),
-	    offsetof(dsl_dataset_t, ds_synced_link));
+	ASSERT(dsl_pool_sync_context(dp));
 
 	tx = dmu_tx_create_assigned(dp, txg);
-
-	/*
-	 * Write out all dirty blocks of dirty datasets.
-	 */
 	zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
 	while ((ds = txg_list_remove(&dp->dp_dirty_datasets, txg)) != NULL) {
 		/*
@@ -493,10 +507,31 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 		 * may sync newly-created datasets on pass 2.
 		 */
 		ASSERT(!list_link_active(&ds->ds_synced_link));
-		list_insert_tail(&synced_datasets, ds);
+		list_insert_tail(&dp->dp_synced_datasets, ds);
 		dsl_dataset_sync(ds, zio, tx);
 	}
 	VERIFY0(zio_wait(zio));
+	dmu_tx_commit(tx);
+}
+
+void
+dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
+{
+	zio_t *zio;
+	dmu_tx_t *tx;
+	dsl_dir_t *dd;
+	dsl_dataset_t *ds;
+	objset_t *mos = dp->dp_meta_objset;
+	list_t *synced_datasets = &dp->dp_synced_datasets;
+
+	/*
+	 * Write out all dirty blocks of dirty datasets.  On the first
+	 * pass some or all of them may already have been written out
+	 * while the previous txg was committing (see spa_sync()).
+	 */
+	dsl_pool_sync_datasets(dp, txg);
+
+	tx = dmu_tx_create_assigned(dp, txg);
 
 	/*
 	 * We have written all of the accounted dirty data, so our
@@ -511,8 +546,8 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	 * After the data blocks have been written (ensured by the zio_wait()
 	 * above), update the user/group space accounting.
 	 */
-	for (ds = list_head(&synced_datasets); ds != NULL;
-	    ds = list_next(&synced_datasets, ds)) {
+	for (ds = list_head(synced_datasets); ds != NULL;
+	    ds = list_next(synced_datasets, ds)) {
 		dmu_objset_do_userquota_updates(ds->ds_objset, tx);
 	}
 
@@ -538,7 +573,7 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	 *  - move dead blocks from the pending deadlist to the on-disk deadlist
 	 *  - release hold from dsl_dataset_dirty()
 	 */
-	while ((ds = list_remove_head(&synced_datasets)) != NULL) {
+	while ((ds = list_remove_head(synced_datasets)) != NULL) {
 		ASSERTV(objset_t *os = ds->ds_objset);
 		bplist_iterate(&ds->ds_pending_deadlist,
 		    deadlist_enqueue_cb, &ds->ds_deadlist, tx);
@@ -566,8 +601,7 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 		dp->dp_mos_uncompressed_delta = 0;
 	}
 
-	if (list_head(&mos->os_dirty_dnodes[txg & TXG_MASK]) != NULL ||
-	    list_head(&mos->os_free_dnodes[txg & TXG_MASK]) != NULL) {
+	if (!multilist_is_empty(&mos->os_dirty_dnodes[txg & TXG_MASK])) {
 		dsl_pool_sync_mos(dp, tx);
 	}
 
@@ -611,13 +645,16 @@ dsl_pool_sync_done(dsl_pool_t *dp, uint64_t txg)
 }
 
 /*
- * TRUE if the current thread is the tx_sync_thread or if we
- * are being called from SPA context during pool initialization.
+ * TRUE if the current thread is the tx_sync_thread, is writing out the
+ * next txg's datasets or syncing dnodes on its behalf, or if we are being
+ * called from SPA context during pool initialization.
  */
 int
 dsl_pool_sync_context(dsl_pool_t *dp)
 {
 	return (curthread == dp->dp_tx.tx_sync_thread ||
+	    taskq_member(dp->dp_early_sync_taskq, curthread) ||
+	    taskq_member(dp->dp_sync_taskq, curthread) ||
 	    spa_is_initializing(dp->dp_spa));
 }
 
@@ -1112,4 +1149,9 @@ MODULE_PARM_DESC(zfs_dirty_data_sync, "sync txg when this much dirty data");
 
 module_param(zfs_delay_scale, ulong, 0644);
 MODULE_PARM_DESC(zfs_delay_scale, "how quickly delay approaches infinity");
+
+/* zfs_sync_taskq_batch_pct only applied at pool import. */
+module_param(zfs_sync_taskq_batch_pct, int, 0644);
+MODULE_PARM_DESC(zfs_sync_taskq_batch_pct,
+	"max percent of CPUs that are used to sync dirty dnodes");
 #endif
@@ -73,6 +73,8 @@ enum ddt_class zfs_scrub_ddt_class_max = DDT_CLASS_DUPLICATE;
 int dsl_scan_delay_completion = B_FALSE; /* set to delay scan completion */
 /* max number of blocks to free in a single TXG */
 ulong zfs_free_max_blocks = 100000;
+/* target spa_sync() time while freeing, 0 to disable adaptation */
+int zfs_free_sync_target_ms = 2000;
 
 #define	DSL_SCAN_IS_SCRUB_RESILVER(scn) \
 	((scn)->scn_phys.scn_func == POOL_SCAN_SCRUB || \
@@ -279,6 +281,12 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 	scn->scn_phys.scn_queue_obj = zap_create(dp->dp_meta_objset,
 	    ot ? ot : DMU_OT_SCAN_QUEUE, DMU_OT_NONE, 0, tx);
 
+	/*
+	 * The DDT is walked class by class, which the DDT logs aren't
+	 * ordered by; write them out now and don't log during the scan.
+	 */
+	ddt_log_flush_all(spa, tx);
+
 	dsl_scan_sync_state(scn, tx);
 
 	spa_history_log_internal(spa, "scan setup", tx,
@@ -1306,6 +1314,7 @@ dsl_scan_ddt(dsl_scan_t *scn, dmu_tx_t *tx)
 
 	while ((error = ddt_walk(scn->scn_dp->dp_spa, ddb, &dde)) == 0) {
 		ddt_t *ddt;
+		int s;
 
 		if (ddb->ddb_class > scn->scn_phys.scn_ddt_class_max)
 			break;
@@ -1317,7 +1326,8 @@ dsl_scan_ddt(dsl_scan_t *scn, dmu_tx_t *tx)
 
 		/* There should be no pending changes to the dedup table */
 		ddt = scn->scn_dp->dp_spa->spa_ddt[ddb->ddb_checksum];
-		ASSERT(avl_first(&ddt->ddt_tree) == NULL);
+		for (s = 0; s < DDT_SHARDS; s++)
+			ASSERT(avl_first(&ddt->ddt_shard[s].dds_tree) == NULL);
 
 		dsl_scan_ddt_entry(scn, ddb->ddb_checksum, &dde, tx);
 		n++;
@@ -1460,7 +1470,7 @@ dsl_scan_free_should_pause(dsl_scan_t *scn)
 	if (zfs_recover)
 		return (B_FALSE);
 
-	if (scn->scn_visited_this_txg >= zfs_free_max_blocks)
+	if (scn->scn_visited_this_txg >= scn->scn_free_max_blocks)
 		return (B_TRUE);
 
 	elapsed_nanosecs = gethrtime() - scn->scn_sync_start_time;
@@ -1470,10 +1480,43 @@ dsl_scan_free_should_pause(dsl_scan_t *scn)
 	    spa_shutting_down(scn->scn_dp->dp_spa));
 }
 
+/*
+ * Pick the number of blocks that may be freed in this txg.  Freeing
+ * competes with the rest of spa_sync() for the vdevs (reading indirect
+ * blocks, loading and writing space maps, updating the DDT), so if the
+ * last txg took longer than zfs_free_sync_target_ms to sync, halve the
+ * budget; if it synced in under half that time, grow the budget back
+ * towards zfs_free_max_blocks.  The budget never drops below 1/16th of
+ * zfs_free_max_blocks, so that a busy pool still makes progress.
+ */
+static void
+dsl_scan_free_budget(dsl_scan_t *scn)
+{
+	spa_t *spa = scn->scn_dp->dp_spa;
+	uint64_t max_blocks = zfs_free_max_blocks;
+	uint64_t step = MAX(max_blocks / 16, 1);
+	uint64_t budget = scn->scn_free_max_blocks;
+	hrtime_t target = MSEC2NSEC(zfs_free_sync_target_ms);
+
+	if (zfs_free_sync_target_ms <= 0 || budget == 0 ||
+	    budget > max_blocks) {
+		scn->scn_free_max_blocks = max_blocks;
+		return;
+	}
+
+	if (spa->spa_sync_time > target)
+		budget = MAX(budget / 2, step);
+	else if (spa->spa_sync_time < target / 2)
+		budget = MIN(budget + step, max_blocks);
+
+	scn->scn_free_max_blocks = budget;
+}
+
 static int
 dsl_scan_free_block_cb(void *arg, const blkptr_t *bp, dmu_tx_t *tx)
 {
 	dsl_scan_t *scn = arg;
+	uint64_t dsize;
 
 	if (!scn->scn_is_bptree ||
 	    (BP_GET_LEVEL(bp) == 0 && BP_GET_TYPE(bp) != DMU_OT_OBJSET)) {
@@ -1481,11 +1524,12 @@ dsl_scan_free_block_cb(void *arg, const blkptr_t *bp, dmu_tx_t *tx)
 			return (SET_ERROR(ERESTART));
 	}
 
+	dsize = bp_get_dsize_sync(scn->scn_dp->dp_spa, bp);
 	zio_nowait(zio_free_sync(scn->scn_zio_root, scn->scn_dp->dp_spa,
 	    dmu_tx_get_txg(tx), bp, 0));
 	dsl_dir_diduse_space(tx->tx_pool->dp_free_dir, DD_USED_HEAD,
-	    -bp_get_dsize_sync(scn->scn_dp->dp_spa, bp),
-	    -BP_GET_PSIZE(bp), -BP_GET_UCSIZE(bp), tx);
+	    -dsize, -BP_GET_PSIZE(bp), -BP_GET_UCSIZE(bp), tx);
+	scn->scn_freed_bytes += dsize;
 	scn->scn_visited_this_txg++;
 	return (0);
 }
@@ -1558,6 +1602,17 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	scn->scn_sync_start_time = gethrtime();
 	spa->spa_scrub_active = B_TRUE;
 
+	/*
+	 * Note when this round of freeing started, so that zpool status
+	 * can report the rate at which we are freeing.
+	 */
+	if (scn->scn_free_start_time == 0 && dp->dp_free_dir != NULL &&
+	    dsl_dir_phys(dp->dp_free_dir)->dd_used_bytes != 0) {
+		scn->scn_free_start_time = gethrestime_sec();
+		scn->scn_freed_bytes = 0;
+	}
+	dsl_scan_free_budget(scn);
+
 	/*
 	 * First process the async destroys.  If we pause, don't do
 	 * any scrubbing or resilvering.  This ensures that there are no
@@ -1670,6 +1725,8 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		ASSERT0(dsl_dir_phys(dp->dp_free_dir)->dd_used_bytes);
 		ASSERT0(dsl_dir_phys(dp->dp_free_dir)->dd_compressed_bytes);
 		ASSERT0(dsl_dir_phys(dp->dp_free_dir)->dd_uncompressed_bytes);
+		scn->scn_free_start_time = 0;
+		scn->scn_freed_bytes = 0;
 	}
 
 	if (scn->scn_phys.scn_state != DSS_SCANNING)
@@ -1991,6 +2048,10 @@ MODULE_PARM_DESC(zfs_no_scrub_prefetch, "Set to disable scrub prefetching");
 module_param(zfs_free_max_blocks, ulong, 0644);
 MODULE_PARM_DESC(zfs_free_max_blocks, "Max number of blocks freed in one txg");
 
+module_param(zfs_free_sync_target_ms, int, 0644);
+MODULE_PARM_DESC(zfs_free_sync_target_ms,
+	"Target txg sync time in millisecs while freeing");
+
 module_param(zfs_free_bpobj_enabled, int, 0644);
 MODULE_PARM_DESC(zfs_free_bpobj_enabled, "Enable processing of the free_bpobj");
 #endif
@@ -838,12 +838,14 @@ sa_attr_table_setup(objset_t *os, sa_attr_reg_t *reg_attrs, int count)
 	uint64_t sa_attr_count = 0;
 	uint64_t sa_reg_count = 0;
 	int error = 0;
-	uint64_t attr_value;
+	uint64_t *attr_values;
+	zap_batch_ent_t *zbe;
+	int nlookups = 0;
 	sa_attr_table_t *tb;
 	zap_cursor_t zc;
 	zap_attribute_t za;
 	int registered_count = 0;
-	int i;
+	int i, j;
 	dmu_objset_type_t ostype = dmu_objset_type(os);
 
 	sa->sa_user_table =
@@ -869,9 +871,10 @@ sa_attr_table_setup(objset_t *os, sa_attr_reg_t *reg_attrs, int count)
 		sa_attr_count += sa_legacy_attr_count;
 
 	/* Allocate attribute numbers for attributes that aren't registered */
+	zbe = kmem_zalloc(count * sizeof (zap_batch_ent_t), KM_SLEEP);
+	attr_values = kmem_zalloc(count * sizeof (uint64_t), KM_SLEEP);
 	for (i = 0; i != count; i++) {
 		boolean_t found = B_FALSE;
-		int j;
 
 		if (ostype == DMU_OST_ZFS) {
 			for (j = 0; j != sa_legacy_attr_count; j++) {
@@ -886,23 +889,38 @@ sa_attr_table_setup(objset_t *os, sa_attr_reg_t *reg_attrs, int count)
 		if (found)
 			continue;
 
-		if (sa->sa_reg_attr_obj)
-			error = zap_lookup(os, sa->sa_reg_attr_obj,
-			    reg_attrs[i].sa_name, 8, 1, &attr_value);
-		else
-			error = SET_ERROR(ENOENT);
-		switch (error) {
-		case ENOENT:
+		zbe[nlookups].zbe_key = reg_attrs[i].sa_name;
+		zbe[nlookups].zbe_integer_size = 8;
+		zbe[nlookups].zbe_num_integers = 1;
+		zbe[nlookups].zbe_val = &attr_values[nlookups];
+		zbe[nlookups].zbe_error = SET_ERROR(ENOENT);
+		nlookups++;
+	}
+
+	/* Look up all the remaining attributes with one pass over the zap */
+	if (sa->sa_reg_attr_obj && nlookups != 0)
+		(void) zap_lookup_batch(os, sa->sa_reg_attr_obj,
+		    zbe, nlookups);
+
+	for (i = 0, j = 0; i != count && j != nlookups; i++) {
+		if (zbe[j].zbe_key != reg_attrs[i].sa_name)
+			continue;
+
+		error = zbe[j].zbe_error;
+		if (error == ENOENT) {
 			sa->sa_user_table[i] = (sa_attr_type_t)sa_attr_count;
 			sa_attr_count++;
+		} else if (error == 0) {
+			sa->sa_user_table[i] = ATTR_NUM(attr_values[j]);
+		} else {
 			break;
-		case 0:
-			sa->sa_user_table[i] = ATTR_NUM(attr_value);
-			break;
-		default:
-			goto bail;
 		}
+		j++;
 	}
+	kmem_free(attr_values, count * sizeof (uint64_t));
+	kmem_free(zbe, count * sizeof (zap_batch_ent_t));
+	if (error != 0 && error != ENOENT)
+		goto bail;
 
 	sa->sa_num_attrs = sa_attr_count;
 	tb = sa->sa_attr_table =
@@ -1588,10 +1606,11 @@ sa_default_locator(void **dataptr, uint32_t *len, uint32_t total_len,
 static void
 sa_attr_register_sync(sa_handle_t *hdl, dmu_tx_t *tx)
 {
-	uint64_t attr_value = 0;
+	uint64_t *attr_values;
+	zap_batch_ent_t *zbe;
 	sa_os_t *sa = hdl->sa_os->os_sa;
 	sa_attr_table_t *tb = sa->sa_attr_table;
-	int i;
+	int i, n = 0;
 
 	mutex_enter(&sa->sa_lock);
 
@@ -1605,15 +1624,26 @@ sa_attr_register_sync(sa_handle_t *hdl, dmu_tx_t *tx)
 		    DMU_OT_SA_ATTR_REGISTRATION,
 		    sa->sa_master_obj, SA_REGISTRY, tx);
 	}
+
+	zbe = kmem_alloc(sa->sa_num_attrs * sizeof (zap_batch_ent_t), KM_SLEEP);
+	attr_values = kmem_zalloc(sa->sa_num_attrs * sizeof (uint64_t),
+	    KM_SLEEP);
 	for (i = 0; i != sa->sa_num_attrs; i++) {
 		if (sa->sa_attr_table[i].sa_registered)
 			continue;
-		ATTR_ENCODE(attr_value, tb[i].sa_attr, tb[i].sa_length,
+		ATTR_ENCODE(attr_values[n], tb[i].sa_attr, tb[i].sa_length,
 		    tb[i].sa_byteswap);
-		VERIFY(0 == zap_update(hdl->sa_os, sa->sa_reg_attr_obj,
-		    tb[i].sa_name, 8, 1, &attr_value, tx));
+		zbe[n].zbe_key = tb[i].sa_name;
+		zbe[n].zbe_integer_size = 8;
+		zbe[n].zbe_num_integers = 1;
+		zbe[n].zbe_val = &attr_values[n];
+		n++;
 		tb[i].sa_registered = B_TRUE;
 	}
+	VERIFY0(zap_update_batch(hdl->sa_os, sa->sa_reg_attr_obj,
+	    zbe, n, tx));
+	kmem_free(attr_values, sa->sa_num_attrs * sizeof (uint64_t));
+	kmem_free(zbe, sa->sa_num_attrs * sizeof (zap_batch_ent_t));
 	sa->sa_need_attr_registration = B_FALSE;
 	mutex_exit(&sa->sa_lock);
 }
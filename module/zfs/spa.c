@@ -45,6 +45,7 @@
 #include <sys/zap.h>
 #include <sys/zil.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/vdev_impl.h>
 #include <sys/vdev_disk.h>
 #include <sys/metaslab.h>
@@ -1350,6 +1351,7 @@ spa_unload(spa_t *spa)
 	}
 
 	ddt_unload(spa);
+	brt_unload(spa);
 
 
 	/*
@@ -2856,6 +2858,13 @@ spa_load_impl(spa_t *spa, uint64_t pool_guid, nvlist_t *config,
 	if (error != 0)
 		return (spa_vdev_err(rvd, VDEV_AUX_CORRUPT_DATA, EIO));
 
+	/*
+	 * Load the block reference table.
+	 */
+	error = brt_load(spa);
+	if (error != 0)
+		return (spa_vdev_err(rvd, VDEV_AUX_CORRUPT_DATA, EIO));
+
 	spa_update_dspace(spa);
 
 	/*
@@ -3872,6 +3881,7 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	 * Create DDTs (dedup tables).
 	 */
 	ddt_create(spa);
+	brt_create(spa);
 
 	spa_update_dspace(spa);
 
@@ -6604,6 +6614,40 @@ spa_sync_upgrades(spa_t *spa, dmu_tx_t *tx)
 	rrw_exit(&dp->dp_config_rwlock, FTAG);
 }
 
+/*
+ * Start writing out the next txg's dirty datasets while the current txg
+ * commits its labels and uberblock.
+ */
+int zfs_sync_overlap = 1;
+
+/*
+ * Write out the dirty datasets of spa_early_sync_txg.  This runs on
+ * dp_early_sync_taskq alongside the tail of spa_sync() for the previous
+ * txg, and takes over as the syncing txg: nothing left in that tail
+ * looks at spa_syncing_txg or spa_sync_pass.  Frees from the previous
+ * txgs only go back into circulation in metaslab_sync_done(), after their
+ * uberblock is on disk, so the blocks allocated here can not overwrite
+ * anything that the last synced uberblock still references.
+ */
+static void
+spa_sync_early(void *arg)
+{
+	spa_t *spa = arg;
+	uint64_t txg = spa->spa_early_sync_txg;
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+
+	spa->spa_syncing_txg = txg;
+	spa->spa_sync_pass = 1;
+
+	brt_pending_apply(spa, txg);
+	dsl_pool_sync_datasets(spa->spa_dsl_pool, txg);
+
+	spa->spa_sync_pass = 0;
+
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+}
+
 /*
  * Sync the specified transaction group.  New blocks may be dirtied as
  * part of the process, so we iterate until it converges.
@@ -6622,6 +6666,14 @@ spa_sync(spa_t *spa, uint64_t txg)
 
 	VERIFY(spa_writeable(spa));
 
+	/*
+	 * Wait for the datasets which spa_sync_early() may have started
+	 * writing out while the previous txg was committing.  This must
+	 * be done before we take SCL_CONFIG, which a pending writer would
+	 * otherwise keep spa_sync_early() from getting.
+	 */
+	taskq_wait(dp->dp_early_sync_taskq);
+
 	/*
 	 * Lock out configuration changes.
 	 */
@@ -6683,6 +6735,12 @@ spa_sync(spa_t *spa, uint64_t txg)
 		}
 	}
 
+	/*
+	 * Blocks cloned in this txg must be accounted for before any of
+	 * its frees are processed.
+	 */
+	brt_pending_apply(spa, txg);
+
 	/*
 	 * Iterate to convergence.
 	 */
@@ -6711,6 +6769,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 
 		ddt_sync(spa, txg);
 		dsl_scan_sync(dp, tx);
+		brt_sync(spa, txg);
 
 		while ((vd = txg_list_remove(&spa->spa_vdev_txg_list, txg)))
 			vdev_sync(vd, txg);
@@ -6766,6 +6825,25 @@ spa_sync(spa_t *spa, uint64_t txg)
 	}
 #endif
 
+	spa->spa_sync_pass = 0;
+
+	/*
+	 * All that is left for this txg is the label and uberblock update
+	 * and the cache flushes around it, which leave the devices mostly
+	 * idle.  If the next txg has already quiesced, start writing out
+	 * its dirty datasets in the meantime.  Pools with a pending version
+	 * upgrade are skipped, since the upgrade is applied in spa_sync()
+	 * before any dataset is written.
+	 */
+	if (zfs_sync_overlap &&
+	    spa->spa_ubsync.ub_version >= SPA_VERSION_FEATURES &&
+	    txg_quiesced(dp, txg + 1) &&
+	    !txg_list_empty(&dp->dp_dirty_datasets, txg + 1)) {
+		spa->spa_early_sync_txg = txg + 1;
+		(void) taskq_dispatch(dp->dp_early_sync_taskq,
+		    spa_sync_early, spa, TQ_SLEEP);
+	}
+
 	/*
 	 * Rewrite the vdev configuration (which includes the uberblock)
 	 * to commit the transaction group.
@@ -6853,12 +6931,12 @@ spa_sync(spa_t *spa, uint64_t txg)
 	ASSERT(txg_list_empty(&dp->dp_dirty_dirs, txg));
 	ASSERT(txg_list_empty(&spa->spa_vdev_txg_list, txg));
 
-	spa->spa_sync_pass = 0;
-
 	spa_config_exit(spa, SCL_CONFIG, FTAG);
 
 	spa_handle_ignored_writes(spa);
 
+	spa->spa_sync_time = gethrtime() - spa->spa_sync_starttime;
+
 	/*
 	 * If any async tasks have been requested, kick them off.
 	 */
@@ -7107,4 +7185,8 @@ module_param(zio_taskq_batch_pct, uint, 0444);
 MODULE_PARM_DESC(zio_taskq_batch_pct,
 	"Percentage of CPUs to run an IO worker thread");
 
+module_param(zfs_sync_overlap, int, 0644);
+MODULE_PARM_DESC(zfs_sync_overlap,
+	"Write the next txg's dirty data while the current txg commits");
+
 #endif
@@ -51,6 +51,7 @@
 #include <sys/metaslab_impl.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/kstat.h>
 #include "zfs_prop.h"
 #include "zfeature_common.h"
@@ -1618,7 +1619,7 @@ void
 spa_update_dspace(spa_t *spa)
 {
 	spa->spa_dspace = metaslab_class_get_dspace(spa_normal_class(spa)) +
-	    ddt_get_dedup_dspace(spa);
+	    ddt_get_dedup_dspace(spa) + brt_get_dspace(spa);
 }
 
 /*
@@ -1828,6 +1829,7 @@ spa_init(int mode)
 	unique_init();
 	range_tree_init();
 	ddt_init();
+	brt_init();
 	zio_init();
 	dmu_init();
 	zil_init();
@@ -1852,6 +1854,7 @@ spa_fini(void)
 	zil_fini();
 	dmu_fini();
 	zio_fini();
+	brt_fini();
 	ddt_fini();
 	range_tree_fini();
 	unique_fini();
@@ -1985,6 +1988,28 @@ spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps)
 	return (0);
 }
 
+/*
+ * Get background free stats for zpool status reports
+ */
+int
+spa_free_get_stats(spa_t *spa, pool_free_stat_t *pfs)
+{
+	dsl_pool_t *dp = spa->spa_dsl_pool;
+	dsl_scan_t *scn = dp ? dp->dp_scan : NULL;
+
+	if (scn == NULL || dp->dp_free_dir == NULL ||
+	    scn->scn_free_start_time == 0)
+		return (SET_ERROR(ENOENT));
+	bzero(pfs, sizeof (pool_free_stat_t));
+
+	pfs->pfs_start_time = scn->scn_free_start_time;
+	pfs->pfs_to_free = dsl_dir_phys(dp->dp_free_dir)->dd_used_bytes;
+	pfs->pfs_freed = scn->scn_freed_bytes;
+	pfs->pfs_txg_blocks = scn->scn_free_max_blocks;
+
+	return (0);
+}
+
 boolean_t
 spa_debug_enabled(spa_t *spa)
 {
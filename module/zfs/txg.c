@@ -747,6 +747,19 @@ txg_sync_waiting(dsl_pool_t *dp)
 	    tx->tx_quiesced_txg != 0);
 }
 
+boolean_t
+txg_quiesced(dsl_pool_t *dp, uint64_t txg)
+{
+	tx_state_t *tx = &dp->dp_tx;
+	boolean_t quiesced;
+
+	mutex_enter(&tx->tx_sync_lock);
+	quiesced = (tx->tx_quiesced_txg == txg);
+	mutex_exit(&tx->tx_sync_lock);
+
+	return (quiesced);
+}
+
 /*
  * Per-txg object lists.
  */
@@ -947,6 +960,7 @@ EXPORT_SYMBOL(txg_wait_open);
 EXPORT_SYMBOL(txg_wait_callbacks);
 EXPORT_SYMBOL(txg_stalled);
 EXPORT_SYMBOL(txg_sync_waiting);
+EXPORT_SYMBOL(txg_quiesced);
 
 module_param(zfs_txg_timeout, int, 0644);
 MODULE_PARM_DESC(zfs_txg_timeout, "Max seconds worth of delta per txg");
@@ -36,6 +36,17 @@
  * Virtual device vector for files.
  */
 
+/*
+ * Each file vdev services its reads and writes from a dedicated taskq
+ * rather than the shared system_taskq, so that one busy vdev (or any
+ * other system_taskq consumer) can't starve the others.  The taskq is
+ * dynamic and grows up to this many threads, bounded by the number of
+ * I/Os the vdev queue will ever issue concurrently.
+ */
+int zfs_vdev_file_threads = 16;
+
+extern uint32_t zfs_vdev_max_active;
+
 static void
 vdev_file_hold(vdev_t *vd)
 {
@@ -96,6 +107,9 @@ vdev_file_open(vdev_t *vd, uint64_t *psize, uint64_t *max_psize,
 	}
 
 	vf->vf_vnode = vp;
+	vf->vf_taskq = taskq_create("z_vdev_file",
+	    MAX(MIN(zfs_vdev_file_threads, (int)zfs_vdev_max_active), 1),
+	    minclsyspri, 1, INT_MAX, TASKQ_DYNAMIC);
 
 #ifdef _KERNEL
 	/*
@@ -132,6 +146,9 @@ vdev_file_close(vdev_t *vd)
 	if (vd->vdev_reopening || vf == NULL)
 		return;
 
+	if (vf->vf_taskq != NULL)
+		taskq_destroy(vf->vf_taskq);
+
 	if (vf->vf_vnode != NULL) {
 		(void) VOP_PUTPAGE(vf->vf_vnode, 0, 0, B_INVAL, kcred, NULL);
 		(void) VOP_CLOSE(vf->vf_vnode, spa_mode(vd->vdev_spa), 1, 0,
@@ -201,7 +218,7 @@ vdev_file_io_start(zio_t *zio)
 			 * the sync must be dispatched to a different context.
 			 */
 			if (spl_fstrans_check()) {
-				VERIFY3U(taskq_dispatch(system_taskq,
+				VERIFY3U(taskq_dispatch(vf->vf_taskq,
 				    vdev_file_io_fsync, zio, TQ_SLEEP), !=, 0);
 				return;
 			}
@@ -219,7 +236,7 @@ vdev_file_io_start(zio_t *zio)
 
 	zio->io_target_timestamp = zio_handle_io_delay(zio);
 
-	VERIFY3U(taskq_dispatch(system_taskq, vdev_file_io_strategy, zio,
+	VERIFY3U(taskq_dispatch(vf->vf_taskq, vdev_file_io_strategy, zio,
 	    TQ_SLEEP), !=, 0);
 }
 
@@ -261,3 +278,9 @@ vdev_ops_t vdev_disk_ops = {
 };
 
 #endif
+
+#if defined(_KERNEL) && defined(HAVE_SPL)
+module_param(zfs_vdev_file_threads, int, 0644);
+MODULE_PARM_DESC(zfs_vdev_file_threads,
+	"Max threads servicing I/O for each file vdev");
+#endif
@@ -449,6 +449,7 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 
 	if (getstats) {
 		pool_scan_stat_t ps;
+		pool_free_stat_t pfs;
 
 		vdev_config_generate_stats(vd, nv);
 
@@ -458,6 +459,14 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 			    ZPOOL_CONFIG_SCAN_STATS, (uint64_t *)&ps,
 			    sizeof (pool_scan_stat_t) / sizeof (uint64_t));
 		}
+
+		/* background frees are pool-wide; report them at the root */
+		if (vd == spa->spa_root_vdev &&
+		    spa_free_get_stats(spa, &pfs) == 0) {
+			fnvlist_add_uint64_array(nv,
+			    ZPOOL_CONFIG_FREE_STATS, (uint64_t *)&pfs,
+			    sizeof (pool_free_stat_t) / sizeof (uint64_t));
+		}
 	}
 
 	if (!vd->vdev_ops->vdev_op_leaf) {
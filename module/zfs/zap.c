@@ -691,7 +691,7 @@ zap_expand_leaf(zap_name_t *zn, zap_leaf_t *l, dmu_tx_t *tx, zap_leaf_t **lp)
 	return (0);
 }
 
-static void
+static int
 zap_put_leaf_maybe_grow_ptrtbl(zap_name_t *zn, zap_leaf_t *l, dmu_tx_t *tx)
 {
 	zap_t *zap = zn->zn_zap;
@@ -717,13 +717,14 @@ zap_put_leaf_maybe_grow_ptrtbl(zap_name_t *zn, zap_leaf_t *l, dmu_tx_t *tx)
 			    RW_WRITER, FALSE, FALSE, &zn->zn_zap);
 			zap = zn->zn_zap;
 			if (err)
-				return;
+				return (err);
 		}
 
 		/* could have finished growing while our locks were down */
 		if (zap_f_phys(zap)->zap_ptrtbl.zt_shift == shift)
 			(void) zap_grow_ptrtbl(zap, tx);
 	}
+	return (0);
 }
 
 static int
@@ -841,7 +842,7 @@ retry:
 
 out:
 	if (zap != NULL)
-		zap_put_leaf_maybe_grow_ptrtbl(zn, l, tx);
+		(void) zap_put_leaf_maybe_grow_ptrtbl(zn, l, tx);
 	return (err);
 }
 
@@ -897,7 +898,7 @@ retry:
 	}
 
 	if (zap != NULL)
-		zap_put_leaf_maybe_grow_ptrtbl(zn, l, tx);
+		(void) zap_put_leaf_maybe_grow_ptrtbl(zn, l, tx);
 	return (err);
 }
 
@@ -944,6 +945,147 @@ fzap_remove(zap_name_t *zn, dmu_tx_t *tx)
 	return (err);
 }
 
+/*
+ * Apply op to the n names, which must be sorted by hash.  Consecutive
+ * names that map to the same leaf are handled under a single hold of it.
+ * The result for each name is stored in its zbe_error.  A non-zero
+ * return means the zap could not be relocked while growing it; *zapp is
+ * then NULL and the remaining names have been failed with that error.
+ */
+int
+fzap_batch(zap_t **zapp, zap_batch_name_t *zbn, int n, zap_batch_op_t op,
+    dmu_tx_t *tx)
+{
+	zap_t *zap = *zapp;
+	zap_name_t *lzn = NULL;
+	zap_leaf_t *l = NULL;
+	krw_t lt = (op == ZAP_BATCH_LOOKUP) ? RW_READER : RW_WRITER;
+	int i, err = 0;
+
+	ASSERT(RW_LOCK_HELD(&zap->zap_rwlock));
+	ASSERT(!zap->zap_ismicro);
+
+	for (i = 0; i < n; i++) {
+		zap_name_t *zn = zbn[i].zbn_zn;
+		zap_batch_ent_t *zbe = zbn[i].zbn_ent;
+		zap_entry_handle_t zeh;
+		uint64_t idx, blk;
+		int e;
+
+		ASSERT(i == 0 || zbn[i - 1].zbn_zn->zn_hash <= zn->zn_hash);
+		zn->zn_zap = zap;
+
+		if (op == ZAP_BATCH_UPDATE) {
+			e = fzap_check(zn, zbe->zbe_integer_size,
+			    zbe->zbe_num_integers);
+		} else if (op == ZAP_BATCH_LOOKUP) {
+			e = fzap_checkname(zn);
+		} else {
+			e = 0;
+		}
+		if (e != 0) {
+			zbe->zbe_error = e;
+			continue;
+		}
+
+		/* Let go of the leaf we hold if this name lives elsewhere. */
+		if (l != NULL) {
+			idx = ZAP_HASH_IDX(zn->zn_hash,
+			    zap_f_phys(zap)->zap_ptrtbl.zt_shift);
+			if (zap_idx_to_blk(zap, idx, &blk) != 0 ||
+			    blk != l->l_blkid) {
+				if (op == ZAP_BATCH_UPDATE) {
+					err = zap_put_leaf_maybe_grow_ptrtbl(
+					    lzn, l, tx);
+					zap = zn->zn_zap = lzn->zn_zap;
+				} else {
+					zap_put_leaf(l);
+				}
+				l = NULL;
+				if (err != 0) {
+					zbe->zbe_error = err;
+					break;
+				}
+			}
+		}
+		if (l == NULL) {
+			e = zap_deref_leaf(zap, zn->zn_hash, tx, lt, &l);
+			if (e != 0) {
+				l = NULL;
+				zbe->zbe_error = e;
+				continue;
+			}
+			lzn = zn;
+		}
+
+retry:
+		e = zap_leaf_lookup(l, zn, &zeh);
+		switch (op) {
+		case ZAP_BATCH_LOOKUP:
+			if (e == 0) {
+				e = fzap_checksize(zbe->zbe_integer_size,
+				    zbe->zbe_num_integers);
+			}
+			if (e == 0) {
+				e = zap_entry_read(&zeh, zbe->zbe_integer_size,
+				    zbe->zbe_num_integers, zbe->zbe_val);
+			}
+			break;
+		case ZAP_BATCH_REMOVE:
+			if (e == 0) {
+				zap_entry_remove(&zeh);
+				zap_increment_num_entries(zap, -1, tx);
+			}
+			break;
+		case ZAP_BATCH_UPDATE:
+			ASSERT(e == 0 || e == ENOENT);
+			if (e == ENOENT) {
+				e = zap_entry_create(l, zn, ZAP_NEED_CD,
+				    zbe->zbe_integer_size,
+				    zbe->zbe_num_integers, zbe->zbe_val, &zeh);
+				if (e == 0)
+					zap_increment_num_entries(zap, 1, tx);
+			} else {
+				e = zap_entry_update(&zeh,
+				    zbe->zbe_integer_size,
+				    zbe->zbe_num_integers, zbe->zbe_val);
+			}
+			if (e == EAGAIN) {
+				/* zap_expand_leaf() may change zap */
+				e = zap_expand_leaf(zn, l, tx, &l);
+				zap = zn->zn_zap;
+				lzn = zn;
+				if (e == 0)
+					goto retry;
+				/* as in fzap_update() */
+				zbe->zbe_error = err = e;
+				if (zap != NULL) {
+					(void) zap_put_leaf_maybe_grow_ptrtbl(
+					    zn, l, tx);
+					zap = zn->zn_zap;
+				}
+				goto out;
+			}
+			break;
+		}
+		zbe->zbe_error = e;
+	}
+
+	if (l != NULL) {
+		if (op == ZAP_BATCH_UPDATE) {
+			err = zap_put_leaf_maybe_grow_ptrtbl(lzn, l, tx);
+			zap = lzn->zn_zap;
+		} else {
+			zap_put_leaf(l);
+		}
+	}
+out:
+	for (i++; err != 0 && i < n; i++)
+		zbn[i].zbn_ent->zbe_error = err;
+	*zapp = zap;
+	return (err);
+}
+
 void
 fzap_prefetch(zap_name_t *zn)
 {
@@ -32,12 +32,14 @@
 #include <sys/refcount.h>
 #include <sys/zap_impl.h>
 #include <sys/zap_leaf.h>
-#include <sys/avl.h>
 #include <sys/arc.h>
 #include <sys/dmu_objset.h>
 
 #ifdef _KERNEL
 #include <sys/sunddi.h>
+#include <util/qsort.h>
+#else
+#include <stdlib.h>
 #endif
 
 extern inline mzap_phys_t *zap_m_phys(zap_t *zap);
@@ -250,60 +252,99 @@ zap_byteswap(void *buf, size_t size)
 	}
 }
 
+/*
+ * Return the index of the first entry in zap_ents that sorts at or after
+ * the given hash and cd.
+ */
 static int
-mze_compare(const void *arg1, const void *arg2)
+mze_lower_bound(zap_t *zap, uint64_t hash, uint32_t cd)
 {
-	const mzap_ent_t *mze1 = arg1;
-	const mzap_ent_t *mze2 = arg2;
+	mzap_ent_t *ents = zap->zap_m.zap_ents;
+	int lo = 0;
+	int hi = zap->zap_m.zap_num_entries;
 
-	if (mze1->mze_hash > mze2->mze_hash)
-		return (+1);
-	if (mze1->mze_hash < mze2->mze_hash)
-		return (-1);
-	if (mze1->mze_cd > mze2->mze_cd)
-		return (+1);
-	if (mze1->mze_cd < mze2->mze_cd)
-		return (-1);
-	return (0);
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (ents[mid].mze_hash < hash ||
+		    (ents[mid].mze_hash == hash && ents[mid].mze_cd < cd))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+/*
+ * Size zap_ents to hold one entry per chunk of the micro zap.
+ */
+static void
+mze_resize(zap_t *zap, int nchunks)
+{
+	mzap_ent_t *ents;
+
+	ASSERT(zap->zap_ismicro);
+	ASSERT3S(nchunks, >=, zap->zap_m.zap_num_entries);
+
+	ents = kmem_alloc(nchunks * sizeof (mzap_ent_t), KM_SLEEP);
+	if (zap->zap_m.zap_ents != NULL) {
+		bcopy(zap->zap_m.zap_ents, ents,
+		    zap->zap_m.zap_num_entries * sizeof (mzap_ent_t));
+		kmem_free(zap->zap_m.zap_ents,
+		    zap->zap_m.zap_num_chunks * sizeof (mzap_ent_t));
+	}
+	zap->zap_m.zap_ents = ents;
+	zap->zap_m.zap_num_chunks = nchunks;
 }
 
 static void
 mze_insert(zap_t *zap, int chunkid, uint64_t hash)
 {
 	mzap_ent_t *mze;
+	uint32_t cd;
+	int idx;
 
 	ASSERT(zap->zap_ismicro);
 	ASSERT(RW_WRITE_HELD(&zap->zap_rwlock));
+	ASSERT3S(zap->zap_m.zap_num_entries, <, zap->zap_m.zap_num_chunks);
+
+	cd = zap_m_phys(zap)->mz_chunk[chunkid].mze_cd;
+	idx = mze_lower_bound(zap, hash, cd);
+	mze = &zap->zap_m.zap_ents[idx];
+	ASSERT(idx == zap->zap_m.zap_num_entries ||
+	    mze->mze_hash != hash || mze->mze_cd != cd);
+	memmove(mze + 1, mze,
+	    (zap->zap_m.zap_num_entries - idx) * sizeof (mzap_ent_t));
+	zap->zap_m.zap_num_entries++;
 
-	mze = kmem_alloc(sizeof (mzap_ent_t), KM_SLEEP);
 	mze->mze_chunkid = chunkid;
 	mze->mze_hash = hash;
-	mze->mze_cd = MZE_PHYS(zap, mze)->mze_cd;
+	mze->mze_cd = cd;
 	ASSERT(MZE_PHYS(zap, mze)->mze_name[0] != 0);
-	avl_add(&zap->zap_m.zap_avl, mze);
 }
 
+/*
+ * The returned entry is only valid until the next mze_insert() or
+ * mze_remove().
+ */
 static mzap_ent_t *
 mze_find(zap_name_t *zn)
 {
-	mzap_ent_t mze_tofind;
+	zap_t *zap = zn->zn_zap;
 	mzap_ent_t *mze;
-	avl_index_t idx;
-	avl_tree_t *avl = &zn->zn_zap->zap_m.zap_avl;
+	int idx;
 
-	ASSERT(zn->zn_zap->zap_ismicro);
-	ASSERT(RW_LOCK_HELD(&zn->zn_zap->zap_rwlock));
-
-	mze_tofind.mze_hash = zn->zn_hash;
-	mze_tofind.mze_cd = 0;
+	ASSERT(zap->zap_ismicro);
+	ASSERT(RW_LOCK_HELD(&zap->zap_rwlock));
 
 again:
-	mze = avl_find(avl, &mze_tofind, &idx);
-	if (mze == NULL)
-		mze = avl_nearest(avl, idx, AVL_AFTER);
-	for (; mze && mze->mze_hash == zn->zn_hash; mze = AVL_NEXT(avl, mze)) {
-		ASSERT3U(mze->mze_cd, ==, MZE_PHYS(zn->zn_zap, mze)->mze_cd);
-		if (zap_match(zn, MZE_PHYS(zn->zn_zap, mze)->mze_name))
+	for (idx = mze_lower_bound(zap, zn->zn_hash, 0);
+	    idx < zap->zap_m.zap_num_entries; idx++) {
+		mze = &zap->zap_m.zap_ents[idx];
+		if (mze->mze_hash != zn->zn_hash)
+			break;
+		ASSERT3U(mze->mze_cd, ==, MZE_PHYS(zap, mze)->mze_cd);
+		if (zap_match(zn, MZE_PHYS(zap, mze)->mze_name))
 			return (mze);
 	}
 	if (zn->zn_matchtype == MT_BEST) {
@@ -316,22 +357,18 @@ again:
 static uint32_t
 mze_find_unused_cd(zap_t *zap, uint64_t hash)
 {
-	mzap_ent_t mze_tofind;
 	mzap_ent_t *mze;
-	avl_index_t idx;
-	avl_tree_t *avl = &zap->zap_m.zap_avl;
 	uint32_t cd;
+	int idx;
 
 	ASSERT(zap->zap_ismicro);
 	ASSERT(RW_LOCK_HELD(&zap->zap_rwlock));
 
-	mze_tofind.mze_hash = hash;
-	mze_tofind.mze_cd = 0;
-
 	cd = 0;
-	for (mze = avl_find(avl, &mze_tofind, &idx);
-	    mze && mze->mze_hash == hash; mze = AVL_NEXT(avl, mze)) {
-		if (mze->mze_cd != cd)
+	for (idx = mze_lower_bound(zap, hash, 0);
+	    idx < zap->zap_m.zap_num_entries; idx++) {
+		mze = &zap->zap_m.zap_ents[idx];
+		if (mze->mze_hash != hash || mze->mze_cd != cd)
 			break;
 		cd++;
 	}
@@ -342,22 +379,23 @@ mze_find_unused_cd(zap_t *zap, uint64_t hash)
 static void
 mze_remove(zap_t *zap, mzap_ent_t *mze)
 {
+	int idx = mze - zap->zap_m.zap_ents;
+
 	ASSERT(zap->zap_ismicro);
 	ASSERT(RW_WRITE_HELD(&zap->zap_rwlock));
+	ASSERT3S(idx, <, zap->zap_m.zap_num_entries);
 
-	avl_remove(&zap->zap_m.zap_avl, mze);
-	kmem_free(mze, sizeof (mzap_ent_t));
+	zap->zap_m.zap_num_entries--;
+	memmove(mze, mze + 1,
+	    (zap->zap_m.zap_num_entries - idx) * sizeof (mzap_ent_t));
 }
 
 static void
 mze_destroy(zap_t *zap)
 {
-	mzap_ent_t *mze;
-	void *avlcookie = NULL;
-
-	while ((mze = avl_destroy_nodes(&zap->zap_m.zap_avl, &avlcookie)))
-		kmem_free(mze, sizeof (mzap_ent_t));
-	avl_destroy(&zap->zap_m.zap_avl);
+	kmem_free(zap->zap_m.zap_ents,
+	    zap->zap_m.zap_num_chunks * sizeof (mzap_ent_t));
+	zap->zap_m.zap_ents = NULL;
 }
 
 static zap_t *
@@ -404,9 +442,7 @@ mzap_open(objset_t *os, uint64_t obj, dmu_buf_t *db)
 	if (zap->zap_ismicro) {
 		zap->zap_salt = zap_m_phys(zap)->mz_salt;
 		zap->zap_normflags = zap_m_phys(zap)->mz_normflags;
-		zap->zap_m.zap_num_chunks = db->db_size / MZAP_ENT_LEN - 1;
-		avl_create(&zap->zap_m.zap_avl, mze_compare,
-		    sizeof (mzap_ent_t), offsetof(mzap_ent_t, mze_node));
+		mze_resize(zap, db->db_size / MZAP_ENT_LEN - 1);
 
 		for (i = 0; i < zap->zap_m.zap_num_chunks; i++) {
 			mzap_ent_phys_t *mze =
@@ -414,7 +450,6 @@ mzap_open(objset_t *os, uint64_t obj, dmu_buf_t *db)
 			if (mze->mze_name[0]) {
 				zap_name_t *zn;
 
-				zap->zap_m.zap_num_entries++;
 				zn = zap_name_alloc(zap, mze->mze_name,
 				    MT_EXACT);
 				mze_insert(zap, i, zn->zn_hash);
@@ -456,6 +491,31 @@ handle_winner:
 	return (winner);
 }
 
+/*
+ * Make room for one more entry in a full microzap, by growing its block
+ * or, once it has reached MZAP_MAX_BLKSZ, by upgrading it to a fatzap.
+ */
+static int
+mzap_make_room(zap_t **zapp, dmu_tx_t *tx)
+{
+	zap_t *zap = *zapp;
+	dmu_buf_t *db = zap->zap_dbuf;
+	uint64_t newsz = db->db_size + SPA_MINBLOCKSIZE;
+
+	ASSERT(RW_WRITE_HELD(&zap->zap_rwlock));
+	ASSERT3U(zap->zap_m.zap_num_entries, ==, zap->zap_m.zap_num_chunks);
+
+	if (newsz > MZAP_MAX_BLKSZ) {
+		dprintf("upgrading obj %llu: num_entries=%u\n",
+		    zap->zap_object, zap->zap_m.zap_num_entries);
+		return (mzap_upgrade(zapp, tx, 0));
+	}
+	VERIFY0(dmu_object_set_blocksize(zap->zap_objset, zap->zap_object,
+	    newsz, 0, tx));
+	mze_resize(zap, db->db_size / MZAP_ENT_LEN - 1);
+	return (0);
+}
+
 int
 zap_lockdir(objset_t *os, uint64_t obj, dmu_tx_t *tx,
     krw_t lti, boolean_t fatreader, boolean_t adding, zap_t **zapp)
@@ -516,22 +576,11 @@ zap_lockdir(objset_t *os, uint64_t obj, dmu_tx_t *tx,
 
 	ASSERT(!zap->zap_ismicro ||
 	    zap->zap_m.zap_num_entries <= zap->zap_m.zap_num_chunks);
+	*zapp = zap;
 	if (zap->zap_ismicro && tx && adding &&
-	    zap->zap_m.zap_num_entries == zap->zap_m.zap_num_chunks) {
-		uint64_t newsz = db->db_size + SPA_MINBLOCKSIZE;
-		if (newsz > MZAP_MAX_BLKSZ) {
-			dprintf("upgrading obj %llu: num_entries=%u\n",
-			    obj, zap->zap_m.zap_num_entries);
-			*zapp = zap;
-			return (mzap_upgrade(zapp, tx, 0));
-		}
-		err = dmu_object_set_blocksize(os, obj, newsz, 0, tx);
-		ASSERT0(err);
-		zap->zap_m.zap_num_chunks =
-		    db->db_size / MZAP_ENT_LEN - 1;
-	}
+	    zap->zap_m.zap_num_entries == zap->zap_m.zap_num_chunks)
+		return (mzap_make_room(zapp, tx));
 
-	*zapp = zap;
 	return (0);
 }
 
@@ -568,7 +617,7 @@ mzap_upgrade(zap_t **zapp, dmu_tx_t *tx, zap_flags_t flags)
 
 	dprintf("upgrading obj=%llu with %u chunks\n",
 	    zap->zap_object, nchunks);
-	/* XXX destroy the avl later, so we can use the stored hash value */
+	/* XXX destroy the index later, so we can use the stored hash value */
 	mze_destroy(zap);
 
 	fzap_upgrade(zap, tx, flags);
@@ -781,17 +830,20 @@ zap_count(objset_t *os, uint64_t zapobj, uint64_t *count)
 static boolean_t
 mzap_normalization_conflict(zap_t *zap, zap_name_t *zn, mzap_ent_t *mze)
 {
+	mzap_ent_t *first = zap->zap_m.zap_ents;
+	mzap_ent_t *last = first + zap->zap_m.zap_num_entries - 1;
 	mzap_ent_t *other;
-	int direction = AVL_BEFORE;
+	int direction = -1;
 	boolean_t allocdzn = B_FALSE;
 
 	if (zap->zap_normflags == 0)
 		return (B_FALSE);
 
 again:
-	for (other = avl_walk(&zap->zap_m.zap_avl, mze, direction);
-	    other && other->mze_hash == mze->mze_hash;
-	    other = avl_walk(&zap->zap_m.zap_avl, other, direction)) {
+	for (other = mze + direction;
+	    other >= first && other <= last &&
+	    other->mze_hash == mze->mze_hash;
+	    other += direction) {
 
 		if (zn == NULL) {
 			zn = zap_name_alloc(zap, MZE_PHYS(zap, mze)->mze_name,
@@ -805,8 +857,8 @@ again:
 		}
 	}
 
-	if (direction == AVL_BEFORE) {
-		direction = AVL_AFTER;
+	if (direction == -1) {
+		direction = 1;
 		goto again;
 	}
 
@@ -1041,7 +1093,6 @@ again:
 			mze->mze_value = value;
 			mze->mze_cd = cd;
 			(void) strcpy(mze->mze_name, zn->zn_key_orig);
-			zap->zap_m.zap_num_entries++;
 			zap->zap_m.zap_alloc_next = i+1;
 			if (zap->zap_m.zap_alloc_next ==
 			    zap->zap_m.zap_num_chunks)
@@ -1237,7 +1288,6 @@ zap_remove_norm(objset_t *os, uint64_t zapobj, const char *name,
 		if (mze == NULL) {
 			err = SET_ERROR(ENOENT);
 		} else {
-			zap->zap_m.zap_num_entries--;
 			bzero(&zap_m_phys(zap)->mz_chunk[mze->mze_chunkid],
 			    sizeof (mzap_ent_phys_t));
 			mze_remove(zap, mze);
@@ -1270,6 +1320,226 @@ zap_remove_uint64(objset_t *os, uint64_t zapobj, const uint64_t *key,
 	return (err);
 }
 
+/*
+ * Routines for batched operations.
+ */
+
+static int
+zap_batch_name_compare(const void *x1, const void *x2)
+{
+	const zap_batch_name_t *zbn1 = x1;
+	const zap_batch_name_t *zbn2 = x2;
+
+	if (zbn1->zbn_zn->zn_hash < zbn2->zbn_zn->zn_hash)
+		return (-1);
+	if (zbn1->zbn_zn->zn_hash > zbn2->zbn_zn->zn_hash)
+		return (1);
+	return (0);
+}
+
+static boolean_t
+mzap_batch_fits(zap_batch_name_t *zbn)
+{
+	return (zbn->zbn_ent->zbe_integer_size == 8 &&
+	    zbn->zbn_ent->zbe_num_integers == 1 &&
+	    strlen(zbn->zbn_zn->zn_key_orig) < MZAP_NAME_LEN);
+}
+
+/*
+ * The microzap half of zap_batch_impl().  If an update needs the zap to
+ * be upgraded, the remaining names are handed to fzap_batch().
+ */
+static int
+mzap_batch(zap_t **zapp, zap_batch_name_t *zbn, int n, zap_batch_op_t op,
+    dmu_tx_t *tx)
+{
+	zap_t *zap = *zapp;
+	int i, err;
+
+	ASSERT(zap->zap_ismicro);
+
+	for (i = 0; op == ZAP_BATCH_UPDATE && i < n; i++) {
+		if (!mzap_batch_fits(&zbn[i])) {
+			dprintf("upgrading obj %llu: batch of %d\n",
+			    zap->zap_object, n);
+			i = 0;
+			goto upgrade;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		zap_name_t *zn = zbn[i].zbn_zn;
+		zap_batch_ent_t *zbe = zbn[i].zbn_ent;
+		mzap_ent_t *mze;
+		int e = 0;
+
+		zn->zn_zap = zap;
+		mze = mze_find(zn);
+		switch (op) {
+		case ZAP_BATCH_LOOKUP:
+			if (mze == NULL) {
+				e = SET_ERROR(ENOENT);
+			} else if (zbe->zbe_num_integers < 1) {
+				e = SET_ERROR(EOVERFLOW);
+			} else if (zbe->zbe_integer_size != 8) {
+				e = SET_ERROR(EINVAL);
+			} else {
+				*(uint64_t *)zbe->zbe_val =
+				    MZE_PHYS(zap, mze)->mze_value;
+			}
+			break;
+		case ZAP_BATCH_REMOVE:
+			if (mze == NULL) {
+				e = SET_ERROR(ENOENT);
+			} else {
+				bzero(&zap_m_phys(zap)->
+				    mz_chunk[mze->mze_chunkid],
+				    sizeof (mzap_ent_phys_t));
+				mze_remove(zap, mze);
+			}
+			break;
+		case ZAP_BATCH_UPDATE:
+			if (mze != NULL) {
+				MZE_PHYS(zap, mze)->mze_value =
+				    *(const uint64_t *)zbe->zbe_val;
+				break;
+			}
+			if (zap->zap_m.zap_num_entries ==
+			    zap->zap_m.zap_num_chunks) {
+				err = mzap_make_room(&zn->zn_zap, tx);
+				zap = zn->zn_zap;
+				if (err != 0 || !zap->zap_ismicro)
+					goto upgraded;
+			}
+			mzap_addent(zn, *(const uint64_t *)zbe->zbe_val);
+			break;
+		}
+		zbe->zbe_error = e;
+	}
+
+	*zapp = zap;
+	return (0);
+
+upgrade:
+	zbn[i].zbn_zn->zn_zap = zap;
+	err = mzap_upgrade(&zbn[i].zbn_zn->zn_zap, tx, 0);
+	zap = zbn[i].zbn_zn->zn_zap;
+upgraded:
+	*zapp = zap;
+	if (err == 0)
+		return (fzap_batch(zapp, &zbn[i], n - i, op, tx));
+	for (; i < n; i++)
+		zbn[i].zbn_ent->zbe_error = err;
+	return (err);
+}
+
+static int
+zap_batch_impl(objset_t *os, uint64_t zapobj, int key_numints,
+    zap_batch_ent_t *zbe, int n, zap_batch_op_t op, dmu_tx_t *tx)
+{
+	zap_batch_name_t *zbn;
+	zap_t *zap;
+	int i, m, err;
+
+	if (n == 0)
+		return (0);
+
+	if (op == ZAP_BATCH_LOOKUP) {
+		err = zap_lockdir(os, zapobj, NULL, RW_READER, TRUE, FALSE,
+		    &zap);
+	} else {
+		err = zap_lockdir(os, zapobj, tx, RW_WRITER, TRUE,
+		    op == ZAP_BATCH_UPDATE, &zap);
+	}
+	if (err) {
+		for (i = 0; i < n; i++)
+			zbe[i].zbe_error = err;
+		return (err);
+	}
+	ASSERT(key_numints == 0 || !zap->zap_ismicro);
+
+	zbn = vmem_alloc(n * sizeof (zap_batch_name_t), KM_SLEEP);
+	for (i = 0, m = 0; i < n; i++) {
+		zap_name_t *zn;
+
+		if (key_numints == 0)
+			zn = zap_name_alloc(zap, zbe[i].zbe_key, MT_EXACT);
+		else
+			zn = zap_name_alloc_uint64(zap, zbe[i].zbe_key,
+			    key_numints);
+		if (zn == NULL) {
+			zbe[i].zbe_error = SET_ERROR(ENOTSUP);
+			continue;
+		}
+		zbe[i].zbe_error = 0;
+		zbn[m].zbn_zn = zn;
+		zbn[m].zbn_ent = &zbe[i];
+		m++;
+	}
+	qsort(zbn, m, sizeof (zap_batch_name_t), zap_batch_name_compare);
+
+	if (m == 0)
+		err = 0;
+	else if (zap->zap_ismicro)
+		err = mzap_batch(&zap, zbn, m, op, tx);
+	else
+		err = fzap_batch(&zap, zbn, m, op, tx);
+
+	for (i = 0; i < m; i++)
+		zap_name_free(zbn[i].zbn_zn);
+	vmem_free(zbn, n * sizeof (zap_batch_name_t));
+	if (zap != NULL)	/* may be NULL if the batch failed */
+		zap_unlockdir(zap);
+
+	for (i = 0; err == 0 && i < n; i++)
+		err = zbe[i].zbe_error;
+	return (err);
+}
+
+int
+zap_lookup_batch(objset_t *os, uint64_t zapobj, zap_batch_ent_t *zbe, int n)
+{
+	return (zap_batch_impl(os, zapobj, 0, zbe, n, ZAP_BATCH_LOOKUP, NULL));
+}
+
+int
+zap_lookup_uint64_batch(objset_t *os, uint64_t zapobj, int key_numints,
+    zap_batch_ent_t *zbe, int n)
+{
+	return (zap_batch_impl(os, zapobj, key_numints, zbe, n,
+	    ZAP_BATCH_LOOKUP, NULL));
+}
+
+int
+zap_update_batch(objset_t *os, uint64_t zapobj, zap_batch_ent_t *zbe, int n,
+    dmu_tx_t *tx)
+{
+	return (zap_batch_impl(os, zapobj, 0, zbe, n, ZAP_BATCH_UPDATE, tx));
+}
+
+int
+zap_update_uint64_batch(objset_t *os, uint64_t zapobj, int key_numints,
+    zap_batch_ent_t *zbe, int n, dmu_tx_t *tx)
+{
+	return (zap_batch_impl(os, zapobj, key_numints, zbe, n,
+	    ZAP_BATCH_UPDATE, tx));
+}
+
+int
+zap_remove_batch(objset_t *os, uint64_t zapobj, zap_batch_ent_t *zbe, int n,
+    dmu_tx_t *tx)
+{
+	return (zap_batch_impl(os, zapobj, 0, zbe, n, ZAP_BATCH_REMOVE, tx));
+}
+
+int
+zap_remove_uint64_batch(objset_t *os, uint64_t zapobj, int key_numints,
+    zap_batch_ent_t *zbe, int n, dmu_tx_t *tx)
+{
+	return (zap_batch_impl(os, zapobj, key_numints, zbe, n,
+	    ZAP_BATCH_REMOVE, tx));
+}
+
 /*
  * Routines for iterating over the attributes.
  */
@@ -1335,9 +1605,8 @@ int
 zap_cursor_retrieve(zap_cursor_t *zc, zap_attribute_t *za)
 {
 	int err;
-	avl_index_t idx;
-	mzap_ent_t mze_tofind;
 	mzap_ent_t *mze;
+	int idx;
 
 	if (zc->zc_hash == -1ULL)
 		return (SET_ERROR(ENOENT));
@@ -1366,16 +1635,12 @@ zap_cursor_retrieve(zap_cursor_t *zc, zap_attribute_t *za)
 	if (!zc->zc_zap->zap_ismicro) {
 		err = fzap_cursor_retrieve(zc->zc_zap, zc, za);
 	} else {
-		mze_tofind.mze_hash = zc->zc_hash;
-		mze_tofind.mze_cd = zc->zc_cd;
+		idx = mze_lower_bound(zc->zc_zap, zc->zc_hash, zc->zc_cd);
+		if (idx < zc->zc_zap->zap_m.zap_num_entries) {
+			mzap_ent_phys_t *mzep;
 
-		mze = avl_find(&zc->zc_zap->zap_m.zap_avl, &mze_tofind, &idx);
-		if (mze == NULL) {
-			mze = avl_nearest(&zc->zc_zap->zap_m.zap_avl,
-			    idx, AVL_AFTER);
-		}
-		if (mze) {
-			mzap_ent_phys_t *mzep = MZE_PHYS(zc->zc_zap, mze);
+			mze = &zc->zc_zap->zap_m.zap_ents[idx];
+			mzep = MZE_PHYS(zc->zc_zap, mze);
 			ASSERT3U(mze->mze_cd, ==, mzep->mze_cd);
 			za->za_normalization_conflict =
 			    mzap_normalization_conflict(zc->zc_zap, NULL, mze);
@@ -1528,6 +1793,12 @@ EXPORT_SYMBOL(zap_length_uint64);
 EXPORT_SYMBOL(zap_remove);
 EXPORT_SYMBOL(zap_remove_norm);
 EXPORT_SYMBOL(zap_remove_uint64);
+EXPORT_SYMBOL(zap_lookup_batch);
+EXPORT_SYMBOL(zap_lookup_uint64_batch);
+EXPORT_SYMBOL(zap_update_batch);
+EXPORT_SYMBOL(zap_update_uint64_batch);
+EXPORT_SYMBOL(zap_remove_batch);
+EXPORT_SYMBOL(zap_remove_uint64_batch);
 EXPORT_SYMBOL(zap_count);
 EXPORT_SYMBOL(zap_value_search);
 EXPORT_SYMBOL(zap_join);
@@ -253,4 +253,19 @@ zpool_feature_init(void)
 	    "Variable on-disk size of dnodes.",
 	    ZFEATURE_FLAG_PER_DATASET, large_dnode_deps);
 	}
+
+	zfeature_register(SPA_FEATURE_BLOCK_CLONING,
+	    "org.zfsonlinux:block_cloning", "block_cloning",
+	    "File blocks can be cloned without copying their data.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, NULL);
+
+	zfeature_register(SPA_FEATURE_DEDUP_LOG,
+	    "org.zfsonlinux:dedup_log", "dedup_log",
+	    "Dedup table changes are logged and flushed in batches.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, NULL);
+
+	zfeature_register(SPA_FEATURE_DEDUP_BLOOM,
+	    "org.zfsonlinux:dedup_bloom", "dedup_bloom",
+	    "Dedup tables keep a bloom filter of their keys.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, NULL);
 }
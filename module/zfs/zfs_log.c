@@ -458,10 +458,9 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 	znode_t *zp, offset_t off, ssize_t resid, int ioflag,
 	zil_callback_t callback, void *callback_data)
 {
+	uint32_t blocksize = zp->z_blksz;
 	itx_wr_state_t write_state;
-	boolean_t slogging;
 	uintptr_t fsync_cnt;
-	ssize_t immediate_write_sz;
 
 	if (zil_replaying(zilog, tx) || zp->z_unlinked) {
 		if (callback != NULL)
@@ -469,12 +468,7 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 		return;
 	}
 
-	immediate_write_sz = (zilog->zl_logbias == ZFS_LOGBIAS_THROUGHPUT)
-	    ? 0 : (ssize_t)zfs_immediate_write_sz;
-
-	slogging = spa_has_slogs(zilog->zl_spa) &&
-	    (zilog->zl_logbias == ZFS_LOGBIAS_LATENCY);
-	if (resid > immediate_write_sz && !slogging && resid <= zp->z_blksz)
+	if (zil_write_indirect(zilog, resid, zfs_immediate_write_sz))
 		write_state = WR_INDIRECT;
 	else if (ioflag & (FSYNC | FDSYNC))
 		write_state = WR_COPIED;
@@ -491,9 +485,13 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 		ssize_t len;
 
 		/*
-		 * If the write would overflow the largest block then split it.
+		 * An indirect write is logged one file block at a time, so
+		 * each record can be written in place by dmu_sync().  If a
+		 * copied write would overflow the largest block then split it.
 		 */
-		if (write_state != WR_INDIRECT && resid > ZIL_MAX_LOG_DATA)
+		if (write_state == WR_INDIRECT)
+			len = MIN(blocksize - (off % blocksize), resid);
+		else if (resid > ZIL_MAX_LOG_DATA)
 			len = SPA_OLD_MAXBLOCKSIZE >> 1;
 		else
 			len = resid;
@@ -671,10 +671,12 @@ zfs_replay_write(zfs_sb_t *zsb, lr_write_t *lr, boolean_t byteswap)
 	 * write needs to be there. So we write the whole block and
 	 * reduce the eof. This needs to be done within the single dmu
 	 * transaction created within vn_rdwr -> zfs_write. So a possible
-	 * new end of file is passed through in zsb->z_replay_eof
+	 * new end of file is passed through in zp->z_replay_eof.
+	 * Records for one object are never replayed concurrently, so
+	 * the znode is a safe place to carry it.
 	 */
 
-	zsb->z_replay_eof = 0; /* 0 means don't change end of file */
+	zp->z_replay_eof = 0; /* 0 means don't change end of file */
 
 	/* If it's a dmu_sync() block, write the whole block */
 	if (lr->lr_common.lrc_reclen == sizeof (lr_write_t)) {
@@ -684,7 +686,7 @@ zfs_replay_write(zfs_sb_t *zsb, lr_write_t *lr, boolean_t byteswap)
 			length = blocksize;
 		}
 		if (zp->z_size < eod)
-			zsb->z_replay_eof = eod;
+			zp->z_replay_eof = eod;
 	}
 
 	written = zpl_write_common(ZTOI(zp), data, length, &offset,
@@ -694,8 +696,8 @@ zfs_replay_write(zfs_sb_t *zsb, lr_write_t *lr, boolean_t byteswap)
 	else if (written < length)
 		error = SET_ERROR(EIO); /* short write */
 
+	zp->z_replay_eof = 0;	/* safety */
 	iput(ZTOI(zp));
-	zsb->z_replay_eof = 0;	/* safety */
 
 	return (error);
 }
@@ -77,6 +77,7 @@
 #include <sys/cred.h>
 #include <sys/attr.h>
 #include <sys/zpl.h>
+#include <sys/zfeature.h>
 
 /*
  * Programming rules.
@@ -405,7 +406,7 @@ mappedread(struct inode *ip, int nbytes, uio_t *uio)
 			put_page(pp);
 		} else {
 			error = dmu_read_uio_dbuf(sa_get_db(zp->z_sa_hdl),
-			    uio, bytes);
+			    uio, bytes, DMU_READ_PREFETCH);
 		}
 
 		len -= bytes;
@@ -419,6 +420,30 @@ mappedread(struct inode *ip, int nbytes, uio_t *uio)
 
 unsigned long zfs_read_chunk_size = 1024 * 1024; /* Tunable */
 unsigned long zfs_delete_blocks = DMU_MAX_DELETEBLKCNT;
+unsigned long zfs_clone_max_blocks = 1024; /* Tunable */
+
+/*
+ * O_DIRECT requests which start on a block boundary and end on one (or at
+ * end-of-file) are not retained in the ARC: the blocks they touch are
+ * dropped once the request is done with them, or for writes once they
+ * have been written out.  Callers using O_DIRECT manage their own cache,
+ * so a second copy in the ARC only displaces other data.  Other requests
+ * are cached as usual.
+ */
+static uint32_t
+zfs_direct_flags(znode_t *zp, offset_t off, ssize_t len, int ioflag)
+{
+	uint64_t blksz = zp->z_blksz;
+
+	if (!(ioflag & O_DIRECT) || blksz == 0)
+		return (DMU_READ_PREFETCH);
+
+	if (off % blksz != 0 ||
+	    ((off + len) % blksz != 0 && off + len < zp->z_size))
+		return (DMU_READ_PREFETCH);
+
+	return (DMU_READ_NO_PREFETCH | DMU_UNCACHED);
+}
 
 /*
  * Read bytes from specified file into supplied buffer.
@@ -427,7 +452,7 @@ unsigned long zfs_delete_blocks = DMU_MAX_DELETEBLKCNT;
  *		uio	- structure supplying read location, range info,
  *			  and return buffer.
  *		ioflag	- FSYNC flags; used to provide FRSYNC semantics.
- *			  O_DIRECT flag; used to bypass page cache.
+ *			  O_DIRECT flag; used to bypass page cache and ARC.
  *		cr	- credentials of caller.
  *
  *	OUT:	uio	- updated offset and range, buffer filled.
@@ -445,6 +470,7 @@ zfs_read(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 	zfs_sb_t	*zsb = ITOZSB(ip);
 	ssize_t		n, nbytes;
 	int		error = 0;
+	uint32_t	flags;
 	rl_t		*rl;
 #ifdef HAVE_UIO_ZEROCOPY
 	xuio_t		*xuio = NULL;
@@ -480,6 +506,19 @@ zfs_read(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 	if (ioflag & FRSYNC || zsb->z_os->os_sync == ZFS_SYNC_ALWAYS)
 		zil_commit(zsb->z_log, zp->z_id);
 
+	/*
+	 * O_DIRECT reads don't consult the page cache, so first write
+	 * back any pages dirtied through mmap(2).
+	 */
+	if ((ioflag & O_DIRECT) && zp->z_is_mapped) {
+		error = -filemap_write_and_wait_range(ip->i_mapping,
+		    uio->uio_loffset, uio->uio_loffset + uio->uio_resid - 1);
+		if (error) {
+			ZFS_EXIT(zsb);
+			return (error);
+		}
+	}
+
 	/*
 	 * Lock the range against changes.
 	 */
@@ -497,6 +536,7 @@ zfs_read(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 
 	ASSERT(uio->uio_loffset < zp->z_size);
 	n = MIN(uio->uio_resid, zp->z_size - uio->uio_loffset);
+	flags = zfs_direct_flags(zp, uio->uio_loffset, n, ioflag);
 
 #ifdef HAVE_UIO_ZEROCOPY
 	if ((uio->uio_extflg == UIO_XUIO) &&
@@ -537,7 +577,7 @@ zfs_read(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 			error = mappedread(ip, nbytes, uio);
 		} else {
 			error = dmu_read_uio_dbuf(sa_get_db(zp->z_sa_hdl),
-			    uio, nbytes);
+			    uio, nbytes, flags);
 		}
 
 		if (error) {
@@ -564,7 +604,7 @@ EXPORT_SYMBOL(zfs_read);
  *		uio	- structure supplying write location, range info,
  *			  and data buffer.
  *		ioflag	- FAPPEND flag set if in append mode.
- *			  O_DIRECT flag; used to bypass page cache.
+ *			  O_DIRECT flag; used to bypass ARC.
  *		cr	- credentials of caller.
  *
  *	OUT:	uio	- updated offset and range.
@@ -599,6 +639,7 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 	int		i_iov = 0;
 	const iovec_t	*iovp = uio->uio_iov;
 	int		write_eof;
+	uint32_t	flags;
 	int		count = 0;
 	sa_bulk_attr_t	bulk[4];
 	uint64_t	mtime[2], ctime[2];
@@ -709,6 +750,8 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 
 	end_size = MAX(zp->z_size, woff + n);
 
+	flags = zfs_direct_flags(zp, woff, n, ioflag);
+
 	/*
 	 * Write the file in reasonable size chunks.  Each chunk is written
 	 * in a separate transaction; this keeps the intent log records small
@@ -736,7 +779,7 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 			    aiov->iov_len == arc_buf_size(abuf)));
 			i_iov++;
 		} else if (abuf == NULL && n >= max_blksz &&
-		    woff >= zp->z_size &&
+		    !(flags & DMU_UNCACHED) && woff >= zp->z_size &&
 		    P2PHASE(woff, max_blksz) == 0 &&
 		    zp->z_blksz == max_blksz) {
 			/*
@@ -809,7 +852,7 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 		if (abuf == NULL) {
 			tx_bytes = uio->uio_resid;
 			error = dmu_write_uio_dbuf(sa_get_db(zp->z_sa_hdl),
-			    uio, nbytes, tx);
+			    uio, nbytes, tx, flags);
 			tx_bytes -= uio->uio_resid;
 		} else {
 			tx_bytes = nbytes;
@@ -836,7 +879,7 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 			uioskip(uio, tx_bytes);
 		}
 
-		if (tx_bytes && zp->z_is_mapped && !(ioflag & O_DIRECT))
+		if (tx_bytes && zp->z_is_mapped)
 			update_pages(ip, woff, tx_bytes, zsb->z_os, zp->z_id);
 
 		/*
@@ -890,11 +933,11 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 		}
 		/*
 		 * If we are replaying and eof is non zero then force
-		 * the file size to the specified eof. Note, there's no
-		 * concurrency during replay.
+		 * the file size to the specified eof. Replay only runs
+		 * records for the same object one at a time.
 		 */
-		if (zsb->z_replay && zsb->z_replay_eof != 0)
-			zp->z_size = zsb->z_replay_eof;
+		if (zsb->z_replay && zp->z_replay_eof != 0)
+			zp->z_size = zp->z_replay_eof;
 
 		error = sa_bulk_update(zp->z_sa_hdl, bulk, count, tx);
 
@@ -932,6 +975,271 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 }
 EXPORT_SYMBOL(zfs_write);
 
+/*
+ * Clone a range of a file into another file (or elsewhere in the same file)
+ * by referencing the source's blocks from the destination instead of
+ * copying their data.  Both files must live in the same dataset and share
+ * a block size; the offsets must be block aligned, and the length must be
+ * a multiple of the block size unless the range ends at the source's EOF
+ * and at or beyond the destination's EOF.  An empty destination is grown
+ * to the source's block size.
+ *
+ * Clones are not logged to the ZIL; instead we wait for the txg holding
+ * the last of them to sync before returning.
+ *
+ *	IN:	inip	- source inode.
+ *		inoff	- offset in source.
+ *		outip	- destination inode.
+ *		outoff	- offset in destination.
+ *		lenp	- number of bytes to clone.
+ *		cr	- credentials of caller.
+ *
+ *	OUT:	lenp	- number of bytes cloned.
+ *
+ *	RETURN:	0 on success (possibly partial), error code if nothing
+ *		was cloned.
+ *
+ * Timestamps:
+ *	outip - ctime|mtime updated if any bytes were cloned.
+ */
+/* ARGSUSED */
+int
+zfs_clone_range(struct inode *inip, uint64_t inoff, struct inode *outip,
+    uint64_t outoff, uint64_t *lenp, cred_t *cr)
+{
+	znode_t		*inzp = ITOZ(inip);
+	znode_t		*outzp = ITOZ(outip);
+	zfs_sb_t	*zsb = ITOZSB(inip);
+	objset_t	*os = zsb->z_os;
+	dsl_pool_t	*dp = dmu_objset_pool(os);
+	rl_t		*inrl, *outrl;
+	dmu_tx_t	*tx;
+	blkptr_t	*bps;
+	size_t		maxblocks, nbps;
+	uint64_t	len = *lenp, done = 0, txg = 0;
+	uint64_t	blksz, size, nbytes, end_size;
+	boolean_t	grow = B_FALSE;
+	int		count = 0;
+	sa_bulk_attr_t	bulk[3];
+	uint64_t	mtime[2], ctime[2];
+	uint32_t	uid;
+	int		error = 0;
+
+	if (ITOZSB(outip) != zsb)
+		return (SET_ERROR(EXDEV));
+
+	if (len == 0)
+		return (0);
+
+	ZFS_ENTER(zsb);
+	ZFS_VERIFY_ZP(inzp);
+	ZFS_VERIFY_ZP(outzp);
+
+	if (!spa_feature_is_enabled(dmu_objset_spa(os),
+	    SPA_FEATURE_BLOCK_CLONING)) {
+		ZFS_EXIT(zsb);
+		return (SET_ERROR(EOPNOTSUPP));
+	}
+
+	if (zfs_is_readonly(zsb)) {
+		ZFS_EXIT(zsb);
+		return (SET_ERROR(EROFS));
+	}
+
+	if (outzp->z_pflags & (ZFS_IMMUTABLE | ZFS_READONLY | ZFS_APPENDONLY)) {
+		ZFS_EXIT(zsb);
+		return (SET_ERROR(EPERM));
+	}
+
+	if (inoff > MAXOFFSET_T || outoff > MAXOFFSET_T ||
+	    len > MAXOFFSET_T - MAX(inoff, outoff) ||
+	    (inzp == outzp && inoff < outoff + len && outoff < inoff + len)) {
+		ZFS_EXIT(zsb);
+		return (SET_ERROR(EINVAL));
+	}
+
+	/*
+	 * Pages dirtied through mmap(2) must reach the DMU before we look
+	 * at the source's block pointers.
+	 */
+	if (inzp->z_is_mapped) {
+		error = -filemap_write_and_wait_range(inip->i_mapping,
+		    inoff, inoff + len - 1);
+		if (error) {
+			ZFS_EXIT(zsb);
+			return (error);
+		}
+	}
+
+	/*
+	 * Always take the range locks in the same order so that two clones
+	 * between the same pair of files can't deadlock.
+	 */
+	if (inzp->z_id < outzp->z_id ||
+	    (inzp->z_id == outzp->z_id && inoff < outoff)) {
+		inrl = zfs_range_lock(&inzp->z_range_lock, inoff, len,
+		    RL_READER);
+		outrl = zfs_range_lock(&outzp->z_range_lock, 0, UINT64_MAX,
+		    RL_WRITER);
+	} else {
+		outrl = zfs_range_lock(&outzp->z_range_lock, 0, UINT64_MAX,
+		    RL_WRITER);
+		inrl = zfs_range_lock(&inzp->z_range_lock, inoff, len,
+		    RL_READER);
+	}
+
+	/*
+	 * Only clone what the source actually has.
+	 */
+	if (inoff >= inzp->z_size) {
+		error = SET_ERROR(EINVAL);
+		goto unlock;
+	}
+	len = MIN(len, inzp->z_size - inoff);
+
+	blksz = inzp->z_blksz;
+	if (outzp->z_blksz != blksz) {
+		if (outzp->z_size != 0 || outzp->z_blksz > blksz ||
+		    inzp == outzp) {
+			error = SET_ERROR(EINVAL);
+			goto unlock;
+		}
+		grow = B_TRUE;
+	}
+
+	/*
+	 * A single-block file's block size needn't be a power of two.
+	 */
+	if (inoff % blksz != 0 || outoff % blksz != 0 ||
+	    (len % blksz != 0 && (inoff + len < inzp->z_size ||
+	    outoff + len < outzp->z_size))) {
+		error = SET_ERROR(EINVAL);
+		goto unlock;
+	}
+
+	if (zfs_owner_overquota(zsb, outzp, B_FALSE) ||
+	    zfs_owner_overquota(zsb, outzp, B_TRUE)) {
+		error = SET_ERROR(EDQUOT);
+		goto unlock;
+	}
+
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_MTIME(zsb), NULL, &mtime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CTIME(zsb), NULL, &ctime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_SIZE(zsb), NULL,
+	    &outzp->z_size, 8);
+
+	maxblocks = MAX(1, MIN(zfs_clone_max_blocks,
+	    (DMU_MAX_ACCESS / 2) / blksz));
+	bps = vmem_alloc(maxblocks * sizeof (blkptr_t), KM_SLEEP);
+
+	/*
+	 * Neither range may have dirty blocks, as their new contents don't
+	 * have block pointers yet.
+	 */
+	txg_wait_synced(dp, 0);
+
+	while (len > 0) {
+		nbytes = MIN(len, maxblocks * blksz);
+		size = ((nbytes + blksz - 1) / blksz) * blksz;
+
+		error = dmu_read_l0_bps(os, inzp->z_id, inoff, size, bps,
+		    &nbps);
+		if (error == EAGAIN) {
+			txg_wait_synced(dp, 0);
+			continue;
+		} else if (error != 0) {
+			break;
+		}
+
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_sa(tx, outzp->z_sa_hdl, B_FALSE);
+		dmu_tx_hold_write(tx, outzp->z_id, outoff, size);
+		zfs_sa_upgrade_txholds(tx, outzp);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error) {
+			dmu_tx_abort(tx);
+			break;
+		}
+
+		if (grow) {
+			zfs_grow_blocksize(outzp, blksz, tx);
+			grow = B_FALSE;
+		}
+
+		error = dmu_brt_clone(os, outzp->z_id, outoff, size, tx,
+		    bps, nbps);
+		if (error != 0) {
+			txg = dmu_tx_get_txg(tx);
+			dmu_tx_commit(tx);
+			if (error == EAGAIN) {
+				txg_wait_synced(dp, txg);
+				continue;
+			}
+			break;
+		}
+
+		/*
+		 * Clear Set-UID/Set-GID bits as a write would; see zfs_write().
+		 */
+		mutex_enter(&outzp->z_acl_lock);
+		uid = KUID_TO_SUID(outip->i_uid);
+		if ((outzp->z_mode & (S_IXUSR | (S_IXUSR >> 3) |
+		    (S_IXUSR >> 6))) != 0 &&
+		    (outzp->z_mode & (S_ISUID | S_ISGID)) != 0 &&
+		    secpolicy_vnode_setid_retain(cr,
+		    ((outzp->z_mode & S_ISUID) != 0 && uid == 0)) != 0) {
+			uint64_t newmode;
+			outzp->z_mode &= ~(S_ISUID | S_ISGID);
+			newmode = outzp->z_mode;
+			(void) sa_update(outzp->z_sa_hdl, SA_ZPL_MODE(zsb),
+			    (void *)&newmode, sizeof (uint64_t), tx);
+		}
+		mutex_exit(&outzp->z_acl_lock);
+
+		zfs_tstamp_update_setup(outzp, CONTENT_MODIFIED, mtime, ctime);
+
+		while ((end_size = outzp->z_size) < outoff + nbytes) {
+			(void) atomic_cas_64(&outzp->z_size, end_size,
+			    outoff + nbytes);
+		}
+
+		error = sa_bulk_update(outzp->z_sa_hdl, bulk, count, tx);
+
+		txg = dmu_tx_get_txg(tx);
+		dmu_tx_commit(tx);
+
+		if (outzp->z_is_mapped) {
+			txg_wait_synced(dp, txg);
+			update_pages(outip, outoff, nbytes, os, outzp->z_id);
+		}
+
+		done += nbytes;
+		if (error != 0)
+			break;
+
+		inoff += nbytes;
+		outoff += nbytes;
+		len -= nbytes;
+	}
+
+	vmem_free(bps, maxblocks * sizeof (blkptr_t));
+
+	zfs_inode_update(outzp);
+unlock:
+	zfs_range_unlock(outrl);
+	zfs_range_unlock(inrl);
+
+	if (done > 0) {
+		txg_wait_synced(dp, txg);
+		*lenp = done;
+		error = 0;
+	}
+
+	ZFS_EXIT(zsb);
+	return (error);
+}
+EXPORT_SYMBOL(zfs_clone_range);
+
 void
 zfs_iput_async(struct inode *ip)
 {
@@ -964,7 +1272,7 @@ zfs_get_done(zgd_t *zgd, int error)
 	zfs_iput_async(ZTOI(zp));
 
 	if (error == 0 && zgd->zgd_bp)
-		zil_add_block(zgd->zgd_zilog, zgd->zgd_bp);
+		zil_lwb_add_block(zgd->zgd_lwb, zgd->zgd_bp);
 
 	kmem_free(zgd, sizeof (zgd_t));
 }
@@ -977,7 +1285,8 @@ static int zil_fault_io = 0;
  * Get data to generate a TX_WRITE intent log record.
  */
 int
-zfs_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
+zfs_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
+    zio_t *zio)
 {
 	zfs_sb_t *zsb = arg;
 	objset_t *os = zsb->z_os;
@@ -1008,7 +1317,7 @@ zfs_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
 	}
 
 	zgd = (zgd_t *)kmem_zalloc(sizeof (zgd_t), KM_SLEEP);
-	zgd->zgd_zilog = zsb->z_log;
+	zgd->zgd_lwb = lwb;
 	zgd->zgd_private = zp;
 
 	/*
@@ -4762,4 +5071,6 @@ module_param(zfs_delete_blocks, ulong, 0644);
 MODULE_PARM_DESC(zfs_delete_blocks, "Delete files larger than N blocks async");
 module_param(zfs_read_chunk_size, long, 0644);
 MODULE_PARM_DESC(zfs_read_chunk_size, "Bytes to read per chunk");
+module_param(zfs_clone_max_blocks, ulong, 0644);
+MODULE_PARM_DESC(zfs_clone_max_blocks, "Max blocks cloned per transaction");
 #endif
@@ -598,6 +598,7 @@ zfs_znode_alloc(zfs_sb_t *zsb, dmu_buf_t *db, int blksz,
 	zp->z_unlinked = 0;
 	zp->z_atime_dirty = 0;
 	zp->z_mapcnt = 0;
+	zp->z_replay_eof = 0;
 	zp->z_id = db->db_object;
 	zp->z_blksz = blksz;
 	zp->z_seq = 0x7A4653;
@@ -1767,7 +1768,7 @@ zfs_create_fs(objset_t *os, cred_t *cr, nvlist_t *zplprops, dmu_tx_t *tx)
 	 * dnode_phys_t structure isn't initialized yet, dmu_object_next()
 	 * would fail and we'd have to skip to the next dnode block.
 	 */
-	os->os_obj_next = moid + 1;
+	os->os_obj_next_chunk = moid + 1;
 
 	/*
 	 * Set starting attributes.
@@ -84,6 +84,9 @@ zil_stats_t zil_stats = {
 	{ "zil_itx_metaslab_normal_bytes",	KSTAT_DATA_UINT64 },
 	{ "zil_itx_metaslab_slog_count",	KSTAT_DATA_UINT64 },
 	{ "zil_itx_metaslab_slog_bytes",	KSTAT_DATA_UINT64 },
+	{ "zil_lwb_count",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_size_bytes",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_used_bytes",			KSTAT_DATA_UINT64 },
 };
 
 static kstat_t *zil_ksp;
@@ -93,6 +96,20 @@ static kstat_t *zil_ksp;
  */
 int zil_replay_disable = 0;
 
+/*
+ * Number of threads used to apply log records during replay.  Records
+ * which only modify a single object are spread across this many lanes by
+ * object number, so each object still sees its records in log order.
+ * Setting this to 1 replays every record from the thread walking the log.
+ */
+int zil_replay_threads = 4;
+
+/*
+ * Upper bound on the log record bytes (including TX_WRITE data) copied
+ * out for the replay lanes and not yet applied.
+ */
+static uint64_t zil_replay_max_inflight = 64ULL << 20;
+
 /*
  * Tunable parameter for debugging or performance analysis.  Setting
  * zfs_nocacheflush will cause corruption on power loss if a volatile
@@ -100,7 +117,17 @@ int zil_replay_disable = 0;
  */
 int zfs_nocacheflush = 0;
 
+/*
+ * This controls the amount of time that a ZIL block (lwb) will remain
+ * "open" when it isn't "full", and it has a thread waiting for it to be
+ * committed to stable storage, expressed as a percentage of the latency
+ * of the most recent lwb write.  Larger values let more itxs share an
+ * lwb at the cost of zil_commit() latency.
+ */
+int zfs_commit_timeout_pct = 5;
+
 static kmem_cache_t *zil_lwb_cache;
+static kmem_cache_t *zil_zcw_cache;
 
 static void zil_async_to_sync(zilog_t *zilog, uint64_t foid);
 
@@ -272,6 +299,29 @@ zil_read_log_block(zilog_t *zilog, const blkptr_t *bp, blkptr_t *nbp, void *dst,
 	return (error);
 }
 
+/*
+ * Start reading the next log block in the chain while the current one is
+ * being parsed.  The chain can only be followed one block ahead, as each
+ * block carries the pointer to its successor.  The read is speculative:
+ * the block after the end of the chain is allocated but never written.
+ */
+static void
+zil_prefetch_log_block(zilog_t *zilog, const blkptr_t *bp)
+{
+	enum zio_flag zio_flags = ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE;
+	arc_flags_t aflags = ARC_FLAG_NOWAIT | ARC_FLAG_PREFETCH;
+	zbookmark_phys_t zb;
+
+	if (zilog->zl_header->zh_claim_txg == 0)
+		zio_flags |= ZIO_FLAG_SCRUB;
+
+	SET_BOOKMARK(&zb, bp->blk_cksum.zc_word[ZIL_ZC_OBJSET],
+	    ZB_ZIL_OBJECT, ZB_ZIL_LEVEL, bp->blk_cksum.zc_word[ZIL_ZC_SEQ]);
+
+	(void) arc_read(NULL, zilog->zl_spa, bp, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_READ, zio_flags, &aflags, &zb);
+}
+
 /*
  * Read a TX_WRITE log data block.
  */
@@ -368,6 +418,9 @@ zil_parse(zilog_t *zilog, zil_parse_blk_func_t *parse_blk_func,
 		if (error != 0)
 			break;
 
+		if (next_blk.blk_cksum.zc_word[ZIL_ZC_SEQ] <= claim_blk_seq)
+			zil_prefetch_log_block(zilog, &next_blk);
+
 		for (lrp = lrbuf; lrp < end; lrp += reclen) {
 			lr_t *lr = (lr_t *)lrp;
 			reclen = lr->lrc_reclen;
@@ -471,10 +524,13 @@ zil_alloc_lwb(zilog_t *zilog, blkptr_t *bp, uint64_t txg, boolean_t fastwrite)
 	lwb->lwb_zilog = zilog;
 	lwb->lwb_blk = *bp;
 	lwb->lwb_fastwrite = fastwrite;
+	lwb->lwb_state = LWB_STATE_CLOSED;
 	lwb->lwb_buf = zio_buf_alloc(BP_GET_LSIZE(bp));
 	lwb->lwb_max_txg = txg;
-	lwb->lwb_zio = NULL;
+	lwb->lwb_write_zio = NULL;
+	lwb->lwb_root_zio = NULL;
 	lwb->lwb_tx = NULL;
+	lwb->lwb_issued_timestamp = 0;
 	if (BP_GET_CHECKSUM(bp) == ZIO_CHECKSUM_ZILOG2) {
 		lwb->lwb_nused = sizeof (zil_chain_t);
 		lwb->lwb_sz = BP_GET_LSIZE(bp);
@@ -487,9 +543,37 @@ zil_alloc_lwb(zilog_t *zilog, blkptr_t *bp, uint64_t txg, boolean_t fastwrite)
 	list_insert_tail(&zilog->zl_lwb_list, lwb);
 	mutex_exit(&zilog->zl_lock);
 
+	ASSERT(!MUTEX_HELD(&lwb->lwb_vdev_lock));
+	ASSERT(avl_is_empty(&lwb->lwb_vdev_tree));
+	VERIFY(list_is_empty(&lwb->lwb_waiters));
+	VERIFY(list_is_empty(&lwb->lwb_itxs));
+
 	return (lwb);
 }
 
+static void
+zil_free_lwb(zilog_t *zilog, lwb_t *lwb)
+{
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+	ASSERT(!MUTEX_HELD(&lwb->lwb_vdev_lock));
+	VERIFY(list_is_empty(&lwb->lwb_waiters));
+	VERIFY(list_is_empty(&lwb->lwb_itxs));
+	ASSERT(avl_is_empty(&lwb->lwb_vdev_tree));
+	ASSERT3P(lwb->lwb_write_zio, ==, NULL);
+	ASSERT3P(lwb->lwb_root_zio, ==, NULL);
+	ASSERT(lwb->lwb_state == LWB_STATE_CLOSED ||
+	    lwb->lwb_state == LWB_STATE_DONE);
+
+	/*
+	 * Clear the zilog's field to indicate this lwb is no longer
+	 * valid, and prevent use-after-free errors.
+	 */
+	if (zilog->zl_last_lwb_opened == lwb)
+		zilog->zl_last_lwb_opened = NULL;
+
+	kmem_cache_free(zil_lwb_cache, lwb);
+}
+
 /*
  * Called when we create in-memory log transactions so that we know
  * to cleanup the itxs at the end of spa_sync().
@@ -506,6 +590,8 @@ zilog_dirty(zilog_t *zilog, uint64_t txg)
 	if (txg_list_add(&dp->dp_dirty_zilogs, zilog, txg)) {
 		/* up the hold count until we can be written out */
 		dmu_buf_add_ref(ds->ds_dbuf, zilog);
+
+		zilog->zl_dirty_max_txg = MAX(txg, zilog->zl_dirty_max_txg);
 	}
 }
 
@@ -633,15 +719,15 @@ zil_destroy(zilog_t *zilog, boolean_t keep_first)
 		ASSERT(zh->zh_claim_txg == 0);
 		VERIFY(!keep_first);
 		while ((lwb = list_head(&zilog->zl_lwb_list)) != NULL) {
-			ASSERT(lwb->lwb_zio == NULL);
 			if (lwb->lwb_fastwrite)
 				metaslab_fastwrite_unmark(zilog->zl_spa,
 				    &lwb->lwb_blk);
+
 			list_remove(&zilog->zl_lwb_list, lwb);
 			if (lwb->lwb_buf != NULL)
 				zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
 			zio_free_zil(zilog->zl_spa, txg, &lwb->lwb_blk);
-			kmem_cache_free(zil_lwb_cache, lwb);
+			zil_free_lwb(zilog, lwb);
 		}
 	} else if (!keep_first) {
 		zil_destroy_sync(zilog, tx);
@@ -781,7 +867,7 @@ zil_check_log_chain(dsl_pool_t *dp, dsl_dataset_t *ds, void *tx)
 }
 
 static int
-zil_vdev_compare(const void *x1, const void *x2)
+zil_lwb_vdev_compare(const void *x1, const void *x2)
 {
 	const uint64_t v1 = ((zil_vdev_node_t *)x1)->zv_vdev;
 	const uint64_t v2 = ((zil_vdev_node_t *)x2)->zv_vdev;
@@ -795,9 +881,9 @@ zil_vdev_compare(const void *x1, const void *x2)
 }
 
 void
-zil_add_block(zilog_t *zilog, const blkptr_t *bp)
+zil_lwb_add_block(lwb_t *lwb, const blkptr_t *bp)
 {
-	avl_tree_t *t = &zilog->zl_vdev_tree;
+	avl_tree_t *t = &lwb->lwb_vdev_tree;
 	avl_index_t where;
 	zil_vdev_node_t *zv, zvsearch;
 	int ndvas = BP_GET_NDVAS(bp);
@@ -806,14 +892,11 @@ zil_add_block(zilog_t *zilog, const blkptr_t *bp)
 	if (zfs_nocacheflush)
 		return;
 
-	ASSERT(zilog->zl_writer);
-
 	/*
-	 * Even though we're zl_writer, we still need a lock because the
-	 * zl_get_data() callbacks may have dmu_sync() done callbacks
-	 * that will run concurrently.
+	 * The zl_get_data() callbacks may have dmu_sync() done callbacks
+	 * that run concurrently with the thread filling this lwb.
 	 */
-	mutex_enter(&zilog->zl_vdev_lock);
+	mutex_enter(&lwb->lwb_vdev_lock);
 	for (i = 0; i < ndvas; i++) {
 		zvsearch.zv_vdev = DVA_GET_VDEV(&bp->blk_dva[i]);
 		if (avl_find(t, &zvsearch, &where) == NULL) {
@@ -822,56 +905,116 @@ zil_add_block(zilog_t *zilog, const blkptr_t *bp)
 			avl_insert(t, zv, where);
 		}
 	}
-	mutex_exit(&zilog->zl_vdev_lock);
+	mutex_exit(&lwb->lwb_vdev_lock);
 }
 
+/*
+ * This function is a called after all VDEVs associated with a given lwb
+ * write have completed their DKIOCFLUSHWRITECACHE command; or as soon
+ * as the lwb write completes, if "zfs_nocacheflush" is set.
+ *
+ * The intention is for this function to be called as soon as the
+ * contents of an lwb are considered "stable" on disk, and will survive
+ * any sudden loss of power. At this point, any threads waiting for the
+ * lwb to reach this state are signalled, and the "waiter" structures
+ * are marked "done".
+ */
 static void
-zil_flush_vdevs(zilog_t *zilog)
+zil_lwb_flush_vdevs_done(zio_t *zio)
 {
-	spa_t *spa = zilog->zl_spa;
-	avl_tree_t *t = &zilog->zl_vdev_tree;
-	void *cookie = NULL;
-	zil_vdev_node_t *zv;
-	zio_t *zio;
+	lwb_t *lwb = zio->io_private;
+	zilog_t *zilog = lwb->lwb_zilog;
+	dmu_tx_t *tx = lwb->lwb_tx;
+	zil_commit_waiter_t *zcw;
+	itx_t *itx;
+
+	spa_config_exit(zilog->zl_spa, SCL_STATE, lwb);
+
+	zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
 
-	ASSERT(zilog->zl_writer);
+	mutex_enter(&zilog->zl_lock);
 
 	/*
-	 * We don't need zl_vdev_lock here because we're the zl_writer,
-	 * and all zl_get_data() callbacks are done.
+	 * Ensure the lwb buffer pointer is cleared before releasing the
+	 * txg. If we have had an allocation failure and the txg is
+	 * waiting to sync then we want zil_sync() to remove the lwb so
+	 * that it's not picked up as the next new one in
+	 * zil_process_commit_list(). zil_sync() will only remove the
+	 * lwb if lwb_buf is null.
 	 */
-	if (avl_numnodes(t) == 0)
-		return;
+	lwb->lwb_buf = NULL;
+	lwb->lwb_tx = NULL;
 
-	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	ASSERT3U(lwb->lwb_issued_timestamp, >, 0);
+	zilog->zl_last_lwb_latency = gethrtime() - lwb->lwb_issued_timestamp;
 
-	zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	lwb->lwb_root_zio = NULL;
+	lwb->lwb_state = LWB_STATE_DONE;
 
-	while ((zv = avl_destroy_nodes(t, &cookie)) != NULL) {
-		vdev_t *vd = vdev_lookup_top(spa, zv->zv_vdev);
-		if (vd != NULL)
-			zio_flush(zio, vd);
-		kmem_free(zv, sizeof (*zv));
+	if (zilog->zl_last_lwb_opened == lwb) {
+		/*
+		 * Remember the highest committed log sequence number
+		 * for ztest. We only update this value when all the log
+		 * writes succeeded, because ztest wants to ASSERT that
+		 * it got the whole log chain.
+		 */
+		zilog->zl_commit_lr_seq = zilog->zl_lr_seq;
+	}
+
+	while ((itx = list_head(&lwb->lwb_itxs)) != NULL) {
+		list_remove(&lwb->lwb_itxs, itx);
+		zil_itx_destroy(itx);
+	}
+
+	while ((zcw = list_head(&lwb->lwb_waiters)) != NULL) {
+		mutex_enter(&zcw->zcw_lock);
+
+		ASSERT(list_link_active(&zcw->zcw_node));
+		list_remove(&lwb->lwb_waiters, zcw);
+
+		ASSERT3P(zcw->zcw_lwb, ==, lwb);
+		zcw->zcw_lwb = NULL;
+
+		zcw->zcw_zio_error = zio->io_error;
+
+		ASSERT(!zcw->zcw_done);
+		zcw->zcw_done = B_TRUE;
+		cv_broadcast(&zcw->zcw_cv);
+
+		mutex_exit(&zcw->zcw_lock);
 	}
 
+	mutex_exit(&zilog->zl_lock);
+
 	/*
-	 * Wait for all the flushes to complete.  Not all devices actually
-	 * support the DKIOCFLUSHWRITECACHE ioctl, so it's OK if it fails.
+	 * Now that we've written this log block, we have a stable pointer
+	 * to the next block in the chain, so it's OK to let the txg in
+	 * which we allocated the next block sync.
 	 */
-	(void) zio_wait(zio);
-
-	spa_config_exit(spa, SCL_STATE, FTAG);
+	dmu_tx_commit(tx);
 }
 
 /*
- * Function called when a log block write completes
+ * This is called when an lwb write completes. This means, this specific
+ * lwb was written to disk, and all dependent lwb have also been
+ * written to disk.
+ *
+ * At this point, a DKIOCFLUSHWRITECACHE command hasn't been issued to
+ * the VDEVs involved in writing out this specific lwb. The lwb will be
+ * "done" once zil_lwb_flush_vdevs_done() is called, which occurs in the
+ * zio completion callback for the lwb's root zio.
  */
 static void
 zil_lwb_write_done(zio_t *zio)
 {
 	lwb_t *lwb = zio->io_private;
+	spa_t *spa = zio->io_spa;
 	zilog_t *zilog = lwb->lwb_zilog;
-	dmu_tx_t *tx = lwb->lwb_tx;
+	avl_tree_t *t = &lwb->lwb_vdev_tree;
+	void *cookie = NULL;
+	zil_vdev_node_t *zv;
+
+	ASSERT3S(spa_config_held(spa, SCL_STATE, RW_READER), !=, 0);
 
 	ASSERT(BP_GET_COMPRESS(zio->io_bp) == ZIO_COMPRESS_OFF);
 	ASSERT(BP_GET_TYPE(zio->io_bp) == DMU_OT_INTENT_LOG);
@@ -881,76 +1024,121 @@ zil_lwb_write_done(zio_t *zio)
 	ASSERT(!BP_IS_HOLE(zio->io_bp));
 	ASSERT(BP_GET_FILL(zio->io_bp) == 0);
 
-	/*
-	 * Ensure the lwb buffer pointer is cleared before releasing
-	 * the txg. If we have had an allocation failure and
-	 * the txg is waiting to sync then we want want zil_sync()
-	 * to remove the lwb so that it's not picked up as the next new
-	 * one in zil_commit_writer(). zil_sync() will only remove
-	 * the lwb if lwb_buf is null.
-	 */
-	zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
+	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_ISSUED);
+
 	mutex_enter(&zilog->zl_lock);
-	lwb->lwb_zio = NULL;
+	lwb->lwb_write_zio = NULL;
 	lwb->lwb_fastwrite = FALSE;
-	lwb->lwb_buf = NULL;
-	lwb->lwb_tx = NULL;
 	mutex_exit(&zilog->zl_lock);
 
+	if (avl_numnodes(t) == 0)
+		return;
+
 	/*
-	 * Now that we've written this log block, we have a stable pointer
-	 * to the next block in the chain, so it's OK to let the txg in
-	 * which we allocated the next block sync.
+	 * If there was an IO error, we're not going to call zio_flush()
+	 * on these vdevs, so we simply empty the tree and free the
+	 * nodes. We avoid calling zio_flush() since there isn't any
+	 * good reason for doing so, after the lwb block failed to be
+	 * written out.
 	 */
-	dmu_tx_commit(tx);
+	if (zio->io_error != 0) {
+		while ((zv = avl_destroy_nodes(t, &cookie)) != NULL)
+			kmem_free(zv, sizeof (*zv));
+		return;
+	}
+
+	/*
+	 * Not all devices actually support the DKIOCFLUSHWRITECACHE
+	 * ioctl, so the flushes don't propagate errors to the root zio.
+	 */
+	while ((zv = avl_destroy_nodes(t, &cookie)) != NULL) {
+		vdev_t *vd = vdev_lookup_top(spa, zv->zv_vdev);
+		if (vd != NULL)
+			zio_flush(lwb->lwb_root_zio, vd);
+		kmem_free(zv, sizeof (*zv));
+	}
 }
 
 /*
- * Initialize the io for a log block.
+ * This function's purpose is to "open" an lwb such that it is ready to
+ * accept new itxs being committed to it. To do this, the lwb's zio
+ * structures are created, and linked to the lwb. This function is
+ * idempotent; if the passed in lwb has already been opened, this
+ * function is essentially a no-op.
  */
 static void
-zil_lwb_write_init(zilog_t *zilog, lwb_t *lwb)
+zil_lwb_write_open(zilog_t *zilog, lwb_t *lwb)
 {
 	zbookmark_phys_t zb;
 
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+	ASSERT3P(lwb, !=, NULL);
+	EQUIV(lwb->lwb_root_zio == NULL, lwb->lwb_state == LWB_STATE_CLOSED);
+	EQUIV(lwb->lwb_root_zio != NULL, lwb->lwb_state == LWB_STATE_OPENED);
+
 	SET_BOOKMARK(&zb, lwb->lwb_blk.blk_cksum.zc_word[ZIL_ZC_OBJSET],
 	    ZB_ZIL_OBJECT, ZB_ZIL_LEVEL,
 	    lwb->lwb_blk.blk_cksum.zc_word[ZIL_ZC_SEQ]);
 
-	if (zilog->zl_root_zio == NULL) {
-		zilog->zl_root_zio = zio_root(zilog->zl_spa, NULL, NULL,
-		    ZIO_FLAG_CANFAIL);
-	}
-
 	/* Lock so zil_sync() doesn't fastwrite_unmark after zio is created */
 	mutex_enter(&zilog->zl_lock);
-	if (lwb->lwb_zio == NULL) {
+	if (lwb->lwb_root_zio == NULL) {
+		lwb_t *last_lwb_opened = zilog->zl_last_lwb_opened;
+
 		if (!lwb->lwb_fastwrite) {
 			metaslab_fastwrite_mark(zilog->zl_spa, &lwb->lwb_blk);
 			lwb->lwb_fastwrite = 1;
 		}
-		lwb->lwb_zio = zio_rewrite(zilog->zl_root_zio, zilog->zl_spa,
-		    0, &lwb->lwb_blk, lwb->lwb_buf, BP_GET_LSIZE(&lwb->lwb_blk),
-		    zil_lwb_write_done, lwb, ZIO_PRIORITY_SYNC_WRITE,
-		    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE |
+
+		lwb->lwb_root_zio = zio_root(zilog->zl_spa,
+		    zil_lwb_flush_vdevs_done, lwb, ZIO_FLAG_CANFAIL);
+		ASSERT3P(lwb->lwb_root_zio, !=, NULL);
+
+		/*
+		 * Unlike the flushes, a failed write must reach the root
+		 * zio, and through it every later lwb, so that their
+		 * waiters fall back to txg_wait_synced().
+		 */
+		lwb->lwb_write_zio = zio_rewrite(lwb->lwb_root_zio,
+		    zilog->zl_spa, 0, &lwb->lwb_blk, lwb->lwb_buf,
+		    BP_GET_LSIZE(&lwb->lwb_blk), zil_lwb_write_done, lwb,
+		    ZIO_PRIORITY_SYNC_WRITE, ZIO_FLAG_CANFAIL |
 		    ZIO_FLAG_FASTWRITE, &zb);
+		ASSERT3P(lwb->lwb_write_zio, !=, NULL);
+
+		lwb->lwb_state = LWB_STATE_OPENED;
+
+		/*
+		 * The zilog's "zl_last_lwb_opened" field is used to
+		 * build the lwb/zio dependency chain, which is used to
+		 * preserve the ordering of lwb completions that is
+		 * required by the semantics of the ZIL. Each new lwb
+		 * zio becomes a parent of the "previous" lwb zio, such
+		 * that the new lwb's zio cannot complete until the
+		 * "previous" lwb's zio completes.
+		 *
+		 * This is required by the semantics of zil_commit();
+		 * the commit waiters attached to the lwbs will be woken
+		 * in the lwb zio's completion callback, so this zio
+		 * dependency graph ensures the waiters are woken in the
+		 * correct order (the same order the lwbs were created).
+		 */
+		if (last_lwb_opened != NULL &&
+		    last_lwb_opened->lwb_state != LWB_STATE_DONE) {
+			ASSERT(last_lwb_opened->lwb_state == LWB_STATE_OPENED ||
+			    last_lwb_opened->lwb_state == LWB_STATE_ISSUED);
+			ASSERT3P(last_lwb_opened->lwb_root_zio, !=, NULL);
+			zio_add_child(lwb->lwb_root_zio,
+			    last_lwb_opened->lwb_root_zio);
+		}
+		zilog->zl_last_lwb_opened = lwb;
 	}
 	mutex_exit(&zilog->zl_lock);
-}
 
-/*
- * Define a limited set of intent log block sizes.
- *
- * These must be a multiple of 4KB. Note only the amount used (again
- * aligned to 4KB) actually gets written. However, we can't always just
- * allocate SPA_OLD_MAXBLOCKSIZE as the slog space could be exhausted.
- */
-uint64_t zil_block_buckets[] = {
-    4096,		/* non TX_WRITE */
-    8192+4096,		/* data base */
-    32*1024 + 4096, 	/* NFS writes */
-    UINT64_MAX
-};
+	ASSERT3P(lwb->lwb_root_zio, !=, NULL);
+	ASSERT3P(lwb->lwb_write_zio, !=, NULL);
+	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_OPENED);
+}
 
 /*
  * Use the slog as long as the current commit size is less than the
@@ -962,11 +1150,78 @@ unsigned long zil_slog_limit = 1024 * 1024;
 	((zilog)->zl_itx_list_sz < (zil_slog_limit << 1)))
 
 /*
- * Start a log block write and advance to the next log block.
- * Calls are serialized.
+ * With logbias=latency and a separate log device, sync writes larger than
+ * this are written once, directly to their final location in the pool,
+ * and only their block pointers are logged to the slog.  Zero logs the
+ * data of every such write to the slog.
+ */
+unsigned long zil_slog_write_sz = 0;
+
+/*
+ * A commit "burst" is the log records written between two points at
+ * which a commit waiter had to issue a partly filled lwb; remember its
+ * size so that the following log blocks can be sized from it.
+ */
+static void
+zil_burst_done(zilog_t *zilog)
+{
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+
+	zilog->zl_prev_bursts[zilog->zl_prev_rotor] = zilog->zl_cur_used;
+	zilog->zl_prev_rotor = (zilog->zl_prev_rotor + 1) &
+	    (ZIL_PREV_BURSTS - 1);
+	zilog->zl_cur_used = 0;
+}
+
+/*
+ * Predict the size of the next log block.
+ *
+ * Log blocks are pre-allocated, one ahead of the block being written,
+ * so the size has to be guessed before the records that will fill it
+ * are known.  Only the amount used (rounded up to ZIL_MIN_BLKSZ) is
+ * written, but allocating ZIL_MAX_BLKSZ every time could exhaust the
+ * log space, while blocks that are too small split a commit into many
+ * writes.
+ *
+ * The block is sized to hold the largest of the recent commits in one
+ * piece, plus the zil_chain_t that points to the block after it.  A
+ * single outlier more than twice the size of any other recent commit
+ * is ignored, so that one large fsync doesn't inflate the following
+ * blocks.  If the commit in progress has already grown past that, the
+ * workload is streaming and the block is sized for it instead.
+ */
+static uint64_t
+zil_lwb_predict(zilog_t *zilog)
+{
+	uint64_t m1 = 0, m2 = 0, size;
+	int i;
+
+	for (i = 0; i < ZIL_PREV_BURSTS; i++) {
+		uint64_t b = zilog->zl_prev_bursts[i];
+
+		if (b >= m1) {
+			m2 = m1;
+			m1 = b;
+		} else if (b > m2) {
+			m2 = b;
+		}
+	}
+
+	size = (m1 < m2 * 2) ? m1 : m2;
+	size = MAX(size, zilog->zl_cur_used) + sizeof (zil_chain_t);
+	if (size >= ZIL_MAX_BLKSZ)
+		return (ZIL_MAX_BLKSZ);
+
+	return (P2ROUNDUP_TYPED(size, ZIL_MIN_BLKSZ, uint64_t));
+}
+
+/*
+ * This function's purpose is to "issue" the lwb to disk, after the lwb
+ * has been filled with itxs, and to advance to the next log block.
+ * Calls are serialized by the zilog's "zl_issuer_lock".
  */
 static lwb_t *
-zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
+zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
 {
 	lwb_t *nlwb = NULL;
 	zil_chain_t *zilc;
@@ -975,9 +1230,12 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	dmu_tx_t *tx;
 	uint64_t txg;
 	uint64_t zil_blksz, wsz;
-	int i, error;
+	int error;
 	boolean_t use_slog;
 
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_OPENED);
+
 	if (BP_GET_CHECKSUM(&lwb->lwb_blk) == ZIO_CHECKSUM_ZILOG2) {
 		zilc = (zil_chain_t *)lwb->lwb_buf;
 		bp = &zilc->zc_next_blk;
@@ -993,7 +1251,8 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	 * before writing it in order to establish the log chain.
 	 * Note that if the allocation of nlwb synced before we wrote
 	 * the block that points at it (lwb), we'd leak it if we crashed.
-	 * Therefore, we don't do dmu_tx_commit() until zil_lwb_write_done().
+	 * Therefore, we don't do dmu_tx_commit() until
+	 * zil_lwb_flush_vdevs_done().
 	 * We dirty the dataset to ensure that zil_sync() will be called
 	 * to clean up in the event of allocation failure or I/O failure.
 	 */
@@ -1004,32 +1263,7 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 
 	lwb->lwb_tx = tx;
 
-	/*
-	 * Log blocks are pre-allocated. Here we select the size of the next
-	 * block, based on size used in the last block.
-	 * - first find the smallest bucket that will fit the block from a
-	 *   limited set of block sizes. This is because it's faster to write
-	 *   blocks allocated from the same metaslab as they are adjacent or
-	 *   close.
-	 * - next find the maximum from the new suggested size and an array of
-	 *   previous sizes. This lessens a picket fence effect of wrongly
-	 *   guesssing the size if we have a stream of say 2k, 64k, 2k, 64k
-	 *   requests.
-	 *
-	 * Note we only write what is used, but we can't just allocate
-	 * the maximum block size because we can exhaust the available
-	 * pool log space.
-	 */
-	zil_blksz = zilog->zl_cur_used + sizeof (zil_chain_t);
-	for (i = 0; zil_blksz > zil_block_buckets[i]; i++)
-		continue;
-	zil_blksz = zil_block_buckets[i];
-	if (zil_blksz == UINT64_MAX)
-		zil_blksz = SPA_OLD_MAXBLOCKSIZE;
-	zilog->zl_prev_blks[zilog->zl_prev_rotor] = zil_blksz;
-	for (i = 0; i < ZIL_PREV_BLKS; i++)
-		zil_blksz = MAX(zil_blksz, zilog->zl_prev_blks[i]);
-	zilog->zl_prev_rotor = (zilog->zl_prev_rotor + 1) & (ZIL_PREV_BLKS - 1);
+	zil_blksz = zil_lwb_predict(zilog);
 
 	BP_ZERO(bp);
 	use_slog = USE_SLOG(zilog);
@@ -1051,16 +1285,13 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 		 * Allocate a new log write buffer (lwb).
 		 */
 		nlwb = zil_alloc_lwb(zilog, bp, txg, TRUE);
-
-		/* Record the block for later vdev flushing */
-		zil_add_block(zilog, &lwb->lwb_blk);
 	}
 
 	if (BP_GET_CHECKSUM(&lwb->lwb_blk) == ZIO_CHECKSUM_ZILOG2) {
 		/* For Slim ZIL only write what is used. */
 		wsz = P2ROUNDUP_TYPED(lwb->lwb_nused, ZIL_MIN_BLKSZ, uint64_t);
 		ASSERT3U(wsz, <=, lwb->lwb_sz);
-		zio_shrink(lwb->lwb_zio, wsz);
+		zio_shrink(lwb->lwb_write_zio, wsz);
 
 	} else {
 		wsz = lwb->lwb_sz;
@@ -1070,12 +1301,28 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	zilc->zc_nused = lwb->lwb_nused;
 	zilc->zc_eck.zec_cksum = lwb->lwb_blk.blk_cksum;
 
+	ZIL_STAT_BUMP(zil_lwb_count);
+	ZIL_STAT_INCR(zil_lwb_size_bytes, BP_GET_LSIZE(&lwb->lwb_blk));
+	ZIL_STAT_INCR(zil_lwb_used_bytes, lwb->lwb_nused);
+
 	/*
 	 * clear unused data for security
 	 */
 	bzero(lwb->lwb_buf + lwb->lwb_nused, wsz - lwb->lwb_nused);
 
-	zio_nowait(lwb->lwb_zio); /* Kick off the write for the old log block */
+	/*
+	 * The configuration is held until zil_lwb_flush_vdevs_done(), so
+	 * that the vdevs recorded for flushing can't go away.
+	 */
+	spa_config_enter(spa, SCL_STATE, lwb, RW_READER);
+
+	/* Record the block for later vdev flushing */
+	zil_lwb_add_block(lwb, &lwb->lwb_blk);
+	lwb->lwb_issued_timestamp = gethrtime();
+	lwb->lwb_state = LWB_STATE_ISSUED;
+
+	zio_nowait(lwb->lwb_root_zio);
+	zio_nowait(lwb->lwb_write_zio);
 
 	/*
 	 * If there was an allocation failure then nlwb will be null which
@@ -1084,6 +1331,63 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	return (nlwb);
 }
 
+/*
+ * Mark a commit waiter "done" without it having been attached to an lwb;
+ * the itxs it was waiting on are already on stable storage (or never
+ * will be, and the caller has waited for the txg to sync instead).
+ */
+static void
+zil_commit_waiter_skip(zil_commit_waiter_t *zcw)
+{
+	mutex_enter(&zcw->zcw_lock);
+	ASSERT(!zcw->zcw_done);
+	zcw->zcw_done = B_TRUE;
+	cv_broadcast(&zcw->zcw_cv);
+	mutex_exit(&zcw->zcw_lock);
+}
+
+/*
+ * This function is used when the given waiter is to be linked into an
+ * lwb's "lwb_waiter" list; i.e. when the itx is committed to the lwb.
+ * At this point, the waiter will no longer be referenced by the itx,
+ * and instead, will be referenced by the lwb.
+ */
+static void
+zil_commit_waiter_link_lwb(zil_commit_waiter_t *zcw, lwb_t *lwb)
+{
+	/*
+	 * The lwb_waiters field of the lwb is protected by the zilog's
+	 * zl_lock, thus it must be held when calling this function.
+	 */
+	ASSERT(MUTEX_HELD(&lwb->lwb_zilog->zl_lock));
+
+	mutex_enter(&zcw->zcw_lock);
+	ASSERT(!list_link_active(&zcw->zcw_node));
+	ASSERT3P(zcw->zcw_lwb, ==, NULL);
+	ASSERT3P(lwb, !=, NULL);
+	ASSERT(lwb->lwb_state == LWB_STATE_OPENED ||
+	    lwb->lwb_state == LWB_STATE_ISSUED);
+
+	list_insert_tail(&lwb->lwb_waiters, zcw);
+	zcw->zcw_lwb = lwb;
+	mutex_exit(&zcw->zcw_lock);
+}
+
+/*
+ * This function is used when zio_alloc_zil() fails to allocate a ZIL
+ * block, and the given waiter must be linked to the "nolwb waiters"
+ * list inside of zil_process_commit_list().
+ */
+static void
+zil_commit_waiter_link_nolwb(zil_commit_waiter_t *zcw, list_t *nolwb)
+{
+	mutex_enter(&zcw->zcw_lock);
+	ASSERT(!list_link_active(&zcw->zcw_node));
+	ASSERT3P(zcw->zcw_lwb, ==, NULL);
+	list_insert_tail(nolwb, zcw);
+	mutex_exit(&zcw->zcw_lock);
+}
+
 static lwb_t *
 zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 {
@@ -1094,29 +1398,48 @@ zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 	uint64_t reclen = lrc->lrc_reclen;
 	uint64_t dlen = 0;
 
-	if (lwb == NULL)
-		return (NULL);
-
-	ASSERT(lwb->lwb_buf != NULL);
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+	ASSERT3P(lwb, !=, NULL);
+	ASSERT3P(lwb->lwb_buf, !=, NULL);
 	ASSERT(zilog_is_dirty(zilog) ||
 	    spa_freeze_txg(zilog->zl_spa) != UINT64_MAX);
 
+	zil_lwb_write_open(zilog, lwb);
+
+	/*
+	 * A commit itx doesn't represent any on-disk state; instead
+	 * it's simply used as a place holder on the commit list, and
+	 * provides a mechanism for attaching a "commit waiter" onto the
+	 * correct lwb (such that the waiter can be signalled upon
+	 * completion of that lwb). Thus, we don't process this itx's
+	 * log record if it's a commit itx (these itx's don't have log
+	 * records), and instead link the itx's waiter onto the lwb's
+	 * list of waiters.
+	 *
+	 * For more details, see the comment above zil_commit().
+	 */
+	if (lrc->lrc_txtype == TX_COMMIT) {
+		mutex_enter(&zilog->zl_lock);
+		zil_commit_waiter_link_lwb(itx->itx_private, lwb);
+		itx->itx_private = NULL;
+		mutex_exit(&zilog->zl_lock);
+		return (lwb);
+	}
+
 	if (lrc->lrc_txtype == TX_WRITE && itx->itx_wr_state == WR_NEED_COPY)
 		dlen = P2ROUNDUP_TYPED(
 		    lrw->lr_length, sizeof (uint64_t), uint64_t);
 
 	zilog->zl_cur_used += (reclen + dlen);
 
-	zil_lwb_write_init(zilog, lwb);
-
 	/*
 	 * If this record won't fit in the current log block, start a new one.
 	 */
 	if (lwb->lwb_nused + reclen + dlen > lwb->lwb_sz) {
-		lwb = zil_lwb_write_start(zilog, lwb);
+		lwb = zil_lwb_write_issue(zilog, lwb);
 		if (lwb == NULL)
 			return (NULL);
-		zil_lwb_write_init(zilog, lwb);
+		zil_lwb_write_open(zilog, lwb);
 		ASSERT(LWB_EMPTY(lwb));
 		if (lwb->lwb_nused + reclen + dlen > lwb->lwb_sz) {
 			txg_wait_synced(zilog->zl_dmu_pool, txg);
@@ -1158,8 +1481,8 @@ zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 				ZIL_STAT_INCR(zil_itx_indirect_bytes,
 				    lrw->lr_length);
 			}
-			error = zilog->zl_get_data(
-			    itx->itx_private, lrw, dbuf, lwb->lwb_zio);
+			error = zilog->zl_get_data(itx->itx_private, lrw,
+			    dbuf, lwb, lwb->lwb_write_zio);
 			if (error == EIO) {
 				txg_wait_synced(zilog->zl_dmu_pool, txg);
 				return (lwb);
@@ -1209,9 +1532,50 @@ zil_itx_create(uint64_t txtype, size_t lrsize)
 void
 zil_itx_destroy(itx_t *itx)
 {
+	IMPLY(itx->itx_lr.lrc_txtype == TX_COMMIT, itx->itx_callback == NULL);
+
+	if (itx->itx_callback != NULL)
+		itx->itx_callback(itx->itx_callback_data);
+
 	zio_data_buf_free(itx, offsetof(itx_t, itx_lr)+itx->itx_lr.lrc_reclen);
 }
 
+/*
+ * Free up a list of itxs which has been detached from the zilog.
+ */
+static void
+zil_itx_list_clean(list_t *list)
+{
+	itx_t *itx;
+
+	while ((itx = list_head(list)) != NULL) {
+		/*
+		 * In the general case, commit itxs will not be found
+		 * here, as they'll be committed to an lwb via
+		 * zil_lwb_commit(), and free'd in that function. Having
+		 * said that, it is still possible for commit itxs to be
+		 * found here, due to the following race:
+		 *
+		 *	- a thread calls zil_commit() which assigns the
+		 *	  commit itx to a per-txg i_sync_list
+		 *	- zil_itxg_clean() is called (e.g. via spa_sync())
+		 *	  while the waiter is still on the i_sync_list
+		 *
+		 * There's nothing to prevent syncing the txg while the
+		 * waiter is on the i_sync_list. This normally doesn't
+		 * happen because spa_sync() is slower than zil_commit(),
+		 * but if zil_commit() calls txg_wait_synced() (e.g.
+		 * because zil_create() or zil_commit_writer_stall() is
+		 * called) we will hit this case.
+		 */
+		if (itx->itx_lr.lrc_txtype == TX_COMMIT)
+			zil_commit_waiter_skip(itx->itx_private);
+
+		list_remove(list, itx);
+		zil_itx_destroy(itx);
+	}
+}
+
 /*
  * Free up the sync and async itxs. The itxs_t has already been detached
  * so no locks are needed.
@@ -1225,21 +1589,15 @@ zil_itxg_clean(itxs_t *itxs)
 	void *cookie;
 	itx_async_node_t *ian;
 
-	list = &itxs->i_sync_list;
-	while ((itx = list_head(list)) != NULL) {
-		if (itx->itx_callback != NULL)
-			itx->itx_callback(itx->itx_callback_data);
-		list_remove(list, itx);
-		zil_itx_destroy(itx);
-	}
+	zil_itx_list_clean(&itxs->i_sync_list);
 
 	cookie = NULL;
 	t = &itxs->i_async_tree;
 	while ((ian = avl_destroy_nodes(t, &cookie)) != NULL) {
 		list = &ian->ia_list;
 		while ((itx = list_head(list)) != NULL) {
-			if (itx->itx_callback != NULL)
-				itx->itx_callback(itx->itx_callback_data);
+			/* commit itxs should never be on the async lists. */
+			ASSERT3U(itx->itx_lr.lrc_txtype, !=, TX_COMMIT);
 			list_remove(list, itx);
 			zil_itx_destroy(itx);
 		}
@@ -1266,47 +1624,203 @@ zil_aitx_compare(const void *x1, const void *x2)
 }
 
 /*
- * Remove all async itx with the given oid.
+ * Add an itx to the sync list or to its object's async list.
  */
 static void
-zil_remove_async(zilog_t *zilog, uint64_t oid)
+zil_itxs_add(itxs_t *itxs, itx_t *itx)
 {
-	uint64_t otxg, txg;
-	itx_async_node_t *ian;
-	avl_tree_t *t;
-	avl_index_t where;
-	list_t clean_list;
-	itx_t *itx;
-
-	ASSERT(oid != 0);
-	list_create(&clean_list, sizeof (itx_t), offsetof(itx_t, itx_node));
-
-	if (spa_freeze_txg(zilog->zl_spa) != UINT64_MAX) /* ziltest support */
-		otxg = ZILTEST_TXG;
-	else
-		otxg = spa_last_synced_txg(zilog->zl_spa) + 1;
-
-	for (txg = otxg; txg < (otxg + TXG_CONCURRENT_STATES); txg++) {
-		itxg_t *itxg = &zilog->zl_itxg[txg & TXG_MASK];
+	if (itx->itx_sync) {
+		list_insert_tail(&itxs->i_sync_list, itx);
+	} else {
+		avl_tree_t *t = &itxs->i_async_tree;
+		uint64_t foid =
+		    LR_FOID_GET_OBJ(((lr_ooo_t *)&itx->itx_lr)->lr_foid);
+		itx_async_node_t *ian;
+		avl_index_t where;
 
-		mutex_enter(&itxg->itxg_lock);
-		if (itxg->itxg_txg != txg) {
-			mutex_exit(&itxg->itxg_lock);
-			continue;
+		ian = avl_find(t, &foid, &where);
+		if (ian == NULL) {
+			ian = kmem_alloc(sizeof (itx_async_node_t),
+			    KM_SLEEP);
+			list_create(&ian->ia_list, sizeof (itx_t),
+			    offsetof(itx_t, itx_node));
+			ian->ia_foid = foid;
+			avl_insert(t, ian, where);
 		}
+		list_insert_tail(&ian->ia_list, itx);
+	}
+}
 
-		/*
-		 * Locate the object node and append its list.
+/*
+ * Merge the itxs on 'src', which are in itx_stamp order, into 'dst'.
+ */
+static void
+zil_itx_list_merge(list_t *dst, list_t *src)
+{
+	itx_t *d = list_head(dst);
+	itx_t *itx;
+
+	while ((itx = list_head(src)) != NULL) {
+		while (d != NULL && d->itx_stamp < itx->itx_stamp)
+			d = list_next(dst, d);
+		if (d == NULL) {
+			list_move_tail(dst, src);
+			break;
+		}
+		list_remove(src, itx);
+		list_insert_before(dst, d, itx);
+	}
+}
+
+static itxs_t *
+zil_itxs_alloc(void)
+{
+	itxs_t *itxs = kmem_zalloc(sizeof (itxs_t), KM_SLEEP);
+
+	list_create(&itxs->i_sync_list, sizeof (itx_t),
+	    offsetof(itx_t, itx_node));
+	avl_create(&itxs->i_async_tree, zil_aitx_compare,
+	    sizeof (itx_async_node_t), offsetof(itx_async_node_t, ia_node));
+
+	return (itxs);
+}
+
+/*
+ * Take the itxs staged on every CPU for 'txg' onto 'dst', merged into
+ * the order they were assigned if 'sorted' is set.  Returns the size on
+ * disk of the sync itxs taken.
+ */
+static uint64_t
+zil_itxg_take_staged(itxg_t *itxg, uint64_t txg, list_t *dst,
+    boolean_t sorted)
+{
+	list_t staged;
+	uint64_t sod = 0;
+	int c;
+
+	ASSERT(MUTEX_HELD(&itxg->itxg_lock));
+
+	list_create(&staged, sizeof (itx_t), offsetof(itx_t, itx_node));
+	for (c = 0; c < max_ncpus; c++) {
+		itxg_cpu_t *ic = &itxg->itxg_cpus[c];
+
+		mutex_enter(&ic->ic_lock);
+		if (ic->ic_txg != txg || list_is_empty(&ic->ic_list)) {
+			mutex_exit(&ic->ic_lock);
+			continue;
+		}
+		list_move_tail(&staged, &ic->ic_list);
+		sod += ic->ic_sod;
+		ic->ic_sod = 0;
+		mutex_exit(&ic->ic_lock);
+
+		if (sorted)
+			zil_itx_list_merge(dst, &staged);
+		else
+			list_move_tail(dst, &staged);
+	}
+	list_destroy(&staged);
+
+	return (sod);
+}
+
+/*
+ * Move the itxs staged on every CPU for 'txg' onto the itxg, in the order
+ * they were assigned.  If the itxg still holds the itxs of an older txg,
+ * because zil_clean() hasn't got around to it, they are detached and
+ * returned in '*cleanp' to be freed once itxg_lock has been dropped.
+ * Returns B_TRUE if the itxg holds itxs for 'txg'.
+ */
+static boolean_t
+zil_itxg_merge(zilog_t *zilog, itxg_t *itxg, uint64_t txg, itxs_t **cleanp)
+{
+	list_t merged;
+	uint64_t sod;
+	itx_t *itx;
+
+	list_create(&merged, sizeof (itx_t), offsetof(itx_t, itx_node));
+	sod = zil_itxg_take_staged(itxg, txg, &merged, B_TRUE);
+
+	if (list_is_empty(&merged)) {
+		list_destroy(&merged);
+		return (itxg->itxg_txg == txg);
+	}
+
+	if (itxg->itxg_txg != txg) {
+		if (itxg->itxg_itxs != NULL) {
+			/*
+			 * The zil_clean callback hasn't got around to cleaning
+			 * this itxg. Save the itxs for release by the caller.
+			 * This should be rare.
+			 */
+			atomic_add_64(&zilog->zl_itx_list_sz, -itxg->itxg_sod);
+			itxg->itxg_sod = 0;
+			ASSERT3P(*cleanp, ==, NULL);
+			*cleanp = itxg->itxg_itxs;
+		}
+		ASSERT(itxg->itxg_sod == 0);
+		itxg->itxg_txg = txg;
+		itxg->itxg_itxs = zil_itxs_alloc();
+	}
+
+	while ((itx = list_remove_head(&merged)) != NULL)
+		zil_itxs_add(itxg->itxg_itxs, itx);
+	list_destroy(&merged);
+
+	atomic_add_64(&zilog->zl_itx_list_sz, sod);
+	itxg->itxg_sod += sod;
+
+	return (B_TRUE);
+}
+
+/*
+ * Remove all async itx with the given oid.
+ */
+static void
+zil_remove_async(zilog_t *zilog, uint64_t oid)
+{
+	uint64_t otxg, txg;
+	itx_async_node_t *ian;
+	avl_tree_t *t;
+	avl_index_t where;
+	list_t clean_list;
+	itx_t *itx;
+
+	ASSERT(oid != 0);
+	list_create(&clean_list, sizeof (itx_t), offsetof(itx_t, itx_node));
+
+	if (spa_freeze_txg(zilog->zl_spa) != UINT64_MAX) /* ziltest support */
+		otxg = ZILTEST_TXG;
+	else
+		otxg = spa_last_synced_txg(zilog->zl_spa) + 1;
+
+	for (txg = otxg; txg < (otxg + TXG_CONCURRENT_STATES); txg++) {
+		itxg_t *itxg = &zilog->zl_itxg[txg & TXG_MASK];
+		itxs_t *clean = NULL;
+
+		mutex_enter(&itxg->itxg_lock);
+		if (!zil_itxg_merge(zilog, itxg, txg, &clean)) {
+			mutex_exit(&itxg->itxg_lock);
+			if (clean != NULL)
+				zil_itxg_clean(clean);
+			continue;
+		}
+
+		/*
+		 * Locate the object node and append its list.
 		 */
 		t = &itxg->itxg_itxs->i_async_tree;
 		ian = avl_find(t, &oid, &where);
 		if (ian != NULL)
 			list_move_tail(&clean_list, &ian->ia_list);
 		mutex_exit(&itxg->itxg_lock);
+
+		if (clean != NULL)
+			zil_itxg_clean(clean);
 	}
 	while ((itx = list_head(&clean_list)) != NULL) {
-		if (itx->itx_callback != NULL)
-			itx->itx_callback(itx->itx_callback_data);
+		/* commit itxs should never be on the async lists. */
+		ASSERT3U(itx->itx_lr.lrc_txtype, !=, TX_COMMIT);
 		list_remove(&clean_list, itx);
 		zil_itx_destroy(itx);
 	}
@@ -1318,7 +1832,8 @@ zil_itx_assign(zilog_t *zilog, itx_t *itx, dmu_tx_t *tx)
 {
 	uint64_t txg;
 	itxg_t *itxg;
-	itxs_t *itxs, *clean = NULL;
+	itxg_cpu_t *ic;
+	list_t *stale = NULL;
 
 	/*
 	 * Object ids can be re-instantiated in the next txg so
@@ -1342,60 +1857,54 @@ zil_itx_assign(zilog_t *zilog, itx_t *itx, dmu_tx_t *tx)
 		txg = dmu_tx_get_txg(tx);
 
 	itxg = &zilog->zl_itxg[txg & TXG_MASK];
-	mutex_enter(&itxg->itxg_lock);
-	itxs = itxg->itxg_itxs;
-	if (itxg->itxg_txg != txg) {
-		if (itxs != NULL) {
+	ic = &itxg->itxg_cpus[CPU_SEQID % max_ncpus];
+	mutex_enter(&ic->ic_lock);
+	if (ic->ic_txg != txg) {
+		if (!list_is_empty(&ic->ic_list)) {
 			/*
-			 * The zil_clean callback hasn't got around to cleaning
-			 * this itxg. Save the itxs for release below.
+			 * These itxs belong to a synced txg which zil_clean()
+			 * hasn't got around to yet.  Release them below.
 			 * This should be rare.
 			 */
-			atomic_add_64(&zilog->zl_itx_list_sz, -itxg->itxg_sod);
-			itxg->itxg_sod = 0;
-			clean = itxg->itxg_itxs;
-		}
-		ASSERT(itxg->itxg_sod == 0);
-		itxg->itxg_txg = txg;
-		itxs = itxg->itxg_itxs = kmem_zalloc(sizeof (itxs_t),
-		    KM_SLEEP);
-
-		list_create(&itxs->i_sync_list, sizeof (itx_t),
-		    offsetof(itx_t, itx_node));
-		avl_create(&itxs->i_async_tree, zil_aitx_compare,
-		    sizeof (itx_async_node_t),
-		    offsetof(itx_async_node_t, ia_node));
-	}
-	if (itx->itx_sync) {
-		list_insert_tail(&itxs->i_sync_list, itx);
-		atomic_add_64(&zilog->zl_itx_list_sz, itx->itx_sod);
-		itxg->itxg_sod += itx->itx_sod;
-	} else {
-		avl_tree_t *t = &itxs->i_async_tree;
-		uint64_t foid =
-		    LR_FOID_GET_OBJ(((lr_ooo_t *)&itx->itx_lr)->lr_foid);
-		itx_async_node_t *ian;
-		avl_index_t where;
-
-		ian = avl_find(t, &foid, &where);
-		if (ian == NULL) {
-			ian = kmem_alloc(sizeof (itx_async_node_t),
-			    KM_SLEEP);
-			list_create(&ian->ia_list, sizeof (itx_t),
+			stale = kmem_alloc(sizeof (list_t), KM_SLEEP);
+			list_create(stale, sizeof (itx_t),
 			    offsetof(itx_t, itx_node));
-			ian->ia_foid = foid;
-			avl_insert(t, ian, where);
+			list_move_tail(stale, &ic->ic_list);
 		}
-		list_insert_tail(&ian->ia_list, itx);
+		ic->ic_sod = 0;
+		ic->ic_txg = txg;
 	}
 
+	/*
+	 * The stamp is taken under ic_lock so each staged list stays sorted,
+	 * and any itx whose assignment completed before this one started
+	 * (e.g. the create of the directory an entry is being added to) is
+	 * ordered ahead of it when the lists are merged.
+	 */
+	itx->itx_stamp = atomic_inc_64_nv(&zilog->zl_itx_stamp);
 	itx->itx_lr.lrc_txg = dmu_tx_get_txg(tx);
-	zilog_dirty(zilog, txg);
-	mutex_exit(&itxg->itxg_lock);
+	list_insert_tail(&ic->ic_list, itx);
+	if (itx->itx_sync)
+		ic->ic_sod += itx->itx_sod;
+	mutex_exit(&ic->ic_lock);
 
-	/* Release the old itxs now we've dropped the lock */
-	if (clean != NULL)
-		zil_itxg_clean(clean);
+	/*
+	 * We don't want to dirty the ZIL using ZILTEST_TXG, because
+	 * zil_clean() will never be called using ZILTEST_TXG. Thus, we
+	 * need to be careful to always dirty the ZIL using the "real"
+	 * TXG (not itxg_txg) even when the SPA is frozen.  Only the first
+	 * itx of a txg dirties it, so check membership first to keep the
+	 * pool-wide dirty list lock out of this path.
+	 */
+	if (!txg_list_member(&zilog->zl_dmu_pool->dp_dirty_zilogs, zilog,
+	    dmu_tx_get_txg(tx)))
+		zilog_dirty(zilog, dmu_tx_get_txg(tx));
+
+	if (stale != NULL) {
+		zil_itx_list_clean(stale);
+		list_destroy(stale);
+		kmem_free(stale, sizeof (list_t));
+	}
 }
 
 /*
@@ -1410,10 +1919,25 @@ zil_clean(zilog_t *zilog, uint64_t synced_txg)
 {
 	itxg_t *itxg = &zilog->zl_itxg[synced_txg & TXG_MASK];
 	itxs_t *clean_me;
+	list_t staged;
+
+	list_create(&staged, sizeof (itx_t), offsetof(itx_t, itx_node));
 
 	mutex_enter(&itxg->itxg_lock);
+
+	/*
+	 * The itxs still staged per-CPU are only going to be freed, so
+	 * there's no need to sort them.
+	 */
+	(void) zil_itxg_take_staged(itxg, synced_txg, &staged, B_FALSE);
+	if (!list_is_empty(&staged) && itxg->itxg_itxs == NULL) {
+		itxg->itxg_txg = synced_txg;
+		itxg->itxg_itxs = zil_itxs_alloc();
+	}
 	if (itxg->itxg_itxs == NULL || itxg->itxg_txg == ZILTEST_TXG) {
 		mutex_exit(&itxg->itxg_lock);
+		ASSERT(list_is_empty(&staged));
+		list_destroy(&staged);
 		return;
 	}
 	ASSERT3U(itxg->itxg_txg, <=, synced_txg);
@@ -1425,6 +1949,10 @@ zil_clean(zilog_t *zilog, uint64_t synced_txg)
 	itxg->itxg_itxs = NULL;
 	itxg->itxg_txg = 0;
 	mutex_exit(&itxg->itxg_lock);
+
+	list_move_tail(&clean_me->i_sync_list, &staged);
+	list_destroy(&staged);
+
 	/*
 	 * Preferably start a task queue to free up the old itxs but
 	 * if taskq_dispatch can't allocate resources to do that then
@@ -1453,18 +1981,19 @@ zil_get_commit_list(zilog_t *zilog)
 
 	for (txg = otxg; txg < (otxg + TXG_CONCURRENT_STATES); txg++) {
 		itxg_t *itxg = &zilog->zl_itxg[txg & TXG_MASK];
+		itxs_t *clean = NULL;
 
 		mutex_enter(&itxg->itxg_lock);
-		if (itxg->itxg_txg != txg) {
-			mutex_exit(&itxg->itxg_lock);
-			continue;
+		if (zil_itxg_merge(zilog, itxg, txg, &clean)) {
+			list_move_tail(commit_list,
+			    &itxg->itxg_itxs->i_sync_list);
+			push_sod += itxg->itxg_sod;
+			itxg->itxg_sod = 0;
 		}
-
-		list_move_tail(commit_list, &itxg->itxg_itxs->i_sync_list);
-		push_sod += itxg->itxg_sod;
-		itxg->itxg_sod = 0;
-
 		mutex_exit(&itxg->itxg_lock);
+
+		if (clean != NULL)
+			zil_itxg_clean(clean);
 	}
 	atomic_add_64(&zilog->zl_itx_list_sz, -push_sod);
 }
@@ -1487,10 +2016,13 @@ zil_async_to_sync(zilog_t *zilog, uint64_t foid)
 
 	for (txg = otxg; txg < (otxg + TXG_CONCURRENT_STATES); txg++) {
 		itxg_t *itxg = &zilog->zl_itxg[txg & TXG_MASK];
+		itxs_t *clean = NULL;
 
 		mutex_enter(&itxg->itxg_lock);
-		if (itxg->itxg_txg != txg) {
+		if (!zil_itxg_merge(zilog, itxg, txg, &clean)) {
 			mutex_exit(&itxg->itxg_lock);
+			if (clean != NULL)
+				zil_itxg_clean(clean);
 			continue;
 		}
 
@@ -1518,151 +2050,831 @@ zil_async_to_sync(zilog_t *zilog, uint64_t foid)
 			}
 		}
 		mutex_exit(&itxg->itxg_lock);
+
+		if (clean != NULL)
+			zil_itxg_clean(clean);
 	}
 }
 
+/*
+ * Remove any commit itxs at the head of zl_itx_commit_list. Nothing
+ * precedes them on the list, so their waiters can simply be attached to
+ * the most recently opened lwb (or marked done, if it has completed)
+ * without opening a new lwb just to hold them.
+ */
 static void
-zil_commit_writer(zilog_t *zilog)
+zil_prune_commit_list(zilog_t *zilog)
 {
-	uint64_t txg;
 	itx_t *itx;
-	lwb_t *lwb;
-	spa_t *spa = zilog->zl_spa;
-	int error = 0;
 
-	ASSERT(zilog->zl_root_zio == NULL);
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
 
-	mutex_exit(&zilog->zl_lock);
+	while ((itx = list_head(&zilog->zl_itx_commit_list)) != NULL) {
+		lr_t *lrc = &itx->itx_lr;
+		lwb_t *last_lwb;
 
-	zil_get_commit_list(zilog);
+		if (lrc->lrc_txtype != TX_COMMIT)
+			break;
+
+		mutex_enter(&zilog->zl_lock);
+
+		last_lwb = zilog->zl_last_lwb_opened;
+		if (last_lwb == NULL || last_lwb->lwb_state == LWB_STATE_DONE) {
+			/*
+			 * All of the itxs this waiter was waiting on
+			 * must have already completed (or there were
+			 * never any itx's for it to wait on), so it's
+			 * safe to skip this waiter and mark it done.
+			 */
+			zil_commit_waiter_skip(itx->itx_private);
+		} else {
+			/*
+			 * Join the most recent lwb, whether it is still
+			 * being filled or already in flight; it can't be
+			 * done before everything ahead of this waiter is.
+			 */
+			zil_commit_waiter_link_lwb(itx->itx_private, last_lwb);
+			itx->itx_private = NULL;
+		}
+
+		mutex_exit(&zilog->zl_lock);
+
+		list_remove(&zilog->zl_itx_commit_list, itx);
+		zil_itx_destroy(itx);
+	}
+
+	IMPLY(itx != NULL, itx->itx_lr.lrc_txtype != TX_COMMIT);
+}
+
+/*
+ * When zio_alloc_zil() fails to allocate the next lwb block on disk, we
+ * must stall the ZIL write pipeline until every lwb already issued is
+ * done, and everything they cover has been synced by spa_sync().  The
+ * next zil_commit() will then start a new log chain via zil_create().
+ */
+static void
+zil_commit_writer_stall(zilog_t *zilog)
+{
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+	txg_wait_synced(zilog->zl_dmu_pool, 0);
+	ASSERT3P(list_tail(&zilog->zl_lwb_list), ==, NULL);
+}
+
+/*
+ * This function will traverse the commit list, creating new lwbs as
+ * needed, and committing the itxs from the commit list to these newly
+ * created lwbs. Additionally, as a new lwb is created, the previous
+ * lwb will be issued to the zio layer to be written to disk.
+ */
+static void
+zil_process_commit_list(zilog_t *zilog)
+{
+	spa_t *spa = zilog->zl_spa;
+	list_t nolwb_itxs;
+	list_t nolwb_waiters;
+	zil_commit_waiter_t *zcw;
+	lwb_t *lwb;
+	itx_t *itx;
+
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
 
 	/*
 	 * Return if there's nothing to commit before we dirty the fs by
 	 * calling zil_create().
 	 */
-	if (list_head(&zilog->zl_itx_commit_list) == NULL) {
-		mutex_enter(&zilog->zl_lock);
+	if (list_head(&zilog->zl_itx_commit_list) == NULL)
 		return;
-	}
 
-	if (zilog->zl_suspend) {
-		lwb = NULL;
+	list_create(&nolwb_itxs, sizeof (itx_t), offsetof(itx_t, itx_node));
+	list_create(&nolwb_waiters, sizeof (zil_commit_waiter_t),
+	    offsetof(zil_commit_waiter_t, zcw_node));
+
+	lwb = list_tail(&zilog->zl_lwb_list);
+	if (lwb == NULL) {
+		lwb = zil_create(zilog);
 	} else {
-		lwb = list_tail(&zilog->zl_lwb_list);
-		if (lwb == NULL)
-			lwb = zil_create(zilog);
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_ISSUED);
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_DONE);
 	}
 
 	DTRACE_PROBE1(zil__cw1, zilog_t *, zilog);
-	for (itx = list_head(&zilog->zl_itx_commit_list); itx != NULL;
-	    itx = list_next(&zilog->zl_itx_commit_list, itx)) {
-		txg = itx->itx_lr.lrc_txg;
-		ASSERT(txg);
+	while ((itx = list_head(&zilog->zl_itx_commit_list)) != NULL) {
+		lr_t *lrc = &itx->itx_lr;
+		uint64_t txg = lrc->lrc_txg;
+		boolean_t synced, frozen;
 
-		if (txg > spa_last_synced_txg(spa) || txg > spa_freeze_txg(spa))
-			lwb = zil_lwb_commit(zilog, itx, lwb);
+		ASSERT3U(txg, !=, 0);
+
+		list_remove(&zilog->zl_itx_commit_list, itx);
+
+		/*
+		 * This is inherently racy and may result in us writing
+		 * out a log block for a txg that was just synced. This is
+		 * ok since we'll end cleaning up that log block the next
+		 * time we call zil_sync().
+		 */
+		synced = (txg <= spa_last_synced_txg(spa));
+		frozen = (txg > spa_freeze_txg(spa));
+
+		if (!synced || frozen) {
+			if (lwb != NULL) {
+				lwb = zil_lwb_commit(zilog, itx, lwb);
+				if (lwb == NULL)
+					list_insert_tail(&nolwb_itxs, itx);
+				else
+					list_insert_tail(&lwb->lwb_itxs, itx);
+			} else {
+				if (lrc->lrc_txtype == TX_COMMIT) {
+					zil_commit_waiter_link_nolwb(
+					    itx->itx_private, &nolwb_waiters);
+				}
+
+				list_insert_tail(&nolwb_itxs, itx);
+			}
+		} else {
+			/*
+			 * If this is a commit itx, then there will be a
+			 * thread that is either: already waiting for
+			 * it, or soon will be waiting.
+			 *
+			 * This itx has already been committed to disk
+			 * via spa_sync() so we don't bother committing
+			 * it to an lwb. As a result, we cannot use the
+			 * lwb zio callback to signal the waiter and
+			 * mark it as done, so we must do that here.
+			 */
+			if (lrc->lrc_txtype == TX_COMMIT)
+				zil_commit_waiter_skip(itx->itx_private);
+			zil_itx_destroy(itx);
+		}
 	}
 	DTRACE_PROBE1(zil__cw2, zilog_t *, zilog);
 
-	/* write the last block out */
-	if (lwb != NULL && lwb->lwb_zio != NULL)
-		lwb = zil_lwb_write_start(zilog, lwb);
+	if (lwb == NULL) {
+		/*
+		 * This indicates zio_alloc_zil() failed to allocate the
+		 * "next" lwb on-disk. When this happens, we must stall
+		 * the ZIL write pipeline; see the comment within
+		 * zil_commit_writer_stall() for more details.
+		 */
+		zil_commit_writer_stall(zilog);
 
-	zilog->zl_cur_used = 0;
+		/*
+		 * Additionally, we have to signal and mark the "nolwb"
+		 * waiters as "done" here, since without an lwb, we
+		 * can't do this via zil_lwb_flush_vdevs_done() like
+		 * normal.
+		 */
+		while ((zcw = list_head(&nolwb_waiters)) != NULL) {
+			zil_commit_waiter_skip(zcw);
+			list_remove(&nolwb_waiters, zcw);
+		}
+
+		/*
+		 * And finally, we have to destroy the itx's that
+		 * couldn't be committed to an lwb; this will also call
+		 * the itx's callback if one exists for the itx.
+		 */
+		while ((itx = list_head(&nolwb_itxs)) != NULL) {
+			list_remove(&nolwb_itxs, itx);
+			zil_itx_destroy(itx);
+		}
+	} else {
+		ASSERT(list_is_empty(&nolwb_waiters));
+		ASSERT(list_is_empty(&nolwb_itxs));
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_ISSUED);
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_DONE);
+
+		/*
+		 * At this point, the ZIL block pointed at by the "lwb"
+		 * variable is in one of the following states: "closed"
+		 * or "open".
+		 *
+		 * If it's "closed", then no itxs have been committed to
+		 * it, so there's no point in issuing its zio (i.e. it's
+		 * "empty").
+		 *
+		 * If it's "open", then it contains one or more itxs that
+		 * eventually need to be committed to stable storage. In
+		 * this case we intentionally do not issue the lwb's zio
+		 * to disk yet, and instead rely on one of the following
+		 * two mechanisms for issuing the zio:
+		 *
+		 * 1. Ideally, there will be more ZIL activity occurring
+		 * on the system, such that this function will be
+		 * immediately called again (not necessarily by the same
+		 * thread) and this lwb's zio will be issued via
+		 * zil_lwb_commit(). This way, the lwb is guaranteed to
+		 * be "full" when it is issued to disk, and we'll make
+		 * use of the lwb's size the best we can.
+		 *
+		 * 2. If there isn't sufficient ZIL activity occurring on
+		 * the system, such that this lwb's zio isn't issued via
+		 * zil_lwb_commit(), zil_commit_waiter() will issue the
+		 * lwb's zio. If this occurs, the lwb is not guaranteed
+		 * to be "full" by the time its zio is issued, and means
+		 * the size of the lwb was "too large" given the amount
+		 * of ZIL activity occurring on the system at that time.
+		 *
+		 * We do this for a couple of reasons:
+		 *
+		 * 1. To try and reduce the number of IOPs needed to
+		 * write the same number of itxs. If an lwb has space
+		 * available in its buffer for more itxs, and more itxs
+		 * will be committed relatively soon (relative to the
+		 * latency of performing a write), then it's beneficial
+		 * to wait for these "next" itxs. This way, more itxs
+		 * can be committed to stable storage with fewer writes.
+		 *
+		 * 2. To try and use the largest lwb block size that the
+		 * incoming rate of itxs can support. Again, this is to
+		 * try and pack as many itxs into as few lwbs as
+		 * possible, without significantly impacting the latency
+		 * of each individual itx.
+		 */
+	}
+
+	list_destroy(&nolwb_itxs);
+	list_destroy(&nolwb_waiters);
+}
+
+/*
+ * This function is responsible for ensuring the passed in commit waiter
+ * (and associated commit itx) is committed to an lwb. If the waiter is
+ * not already committed to an lwb, all itxs in the zilog's queue of
+ * itxs will be processed. The assumption is the passed in waiter's
+ * commit itx will found in the queue just like the other non-commit
+ * itxs, such that when the entire queue is processed, the waiter will
+ * have been committed to an lwb.
+ *
+ * The lwb associated with the passed in waiter is not guaranteed to
+ * have been issued by the time this function completes. If the lwb is
+ * not issued, we rely on future calls to zil_commit_writer() to issue
+ * the lwb, or the timeout mechanism found in zil_commit_waiter().
+ */
+static void
+zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	ASSERT(!MUTEX_HELD(&zilog->zl_lock));
+	ASSERT(spa_writeable(zilog->zl_spa));
+
+	mutex_enter(&zilog->zl_issuer_lock);
+
+	if (zcw->zcw_lwb != NULL || zcw->zcw_done) {
+		/*
+		 * It's possible that, while we were waiting to acquire
+		 * the "zl_issuer_lock", another thread committed this
+		 * waiter to an lwb. If that occurs, we bail out early,
+		 * without processing the "commit list".
+		 *
+		 * It's also possible for the waiter to already be
+		 * "done"; e.g. when its itxs were synced by spa_sync().
+		 */
+		goto out;
+	}
+
+	ZIL_STAT_BUMP(zil_commit_writer_count);
+
+	zil_get_commit_list(zilog);
+	zil_prune_commit_list(zilog);
+	zil_process_commit_list(zilog);
+
+out:
+	mutex_exit(&zilog->zl_issuer_lock);
+}
+
+static void
+zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	lwb_t *lwb, *nlwb;
+
+	ASSERT(!MUTEX_HELD(&zilog->zl_issuer_lock));
+	ASSERT(MUTEX_HELD(&zcw->zcw_lock));
+	ASSERT(!zcw->zcw_done);
+
+	lwb = zcw->zcw_lwb;
+	ASSERT3P(lwb, !=, NULL);
+	ASSERT3S(lwb->lwb_state, !=, LWB_STATE_CLOSED);
+
+	/*
+	 * If the lwb has already been issued by another thread, we can
+	 * immediately return since there's no work to be done (the
+	 * point of this function is to issue the lwb). Additionally, we
+	 * do this prior to acquiring the zl_issuer_lock, to avoid
+	 * acquiring it when it's not necessary to do so.
+	 */
+	if (lwb->lwb_state == LWB_STATE_ISSUED ||
+	    lwb->lwb_state == LWB_STATE_DONE)
+		return;
+
+	/*
+	 * In order to call zil_lwb_write_issue() we must hold the
+	 * zilog's "zl_issuer_lock". We can't simply acquire that lock,
+	 * since we're already holding the commit waiter's "zcw_lock",
+	 * and those two locks are acquired in the opposite order
+	 * elsewhere.
+	 */
+	mutex_exit(&zcw->zcw_lock);
+	mutex_enter(&zilog->zl_issuer_lock);
+	mutex_enter(&zcw->zcw_lock);
+
+	/*
+	 * Since we just dropped and re-acquired the commit waiter's
+	 * lock, we have to re-check to see if the waiter was marked
+	 * "done" during that process. If the waiter was marked "done",
+	 * the "lwb" pointer is no longer valid (it can be free'd after
+	 * the waiter is marked "done"), so without this check we could
+	 * wind up with a use-after-free error below.
+	 */
+	if (zcw->zcw_done)
+		goto out;
+
+	ASSERT3P(lwb, ==, zcw->zcw_lwb);
+
+	/*
+	 * We've already checked this above, but since we hadn't
+	 * acquired the zilog's zl_issuer_lock, we have to perform this
+	 * check a second time while holding the lock. We must not call
+	 * zil_lwb_write_issue() if the lwb had already been issued.
+	 *
+	 * We don't need to hold the zl_lock since the lwb cannot
+	 * transition from OPENED to ISSUED while we hold the
+	 * zl_issuer_lock. The lwb _can_ transition from ISSUED to DONE,
+	 * but it's OK to race with that transition since we treat the
+	 * lwb the same, whether it's in the ISSUED or DONE states.
+	 */
+	if (lwb->lwb_state == LWB_STATE_ISSUED ||
+	    lwb->lwb_state == LWB_STATE_DONE)
+		goto out;
+
+	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_OPENED);
+
+	/*
+	 * Since the lwb's zio hadn't been issued by the time this thread
+	 * reached its timeout, the commit burst it belongs to is over.
+	 * Record its size before the next lwb is allocated, so that
+	 * zil_lwb_predict() sizes that block for the commits actually
+	 * seen rather than for one that keeps on growing.
+	 */
+	zil_burst_done(zilog);
 
 	/*
-	 * Wait if necessary for the log blocks to be on stable storage.
+	 * As described in the comments above zil_commit_waiter() and
+	 * zil_process_commit_list(), we need to issue this lwb's zio
+	 * since we've reached the commit waiter's timeout and it still
+	 * hasn't been issued.
 	 */
-	if (zilog->zl_root_zio) {
-		error = zio_wait(zilog->zl_root_zio);
-		zilog->zl_root_zio = NULL;
-		zil_flush_vdevs(zilog);
+	nlwb = zil_lwb_write_issue(zilog, lwb);
+
+	IMPLY(nlwb != NULL, lwb->lwb_state != LWB_STATE_OPENED);
+
+	if (nlwb == NULL) {
+		/*
+		 * When zil_lwb_write_issue() returns NULL, this
+		 * indicates zio_alloc_zil() failed to allocate the
+		 * "next" lwb on-disk. When this occurs, the ZIL write
+		 * pipeline must be stalled; see the comment within the
+		 * zil_commit_writer_stall() function for more details.
+		 *
+		 * We must drop the commit waiter's lock prior to
+		 * calling zil_commit_writer_stall() or else we can wind
+		 * up with the following deadlock:
+		 *
+		 * - This thread is waiting for the txg to sync while
+		 *   holding the waiter's lock; txg_wait_synced() is
+		 *   used within zil_commit_writer_stall().
+		 *
+		 * - The txg can't sync because it is waiting for this
+		 *   lwb's zio callback to call dmu_tx_commit().
+		 *
+		 * - The lwb's zio callback can't call dmu_tx_commit()
+		 *   because it's blocked trying to acquire the waiter's
+		 *   lock, which occurs prior to calling dmu_tx_commit()
+		 */
+		mutex_exit(&zcw->zcw_lock);
+		zil_commit_writer_stall(zilog);
+		mutex_enter(&zcw->zcw_lock);
 	}
 
-	if (error || lwb == NULL)
-		txg_wait_synced(zilog->zl_dmu_pool, 0);
+out:
+	mutex_exit(&zilog->zl_issuer_lock);
+	ASSERT(MUTEX_HELD(&zcw->zcw_lock));
+}
+
+/*
+ * This function is responsible for performing the following two tasks:
+ *
+ * 1. its primary responsibility is to block until the given "commit
+ *    waiter" is considered "done".
+ *
+ * 2. its secondary responsibility is to issue the zio for the lwb that
+ *    the given "commit waiter" is waiting on, if this function has
+ *    waited "long enough" and the lwb is still in the "open" state.
+ *
+ * Given a sufficient amount of itxs being generated and written using
+ * the ZIL, the lwb's zio will be issued via the zil_lwb_commit()
+ * function. If this does not occur, this secondary responsibility will
+ * ensure the lwb is issued even if there is not other synchronous
+ * activity on the system.
+ *
+ * For more details, see zil_process_commit_list(); more specifically,
+ * the comment at the bottom of that function.
+ */
+static void
+zil_commit_waiter(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	hrtime_t sleep, wakeup;
+	boolean_t timedout = B_FALSE;
+	int pct;
 
-	while ((itx = list_head(&zilog->zl_itx_commit_list))) {
-		txg = itx->itx_lr.lrc_txg;
-		ASSERT(txg);
+	ASSERT(!MUTEX_HELD(&zilog->zl_lock));
+	ASSERT(!MUTEX_HELD(&zilog->zl_issuer_lock));
+	ASSERT(spa_writeable(zilog->zl_spa));
 
-		if (itx->itx_callback != NULL)
-			itx->itx_callback(itx->itx_callback_data);
-		list_remove(&zilog->zl_itx_commit_list, itx);
-		zil_itx_destroy(itx);
+	mutex_enter(&zcw->zcw_lock);
+
+	/*
+	 * The timeout is scaled based on the lwb latency to avoid
+	 * significantly impacting the latency of each individual itx.
+	 * For more details, see the comment at the bottom of the
+	 * zil_process_commit_list() function.
+	 */
+	pct = MAX(zfs_commit_timeout_pct, 1);
+	sleep = (zilog->zl_last_lwb_latency * pct) / 100;
+	wakeup = gethrtime() + sleep;
+
+	while (!zcw->zcw_done) {
+		lwb_t *lwb = zcw->zcw_lwb;
+
+		ASSERT(MUTEX_HELD(&zcw->zcw_lock));
+
+		/*
+		 * Usually, the waiter will have a non-NULL lwb field here,
+		 * but it's possible for it to be NULL as a result of
+		 * zil_commit() racing with spa_sync().
+		 *
+		 * When zil_clean() is called, it's possible for the itxg
+		 * list (which may be cleaned via a taskq) to contain
+		 * commit itxs. When this occurs, the commit waiters linked
+		 * off of these commit itxs will not be committed to an
+		 * lwb. Additionally, these commit waiters will not be
+		 * marked done until zil_commit_waiter_skip() is called via
+		 * zil_itxg_clean().
+		 *
+		 * Thus, it's possible for this commit waiter (i.e. the
+		 * "zcw" variable) to be found in this "in between" state;
+		 * where its "zcw_lwb" field is NULL, and it hasn't yet
+		 * been skipped, so its "zcw_done" field is still B_FALSE.
+		 */
+		IMPLY(lwb != NULL, lwb->lwb_state != LWB_STATE_CLOSED);
+
+		if (lwb != NULL && lwb->lwb_state == LWB_STATE_OPENED) {
+			clock_t timeleft;
+
+			ASSERT(!timedout);
+
+			/*
+			 * If the lwb hasn't been issued yet, then we
+			 * need to wait with a timeout, in case this
+			 * function needs to issue the lwb after the
+			 * timeout is reached; responsibility (2) from
+			 * the comment above this function.
+			 */
+			timeleft = cv_timedwait_hires(&zcw->zcw_cv,
+			    &zcw->zcw_lock, wakeup, NSEC_PER_USEC,
+			    CALLOUT_FLAG_ABSOLUTE);
+
+			if (timeleft >= 0 || zcw->zcw_done)
+				continue;
+
+			timedout = B_TRUE;
+			zil_commit_waiter_timeout(zilog, zcw);
+
+			if (!zcw->zcw_done) {
+				/*
+				 * If the commit waiter has already been
+				 * marked "done", it's possible for the
+				 * waiter's lwb structure to have already
+				 * been freed. Thus, we can only reliably
+				 * make these assertions if the waiter
+				 * isn't done.
+				 */
+				ASSERT3P(lwb, ==, zcw->zcw_lwb);
+				ASSERT3S(lwb->lwb_state, !=, LWB_STATE_OPENED);
+			}
+		} else {
+			/*
+			 * If the lwb isn't open, then it must have already
+			 * been issued. In that case, there's no need to
+			 * use a timeout when waiting for the lwb to
+			 * complete.
+			 *
+			 * Additionally, if the lwb is NULL, the waiter
+			 * will soon be signalled and marked done via
+			 * zil_clean() and zil_itxg_clean(), so no timeout
+			 * is required.
+			 */
+			IMPLY(lwb != NULL,
+			    lwb->lwb_state == LWB_STATE_ISSUED ||
+			    lwb->lwb_state == LWB_STATE_DONE);
+			cv_wait(&zcw->zcw_cv, &zcw->zcw_lock);
+		}
 	}
 
-	mutex_enter(&zilog->zl_lock);
+	mutex_exit(&zcw->zcw_lock);
+}
+
+static zil_commit_waiter_t *
+zil_alloc_commit_waiter(void)
+{
+	zil_commit_waiter_t *zcw = kmem_cache_alloc(zil_zcw_cache, KM_SLEEP);
+
+	cv_init(&zcw->zcw_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&zcw->zcw_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_link_init(&zcw->zcw_node);
+	zcw->zcw_lwb = NULL;
+	zcw->zcw_done = B_FALSE;
+	zcw->zcw_zio_error = 0;
+
+	return (zcw);
+}
+
+static void
+zil_free_commit_waiter(zil_commit_waiter_t *zcw)
+{
+	ASSERT(!list_link_active(&zcw->zcw_node));
+	ASSERT3P(zcw->zcw_lwb, ==, NULL);
+	ASSERT(zcw->zcw_done);
+	mutex_destroy(&zcw->zcw_lock);
+	cv_destroy(&zcw->zcw_cv);
+	kmem_cache_free(zil_zcw_cache, zcw);
+}
+
+/*
+ * This function is used to create a TX_COMMIT itx and assign it. This
+ * way, it will be linked into the ZIL's list of synchronous itxs, and
+ * then later committed to an lwb (or skipped) when
+ * zil_process_commit_list() is called.
+ */
+static void
+zil_commit_itx_assign(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	dmu_tx_t *tx = dmu_tx_create(zilog->zl_os);
+	itx_t *itx;
+
+	VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+
+	itx = zil_itx_create(TX_COMMIT, sizeof (lr_t));
+	itx->itx_sync = B_TRUE;
+	itx->itx_private = zcw;
+
+	zil_itx_assign(zilog, itx, tx);
+
+	dmu_tx_commit(tx);
+}
+
+/*
+ * Add a zil_commit() latency to the dataset's histogram.
+ */
+static void
+zil_commit_histo_add(zilog_t *zilog, hrtime_t nsecs)
+{
+	int idx = 0;
+
+	if (nsecs > 1)
+		idx = MIN(highbit64(nsecs - 1), ZIL_COMMIT_HISTO_BUCKETS - 1);
+
+	atomic_inc_64(&zilog->zl_commit_histo[idx].value.ui64);
+}
+
+static void
+zil_commit_impl(zilog_t *zilog, uint64_t foid)
+{
+	zil_commit_waiter_t *zcw;
+	hrtime_t start = gethrtime();
+
+	ZIL_STAT_BUMP(zil_commit_count);
 
 	/*
-	 * Remember the highest committed log sequence number for ztest.
-	 * We only update this value when all the log writes succeeded,
-	 * because ztest wants to ASSERT that it got the whole log chain.
+	 * Move the "async" itxs for the specified foid to the "sync"
+	 * queues, such that they will be later committed (or skipped)
+	 * to an lwb when zil_process_commit_list() is called.
+	 *
+	 * Since these "async" itxs must be committed prior to this
+	 * call to zil_commit returning, we must perform this operation
+	 * before we call zil_commit_itx_assign().
 	 */
-	if (error == 0 && lwb != NULL)
-		zilog->zl_commit_lr_seq = zilog->zl_lr_seq;
+	zil_async_to_sync(zilog, foid);
+
+	/*
+	 * We allocate a new "waiter" structure which will initially be
+	 * linked to the commit itx using the itx's "itx_private" field.
+	 * Since the commit itx doesn't represent any on-disk state,
+	 * when it's committed to an lwb, rather than copying the its
+	 * lr_t into the lwb's buffer, the commit itx's "waiter" will be
+	 * added to the lwb's list of waiters. Then, when the lwb is
+	 * committed to stable storage, each waiter in the lwb's list of
+	 * waiters will be marked "done", and signalled.
+	 *
+	 * We must create the waiter and assign the commit itx prior to
+	 * calling zil_commit_writer(), or else our specific commit itx
+	 * is not guaranteed to be committed to an lwb prior to calling
+	 * zil_commit_waiter().
+	 */
+	zcw = zil_alloc_commit_waiter();
+	zil_commit_itx_assign(zilog, zcw);
+
+	zil_commit_writer(zilog, zcw);
+	zil_commit_waiter(zilog, zcw);
+
+	if (zcw->zcw_zio_error != 0) {
+		/*
+		 * If there was an error writing out the ZIL blocks that
+		 * this thread is waiting on, then we fallback to
+		 * relying on spa_sync() to write out the data this
+		 * thread is waiting on. Obviously this has performance
+		 * implications, but the expectation is for this to be
+		 * an exceptional case, and shouldn't occur often.
+		 */
+		txg_wait_synced(zilog->zl_dmu_pool, 0);
+	}
+
+	zil_free_commit_waiter(zcw);
+
+	zil_commit_histo_add(zilog, gethrtime() - start);
 }
 
 /*
- * Commit zfs transactions to stable storage.
- * If foid is 0 push out all transactions, otherwise push only those
- * for that object or might reference that object.
+ * Commit ZFS Intent Log transactions (itxs) to stable storage.
+ *
+ * When writing ZIL transactions to the on-disk representation of the
+ * ZIL, the itxs are committed to a Log Write Block (lwb). Multiple
+ * itxs can be committed to a single lwb. Once a lwb is written and
+ * committed to stable storage (i.e. the lwb is written, and vdevs have
+ * been flushed), each itx that was committed to that lwb is also
+ * considered to be committed to stable storage.
+ *
+ * When an itx is committed to an lwb, the log record (lr_t) contained
+ * by the itx is copied into the lwb's zio buffer, and once this buffer
+ * is written to disk, it becomes an on-disk ZIL block.
+ *
+ * As itxs are generated, they're inserted into the ZIL's queue of
+ * uncommitted itxs. The semantics of zil_commit() are such that it will
+ * block until all itxs that were generated prior to the zil_commit()
+ * call, are committed to stable storage.
+ *
+ * If "foid" is zero, this means all "synchronous" and "asynchronous"
+ * itxs, for all objects in the dataset, will be committed to stable
+ * storage prior to zil_commit() returning. If "foid" is non-zero, all
+ * "synchronous" itxs for all objects, but only "asynchronous" itxs
+ * that correspond to the foid passed in, will be committed to stable
+ * storage prior to zil_commit() returning.
+ *
+ * Generally speaking, when zil_commit() is called, the consumer doesn't
+ * actually care about _all_ of the uncommitted itxs. Instead, they're
+ * simply trying to waiting for a specific itx to be committed to disk,
+ * but the interface(s) for interacting with the ZIL don't allow such
+ * fine-grained communication. A better interface would allow a consumer
+ * to create and assign an itx, and then pass a reference to this itx to
+ * zil_commit(); such that zil_commit() would return as soon as that
+ * specific itx was committed to disk (instead of waiting for _all_
+ * itxs to be committed).
+ *
+ * When a thread calls zil_commit() a special "commit itx" will be
+ * generated, along with a corresponding "waiter" for this commit itx.
+ * zil_commit() will wait on this waiter's CV, such that when the waiter
+ * is marked done, and signalled, zil_commit() will return.
+ *
+ * This commit itx is inserted into the queue of uncommitted itxs. This
+ * provides an easy mechanism for determining which itxs were committed
+ * prior to the zil_commit() call: all itxs that are in the queue prior
+ * to the commit itx; the commit itx itself doesn't contain any log
+ * record.
+ *
+ * The commit itx is special; it doesn't have any on-disk
+ * representation. When a commit itx is "committed" to an lwb, the
+ * waiter associated with it is linked onto the lwb's list of waiters.
+ * Then, when that lwb completes, each waiter on the lwb's list is
+ * marked done and signalled -- allowing the thread waiting on the
+ * waiter to return from zil_commit().
  *
- * itxs are committed in batches. In a heavily stressed zil there will be
- * a commit writer thread who is writing out a bunch of itxs to the log
- * for a set of committing threads (cthreads) in the same batch as the writer.
- * Those cthreads are all waiting on the same cv for that batch.
+ * It's important to point out a few critical factors that allow us
+ * to make use of the commit itxs, commit waiters, per-lwb lists of
+ * commit waiters, and zio completion callbacks like we're doing:
  *
- * There will also be a different and growing batch of threads that are
- * waiting to commit (qthreads). When the committing batch completes
- * a transition occurs such that the cthreads exit and the qthreads become
- * cthreads. One of the new cthreads becomes the writer thread for the
- * batch. Any new threads arriving become new qthreads.
+ *   1. The list of waiters for each lwb is traversed, and each commit
+ *      waiter is marked "done" and signalled, in the zio completion
+ *      callback of the lwb's zio[*].
  *
- * Only 2 condition variables are needed and there's no transition
- * between the two cvs needed. They just flip-flop between qthreads
- * and cthreads.
+ *      * Actually, the waiters are signalled in the zio completion
+ *        callback of the root zio for the DKIOCFLUSHWRITECACHE commands
+ *        that are sent to the vdevs upon completion of the lwb zio.
  *
- * Using this scheme we can efficiently wakeup up only those threads
- * that have been committed.
+ *   2. When the itxs are inserted into the ZIL's queue of uncommitted
+ *      itxs, the order in which they are inserted is preserved[*]; as
+ *      itxs are added to the queue, they are added to the tail of
+ *      in-memory linked lists.
+ *
+ *      When committing the itxs to lwbs (to be written to disk), they
+ *      are committed in the same order in which the itxs were added to
+ *      the uncommitted queue's linked list(s); i.e. the linked lists of
+ *      itxs are traversed from head to tail, and each itx is committed
+ *      to an lwb in that order.
+ *
+ *      * To clarify:
+ *
+ *        - the order of "sync" itxs is preserved w.r.t. other
+ *          "sync" itxs, regardless of the corresponding objects.
+ *        - the order of "async" itxs is preserved w.r.t. other
+ *          "async" itxs corresponding to the same object.
+ *        - the order of "async" itxs is *not* preserved w.r.t. other
+ *          "async" itxs corresponding to different objects.
+ *        - the order of "sync" itxs w.r.t. "async" itxs (or vice
+ *          versa) is *not* preserved, even for itxs that correspond
+ *          to the same object.
+ *
+ *      For more details, see: zil_itx_assign(), zil_async_to_sync(),
+ *      zil_get_commit_list(), and zil_process_commit_list().
+ *
+ *   3. The lwbs represent a linked list of blocks on disk. Thus, any
+ *      lwb cannot be considered committed to stable storage, until its
+ *      "previous" lwb is also committed to stable storage. This fact,
+ *      coupled with the fact described above, means that itxs are
+ *      committed in (roughly) the order in which they were generated.
+ *      This is essential because itxs are dependent on prior itxs.
+ *      Thus, we *must not* deem an itx as being committed to stable
+ *      storage, until *all* prior itxs have also been committed to
+ *      stable storage.
+ *
+ *      To enforce this ordering of lwb zio's, while still leveraging as
+ *      much of the underlying storage performance as possible, we rely
+ *      on two fundamental concepts:
+ *
+ *          1. The creation and issuance of lwb zio's is protected by
+ *             the zilog's "zl_issuer_lock", which ensures only a single
+ *             thread is creating and/or issuing lwb's at a time
+ *          2. The "previous" lwb is a child of the "current" lwb
+ *             (leveraging the zio parent-child dependency graph)
+ *
+ *      By relying on this parent-child zio relationship, we can have
+ *      many lwb zio's concurrently issued to the underlying storage,
+ *      but the order in which they complete will be the same order in
+ *      which they were created.
+ *
+ * Because a waiter only depends on the lwb holding its commit itx, a
+ * thread calling zil_commit() while earlier lwbs are still in flight
+ * doesn't wait for them to finish before its own itxs are written: its
+ * itxs go into the next lwb, which is issued as soon as it fills (or
+ * its waiters time out), and it completes right after its predecessors.
  */
 void
 zil_commit(zilog_t *zilog, uint64_t foid)
 {
-	uint64_t mybatch;
+	/*
+	 * We should never attempt to call zil_commit on a snapshot for
+	 * a couple of reasons:
+	 *
+	 * 1. A snapshot may never be modified, thus it cannot have any
+	 *    in-flight itxs that would have modified the dataset.
+	 *
+	 * 2. By design, when zil_commit() is called, a commit itx will
+	 *    be assigned to this zilog; as a result, the zilog will be
+	 *    dirtied. We must not dirty the zilog of a snapshot; there's
+	 *    checks in the code that enforce this invariant, and will
+	 *    cause a panic if it's not upheld.
+	 */
+	if (dmu_objset_is_snapshot(zilog->zl_os))
+		return;
 
 	if (zilog->zl_sync == ZFS_SYNC_DISABLED)
 		return;
 
-	ZIL_STAT_BUMP(zil_commit_count);
-
-	/* move the async itxs for the foid to the sync queues */
-	zil_async_to_sync(zilog, foid);
-
-	mutex_enter(&zilog->zl_lock);
-	mybatch = zilog->zl_next_batch;
-	while (zilog->zl_writer) {
-		cv_wait(&zilog->zl_cv_batch[mybatch & 1], &zilog->zl_lock);
-		if (mybatch <= zilog->zl_com_batch) {
-			mutex_exit(&zilog->zl_lock);
-			return;
-		}
+	if (!spa_writeable(zilog->zl_spa)) {
+		/*
+		 * If the SPA is not writable, there should never be any
+		 * pending itxs waiting to be committed to disk. If that
+		 * weren't true, we'd skip writing those itxs out, and
+		 * would break the semantics of zil_commit(); thus, we're
+		 * verifying that truth before we return to the caller.
+		 */
+		ASSERT(list_is_empty(&zilog->zl_lwb_list));
+		ASSERT3P(zilog->zl_last_lwb_opened, ==, NULL);
+		return;
 	}
 
-	zilog->zl_next_batch++;
-	zilog->zl_writer = B_TRUE;
-	ZIL_STAT_BUMP(zil_commit_writer_count);
-	zil_commit_writer(zilog);
-	zilog->zl_com_batch = mybatch;
-	zilog->zl_writer = B_FALSE;
-
-	/* wake up one thread to become the next writer */
-	cv_signal(&zilog->zl_cv_batch[(mybatch+1) & 1]);
-
-	/* wake up all threads waiting for this batch to be committed */
-	cv_broadcast(&zilog->zl_cv_batch[mybatch & 1]);
+	/*
+	 * If the ZIL is suspended, we don't want to dirty it by calling
+	 * zil_commit_itx_assign() below, nor can we write out
+	 * lwbs like would be done in zil_commit_writer(). Thus, we
+	 * simply rely on txg_wait_synced() to maintain the necessary
+	 * semantics, and avoid calling those functions altogether.
+	 */
+	if (zilog->zl_suspend > 0) {
+		txg_wait_synced(zilog->zl_dmu_pool, 0);
+		return;
+	}
 
-	mutex_exit(&zilog->zl_lock);
+	zil_commit_impl(zilog, foid);
 }
 
 /*
@@ -1721,11 +2933,9 @@ zil_sync(zilog_t *zilog, dmu_tx_t *tx)
 		if (lwb->lwb_buf != NULL || lwb->lwb_max_txg > txg)
 			break;
 
-		ASSERT(lwb->lwb_zio == NULL);
-
 		list_remove(&zilog->zl_lwb_list, lwb);
 		zio_free_zil(spa, txg, &lwb->lwb_blk);
-		kmem_cache_free(zil_lwb_cache, lwb);
+		zil_free_lwb(zilog, lwb);
 
 		/*
 		 * If we don't have anything left in the lwb list then
@@ -1743,7 +2953,7 @@ zil_sync(zilog_t *zilog, dmu_tx_t *tx)
 	 * unused, long-lived LWBs.
 	 */
 	for (; lwb != NULL; lwb = list_next(&zilog->zl_lwb_list, lwb)) {
-		if (lwb->lwb_fastwrite && !lwb->lwb_zio) {
+		if (lwb->lwb_fastwrite && !lwb->lwb_write_zio) {
 			metaslab_fastwrite_unmark(zilog->zl_spa, &lwb->lwb_blk);
 			lwb->lwb_fastwrite = 0;
 		}
@@ -1752,11 +2962,42 @@ zil_sync(zilog_t *zilog, dmu_tx_t *tx)
 	mutex_exit(&zilog->zl_lock);
 }
 
+/* ARGSUSED */
+static int
+zil_lwb_cons(void *vbuf, void *unused, int kmflag)
+{
+	lwb_t *lwb = vbuf;
+
+	list_create(&lwb->lwb_waiters, sizeof (zil_commit_waiter_t),
+	    offsetof(zil_commit_waiter_t, zcw_node));
+	list_create(&lwb->lwb_itxs, sizeof (itx_t),
+	    offsetof(itx_t, itx_node));
+	avl_create(&lwb->lwb_vdev_tree, zil_lwb_vdev_compare,
+	    sizeof (zil_vdev_node_t), offsetof(zil_vdev_node_t, zv_node));
+	mutex_init(&lwb->lwb_vdev_lock, NULL, MUTEX_DEFAULT, NULL);
+	return (0);
+}
+
+/* ARGSUSED */
+static void
+zil_lwb_dest(void *vbuf, void *unused)
+{
+	lwb_t *lwb = vbuf;
+
+	mutex_destroy(&lwb->lwb_vdev_lock);
+	avl_destroy(&lwb->lwb_vdev_tree);
+	list_destroy(&lwb->lwb_waiters);
+	list_destroy(&lwb->lwb_itxs);
+}
+
 void
 zil_init(void)
 {
 	zil_lwb_cache = kmem_cache_create("zil_lwb_cache",
-	    sizeof (struct lwb), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	    sizeof (lwb_t), 0, zil_lwb_cons, zil_lwb_dest, NULL, NULL, NULL, 0);
+
+	zil_zcw_cache = kmem_cache_create("zil_zcw_cache",
+	    sizeof (zil_commit_waiter_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 
 	zil_ksp = kstat_create("zfs", 0, "zil", "misc",
 	    KSTAT_TYPE_NAMED, sizeof (zil_stats) / sizeof (kstat_named_t),
@@ -1771,6 +3012,7 @@ zil_init(void)
 void
 zil_fini(void)
 {
+	kmem_cache_destroy(zil_zcw_cache);
 	kmem_cache_destroy(zil_lwb_cache);
 
 	if (zil_ksp != NULL) {
@@ -1791,6 +3033,25 @@ zil_set_logbias(zilog_t *zilog, uint64_t logbias)
 	zilog->zl_logbias = logbias;
 }
 
+/*
+ * Decide whether a sync write of 'size' bytes should be logged as
+ * WR_INDIRECT, i.e. written in place with dmu_sync() from the lwb's write
+ * zio and logged by block pointer, rather than copied into the log.
+ * 'immediate_write_sz' is the caller's limit for copying data into a log
+ * kept in the main pool.
+ */
+boolean_t
+zil_write_indirect(zilog_t *zilog, uint64_t size, uint64_t immediate_write_sz)
+{
+	if (zilog->zl_logbias == ZFS_LOGBIAS_THROUGHPUT)
+		return (B_TRUE);
+
+	if (!spa_has_slogs(zilog->zl_spa))
+		return (size > immediate_write_sz);
+
+	return (zil_slog_write_sz != 0 && size > zil_slog_write_sz);
+}
+
 zilog_t *
 zil_alloc(objset_t *os, zil_header_t *zh_phys)
 {
@@ -1806,13 +3067,27 @@ zil_alloc(objset_t *os, zil_header_t *zh_phys)
 	zilog->zl_destroy_txg = TXG_INITIAL - 1;
 	zilog->zl_logbias = dmu_objset_logbias(os);
 	zilog->zl_sync = dmu_objset_syncprop(os);
-	zilog->zl_next_batch = 1;
+	zilog->zl_dirty_max_txg = 0;
+	zilog->zl_last_lwb_opened = NULL;
+	zilog->zl_last_lwb_latency = 0;
 
 	mutex_init(&zilog->zl_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&zilog->zl_issuer_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	for (i = 0; i < TXG_SIZE; i++) {
-		mutex_init(&zilog->zl_itxg[i].itxg_lock, NULL,
-		    MUTEX_DEFAULT, NULL);
+		itxg_t *itxg = &zilog->zl_itxg[i];
+		int c;
+
+		mutex_init(&itxg->itxg_lock, NULL, MUTEX_DEFAULT, NULL);
+		itxg->itxg_cpus = kmem_zalloc(max_ncpus *
+		    sizeof (itxg_cpu_t), KM_SLEEP);
+		for (c = 0; c < max_ncpus; c++) {
+			itxg_cpu_t *ic = &itxg->itxg_cpus[c];
+
+			mutex_init(&ic->ic_lock, NULL, MUTEX_DEFAULT, NULL);
+			list_create(&ic->ic_list, sizeof (itx_t),
+			    offsetof(itx_t, itx_node));
+		}
 	}
 
 	list_create(&zilog->zl_lwb_list, sizeof (lwb_t),
@@ -1821,15 +3096,18 @@ zil_alloc(objset_t *os, zil_header_t *zh_phys)
 	list_create(&zilog->zl_itx_commit_list, sizeof (itx_t),
 	    offsetof(itx_t, itx_node));
 
-	mutex_init(&zilog->zl_vdev_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zilog->zl_cv_suspend, NULL, CV_DEFAULT, NULL);
 
-	avl_create(&zilog->zl_vdev_tree, zil_vdev_compare,
-	    sizeof (zil_vdev_node_t), offsetof(zil_vdev_node_t, zv_node));
+	mutex_init(&zilog->zl_commit_histo_lock, NULL, MUTEX_DEFAULT, NULL);
+	zilog->zl_commit_histo = kmem_zalloc(ZIL_COMMIT_HISTO_BUCKETS *
+	    sizeof (kstat_named_t), KM_SLEEP);
+	for (i = 0; i < ZIL_COMMIT_HISTO_BUCKETS; i++) {
+		kstat_named_t *ks = &zilog->zl_commit_histo[i];
 
-	cv_init(&zilog->zl_cv_writer, NULL, CV_DEFAULT, NULL);
-	cv_init(&zilog->zl_cv_suspend, NULL, CV_DEFAULT, NULL);
-	cv_init(&zilog->zl_cv_batch[0], NULL, CV_DEFAULT, NULL);
-	cv_init(&zilog->zl_cv_batch[1], NULL, CV_DEFAULT, NULL);
+		ks->data_type = KSTAT_DATA_UINT64;
+		(void) snprintf(ks->name, KSTAT_STRLEN, "%llu ns",
+		    (u_longlong_t)1 << i);
+	}
 
 	return (zilog);
 }
@@ -1847,13 +3125,13 @@ zil_free(zilog_t *zilog)
 	ASSERT(list_is_empty(&zilog->zl_lwb_list));
 	list_destroy(&zilog->zl_lwb_list);
 
-	avl_destroy(&zilog->zl_vdev_tree);
-	mutex_destroy(&zilog->zl_vdev_lock);
-
 	ASSERT(list_is_empty(&zilog->zl_itx_commit_list));
 	list_destroy(&zilog->zl_itx_commit_list);
 
 	for (i = 0; i < TXG_SIZE; i++) {
+		itxg_t *itxg = &zilog->zl_itxg[i];
+		int c;
+
 		/*
 		 * It's possible for an itx to be generated that doesn't dirty
 		 * a txg (e.g. ztest TX_TRUNCATE). So there's no zil_clean()
@@ -1861,21 +3139,95 @@ zil_free(zilog_t *zilog)
 		 *
 		 * Also free up the ziltest itxs.
 		 */
-		if (zilog->zl_itxg[i].itxg_itxs)
-			zil_itxg_clean(zilog->zl_itxg[i].itxg_itxs);
-		mutex_destroy(&zilog->zl_itxg[i].itxg_lock);
+		if (itxg->itxg_itxs)
+			zil_itxg_clean(itxg->itxg_itxs);
+		mutex_destroy(&itxg->itxg_lock);
+
+		for (c = 0; c < max_ncpus; c++) {
+			itxg_cpu_t *ic = &itxg->itxg_cpus[c];
+
+			zil_itx_list_clean(&ic->ic_list);
+			list_destroy(&ic->ic_list);
+			mutex_destroy(&ic->ic_lock);
+		}
+		kmem_free(itxg->itxg_cpus, max_ncpus * sizeof (itxg_cpu_t));
 	}
 
+	mutex_destroy(&zilog->zl_issuer_lock);
 	mutex_destroy(&zilog->zl_lock);
 
-	cv_destroy(&zilog->zl_cv_writer);
 	cv_destroy(&zilog->zl_cv_suspend);
-	cv_destroy(&zilog->zl_cv_batch[0]);
-	cv_destroy(&zilog->zl_cv_batch[1]);
+
+	ASSERT3P(zilog->zl_commit_ksp, ==, NULL);
+	kmem_free(zilog->zl_commit_histo,
+	    ZIL_COMMIT_HISTO_BUCKETS * sizeof (kstat_named_t));
+	mutex_destroy(&zilog->zl_commit_histo_lock);
 
 	kmem_free(zilog, sizeof (zilog_t));
 }
 
+static int
+zil_commit_histo_update(kstat_t *ksp, int rw)
+{
+	zilog_t *zilog = ksp->ks_private;
+	int i;
+
+	if (rw == KSTAT_WRITE) {
+		for (i = 0; i < ZIL_COMMIT_HISTO_BUCKETS; i++)
+			zilog->zl_commit_histo[i].value.ui64 = 0;
+	}
+
+	for (i = ZIL_COMMIT_HISTO_BUCKETS; i > 0; i--)
+		if (zilog->zl_commit_histo[i-1].value.ui64 != 0)
+			break;
+
+	ksp->ks_ndata = i;
+	ksp->ks_data_size = i * sizeof (kstat_named_t);
+
+	return (0);
+}
+
+/*
+ * Export the zil_commit() latency histogram of an open dataset as the
+ * zfs/<pool>/zil_commit-0x<objset id> kstat.
+ */
+static void
+zil_commit_histo_init(zilog_t *zilog)
+{
+	char name[KSTAT_STRLEN];
+	char kstat_name[KSTAT_STRLEN];
+	kstat_t *ksp;
+
+	(void) snprintf(name, KSTAT_STRLEN, "zfs/%s",
+	    spa_name(zilog->zl_spa));
+	(void) snprintf(kstat_name, KSTAT_STRLEN, "zil_commit-0x%llx",
+	    (u_longlong_t)dmu_objset_id(zilog->zl_os));
+
+	ksp = kstat_create(name, 0, kstat_name, "misc", KSTAT_TYPE_NAMED,
+	    0, KSTAT_FLAG_VIRTUAL);
+	zilog->zl_commit_ksp = ksp;
+
+	if (ksp) {
+		ksp->ks_lock = &zilog->zl_commit_histo_lock;
+		ksp->ks_data = zilog->zl_commit_histo;
+		ksp->ks_ndata = ZIL_COMMIT_HISTO_BUCKETS;
+		ksp->ks_data_size =
+		    ZIL_COMMIT_HISTO_BUCKETS * sizeof (kstat_named_t);
+		ksp->ks_private = zilog;
+		ksp->ks_update = zil_commit_histo_update;
+		kstat_install(ksp);
+	}
+}
+
+static void
+zil_commit_histo_fini(zilog_t *zilog)
+{
+	if (zilog->zl_commit_ksp != NULL) {
+		kstat_delete(zilog->zl_commit_ksp);
+		zilog->zl_commit_ksp = NULL;
+	}
+}
+
 /*
  * Open an intent log.
  */
@@ -1892,6 +3244,8 @@ zil_open(objset_t *os, zil_get_data_t *get_data)
 	zilog->zl_clean_taskq = taskq_create("zil_clean", 1, defclsyspri,
 	    2, 2, TASKQ_PREPOPULATE);
 
+	zil_commit_histo_init(zilog);
+
 	return (zilog);
 }
 
@@ -1902,20 +3256,28 @@ void
 zil_close(zilog_t *zilog)
 {
 	lwb_t *lwb;
-	uint64_t txg = 0;
+	uint64_t txg;
 
-	zil_commit(zilog, 0); /* commit all itx */
+	if (!dmu_objset_is_snapshot(zilog->zl_os)) {
+		zil_commit(zilog, 0);
+	} else {
+		ASSERT3P(list_tail(&zilog->zl_lwb_list), ==, NULL);
+		ASSERT0(zilog->zl_dirty_max_txg);
+		ASSERT(!zilog_is_dirty(zilog));
+	}
 
 	/*
 	 * The lwb_max_txg for the stubby lwb will reflect the last activity
-	 * for the zil.  After a txg_wait_synced() on the txg we know all the
-	 * callbacks have occurred that may clean the zil.  Only then can we
-	 * destroy the zl_clean_taskq.
+	 * for the zil, and zl_dirty_max_txg covers itxs (such as commit
+	 * itxs) that never made it into an lwb.  After a txg_wait_synced()
+	 * on the txg we know all the callbacks have occurred that may clean
+	 * the zil.  Only then can we destroy the zl_clean_taskq.
 	 */
 	mutex_enter(&zilog->zl_lock);
+	txg = zilog->zl_dirty_max_txg;
 	lwb = list_tail(&zilog->zl_lwb_list);
 	if (lwb != NULL)
-		txg = lwb->lwb_max_txg;
+		txg = MAX(txg, lwb->lwb_max_txg);
 	mutex_exit(&zilog->zl_lock);
 	if (txg)
 		txg_wait_synced(zilog->zl_dmu_pool, txg);
@@ -1933,14 +3295,17 @@ zil_close(zilog_t *zilog)
 	lwb = list_head(&zilog->zl_lwb_list);
 	if (lwb != NULL) {
 		ASSERT(lwb == list_tail(&zilog->zl_lwb_list));
-		ASSERT(lwb->lwb_zio == NULL);
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_ISSUED);
 		if (lwb->lwb_fastwrite)
 			metaslab_fastwrite_unmark(zilog->zl_spa, &lwb->lwb_blk);
+
 		list_remove(&zilog->zl_lwb_list, lwb);
 		zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
-		kmem_cache_free(zil_lwb_cache, lwb);
+		zil_free_lwb(zilog, lwb);
 	}
 	mutex_exit(&zilog->zl_lock);
+
+	zil_commit_histo_fini(zilog);
 }
 
 static char *suspend_tag = "zil suspending";
@@ -2040,7 +3405,27 @@ zil_suspend(const char *osname, void **cookiep)
 	zilog->zl_suspending = B_TRUE;
 	mutex_exit(&zilog->zl_lock);
 
-	zil_commit(zilog, 0);
+	/*
+	 * We need to use zil_commit_impl to ensure we wait for all
+	 * LWB_STATE_OPENED and LWB_STATE_ISSUED lwb's to be committed
+	 * to disk before proceeding. If we used zil_commit instead, it
+	 * would just call txg_wait_synced(), because zl_suspend is set.
+	 * txg_wait_synced() doesn't wait for these lwb's to be
+	 * LWB_STATE_DONE before returning.
+	 *
+	 * A ZIL that isn't open has nothing in flight, and a commit itx
+	 * assigned to it would never be cleaned up by zil_clean(), so
+	 * it is skipped.
+	 */
+	if (zilog->zl_clean_taskq != NULL)
+		zil_commit_impl(zilog, 0);
+
+	/*
+	 * Now that we've ensured all lwb's are LWB_STATE_DONE, we use
+	 * txg_wait_synced() to ensure the data from the zilog has
+	 * migrated to the main pool before calling zil_destroy().
+	 */
+	txg_wait_synced(zilog->zl_dmu_pool, 0);
 
 	zil_destroy(zilog, B_FALSE);
 
@@ -2075,15 +3460,31 @@ typedef struct zil_replay_arg {
 	void		*zr_arg;
 	boolean_t	zr_byteswap;
 	char		*zr_lr;
+	int		zr_nlanes;	/* number of replay lanes */
+	taskq_t		**zr_lanes;	/* one single-threaded taskq per lane */
+	boolean_t	zr_lanes_busy;	/* records dispatched since drain */
+	kmutex_t	zr_lock;	/* protects fields below */
+	kcondvar_t	zr_cv;
+	uint64_t	zr_inflight;	/* bytes dispatched but not applied */
+	int		zr_error;	/* first error from a replay lane */
 } zil_replay_arg_t;
 
-static int
-zil_replay_error(zilog_t *zilog, lr_t *lr, int error)
+/*
+ * A log record copied out of its log block for a replay lane.  The record
+ * (and for TX_WRITE with a block pointer, room for its data) follows.
+ */
+typedef struct zil_replay_task {
+	zilog_t		*zrt_zilog;
+	zil_replay_arg_t *zrt_zr;
+	uint64_t	zrt_txtype;
+	size_t		zrt_size;	/* size of this allocation */
+} zil_replay_task_t;
+
+static void
+zil_replay_warn(zilog_t *zilog, lr_t *lr, int error)
 {
 	char name[ZFS_MAX_DATASET_NAME_LEN];
 
-	zilog->zl_replaying_seq--;	/* didn't actually replay this one */
-
 	dmu_objset_name(zilog->zl_os, name);
 
 	cmn_err(CE_WARN, "ZFS replay transaction error %d, "
@@ -2091,10 +3492,196 @@ zil_replay_error(zilog_t *zilog, lr_t *lr, int error)
 	    (u_longlong_t)lr->lrc_seq,
 	    (u_longlong_t)(lr->lrc_txtype & ~TX_CI),
 	    (lr->lrc_txtype & TX_CI) ? "CI" : "");
+}
+
+static int
+zil_replay_error(zilog_t *zilog, lr_t *lr, int error)
+{
+	zilog->zl_replaying_seq--;	/* didn't actually replay this one */
+
+	zil_replay_warn(zilog, lr, error);
+
+	return (error);
+}
+
+/*
+ * Apply a record which has already been copied to a private buffer (and
+ * had its TX_WRITE data read in).
+ */
+static int
+zil_replay_apply(zilog_t *zilog, zil_replay_arg_t *zr, uint64_t txtype,
+    char *lr, uint64_t reclen)
+{
+	int error;
+
+	/*
+	 * The log block containing this lr may have been byteswapped
+	 * so that we can easily examine common fields like lrc_txtype.
+	 * However, the log is a mix of different record types, and only the
+	 * replay vectors know how to byteswap their records.  Therefore, if
+	 * the lr was byteswapped, undo it before invoking the replay vector.
+	 */
+	if (zr->zr_byteswap)
+		byteswap_uint64_array(lr, reclen);
+
+	/*
+	 * We must now do two things atomically: replay this log record,
+	 * and update the log header sequence number to reflect the fact that
+	 * we did so. At the end of each replay function the sequence number
+	 * is updated if we are in replay mode.
+	 */
+	error = zr->zr_replay[txtype](zr->zr_arg, lr, zr->zr_byteswap);
+	if (error != 0) {
+		/*
+		 * The DMU's dnode layer doesn't see removes until the txg
+		 * commits, so a subsequent claim can spuriously fail with
+		 * EEXIST. So if we receive any error we try syncing out
+		 * any removes then retry the transaction.  Note that we
+		 * specify B_FALSE for byteswap now, so we don't do it twice.
+		 */
+		txg_wait_synced(spa_get_dsl(zilog->zl_spa), 0);
+		error = zr->zr_replay[txtype](zr->zr_arg, lr, B_FALSE);
+	}
+
+	return (error);
+}
+
+static void
+zil_replay_lane_func(void *arg)
+{
+	zil_replay_task_t *zrt = arg;
+	zil_replay_arg_t *zr = zrt->zrt_zr;
+	zilog_t *zilog = zrt->zrt_zilog;
+	lr_t *lr = (lr_t *)(zrt + 1);
+	uint64_t reclen = lr->lrc_reclen;
+	size_t size = zrt->zrt_size;
+	int error = 0;
+
+	mutex_enter(&zr->zr_lock);
+	if (zr->zr_error != 0)
+		error = SET_ERROR(ECANCELED);
+	mutex_exit(&zr->zr_lock);
+
+	if (error == 0 && zrt->zrt_txtype == TX_WRITE &&
+	    reclen == sizeof (lr_write_t)) {
+		error = zil_read_log_data(zilog, (lr_write_t *)lr,
+		    (char *)lr + reclen);
+	}
+
+	/*
+	 * The record may be byteswapped in place by zil_replay_apply(), so
+	 * keep a copy of its header for the warning.
+	 */
+	if (error == 0) {
+		lr_t lrc = *lr;
+
+		error = zil_replay_apply(zilog, zr, zrt->zrt_txtype,
+		    (char *)lr, reclen);
+		if (error != 0)
+			zil_replay_warn(zilog, &lrc, error);
+	} else if (error != ECANCELED) {
+		zil_replay_warn(zilog, lr, error);
+	}
+
+	mutex_enter(&zr->zr_lock);
+	if (error != 0 && zr->zr_error == 0)
+		zr->zr_error = error;
+	zr->zr_inflight -= size;
+	cv_broadcast(&zr->zr_cv);
+	mutex_exit(&zr->zr_lock);
+
+	vmem_free(zrt, size);
+}
+
+/*
+ * Wait for every record handed to the replay lanes to be applied, and
+ * return the first error any of them hit.
+ */
+static int
+zil_replay_drain(zil_replay_arg_t *zr)
+{
+	int error;
+	int i;
+
+	if (zr->zr_lanes_busy) {
+		for (i = 0; i < zr->zr_nlanes; i++)
+			taskq_wait(zr->zr_lanes[i]);
+		zr->zr_lanes_busy = B_FALSE;
+	}
+
+	mutex_enter(&zr->zr_lock);
+	ASSERT0(zr->zr_inflight);
+	error = zr->zr_error;
+	mutex_exit(&zr->zr_lock);
 
 	return (error);
 }
 
+/*
+ * Hand a single-object record to the lane owning its object.  Records for
+ * the same object always land on the same single-threaded lane, so they
+ * are applied in log order; records for different objects run in parallel.
+ */
+static int
+zil_replay_dispatch(zilog_t *zilog, zil_replay_arg_t *zr, lr_t *lr,
+    uint64_t txtype)
+{
+	uint64_t reclen = lr->lrc_reclen;
+	uint64_t obj = LR_FOID_GET_OBJ(((lr_ooo_t *)lr)->lr_foid);
+	zil_replay_task_t *zrt;
+	size_t size = sizeof (zil_replay_task_t) + reclen;
+	int error;
+
+	if (txtype == TX_WRITE && reclen == sizeof (lr_write_t)) {
+		lr_write_t *lrw = (lr_write_t *)lr;
+		const blkptr_t *bp = &lrw->lr_blkptr;
+
+		size += MAX(BP_GET_LSIZE(bp), lrw->lr_length);
+
+		/*
+		 * Start the data read now, so it overlaps with the records
+		 * queued ahead of it on the lane.
+		 */
+		if (!BP_IS_HOLE(bp)) {
+			arc_flags_t aflags = ARC_FLAG_NOWAIT | ARC_FLAG_PREFETCH;
+			enum zio_flag zio_flags = ZIO_FLAG_CANFAIL |
+			    ZIO_FLAG_SPECULATIVE;
+			zbookmark_phys_t zb;
+
+			SET_BOOKMARK(&zb, dmu_objset_id(zilog->zl_os),
+			    lrw->lr_foid, ZB_ZIL_LEVEL,
+			    lrw->lr_offset / BP_GET_LSIZE(bp));
+			(void) arc_read(NULL, zilog->zl_spa, bp, NULL, NULL,
+			    ZIO_PRIORITY_ASYNC_READ, zio_flags, &aflags, &zb);
+		}
+	}
+
+	mutex_enter(&zr->zr_lock);
+	while (zr->zr_error == 0 && zr->zr_inflight != 0 &&
+	    zr->zr_inflight + size > zil_replay_max_inflight)
+		cv_wait(&zr->zr_cv, &zr->zr_lock);
+	error = zr->zr_error;
+	if (error == 0)
+		zr->zr_inflight += size;
+	mutex_exit(&zr->zr_lock);
+
+	if (error != 0)
+		return (error);
+
+	zrt = vmem_alloc(size, KM_SLEEP);
+	zrt->zrt_zilog = zilog;
+	zrt->zrt_zr = zr;
+	zrt->zrt_txtype = txtype;
+	zrt->zrt_size = size;
+	bcopy(lr, zrt + 1, reclen);
+
+	zr->zr_lanes_busy = B_TRUE;
+	VERIFY(taskq_dispatch(zr->zr_lanes[obj % zr->zr_nlanes],
+	    zil_replay_lane_func, zrt, TQ_SLEEP) != 0);
+
+	return (0);
+}
+
 static int
 zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 {
@@ -2104,7 +3691,14 @@ zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 	uint64_t txtype = lr->lrc_txtype;
 	int error = 0;
 
-	zilog->zl_replaying_seq = lr->lrc_seq;
+	/*
+	 * While records are outstanding on the replay lanes, the replay
+	 * sequence number stays at the last record applied from this
+	 * thread, so the header never claims a record was replayed before
+	 * it was.  Any lane record re-applied after a crash is idempotent.
+	 */
+	if (!zr->zr_lanes_busy)
+		zilog->zl_replaying_seq = lr->lrc_seq;
 
 	if (lr->lrc_seq <= zh->zh_replay_seq)	/* already replayed */
 		return (0);
@@ -2115,20 +3709,38 @@ zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 	/* Strip case-insensitive bit, still present in log record */
 	txtype &= ~TX_CI;
 
-	if (txtype == 0 || txtype >= TX_MAX_TYPE)
+	if (txtype == 0 || txtype >= TX_MAX_TYPE) {
+		if ((error = zil_replay_drain(zr)) != 0)
+			return (error);
+		zilog->zl_replaying_seq = lr->lrc_seq;
 		return (zil_replay_error(zilog, lr, EINVAL));
+	}
 
 	/*
 	 * If this record type can be logged out of order, the object
 	 * (lr_foid) may no longer exist.  That's legitimate, not an error.
+	 * Records which create or remove objects are never in flight on
+	 * the lanes while this is checked.
 	 */
 	if (TX_OOO(txtype)) {
 		error = dmu_object_info(zilog->zl_os,
 		    LR_FOID_GET_OBJ(((lr_ooo_t *)lr)->lr_foid), NULL);
 		if (error == ENOENT || error == EEXIST)
 			return (0);
+		error = 0;
+
+		if (zr->zr_nlanes > 1)
+			return (zil_replay_dispatch(zilog, zr, lr, txtype));
 	}
 
+	/*
+	 * Everything else may touch several objects, so it acts as a
+	 * barrier: wait for the lanes, then apply it from this thread.
+	 */
+	if ((error = zil_replay_drain(zr)) != 0)
+		return (error);
+	zilog->zl_replaying_seq = lr->lrc_seq;
+
 	/*
 	 * Make a copy of the data so we can revise and extend it.
 	 */
@@ -2144,36 +3756,10 @@ zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 			return (zil_replay_error(zilog, lr, error));
 	}
 
-	/*
-	 * The log block containing this lr may have been byteswapped
-	 * so that we can easily examine common fields like lrc_txtype.
-	 * However, the log is a mix of different record types, and only the
-	 * replay vectors know how to byteswap their records.  Therefore, if
-	 * the lr was byteswapped, undo it before invoking the replay vector.
-	 */
-	if (zr->zr_byteswap)
-		byteswap_uint64_array(zr->zr_lr, reclen);
+	error = zil_replay_apply(zilog, zr, txtype, zr->zr_lr, reclen);
+	if (error != 0)
+		return (zil_replay_error(zilog, lr, error));
 
-	/*
-	 * We must now do two things atomically: replay this log record,
-	 * and update the log header sequence number to reflect the fact that
-	 * we did so. At the end of each replay function the sequence number
-	 * is updated if we are in replay mode.
-	 */
-	error = zr->zr_replay[txtype](zr->zr_arg, zr->zr_lr, zr->zr_byteswap);
-	if (error != 0) {
-		/*
-		 * The DMU's dnode layer doesn't see removes until the txg
-		 * commits, so a subsequent claim can spuriously fail with
-		 * EEXIST. So if we receive any error we try syncing out
-		 * any removes then retry the transaction.  Note that we
-		 * specify B_FALSE for byteswap now, so we don't do it twice.
-		 */
-		txg_wait_synced(spa_get_dsl(zilog->zl_spa), 0);
-		error = zr->zr_replay[txtype](zr->zr_arg, zr->zr_lr, B_FALSE);
-		if (error != 0)
-			return (zil_replay_error(zilog, lr, error));
-	}
 	return (0);
 }
 
@@ -2195,16 +3781,31 @@ zil_replay(objset_t *os, void *arg, zil_replay_func_t replay_func[TX_MAX_TYPE])
 	zilog_t *zilog = dmu_objset_zil(os);
 	const zil_header_t *zh = zilog->zl_header;
 	zil_replay_arg_t zr;
+	boolean_t busy;
+	int i;
 
 	if ((zh->zh_flags & ZIL_REPLAY_NEEDED) == 0) {
 		zil_destroy(zilog, B_TRUE);
 		return;
 	}
 
+	bzero(&zr, sizeof (zr));
 	zr.zr_replay = replay_func;
 	zr.zr_arg = arg;
 	zr.zr_byteswap = BP_SHOULD_BYTESWAP(&zh->zh_log);
 	zr.zr_lr = vmem_alloc(2 * SPA_MAXBLOCKSIZE, KM_SLEEP);
+	mutex_init(&zr.zr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zr.zr_cv, NULL, CV_DEFAULT, NULL);
+
+	zr.zr_nlanes = MAX(zil_replay_threads, 1);
+	if (zr.zr_nlanes > 1) {
+		zr.zr_lanes = kmem_alloc(zr.zr_nlanes * sizeof (taskq_t *),
+		    KM_SLEEP);
+		for (i = 0; i < zr.zr_nlanes; i++) {
+			zr.zr_lanes[i] = taskq_create("zil_replay", 1,
+			    defclsyspri, 1, INT_MAX, 0);
+		}
+	}
 
 	/*
 	 * Wait for in-progress removes to sync before starting replay.
@@ -2216,6 +3817,22 @@ zil_replay(objset_t *os, void *arg, zil_replay_func_t replay_func[TX_MAX_TYPE])
 	ASSERT(zilog->zl_replay_blks == 0);
 	(void) zil_parse(zilog, zil_incr_blks, zil_replay_log_record, &zr,
 	    zh->zh_claim_txg);
+
+	/*
+	 * Once the lanes are idle without error every parsed record has
+	 * been applied, including those after the last serial one.
+	 */
+	busy = zr.zr_lanes_busy;
+	if (zil_replay_drain(&zr) == 0 && busy)
+		zilog->zl_replaying_seq = zilog->zl_parse_lr_seq;
+
+	if (zr.zr_lanes != NULL) {
+		for (i = 0; i < zr.zr_nlanes; i++)
+			taskq_destroy(zr.zr_lanes[i]);
+		kmem_free(zr.zr_lanes, zr.zr_nlanes * sizeof (taskq_t *));
+	}
+	cv_destroy(&zr.zr_cv);
+	mutex_destroy(&zr.zr_lock);
 	vmem_free(zr.zr_lr, 2 * SPA_MAXBLOCKSIZE);
 
 	zil_destroy(zilog, B_FALSE);
@@ -2271,17 +3888,29 @@ EXPORT_SYMBOL(zil_sync);
 EXPORT_SYMBOL(zil_clean);
 EXPORT_SYMBOL(zil_suspend);
 EXPORT_SYMBOL(zil_resume);
-EXPORT_SYMBOL(zil_add_block);
+EXPORT_SYMBOL(zil_lwb_add_block);
 EXPORT_SYMBOL(zil_bp_tree_add);
 EXPORT_SYMBOL(zil_set_sync);
 EXPORT_SYMBOL(zil_set_logbias);
+EXPORT_SYMBOL(zil_write_indirect);
 
 module_param(zil_replay_disable, int, 0644);
 MODULE_PARM_DESC(zil_replay_disable, "Disable intent logging replay");
 
+module_param(zil_replay_threads, int, 0644);
+MODULE_PARM_DESC(zil_replay_threads,
+	"Threads applying independent log records during replay");
+
 module_param(zfs_nocacheflush, int, 0644);
 MODULE_PARM_DESC(zfs_nocacheflush, "Disable cache flushes");
 
+module_param(zfs_commit_timeout_pct, int, 0644);
+MODULE_PARM_DESC(zfs_commit_timeout_pct, "ZIL block open timeout percentage");
+
 module_param(zil_slog_limit, ulong, 0644);
 MODULE_PARM_DESC(zil_slog_limit, "Max commit bytes to separate log device");
+
+module_param(zil_slog_write_sz, ulong, 0644);
+MODULE_PARM_DESC(zil_slog_write_sz,
+	"Largest sync write to copy into a separate log device");
 #endif
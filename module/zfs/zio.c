@@ -37,6 +37,7 @@
 #include <sys/dmu_objset.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/blkptr.h>
 #include <sys/zfeature.h>
 #include <sys/time.h>
@@ -818,6 +819,26 @@ zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite)
 	zio->io_bp_override = bp;
 }
 
+/*
+ * Supply a payload that is already compressed with 'compress' for a
+ * logical write.  It is only used if the pipeline ends up choosing the
+ * same algorithm; the caller keeps ownership of 'cdata' and must not
+ * free it until the zio completes.
+ */
+void
+zio_write_compressed(zio_t *zio, void *cdata, uint64_t csize,
+    enum zio_compress compress)
+{
+	ASSERT(zio->io_type == ZIO_TYPE_WRITE);
+	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
+	ASSERT(zio->io_stage == ZIO_STAGE_OPEN);
+	ASSERT3U(compress, <, ZIO_COMPRESS_FUNCTIONS);
+
+	zio->io_cdata = cdata;
+	zio->io_cdata_size = csize;
+	zio->io_cdata_compress = compress;
+}
+
 void
 zio_free(spa_t *spa, uint64_t txg, const blkptr_t *bp)
 {
@@ -860,6 +881,13 @@ zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	if (BP_IS_EMBEDDED(bp))
 		return (zio_null(pio, spa, NULL, NULL, NULL, 0));
 
+	/*
+	 * A cloned block is only freed when its last reference goes away;
+	 * until then freeing it just drops a reference in the BRT.
+	 */
+	if (brt_maybe_exists(spa, bp) && !brt_entry_decref(spa, bp))
+		return (zio_null(pio, spa, NULL, NULL, NULL, 0));
+
 	metaslab_check_free(spa, bp);
 	arc_freed(spa, bp);
 
@@ -1219,7 +1247,20 @@ zio_write_bp_init(zio_t *zio)
 
 	if (compress != ZIO_COMPRESS_OFF) {
 		void *cbuf = zio_buf_alloc(lsize);
-		psize = zio_compress_data(compress, zio->io_data, cbuf, lsize);
+		/*
+		 * If the caller already has this block compressed with the
+		 * algorithm we would use (e.g. a compressed send stream),
+		 * reuse that payload rather than compressing it again.
+		 */
+		if (zio->io_cdata != NULL &&
+		    compress == zio->io_cdata_compress &&
+		    zio->io_cdata_size < lsize) {
+			psize = zio->io_cdata_size;
+			bcopy(zio->io_cdata, cbuf, psize);
+		} else {
+			psize = zio_compress_data(compress, zio->io_data,
+			    cbuf, lsize);
+		}
 		if (psize == 0 || psize == lsize) {
 			compress = ZIO_COMPRESS_OFF;
 			zio_buf_free(cbuf, lsize);
@@ -2378,7 +2419,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 
 			ddt_bp_fill(ddp, &blk, ddp->ddp_phys_birth);
 
-			ddt_exit(ddt);
+			ddt_exit(ddt, &dde->dde_key);
 
 			error = arc_read(NULL, spa, &blk,
 			    arc_getbuf_func, &abuf, ZIO_PRIORITY_SYNC_READ,
@@ -2393,7 +2434,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 				VERIFY(arc_buf_remove_ref(abuf, &abuf));
 			}
 
-			ddt_enter(ddt);
+			ddt_enter(ddt, &dde->dde_key);
 			return (error != 0);
 		}
 	}
@@ -2413,7 +2454,7 @@ zio_ddt_child_write_ready(zio_t *zio)
 	if (zio->io_error)
 		return;
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &dde->dde_key);
 
 	ASSERT(dde->dde_lead_zio[p] == zio);
 
@@ -2422,7 +2463,7 @@ zio_ddt_child_write_ready(zio_t *zio)
 	while ((pio = zio_walk_parents(zio)) != NULL)
 		ddt_bp_fill(ddp, pio->io_bp, zio->io_txg);
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key);
 }
 
 static void
@@ -2433,7 +2474,7 @@ zio_ddt_child_write_done(zio_t *zio)
 	ddt_entry_t *dde = zio->io_private;
 	ddt_phys_t *ddp = &dde->dde_phys[p];
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &dde->dde_key);
 
 	ASSERT(ddp->ddp_refcnt == 0);
 	ASSERT(dde->dde_lead_zio[p] == zio);
@@ -2446,7 +2487,7 @@ zio_ddt_child_write_done(zio_t *zio)
 		ddt_phys_clear(ddp);
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key);
 }
 
 static void
@@ -2460,7 +2501,7 @@ zio_ddt_ditto_write_done(zio_t *zio)
 	ddt_key_t *ddk = &dde->dde_key;
 	ASSERTV(zio_prop_t *zp = &zio->io_prop);
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, ddk);
 
 	ASSERT(ddp->ddp_refcnt == 0);
 	ASSERT(dde->dde_lead_zio[p] == zio);
@@ -2475,7 +2516,7 @@ zio_ddt_ditto_write_done(zio_t *zio)
 		ddt_phys_fill(ddp, bp);
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, ddk);
 }
 
 static int
@@ -2492,12 +2533,14 @@ zio_ddt_write(zio_t *zio)
 	ddt_t *ddt = ddt_select(spa, bp);
 	ddt_entry_t *dde;
 	ddt_phys_t *ddp;
+	ddt_key_t ddk;
 
 	ASSERT(BP_GET_DEDUP(bp));
 	ASSERT(BP_GET_CHECKSUM(bp) == zp->zp_checksum);
 	ASSERT(BP_IS_HOLE(bp) || zio->io_bp_override);
 
-	ddt_enter(ddt);
+	ddt_key_fill(&ddk, bp);
+	ddt_enter(ddt, &ddk);
 	dde = ddt_lookup(ddt, bp, B_TRUE);
 	ddp = &dde->dde_phys[p];
 
@@ -2517,7 +2560,7 @@ zio_ddt_write(zio_t *zio)
 			zp->zp_dedup = B_FALSE;
 		}
 		zio->io_pipeline = ZIO_WRITE_PIPELINE;
-		ddt_exit(ddt);
+		ddt_exit(ddt, &ddk);
 		return (ZIO_PIPELINE_CONTINUE);
 	}
 
@@ -2543,7 +2586,7 @@ zio_ddt_write(zio_t *zio)
 			zio->io_pipeline = ZIO_WRITE_PIPELINE;
 			zio->io_bp_override = NULL;
 			BP_ZERO(bp);
-			ddt_exit(ddt);
+			ddt_exit(ddt, &ddk);
 			return (ZIO_PIPELINE_CONTINUE);
 		}
 
@@ -2579,7 +2622,7 @@ zio_ddt_write(zio_t *zio)
 		dde->dde_lead_zio[p] = cio;
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &ddk);
 
 	if (cio)
 		zio_nowait(cio);
@@ -2599,18 +2642,20 @@ zio_ddt_free(zio_t *zio)
 	ddt_t *ddt = ddt_select(spa, bp);
 	ddt_entry_t *dde;
 	ddt_phys_t *ddp;
+	ddt_key_t ddk;
 
 	ASSERT(BP_GET_DEDUP(bp));
 	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
 
-	ddt_enter(ddt);
+	ddt_key_fill(&ddk, bp);
+	ddt_enter(ddt, &ddk);
 	freedde = dde = ddt_lookup(ddt, bp, B_TRUE);
 	if (dde) {
 		ddp = ddt_phys_select(dde, bp);
 		if (ddp)
 			ddt_phys_decref(ddp);
 	}
-	ddt_exit(ddt);
+	ddt_exit(ddt, &ddk);
 
 	return (ZIO_PIPELINE_CONTINUE);
 }
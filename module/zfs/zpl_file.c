@@ -410,6 +410,55 @@ zpl_aio_write(struct kiocb *kiocb, const struct iovec *iovp,
 }
 #endif /* HAVE_VFS_RW_ITERATE */
 
+/*
+ * The kernel refuses to open a file O_DIRECT unless the address space
+ * provides .direct_IO.  It is never called by our own read and write
+ * paths, which handle O_DIRECT themselves (see zfs_direct_flags()), but
+ * route any other caller through them so the semantics are the same.
+ */
+#if defined(HAVE_VFS_DIRECT_IO_ITER)
+static ssize_t
+zpl_direct_IO(struct kiocb *kiocb, struct iov_iter *iter)
+{
+	if (iov_iter_rw(iter) == WRITE)
+		return (zpl_iter_write(kiocb, iter));
+	else
+		return (zpl_iter_read(kiocb, iter));
+}
+#elif defined(HAVE_VFS_DIRECT_IO_ITER_OFFSET)
+static ssize_t
+zpl_direct_IO(struct kiocb *kiocb, struct iov_iter *iter, loff_t pos)
+{
+	ASSERT3S(pos, ==, kiocb->ki_pos);
+	if (iov_iter_rw(iter) == WRITE)
+		return (zpl_iter_write(kiocb, iter));
+	else
+		return (zpl_iter_read(kiocb, iter));
+}
+#elif defined(HAVE_VFS_DIRECT_IO_ITER_RW_OFFSET)
+static ssize_t
+zpl_direct_IO(int rw, struct kiocb *kiocb, struct iov_iter *iter, loff_t pos)
+{
+	ASSERT3S(pos, ==, kiocb->ki_pos);
+	if (rw == WRITE)
+		return (zpl_iter_write(kiocb, iter));
+	else
+		return (zpl_iter_read(kiocb, iter));
+}
+#elif defined(HAVE_VFS_DIRECT_IO_IOVEC)
+static ssize_t
+zpl_direct_IO(int rw, struct kiocb *kiocb, const struct iovec *iovp,
+    loff_t pos, unsigned long nr_segs)
+{
+	if (rw == WRITE)
+		return (zpl_aio_write(kiocb, iovp, nr_segs, pos));
+	else
+		return (zpl_aio_read(kiocb, iovp, nr_segs, pos));
+}
+#else
+#error "Unknown direct IO interface"
+#endif
+
 static loff_t
 zpl_llseek(struct file *filp, loff_t offset, int whence)
 {
@@ -693,6 +742,125 @@ zpl_fallocate(struct file *filp, int mode, loff_t offset, loff_t len)
 }
 #endif /* HAVE_FILE_FALLOCATE */
 
+#if defined(HAVE_VFS_COPY_FILE_RANGE) || \
+    defined(HAVE_VFS_CLONE_FILE_RANGE) || \
+    defined(HAVE_VFS_REMAP_FILE_RANGE)
+/*
+ * Share the blocks of a file range with another file when the pool has
+ * the block_cloning feature enabled; see zfs_clone_range().  A length of
+ * zero means up to the source's EOF.
+ */
+static int
+zpl_clone_range_common(struct file *src_file, loff_t src_off,
+    struct file *dst_file, loff_t dst_off, uint64_t *lenp)
+{
+	struct inode *src_ip = file_inode(src_file);
+	struct inode *dst_ip = file_inode(dst_file);
+	cred_t *cr = CRED();
+	fstrans_cookie_t cookie;
+	int error;
+
+	if (src_off < 0 || dst_off < 0)
+		return (-EINVAL);
+
+	if (*lenp == 0) {
+		if (src_off >= i_size_read(src_ip))
+			return (-EINVAL);
+		*lenp = i_size_read(src_ip) - src_off;
+	}
+
+	crhold(cr);
+	cookie = spl_fstrans_mark();
+	error = -zfs_clone_range(src_ip, src_off, dst_ip, dst_off, lenp, cr);
+	spl_fstrans_unmark(cookie);
+	crfree(cr);
+
+	ASSERT3S(error, <=, 0);
+	return (error);
+}
+#endif
+
+#ifdef HAVE_VFS_COPY_FILE_RANGE
+/*
+ * Clone when we can.  Anything we can't clone (unaligned ranges, other
+ * datasets, the feature disabled) is reported as -EOPNOTSUPP so that the
+ * kernel falls back to copying the data.
+ */
+static ssize_t
+zpl_copy_file_range(struct file *src_file, loff_t src_off,
+    struct file *dst_file, loff_t dst_off, size_t len, unsigned int flags)
+{
+	uint64_t nbytes = len;
+	int error;
+
+	if (flags != 0)
+		return (-EINVAL);
+
+	if (len == 0)
+		return (0);
+
+	error = zpl_clone_range_common(src_file, src_off, dst_file, dst_off,
+	    &nbytes);
+	if (error == -EINVAL || error == -EXDEV)
+		error = -EOPNOTSUPP;
+
+	return (error ? error : nbytes);
+}
+#endif /* HAVE_VFS_COPY_FILE_RANGE */
+
+#ifdef HAVE_VFS_CLONE_FILE_RANGE
+static int
+zpl_clone_file_range(struct file *src_file, loff_t src_off,
+    struct file *dst_file, loff_t dst_off, u64 len)
+{
+	uint64_t nbytes = len;
+	int error;
+
+	error = zpl_clone_range_common(src_file, src_off, dst_file, dst_off,
+	    &nbytes);
+
+	/*
+	 * FICLONE and FICLONERANGE are all or nothing, but like a short
+	 * write a failed clone may have updated part of the destination.
+	 */
+	if (error == 0 && len != 0 && nbytes != len)
+		error = -EOPNOTSUPP;
+
+	return (error);
+}
+#endif /* HAVE_VFS_CLONE_FILE_RANGE */
+
+#ifdef HAVE_VFS_REMAP_FILE_RANGE
+static loff_t
+zpl_remap_file_range(struct file *src_file, loff_t src_off,
+    struct file *dst_file, loff_t dst_off, loff_t len, unsigned int flags)
+{
+	uint64_t nbytes = len;
+	int error;
+
+	if (flags & ~(REMAP_FILE_DEDUP | REMAP_FILE_CAN_SHORTEN))
+		return (-EINVAL);
+
+	/*
+	 * Deduplicating requires comparing the ranges first, which we
+	 * leave to the dedup property.
+	 */
+	if (flags & REMAP_FILE_DEDUP)
+		return (-EOPNOTSUPP);
+
+	if (len < 0)
+		return (-EINVAL);
+
+	error = zpl_clone_range_common(src_file, src_off, dst_file, dst_off,
+	    &nbytes);
+	if (error == 0 && len != 0 && nbytes != len &&
+	    !(flags & REMAP_FILE_CAN_SHORTEN))
+		error = -EOPNOTSUPP;
+
+	return (error ? error : nbytes);
+}
+#endif /* HAVE_VFS_REMAP_FILE_RANGE */
+
 /*
  * Map zfs file z_pflags (xvattr_t) to linux file attributes. Only file
  * attributes common to both Linux and Solaris are mapped.
@@ -823,6 +991,7 @@ const struct address_space_operations zpl_address_space_operations = {
 	.readpage	= zpl_readpage,
 	.writepage	= zpl_writepage,
 	.writepages	= zpl_writepages,
+	.direct_IO	= zpl_direct_IO,
 };
 
 const struct file_operations zpl_file_operations = {
@@ -844,6 +1013,15 @@ const struct file_operations zpl_file_operations = {
 #ifdef HAVE_FILE_FALLOCATE
 	.fallocate	= zpl_fallocate,
 #endif /* HAVE_FILE_FALLOCATE */
+#ifdef HAVE_VFS_COPY_FILE_RANGE
+	.copy_file_range	= zpl_copy_file_range,
+#endif /* HAVE_VFS_COPY_FILE_RANGE */
+#ifdef HAVE_VFS_CLONE_FILE_RANGE
+	.clone_file_range	= zpl_clone_file_range,
+#endif /* HAVE_VFS_CLONE_FILE_RANGE */
+#ifdef HAVE_VFS_REMAP_FILE_RANGE
+	.remap_file_range	= zpl_remap_file_range,
+#endif /* HAVE_VFS_REMAP_FILE_RANGE */
 	.unlocked_ioctl	= zpl_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl	= zpl_compat_ioctl,
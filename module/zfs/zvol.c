@@ -58,6 +58,10 @@ unsigned int zvol_inhibit_dev = 0;
 unsigned int zvol_major = ZVOL_MAJOR;
 unsigned int zvol_prefetch_bytes = (128 * 1024);
 unsigned long zvol_max_discard_blocks = 16384;
+unsigned int zvol_threads = 32;
+unsigned int zvol_request_sync = 0;
+
+static taskq_t *zvol_taskq;
 
 static kmutex_t zvol_state_lock;
 static list_t zvol_state_list;
@@ -102,6 +106,17 @@ typedef struct {
 
 #define	ZVOL_RDONLY	0x1
 
+/*
+ * A bio being serviced by zvol_taskq.  The range lock is taken by the
+ * submitter so that overlapping requests are still ordered as issued.
+ */
+typedef struct zv_request {
+	zvol_state_t	*zv;
+	struct bio	*bio;
+	rl_t		*rl;
+	unsigned long	start;		/* jiffies, for I/O accounting */
+} zv_request_t;
+
 /*
  * Find the next available range of ZVOL_MINORS minor numbers.  The
  * zvol_state_list is kept in ascending minor order so we simply need
@@ -561,16 +576,13 @@ zvol_log_write(zvol_state_t *zv, dmu_tx_t *tx, uint64_t offset,
 {
 	uint32_t blocksize = zv->zv_volblocksize;
 	zilog_t *zilog = zv->zv_zilog;
-	boolean_t slogging;
-	ssize_t immediate_write_sz;
+	boolean_t indirect;
 
 	if (zil_replaying(zilog, tx))
 		return;
 
-	immediate_write_sz = (zilog->zl_logbias == ZFS_LOGBIAS_THROUGHPUT)
-		? 0 : zvol_immediate_write_sz;
-	slogging = spa_has_slogs(zilog->zl_spa) &&
-		(zilog->zl_logbias == ZFS_LOGBIAS_LATENCY);
+	indirect = zil_write_indirect(zilog, blocksize,
+	    zvol_immediate_write_sz);
 
 	while (size) {
 		itx_t *itx;
@@ -582,8 +594,7 @@ zvol_log_write(zvol_state_t *zv, dmu_tx_t *tx, uint64_t offset,
 		 * Unlike zfs_log_write() we can be called with
 		 * up to DMU_MAX_ACCESS/2 (5MB) writes.
 		 */
-		if (blocksize > immediate_write_sz && !slogging &&
-		    size >= blocksize && offset % blocksize == 0) {
+		if (indirect && size >= blocksize && offset % blocksize == 0) {
 			write_state = WR_INDIRECT; /* uses dmu_sync */
 			len = blocksize;
 		} else if (sync) {
@@ -624,21 +635,56 @@ zvol_log_write(zvol_state_t *zv, dmu_tx_t *tx, uint64_t offset,
 	}
 }
 
-static int
-zvol_write(zvol_state_t *zv, uio_t *uio, boolean_t sync)
+static void
+zvol_uio_init(uio_t *uio, struct bio *bio)
+{
+	uio->uio_bvec = &bio->bi_io_vec[BIO_BI_IDX(bio)];
+	uio->uio_skip = BIO_BI_SKIP(bio);
+	uio->uio_resid = BIO_BI_SIZE(bio);
+	uio->uio_iovcnt = bio->bi_vcnt - BIO_BI_IDX(bio);
+	uio->uio_loffset = BIO_BI_SECTOR(bio) << 9;
+	uio->uio_limit = MAXOFFSET_T;
+	uio->uio_segflg = UIO_BVEC;
+}
+
+/*
+ * Drop the range lock, complete the bio and free the request.
+ */
+static void
+zvol_request_done(zv_request_t *zvr, int error)
+{
+	struct bio *bio = zvr->bio;
+
+	if (zvr->rl != NULL)
+		zfs_range_unlock(zvr->rl);
+
+	generic_end_io_acct(bio_data_dir(bio), &zvr->zv->zv_disk->part0,
+	    zvr->start);
+	BIO_END_IO(bio, -error);
+	kmem_free(zvr, sizeof (zv_request_t));
+}
+
+static void
+zvol_write(void *arg)
 {
+	zv_request_t *zvr = arg;
+	zvol_state_t *zv = zvr->zv;
+	struct bio *bio = zvr->bio;
 	uint64_t volsize = zv->zv_volsize;
-	rl_t *rl;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+	boolean_t sync;
+	uio_t uio;
 	int error = 0;
 
 	ASSERT(zv && zv->zv_open_count > 0);
 
-	rl = zfs_range_lock(&zv->zv_range_lock, uio->uio_loffset,
-	    uio->uio_resid, RL_WRITER);
+	zvol_uio_init(&uio, bio);
+	sync = ((bio->bi_rw & (VDEV_REQ_FUA|VDEV_REQ_FLUSH)) ||
+	    zv->zv_objset->os_sync == ZFS_SYNC_ALWAYS);
 
-	while (uio->uio_resid > 0 && uio->uio_loffset < volsize) {
-		uint64_t bytes = MIN(uio->uio_resid, DMU_MAX_ACCESS >> 1);
-		uint64_t off = uio->uio_loffset;
+	while (uio.uio_resid > 0 && uio.uio_loffset < volsize) {
+		uint64_t bytes = MIN(uio.uio_resid, DMU_MAX_ACCESS >> 1);
+		uint64_t off = uio.uio_loffset;
 		dmu_tx_t *tx = dmu_tx_create(zv->zv_objset);
 
 		if (bytes > volsize - off)	/* don't write past the end */
@@ -652,7 +698,8 @@ zvol_write(zvol_state_t *zv, uio_t *uio, boolean_t sync)
 			dmu_tx_abort(tx);
 			break;
 		}
-		error = dmu_write_uio_dbuf(zv->zv_dbuf, uio, bytes, tx);
+		error = dmu_write_uio_dbuf(zv->zv_dbuf, &uio, bytes, tx,
+		    DMU_READ_PREFETCH);
 		if (error == 0)
 			zvol_log_write(zv, tx, off, bytes, sync);
 		dmu_tx_commit(tx);
@@ -660,10 +707,13 @@ zvol_write(zvol_state_t *zv, uio_t *uio, boolean_t sync)
 		if (error)
 			break;
 	}
-	zfs_range_unlock(rl);
+	zfs_range_unlock(zvr->rl);
+	zvr->rl = NULL;
 	if (sync)
 		zil_commit(zv->zv_zilog, ZVOL_OBJ);
-	return (error);
+
+	zvol_request_done(zvr, error);
+	spl_fstrans_unmark(cookie);
 }
 
 /*
@@ -690,21 +740,25 @@ zvol_log_truncate(zvol_state_t *zv, dmu_tx_t *tx, uint64_t off, uint64_t len,
 	zil_itx_assign(zilog, itx, tx);
 }
 
-static int
-zvol_discard(struct bio *bio)
+static void
+zvol_discard(void *arg)
 {
-	zvol_state_t *zv = bio->bi_bdev->bd_disk->private_data;
+	zv_request_t *zvr = arg;
+	zvol_state_t *zv = zvr->zv;
+	struct bio *bio = zvr->bio;
 	uint64_t start = BIO_BI_SECTOR(bio) << 9;
 	uint64_t size = BIO_BI_SIZE(bio);
 	uint64_t end = start + size;
-	int error;
-	rl_t *rl;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+	int error = 0;
 	dmu_tx_t *tx;
 
 	ASSERT(zv && zv->zv_open_count > 0);
 
-	if (end > zv->zv_volsize)
-		return (SET_ERROR(EIO));
+	if (end > zv->zv_volsize) {
+		error = SET_ERROR(EIO);
+		goto out;
+	}
 
 	/*
 	 * Align the request to volume block boundaries when REQ_SECURE is
@@ -723,9 +777,8 @@ zvol_discard(struct bio *bio)
 #endif
 
 	if (start >= end)
-		return (0);
+		goto out;
 
-	rl = zfs_range_lock(&zv->zv_range_lock, start, size, RL_WRITER);
 	tx = dmu_tx_create(zv->zv_objset);
 	dmu_tx_mark_netfree(tx);
 	error = dmu_tx_assign(tx, TXG_WAIT);
@@ -737,31 +790,33 @@ zvol_discard(struct bio *bio)
 		error = dmu_free_long_range(zv->zv_objset,
 		    ZVOL_OBJ, start, size);
 	}
-
-	zfs_range_unlock(rl);
-
-	return (error);
+out:
+	zvol_request_done(zvr, error);
+	spl_fstrans_unmark(cookie);
 }
 
-static int
-zvol_read(zvol_state_t *zv, uio_t *uio)
+static void
+zvol_read(void *arg)
 {
+	zv_request_t *zvr = arg;
+	zvol_state_t *zv = zvr->zv;
 	uint64_t volsize = zv->zv_volsize;
-	rl_t *rl;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+	uio_t uio;
 	int error = 0;
 
 	ASSERT(zv && zv->zv_open_count > 0);
 
-	rl = zfs_range_lock(&zv->zv_range_lock, uio->uio_loffset,
-	    uio->uio_resid, RL_READER);
-	while (uio->uio_resid > 0 && uio->uio_loffset < volsize) {
-		uint64_t bytes = MIN(uio->uio_resid, DMU_MAX_ACCESS >> 1);
+	zvol_uio_init(&uio, zvr->bio);
+	while (uio.uio_resid > 0 && uio.uio_loffset < volsize) {
+		uint64_t bytes = MIN(uio.uio_resid, DMU_MAX_ACCESS >> 1);
 
 		/* don't read past the end */
-		if (bytes > volsize - uio->uio_loffset)
-			bytes = volsize - uio->uio_loffset;
+		if (bytes > volsize - uio.uio_loffset)
+			bytes = volsize - uio.uio_loffset;
 
-		error = dmu_read_uio_dbuf(zv->zv_dbuf, uio, bytes);
+		error = dmu_read_uio_dbuf(zv->zv_dbuf, &uio, bytes,
+		    DMU_READ_PREFETCH);
 		if (error) {
 			/* convert checksum errors into IO errors */
 			if (error == ECKSUM)
@@ -769,73 +824,80 @@ zvol_read(zvol_state_t *zv, uio_t *uio)
 			break;
 		}
 	}
-	zfs_range_unlock(rl);
-	return (error);
+
+	zvol_request_done(zvr, error);
+	spl_fstrans_unmark(cookie);
 }
 
+/*
+ * Reads, writes and discards are handed to zvol_taskq rather than being
+ * serviced in the submitting thread, so that a single zvol can have many
+ * requests in flight and one slow ARC miss doesn't stall the submitter.
+ * The range lock is taken here, before dispatch, so overlapping requests
+ * complete in the order they were issued.  Setting zvol_request_sync
+ * services every request in the submitting thread as before.
+ */
 static MAKE_REQUEST_FN_RET
 zvol_request(struct request_queue *q, struct bio *bio)
 {
-	uio_t uio;
 	zvol_state_t *zv = q->queuedata;
 	fstrans_cookie_t cookie = spl_fstrans_mark();
+	uint64_t offset = BIO_BI_SECTOR(bio) << 9;
+	uint64_t size = BIO_BI_SIZE(bio);
 	int rw = bio_data_dir(bio);
-#ifdef HAVE_GENERIC_IO_ACCT
-	unsigned long start = jiffies;
-#endif
+	zv_request_t *zvr = NULL;
+	task_func_t *func;
+	rl_type_t type;
 	int error = 0;
 
-	uio.uio_bvec = &bio->bi_io_vec[BIO_BI_IDX(bio)];
-	uio.uio_skip = BIO_BI_SKIP(bio);
-	uio.uio_resid = BIO_BI_SIZE(bio);
-	uio.uio_iovcnt = bio->bi_vcnt - BIO_BI_IDX(bio);
-	uio.uio_loffset = BIO_BI_SECTOR(bio) << 9;
-	uio.uio_limit = MAXOFFSET_T;
-	uio.uio_segflg = UIO_BVEC;
-
-	if (bio_has_data(bio) && uio.uio_loffset + uio.uio_resid >
-	    zv->zv_volsize) {
+	if (bio_has_data(bio) && offset + size > zv->zv_volsize) {
 		printk(KERN_INFO
 		    "%s: bad access: offset=%llu, size=%lu\n",
 		    zv->zv_disk->disk_name,
-		    (long long unsigned)uio.uio_loffset,
-		    (long unsigned)uio.uio_resid);
+		    (long long unsigned)offset,
+		    (long unsigned)size);
 		error = SET_ERROR(EIO);
-		goto out1;
+		goto out;
 	}
 
-	generic_start_io_acct(rw, bio_sectors(bio), &zv->zv_disk->part0);
-
 	if (rw == WRITE) {
 		if (unlikely(zv->zv_flags & ZVOL_RDONLY)) {
 			error = SET_ERROR(EROFS);
-			goto out2;
-		}
-
-		if (bio_is_discard(bio)) {
-			error = zvol_discard(bio);
-			goto out2;
+			goto out;
 		}
 
 		/*
 		 * Some requests are just for flush and nothing else.
 		 */
-		if (uio.uio_resid == 0) {
+		if (size == 0 && !bio_is_discard(bio)) {
 			if (bio->bi_rw & VDEV_REQ_FLUSH)
 				zil_commit(zv->zv_zilog, ZVOL_OBJ);
-			goto out2;
+			goto out;
 		}
 
-		error = zvol_write(zv, &uio,
-		    ((bio->bi_rw & (VDEV_REQ_FUA|VDEV_REQ_FLUSH)) ||
-		    zv->zv_objset->os_sync == ZFS_SYNC_ALWAYS));
-	} else
-		error = zvol_read(zv, &uio);
+		func = bio_is_discard(bio) ? zvol_discard : zvol_write;
+		type = RL_WRITER;
+	} else {
+		func = zvol_read;
+		type = RL_READER;
+	}
+
+	zvr = kmem_alloc(sizeof (zv_request_t), KM_SLEEP);
+	zvr->zv = zv;
+	zvr->bio = bio;
+	zvr->start = jiffies;
+	zvr->rl = zfs_range_lock(&zv->zv_range_lock, offset, size, type);
 
-out2:
-	generic_end_io_acct(rw, &zv->zv_disk->part0, start);
-out1:
-	BIO_END_IO(bio, -error);
+	generic_start_io_acct(rw, bio_sectors(bio), &zv->zv_disk->part0);
+
+	if (zvol_request_sync || taskq_dispatch(zvol_taskq, func, zvr,
+	    TQ_SLEEP) == 0)
+		func(zvr);
+out:
+	/* Requests handed to a worker are completed by it */
+	if (zvr == NULL) {
+		BIO_END_IO(bio, -error);
+	}
 	spl_fstrans_unmark(cookie);
 #ifdef HAVE_MAKE_REQUEST_FN_RET_INT
 	return (0);
@@ -853,7 +915,7 @@ zvol_get_done(zgd_t *zgd, int error)
 	zfs_range_unlock(zgd->zgd_rl);
 
 	if (error == 0 && zgd->zgd_bp)
-		zil_add_block(zgd->zgd_zilog, zgd->zgd_bp);
+		zil_lwb_add_block(zgd->zgd_lwb, zgd->zgd_bp);
 
 	kmem_free(zgd, sizeof (zgd_t));
 }
@@ -862,7 +924,8 @@ zvol_get_done(zgd_t *zgd, int error)
  * Get data to generate a TX_WRITE intent log record.
  */
 static int
-zvol_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
+zvol_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
+    zio_t *zio)
 {
 	zvol_state_t *zv = arg;
 	objset_t *os = zv->zv_objset;
@@ -878,7 +941,7 @@ zvol_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
 	ASSERT(size != 0);
 
 	zgd = (zgd_t *)kmem_zalloc(sizeof (zgd_t), KM_SLEEP);
-	zgd->zgd_zilog = zv->zv_zilog;
+	zgd->zgd_lwb = lwb;
 	zgd->zgd_rl = zfs_range_lock(&zv->zv_range_lock, offset, size,
 	    RL_READER);
 
@@ -1005,6 +1068,12 @@ out_owned:
 static void
 zvol_last_close(zvol_state_t *zv)
 {
+	/*
+	 * Let any requests still being serviced by zvol_taskq finish
+	 * before the objset is released from under them.
+	 */
+	taskq_wait_outstanding(zvol_taskq, 0);
+
 	zil_close(zv->zv_zilog);
 	zv->zv_zilog = NULL;
 
@@ -1516,28 +1585,19 @@ zvol_create_snap_minor_cb(const char *dsname, void *arg)
 }
 
 /*
- * Mask errors to continue dmu_objset_find() traversal
+ * Create the minor for a zvol found by zvol_create_minors_cb(), followed by
+ * its snapshots when they are visible.  Setting up a zvol replays its
+ * intent log, so zvols are handled in parallel from a taskq.
  */
-static int
-zvol_create_minors_cb(const char *dsname, void *arg)
+static void
+zvol_create_minors_task(void *arg)
 {
+	char *dsname = arg;
 	uint64_t snapdev;
 	int error;
 
-	ASSERT0(MUTEX_HELD(&spa_namespace_lock));
-
 	error = dsl_prop_get_integer(dsname, "snapdev", &snapdev, NULL);
-	if (error)
-		return (0);
-
-	/*
-	 * Given the name and the 'snapdev' property, create device minor nodes
-	 * with the linkages to zvols/snapshots as needed.
-	 * If the name represents a zvol, create a minor node for the zvol, then
-	 * check if its snapshots are 'visible', and if so, iterate over the
-	 * snapshots and create device minor nodes for those.
-	 */
-	if (strchr(dsname, '@') == 0) {
+	if (error == 0) {
 		/* create minor for the 'dsname' explicitly */
 		error = zvol_create_minor_impl(dsname);
 		if ((error == 0 || error == EEXIST) &&
@@ -1547,11 +1607,36 @@ zvol_create_minors_cb(const char *dsname, void *arg)
 			 * traverse snapshots only, do not traverse children,
 			 * and skip the 'dsname'
 			 */
-			error = dmu_objset_find((char *)dsname,
+			(void) dmu_objset_find(dsname,
 			    zvol_create_snap_minor_cb, (void *)dsname,
 			    DS_FIND_SNAPSHOTS);
 			spl_fstrans_unmark(cookie);
 		}
+	}
+
+	spa_strfree(dsname);
+}
+
+/*
+ * Mask errors to continue dmu_objset_find() traversal
+ */
+static int
+zvol_create_minors_cb(const char *dsname, void *arg)
+{
+	taskq_t *tq = arg;
+
+	ASSERT0(MUTEX_HELD(&spa_namespace_lock));
+
+	/*
+	 * Given the name and the 'snapdev' property, create device minor nodes
+	 * with the linkages to zvols/snapshots as needed.
+	 * If the name represents a zvol, create a minor node for the zvol, then
+	 * check if its snapshots are 'visible', and if so, iterate over the
+	 * snapshots and create device minor nodes for those.
+	 */
+	if (strchr(dsname, '@') == 0) {
+		(void) taskq_dispatch(tq, zvol_create_minors_task,
+		    spa_strdup(dsname), TQ_SLEEP);
 	} else {
 		dprintf("zvol_create_minors_cb(): %s is not a zvol name\n",
 			dsname);
@@ -1600,10 +1685,16 @@ zvol_create_minors_impl(const char *name)
 		if (error == 0 && snapdev == ZFS_SNAPDEV_VISIBLE)
 			error = zvol_create_minor_impl(name);
 	} else {
+		taskq_t *tq;
+
+		tq = taskq_create("z_zvol_minors", max_ncpus, defclsyspri,
+		    max_ncpus, INT_MAX, TASKQ_PREPOPULATE | TASKQ_DYNAMIC);
 		cookie = spl_fstrans_mark();
 		error = dmu_objset_find(parent, zvol_create_minors_cb,
-		    NULL, DS_FIND_CHILDREN);
+		    tq, DS_FIND_CHILDREN);
 		spl_fstrans_unmark(cookie);
+		taskq_wait(tq);
+		taskq_destroy(tq);
 	}
 
 	kmem_free(parent, MAXPATHLEN);
@@ -1944,16 +2035,25 @@ zvol_rename_minors(spa_t *spa, const char *name1, const char *name2,
 int
 zvol_init(void)
 {
+	int threads = MIN(MAX(zvol_threads, 1), 1024);
 	int error;
 
 	list_create(&zvol_state_list, sizeof (zvol_state_t),
 	    offsetof(zvol_state_t, zv_next));
 	mutex_init(&zvol_state_lock, NULL, MUTEX_DEFAULT, NULL);
 
+	zvol_taskq = taskq_create(ZVOL_DRIVER, threads, maxclsyspri,
+	    threads * 2, INT_MAX, TASKQ_PREPOPULATE | TASKQ_DYNAMIC);
+	if (zvol_taskq == NULL) {
+		printk(KERN_INFO "ZFS: taskq_create() failed\n");
+		error = -ENOMEM;
+		goto out1;
+	}
+
 	error = register_blkdev(zvol_major, ZVOL_DRIVER);
 	if (error) {
 		printk(KERN_INFO "ZFS: register_blkdev() failed %d\n", error);
-		goto out;
+		goto out2;
 	}
 
 	blk_register_region(MKDEV(zvol_major, 0), 1UL << MINORBITS,
@@ -1961,7 +2061,9 @@ zvol_init(void)
 
 	return (0);
 
-out:
+out2:
+	taskq_destroy(zvol_taskq);
+out1:
 	mutex_destroy(&zvol_state_lock);
 	list_destroy(&zvol_state_list);
 
@@ -1976,6 +2078,7 @@ zvol_fini(void)
 	blk_unregister_region(MKDEV(zvol_major, 0), 1UL << MINORBITS);
 	unregister_blkdev(zvol_major, ZVOL_DRIVER);
 
+	taskq_destroy(zvol_taskq);
 	list_destroy(&zvol_state_list);
 	mutex_destroy(&zvol_state_lock);
 }
@@ -1991,3 +2094,9 @@ MODULE_PARM_DESC(zvol_max_discard_blocks, "Max number of blocks to discard");
 
 module_param(zvol_prefetch_bytes, uint, 0644);
 MODULE_PARM_DESC(zvol_prefetch_bytes, "Prefetch N bytes at zvol start+end");
+
+module_param(zvol_threads, uint, 0444);
+MODULE_PARM_DESC(zvol_threads, "Max number of threads to handle I/O requests");
+
+module_param(zvol_request_sync, uint, 0644);
+MODULE_PARM_DESC(zvol_request_sync, "Synchronously handle bio requests");